@@ -0,0 +1,547 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "common/asynclog.h"
+#include "common/log.h"
+#include "common/lock.h"
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <time.h>
+#include <pthread.h>
+#include <vector>
+
+using namespace YamiMediaCodec;
+
+//per thread ring, 256K holds a few thousand records
+#define RING_SIZE (256 * 1024)
+#define MAX_ARGS 16
+//bytes of %s arguments we copy per record
+#define MAX_STRING 256
+//idle time of the writer thread
+#define IDLE_SLEEP_NS (1000 * 1000)
+
+union LogArg {
+    long long i;
+    unsigned long long u;
+    double d;
+    long double ld;
+    const void* p;
+    uint32_t str; //offset in the string area
+};
+
+struct LogRecord {
+    uint32_t length; //of the whole record, 16 bytes aligned for long double
+    uint16_t argc;
+    uint8_t padding; //skip to the ring start
+    uint8_t truncated;
+    int line;
+    uint64_t time;
+    const char* prefix;
+    const char* file;
+    const char* format;
+    //followed by LogArg args[argc] and the string area
+};
+
+#define MAX_RECORD_SIZE (sizeof(LogRecord) + sizeof(LogArg) * MAX_ARGS + MAX_STRING)
+
+//single producer, single consumer. head is only written by the owner thread,
+//tail only by the thread holding the drain lock.
+struct LogRing {
+    uint8_t buffer[RING_SIZE] __attribute__((aligned(16)));
+    uint64_t head;
+    uint64_t tail;
+    uint64_t dropped;
+    uint64_t reported;
+    long tid;
+    int retired;
+};
+
+static pthread_once_t s_once = PTHREAD_ONCE_INIT;
+static pthread_key_t s_key;
+static pthread_t s_thread;
+static int s_quit = 0;
+static Lock* s_ringsLock;
+static std::vector<LogRing*>* s_rings;
+//serialize consumers: the writer thread and yamiAsyncLogFlush
+static Lock* s_drainLock;
+static __thread LogRing* t_ring;
+
+static uint64_t loadAcquire(uint64_t* p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static void storeRelease(uint64_t* p, uint64_t v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+static void retireRing(void* ring)
+{
+    __atomic_store_n(&((LogRing*)ring)->retired, 1, __ATOMIC_RELEASE);
+}
+
+static void* writerThread(void*);
+static void stopWriter();
+
+static void initOnce()
+{
+    s_ringsLock = new Lock;
+    s_rings = new std::vector<LogRing*>;
+    s_drainLock = new Lock;
+    pthread_key_create(&s_key, retireRing);
+    if (!pthread_create(&s_thread, NULL, writerThread, NULL))
+        atexit(stopWriter);
+}
+
+static LogRing* getRing()
+{
+    if (t_ring)
+        return t_ring;
+    pthread_once(&s_once, initOnce);
+    LogRing* ring = (LogRing*)calloc(1, sizeof(LogRing));
+    if (!ring)
+        return NULL;
+    ring->tid = GETTID();
+    {
+        AutoLock lock(*s_ringsLock);
+        s_rings->push_back(ring);
+    }
+    pthread_setspecific(s_key, ring);
+    t_ring = ring;
+    return ring;
+}
+
+enum ArgType {
+    ARG_NONE,
+    ARG_INT,
+    ARG_UINT,
+    ARG_DOUBLE,
+    ARG_LONG_DOUBLE,
+    ARG_POINTER,
+    ARG_STRING,
+};
+
+//one conversion specification of a printf format
+struct FormatSpec {
+    const char* start;
+    const char* end; //one past the conversion character
+    int stars; //'*' width and precision
+    char length[3];
+    char conversion;
+    ArgType type;
+};
+
+static bool isFlag(char c)
+{
+    return c == '-' || c == '+' || c == ' ' || c == '#' || c == '0' || c == '\'';
+}
+
+static bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static ArgType argType(char conversion, const char* length)
+{
+    switch (conversion) {
+    case 'd':
+    case 'i':
+        return ARG_INT;
+    case 'u':
+    case 'o':
+    case 'x':
+    case 'X':
+        return ARG_UINT;
+    case 'c':
+        return ARG_INT;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+        return length[0] == 'L' ? ARG_LONG_DOUBLE : ARG_DOUBLE;
+    case 'p':
+        return ARG_POINTER;
+    case 's':
+        return ARG_STRING;
+    default:
+        return ARG_NONE;
+    }
+}
+
+//parse the spec at p, which points to the char after '%'
+static const char* parseSpec(const char* p, FormatSpec& spec)
+{
+    spec.start = p - 1;
+    spec.stars = 0;
+    memset(spec.length, 0, sizeof(spec.length));
+    while (isFlag(*p))
+        p++;
+    if (*p == '*') {
+        spec.stars++;
+        p++;
+    }
+    while (isDigit(*p))
+        p++;
+    if (*p == '.') {
+        p++;
+        if (*p == '*') {
+            spec.stars++;
+            p++;
+        }
+        while (isDigit(*p))
+            p++;
+    }
+    int n = 0;
+    while (n < 2 && (*p == 'h' || *p == 'l' || *p == 'L' || *p == 'q' || *p == 'j' || *p == 'z' || *p == 't'))
+        spec.length[n++] = *p++;
+    spec.conversion = *p;
+    if (*p)
+        p++;
+    spec.end = p;
+    spec.type = argType(spec.conversion, spec.length);
+    return p;
+}
+
+//read one integer with the length modifier of spec
+static void readInt(const FormatSpec& spec, va_list& args, LogArg& arg)
+{
+    const char* l = spec.length;
+    bool isSigned = spec.type == ARG_INT;
+    if (!strcmp(l, "ll") || !strcmp(l, "q"))
+        arg.u = va_arg(args, unsigned long long);
+    else if (!strcmp(l, "l"))
+        arg.i = isSigned ? (long long)va_arg(args, long) : (long long)va_arg(args, unsigned long);
+    else if (!strcmp(l, "j"))
+        arg.i = isSigned ? (long long)va_arg(args, intmax_t) : (long long)va_arg(args, uintmax_t);
+    else if (!strcmp(l, "z"))
+        arg.i = isSigned ? (long long)va_arg(args, ssize_t) : (long long)va_arg(args, size_t);
+    else if (!strcmp(l, "t"))
+        arg.i = (long long)va_arg(args, ptrdiff_t);
+    else if (!strcmp(l, "hh"))
+        arg.i = isSigned ? (long long)(signed char)va_arg(args, int) : (long long)(unsigned char)va_arg(args, int);
+    else if (!strcmp(l, "h"))
+        arg.i = isSigned ? (long long)(short)va_arg(args, int) : (long long)(unsigned short)va_arg(args, int);
+    else
+        arg.i = isSigned ? (long long)va_arg(args, int) : (long long)va_arg(args, unsigned int);
+}
+
+void yamiAsyncLog(const char* prefix, const char* file, int line, const char* format, ...)
+{
+    LogRing* ring = getRing();
+    if (!ring)
+        return;
+
+    uint64_t head = ring->head;
+    uint64_t tail = loadAcquire(&ring->tail);
+    uint32_t pos = head % RING_SIZE;
+    uint32_t padding = 0;
+    //a record never wraps, we pad to the ring start instead
+    if (pos + MAX_RECORD_SIZE > RING_SIZE)
+        padding = RING_SIZE - pos;
+    if (head + padding + MAX_RECORD_SIZE - tail > RING_SIZE) {
+        __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+    if (padding) {
+        LogRecord* pad = (LogRecord*)(ring->buffer + pos);
+        pad->length = padding;
+        pad->padding = 1;
+        pos = 0;
+    }
+
+    LogRecord* record = (LogRecord*)(ring->buffer + pos);
+    LogArg* argv = (LogArg*)(record + 1);
+    char* strings = (char*)(argv + MAX_ARGS);
+    uint32_t stringSize = 0;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    record->padding = 0;
+    record->truncated = 0;
+    record->line = line;
+    record->time = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+    record->prefix = prefix;
+    record->file = file;
+    record->format = format;
+
+    va_list args;
+    va_start(args, format);
+    uint32_t argc = 0;
+    const char* p = format;
+    while (*p && !record->truncated) {
+        if (*p++ != '%')
+            continue;
+        if (*p == '%') {
+            p++;
+            continue;
+        }
+        FormatSpec spec;
+        p = parseSpec(p, spec);
+        if (spec.type == ARG_NONE) {
+            //%n or something we don't know, stop here
+            record->truncated = 1;
+            break;
+        }
+        if (argc + spec.stars + 1 > MAX_ARGS) {
+            record->truncated = 1;
+            break;
+        }
+        for (int i = 0; i < spec.stars; i++)
+            argv[argc++].i = va_arg(args, int);
+        LogArg& arg = argv[argc++];
+        switch (spec.type) {
+        case ARG_INT:
+        case ARG_UINT:
+            readInt(spec, args, arg);
+            break;
+        case ARG_DOUBLE:
+            arg.d = va_arg(args, double);
+            break;
+        case ARG_LONG_DOUBLE:
+            arg.ld = va_arg(args, long double);
+            break;
+        case ARG_POINTER:
+            arg.p = va_arg(args, void*);
+            break;
+        case ARG_STRING: {
+            //strings may die with the caller, copy them
+            const char* s = va_arg(args, const char*);
+            if (!s)
+                s = "(null)";
+            size_t len = strlen(s);
+            if (len > MAX_STRING - 1 - stringSize)
+                len = MAX_STRING - 1 - stringSize;
+            memcpy(strings + stringSize, s, len);
+            strings[stringSize + len] = '\0';
+            arg.str = stringSize;
+            stringSize += len + 1;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    va_end(args);
+
+    //move the strings next to the args we used
+    char* end = (char*)(argv + argc);
+    if (stringSize)
+        memmove(end, strings, stringSize);
+    record->argc = argc;
+    record->length = (sizeof(LogRecord) + sizeof(LogArg) * argc + stringSize + 15) & ~15;
+
+    storeRelease(&ring->head, head + padding + record->length);
+}
+
+//printf one spec with a stored argument, integers are printed as long long
+static int formatArg(char* out, size_t size, const FormatSpec& spec,
+    const LogArg* argv, const char* strings)
+{
+    char fmt[64];
+    size_t len = spec.end - spec.start - strlen(spec.length) - 1;
+    if (len + 3 >= sizeof(fmt))
+        return 0;
+    //copy flags, width and precision, then our length modifier and the conversion
+    memcpy(fmt, spec.start, len);
+    fmt[len] = '\0';
+    if (spec.type == ARG_INT || spec.type == ARG_UINT) {
+        if (spec.conversion != 'c')
+            strcat(fmt, "ll");
+    }
+    else if (spec.type == ARG_LONG_DOUBLE)
+        strcat(fmt, "L");
+    size_t n = strlen(fmt);
+    fmt[n] = spec.conversion;
+    fmt[n + 1] = '\0';
+
+    int star[2] = { 0, 0 };
+    for (int i = 0; i < spec.stars; i++)
+        star[i] = (int)argv[i].i;
+    const LogArg& arg = argv[spec.stars];
+
+#define FORMAT_ARG(value)                                              \
+    (spec.stars == 0 ? snprintf(out, size, fmt, value)                 \
+                     : spec.stars == 1 ? snprintf(out, size, fmt, star[0], value) \
+                                       : snprintf(out, size, fmt, star[0], star[1], value))
+
+    switch (spec.type) {
+    case ARG_INT:
+        if (spec.conversion == 'c')
+            return FORMAT_ARG((int)arg.i);
+        return FORMAT_ARG(arg.i);
+    case ARG_UINT:
+        return FORMAT_ARG(arg.u);
+    case ARG_DOUBLE:
+        return FORMAT_ARG(arg.d);
+    case ARG_LONG_DOUBLE:
+        return FORMAT_ARG(arg.ld);
+    case ARG_POINTER:
+        return FORMAT_ARG(arg.p);
+    case ARG_STRING:
+        return FORMAT_ARG(strings + arg.str);
+    default:
+        return 0;
+    }
+#undef FORMAT_ARG
+}
+
+static void writeRecord(const LogRing* ring, const LogRecord* record)
+{
+    char message[1024];
+    size_t used = 0;
+    const LogArg* argv = (const LogArg*)(record + 1);
+    const char* strings = (const char*)(argv + record->argc);
+    uint32_t argc = 0;
+    const char* p = record->format;
+
+    while (*p && used < sizeof(message) - 1) {
+        if (*p != '%') {
+            message[used++] = *p++;
+            continue;
+        }
+        p++;
+        if (*p == '%') {
+            message[used++] = *p++;
+            continue;
+        }
+        FormatSpec spec;
+        p = parseSpec(p, spec);
+        if (spec.type == ARG_NONE || argc + spec.stars + 1 > record->argc)
+            break;
+        int n = formatArg(message + used, sizeof(message) - used, spec, argv + argc, strings);
+        argc += spec.stars + 1;
+        if (n > 0)
+            used += n;
+        if (used > sizeof(message) - 1)
+            used = sizeof(message) - 1;
+    }
+    //the macros append a new line to the format
+    if (used && message[used - 1] == '\n')
+        used--;
+    message[used] = '\0';
+
+    const char* name = strrchr(record->file, '/');
+    name = (name ? (name + 1) : record->file);
+    fprintf(yamiLogFn, "libyami %s %ld %lu.%06lu (%s, %d): %s%s\n", record->prefix, ring->tid,
+        (unsigned long)(record->time / 1000000000ULL), (unsigned long)(record->time % 1000000000ULL / 1000),
+        name, record->line, message, record->truncated ? " ..." : "");
+}
+
+//first real record of ring, NULL if the ring is empty
+static const LogRecord* peekRecord(LogRing* ring)
+{
+    uint64_t head = loadAcquire(&ring->head);
+    while (ring->tail != head) {
+        const LogRecord* record = (const LogRecord*)(ring->buffer + ring->tail % RING_SIZE);
+        if (!record->padding)
+            return record;
+        storeRelease(&ring->tail, ring->tail + record->length);
+    }
+    return NULL;
+}
+
+//write out all records in time order, return false if there was nothing to do
+static bool drain()
+{
+    AutoLock lock(*s_drainLock);
+    std::vector<LogRing*> rings;
+    {
+        AutoLock ringsLock(*s_ringsLock);
+        rings = *s_rings;
+    }
+
+    bool written = false;
+    while (1) {
+        LogRing* first = NULL;
+        const LogRecord* oldest = NULL;
+        for (size_t i = 0; i < rings.size(); i++) {
+            const LogRecord* record = peekRecord(rings[i]);
+            if (record && (!oldest || record->time < oldest->time)) {
+                oldest = record;
+                first = rings[i];
+            }
+        }
+        if (!oldest)
+            break;
+        if (yamiLogFn)
+            writeRecord(first, oldest);
+        storeRelease(&first->tail, first->tail + oldest->length);
+        written = true;
+    }
+
+    for (size_t i = 0; i < rings.size(); i++) {
+        LogRing* ring = rings[i];
+        uint64_t dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+        if (dropped != ring->reported && yamiLogFn) {
+            fprintf(yamiLogFn, "libyami warning %ld: %lu log records dropped\n",
+                ring->tid, (unsigned long)(dropped - ring->reported));
+            ring->reported = dropped;
+            written = true;
+        }
+    }
+    if (written && yamiLogFn)
+        fflush(yamiLogFn);
+
+    //the owner thread is gone and everything it logged is written
+    AutoLock ringsLock(*s_ringsLock);
+    for (size_t i = 0; i < s_rings->size();) {
+        LogRing* ring = (*s_rings)[i];
+        if (__atomic_load_n(&ring->retired, __ATOMIC_ACQUIRE) && !peekRecord(ring)) {
+            s_rings->erase(s_rings->begin() + i);
+            free(ring);
+            continue;
+        }
+        i++;
+    }
+    return written;
+}
+
+static void* writerThread(void*)
+{
+    while (!__atomic_load_n(&s_quit, __ATOMIC_ACQUIRE)) {
+        if (!drain()) {
+            struct timespec idle = { 0, IDLE_SLEEP_NS };
+            nanosleep(&idle, NULL);
+        }
+    }
+    return NULL;
+}
+
+static void stopWriter()
+{
+    __atomic_store_n(&s_quit, 1, __ATOMIC_RELEASE);
+    pthread_join(s_thread, NULL);
+    drain();
+}
+
+void yamiAsyncLogFlush(void)
+{
+    pthread_once(&s_once, initOnce);
+    drain();
+}
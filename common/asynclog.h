@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef asynclog_h
+#define asynclog_h
+
+//asynchronous backend of YAMI_DEBUG_MESSAGE, built with --enable-asynclog.
+//the logging thread only stores a timestamp, the format pointer and the arguments
+//into its own lock free ring. a background thread formats the records and writes
+//them to yamiLogFn, so format, prefix and file must be string literals.
+//records are dropped, not waited for, when a ring is full.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void yamiAsyncLog(const char* prefix, const char* file, int line, const char* format, ...)
+    __attribute__((format(printf, 4, 5)));
+
+//write out all pending records, ASSERT calls it before abort
+void yamiAsyncLogFlush(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //asynclog_h
@@ -20,6 +20,8 @@
 #include "lock.h"
 
 #include <VideoCommonDefs.h>
+#include <errno.h>
+#include <time.h>
 
 namespace YamiMediaCodec{
 
@@ -41,6 +43,12 @@ public:
         pthread_cond_wait(&m_cond, &m_lock.m_lock);
     }
 
+    //deadline is absolute CLOCK_REALTIME time, return false on timeout
+    bool timedWait(const struct timespec& deadline)
+    {
+        return pthread_cond_timedwait(&m_cond, &m_lock.m_lock, &deadline) != ETIMEDOUT;
+    }
+
     void signal()
     {
         pthread_cond_signal(&m_cond);
@@ -44,9 +44,10 @@ public:
         pthread_mutex_unlock(&m_lock);
     }
 
-    void tryLock()
+    //true if we got the lock
+    bool tryLock()
     {
-        pthread_mutex_trylock(&m_lock);
+        return !pthread_mutex_trylock(&m_lock);
     }
 
     friend class Condition;
@@ -48,14 +48,32 @@ extern int isInit;
 }while (0)
 #endif
 
+//messages above this level are compiled out, e.g. -DYAMI_LOG_COMPILE_LEVEL=YAMI_LOG_INFO
+#ifndef YAMI_LOG_COMPILE_LEVEL
+#define YAMI_LOG_COMPILE_LEVEL YAMI_LOG_DEBUG
+#endif
+
+#ifdef __ENABLE_ASYNC_LOG__
+#include "common/asynclog.h"
+
+#define YAMI_DEBUG_MESSAGE(LEVEL, prefix, format, ...) \
+    do {\
+        if (YAMI_LOG_##LEVEL <= YAMI_LOG_COMPILE_LEVEL && yamiLogFlag >= YAMI_LOG_##LEVEL) { \
+            yamiAsyncLog(#prefix, __FILE__, __LINE__, format "\n", ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+#define YAMI_LOG_FLUSH() yamiAsyncLogFlush()
+#else
 #define YAMI_DEBUG_MESSAGE(LEVEL, prefix, format, ...) \
     do {\
-        if (yamiLogFlag >= YAMI_LOG_##LEVEL) { \
+        if (YAMI_LOG_##LEVEL <= YAMI_LOG_COMPILE_LEVEL && yamiLogFlag >= YAMI_LOG_##LEVEL) { \
             const char* name = strrchr(__FILE__, '/'); \
             name = (name ? (name + 1) : __FILE__); \
             yamiMessage(yamiLogFn, "libyami %s %ld (%s, %d): " format "\n", #prefix, (long int)GETTID(), name, __LINE__, ##__VA_ARGS__); \
         } \
     } while (0)
+#endif
 
 #ifndef ERROR
 #define ERROR(format, ...)  YAMI_DEBUG_MESSAGE(ERROR, error, format, ##__VA_ARGS__)
@@ -109,11 +127,16 @@ extern int isInit;
 #endif                          //__ENABLE_DEBUG__
 #endif                          //__ANDROID
 
+#ifndef YAMI_LOG_FLUSH
+#define YAMI_LOG_FLUSH()
+#endif
+
 #ifndef ASSERT
 #define ASSERT(expr)               \
     do {                           \
         if (!(expr)) {             \
             ERROR("assert fails"); \
+            YAMI_LOG_FLUSH();      \
             assert(0 && (expr));   \
         }                          \
     } while (0)
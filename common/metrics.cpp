@@ -0,0 +1,655 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "common/metrics.h"
+#include "common/log.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace YamiMediaCodec{
+
+static uint64_t nowNs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+//split a="x",b="y" into pairs
+static void parseLabels(const std::string& labels, std::vector<std::pair<std::string, std::string> >& pairs)
+{
+    size_t pos = 0;
+    while (pos < labels.size()) {
+        size_t eq = labels.find('=', pos);
+        if (eq == std::string::npos)
+            break;
+        std::string key = labels.substr(pos, eq - pos);
+        size_t start = eq + 1;
+        size_t end;
+        if (start < labels.size() && labels[start] == '"') {
+            start++;
+            end = labels.find('"', start);
+            if (end == std::string::npos)
+                end = labels.size();
+            pairs.push_back(std::make_pair(key, labels.substr(start, end - start)));
+            end = labels.find(',', end);
+        }
+        else {
+            end = labels.find(',', start);
+            pairs.push_back(std::make_pair(key, labels.substr(start, end == std::string::npos ? std::string::npos : end - start)));
+        }
+        if (end == std::string::npos)
+            break;
+        pos = end + 1;
+    }
+}
+
+Metric::Metric(Type type, const char* name, const char* labels, const char* help)
+    : m_type(type)
+    , m_name(name)
+    , m_labels(labels ? labels : "")
+    , m_help(help ? help : "")
+{
+    parseLabels(m_labels, m_labelPairs);
+}
+
+Histogram::Histogram(const char* name, const char* labels, const char* help,
+    const uint64_t* bounds, uint32_t count)
+    : Metric(METRIC_HISTOGRAM, name, labels, help)
+    , m_bounds(bounds, bounds + count)
+    , m_counts(count + 1, 0)
+    , m_sum(0)
+{
+}
+
+void Histogram::observe(uint64_t v)
+{
+    size_t i = std::lower_bound(m_bounds.begin(), m_bounds.end(), v) - m_bounds.begin();
+    __atomic_fetch_add(&m_counts[i], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&m_sum, v, __ATOMIC_RELAXED);
+}
+
+Rate::Rate(const char* name, const char* labels, const char* help, Counter* counter)
+    : Metric(METRIC_RATE, name, labels, help)
+    , m_counter(counter)
+    , m_last(counter->value())
+    , m_lastTime(nowNs())
+    , m_rate(0)
+{
+}
+
+//only called by the exporter thread
+void Rate::update(uint64_t now)
+{
+    uint64_t value = m_counter->value();
+    if (now <= m_lastTime)
+        return;
+    double rate = (double)(value - m_last) * 1000000000.0 / (now - m_lastTime);
+    __atomic_store(&m_rate, &rate, __ATOMIC_RELAXED);
+    m_last = value;
+    m_lastTime = now;
+}
+
+double Rate::value()
+{
+    double rate;
+    __atomic_load(&m_rate, &rate, __ATOMIC_RELAXED);
+    return rate;
+}
+
+Metrics& Metrics::getInstance()
+{
+    static Metrics metrics;
+    return metrics;
+}
+
+Metrics::Metrics()
+    : m_instanceId(0)
+{
+}
+
+//called with m_lock held
+Metric* Metrics::find(Metric::Type type, const char* name, const char* labels)
+{
+    std::string l(labels ? labels : "");
+    for (size_t i = 0; i < m_metrics.size(); i++) {
+        Metric* m = m_metrics[i];
+        if (m->m_name == name && m->m_labels == l) {
+            if (m->m_type != type) {
+                ERROR("metric %s registered with another type", name);
+                return NULL;
+            }
+            return m;
+        }
+    }
+    return NULL;
+}
+
+Counter* Metrics::counter(const char* name, const char* labels, const char* help)
+{
+    AutoLock lock(m_lock);
+    Metric* m = find(Metric::METRIC_COUNTER, name, labels);
+    if (m)
+        return static_cast<Counter*>(m);
+    Counter* c = new Counter(name, labels, help);
+    m_metrics.push_back(c);
+    return c;
+}
+
+Gauge* Metrics::gauge(const char* name, const char* labels, const char* help)
+{
+    AutoLock lock(m_lock);
+    Metric* m = find(Metric::METRIC_GAUGE, name, labels);
+    if (m)
+        return static_cast<Gauge*>(m);
+    Gauge* g = new Gauge(name, labels, help);
+    m_metrics.push_back(g);
+    return g;
+}
+
+Histogram* Metrics::histogram(const char* name, const char* labels, const char* help,
+    const uint64_t* bounds, uint32_t count)
+{
+    AutoLock lock(m_lock);
+    Metric* m = find(Metric::METRIC_HISTOGRAM, name, labels);
+    if (m)
+        return static_cast<Histogram*>(m);
+    Histogram* h = new Histogram(name, labels, help, bounds, count);
+    m_metrics.push_back(h);
+    return h;
+}
+
+Rate* Metrics::rate(const char* name, const char* labels, const char* help, Counter* counter)
+{
+    AutoLock lock(m_lock);
+    Metric* m = find(Metric::METRIC_RATE, name, labels);
+    if (m)
+        return static_cast<Rate*>(m);
+    Rate* r = new Rate(name, labels, help, counter);
+    m_metrics.push_back(r);
+    return r;
+}
+
+uint32_t Metrics::newInstanceId()
+{
+    return __atomic_add_fetch(&m_instanceId, 1, __ATOMIC_RELAXED);
+}
+
+void Metrics::remove(const char* labels)
+{
+    std::string l(labels ? labels : "");
+    AutoLock lock(m_lock);
+    std::vector<Metric*> kept;
+    std::vector<Metric*> removed;
+    for (size_t i = 0; i < m_metrics.size(); i++) {
+        Metric* m = m_metrics[i];
+        if (m->m_labels == l)
+            removed.push_back(m);
+        else
+            kept.push_back(m);
+    }
+    //a rate reads its counter
+    for (size_t i = 0; i < kept.size();) {
+        Metric* m = kept[i];
+        if (m->m_type == Metric::METRIC_RATE
+            && std::find(removed.begin(), removed.end(), static_cast<Rate*>(m)->counter()) != removed.end()) {
+            removed.push_back(m);
+            kept.erase(kept.begin() + i);
+        }
+        else {
+            i++;
+        }
+    }
+    m_metrics.swap(kept);
+    for (size_t i = 0; i < removed.size(); i++)
+        delete removed[i];
+}
+
+static bool lessName(const Metric* a, const Metric* b)
+{
+    return a->m_name < b->m_name;
+}
+
+//metrics of one family next to each other, in registration order
+void Metrics::snapshot(std::vector<Metric*>& metrics)
+{
+    metrics = m_metrics;
+    std::stable_sort(metrics.begin(), metrics.end(), lessName);
+}
+
+void Metrics::updateRates()
+{
+    AutoLock lock(m_lock);
+    std::vector<Metric*> metrics;
+    snapshot(metrics);
+    uint64_t now = nowNs();
+    for (size_t i = 0; i < metrics.size(); i++) {
+        if (metrics[i]->m_type == Metric::METRIC_RATE)
+            static_cast<Rate*>(metrics[i])->update(now);
+    }
+}
+
+static void appendf(std::string& out, const char* format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void appendf(std::string& out, const char* format, ...)
+{
+    char buf[256];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (n > 0)
+        out.append(buf, std::min((size_t)n, sizeof(buf) - 1));
+}
+
+//name{labels,extra}
+static void appendSeries(std::string& out, const std::string& name, const char* suffix,
+    const std::string& labels, const std::string& extra)
+{
+    out += name;
+    out += suffix;
+    if (labels.empty() && extra.empty())
+        return;
+    out += '{';
+    out += labels;
+    if (!labels.empty() && !extra.empty())
+        out += ',';
+    out += extra;
+    out += '}';
+}
+
+static const char* typeName(Metric::Type type)
+{
+    switch (type) {
+    case Metric::METRIC_COUNTER:
+        return "counter";
+    case Metric::METRIC_HISTOGRAM:
+        return "histogram";
+    default:
+        return "gauge";
+    }
+}
+
+void Metrics::writePrometheus(std::string& out)
+{
+    AutoLock lock(m_lock);
+    std::vector<Metric*> metrics;
+    snapshot(metrics);
+    std::string last;
+    for (size_t i = 0; i < metrics.size(); i++) {
+        Metric* m = metrics[i];
+        if (m->m_name != last) {
+            appendf(out, "# HELP %s %s\n", m->m_name.c_str(), m->m_help.c_str());
+            appendf(out, "# TYPE %s %s\n", m->m_name.c_str(), typeName(m->m_type));
+            last = m->m_name;
+        }
+        switch (m->m_type) {
+        case Metric::METRIC_COUNTER:
+            appendSeries(out, m->m_name, "", m->m_labels, "");
+            appendf(out, " %llu\n", (unsigned long long)static_cast<Counter*>(m)->value());
+            break;
+        case Metric::METRIC_GAUGE:
+            appendSeries(out, m->m_name, "", m->m_labels, "");
+            appendf(out, " %lld\n", (long long)static_cast<Gauge*>(m)->value());
+            break;
+        case Metric::METRIC_RATE:
+            appendSeries(out, m->m_name, "", m->m_labels, "");
+            appendf(out, " %.3f\n", static_cast<Rate*>(m)->value());
+            break;
+        case Metric::METRIC_HISTOGRAM: {
+            Histogram* h = static_cast<Histogram*>(m);
+            uint64_t total = 0;
+            for (size_t b = 0; b < h->m_counts.size(); b++) {
+                total += __atomic_load_n(&h->m_counts[b], __ATOMIC_RELAXED);
+                char le[32];
+                if (b < h->m_bounds.size())
+                    snprintf(le, sizeof(le), "le=\"%llu\"", (unsigned long long)h->m_bounds[b]);
+                else
+                    snprintf(le, sizeof(le), "le=\"+Inf\"");
+                appendSeries(out, m->m_name, "_bucket", m->m_labels, le);
+                appendf(out, " %llu\n", (unsigned long long)total);
+            }
+            appendSeries(out, m->m_name, "_sum", m->m_labels, "");
+            appendf(out, " %llu\n", (unsigned long long)__atomic_load_n(&h->m_sum, __ATOMIC_RELAXED));
+            appendSeries(out, m->m_name, "_count", m->m_labels, "");
+            appendf(out, " %llu\n", (unsigned long long)total);
+            break;
+        }
+        }
+    }
+}
+
+static void appendJsonString(std::string& out, const std::string& s)
+{
+    out += '"';
+    for (size_t i = 0; i < s.size(); i++) {
+        char c = s[i];
+        if (c == '"' || c == '\\')
+            out += '\\';
+        if ((unsigned char)c < 0x20)
+            appendf(out, "\\u%04x", c);
+        else
+            out += c;
+    }
+    out += '"';
+}
+
+void Metrics::writeJson(std::string& out)
+{
+    AutoLock lock(m_lock);
+    std::vector<Metric*> metrics;
+    snapshot(metrics);
+    out += "{\"metrics\":[";
+    for (size_t i = 0; i < metrics.size(); i++) {
+        Metric* m = metrics[i];
+        if (i)
+            out += ',';
+        out += "{\"name\":";
+        appendJsonString(out, m->m_name);
+        appendf(out, ",\"type\":\"%s\",\"labels\":{", typeName(m->m_type));
+        for (size_t l = 0; l < m->m_labelPairs.size(); l++) {
+            if (l)
+                out += ',';
+            appendJsonString(out, m->m_labelPairs[l].first);
+            out += ':';
+            appendJsonString(out, m->m_labelPairs[l].second);
+        }
+        out += '}';
+        switch (m->m_type) {
+        case Metric::METRIC_COUNTER:
+            appendf(out, ",\"value\":%llu}", (unsigned long long)static_cast<Counter*>(m)->value());
+            break;
+        case Metric::METRIC_GAUGE:
+            appendf(out, ",\"value\":%lld}", (long long)static_cast<Gauge*>(m)->value());
+            break;
+        case Metric::METRIC_RATE:
+            appendf(out, ",\"value\":%.3f}", static_cast<Rate*>(m)->value());
+            break;
+        case Metric::METRIC_HISTOGRAM: {
+            Histogram* h = static_cast<Histogram*>(m);
+            uint64_t total = 0;
+            out += ",\"buckets\":[";
+            for (size_t b = 0; b < h->m_counts.size(); b++) {
+                total += __atomic_load_n(&h->m_counts[b], __ATOMIC_RELAXED);
+                if (b)
+                    out += ',';
+                if (b < h->m_bounds.size())
+                    appendf(out, "{\"le\":%llu,\"count\":%llu}", (unsigned long long)h->m_bounds[b], (unsigned long long)total);
+                else
+                    appendf(out, "{\"le\":\"+Inf\",\"count\":%llu}", (unsigned long long)total);
+            }
+            appendf(out, "],\"sum\":%llu,\"count\":%llu}",
+                (unsigned long long)__atomic_load_n(&h->m_sum, __ATOMIC_RELAXED), (unsigned long long)total);
+            break;
+        }
+        }
+    }
+    out += "]}\n";
+}
+
+class MetricsExporter
+{
+public:
+    MetricsExporter()
+        : m_json(false)
+        , m_intervalMs(1000)
+        , m_listenFd(-1)
+        , m_quit(false)
+    {
+    }
+    bool init(const char* target, const char* format, const char* interval);
+    static void* start(void* exporter);
+    static void stop();
+
+private:
+    bool listenUnix(const char* path);
+    bool listenTcp(const char* port);
+    void loop();
+    void format(std::string& out);
+    void writeFile();
+    void serve();
+
+    bool m_json;
+    int m_intervalMs;
+    std::string m_path;
+    int m_listenFd;
+    bool m_quit;
+};
+
+static MetricsExporter* s_exporter;
+static pthread_t s_exporterThread;
+
+bool MetricsExporter::listenUnix(const char* path)
+{
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        ERROR("metrics socket path too long: %s", path);
+        return false;
+    }
+    m_listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (m_listenFd < 0)
+        return false;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    m_path = path;
+    return !bind(m_listenFd, (struct sockaddr*)&addr, sizeof(addr)) && !listen(m_listenFd, 8);
+}
+
+bool MetricsExporter::listenTcp(const char* port)
+{
+    struct sockaddr_in addr;
+    int on = 1;
+    m_listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (m_listenFd < 0)
+        return false;
+    setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    //local only, we serve no authentication
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(atoi(port));
+    return !bind(m_listenFd, (struct sockaddr*)&addr, sizeof(addr)) && !listen(m_listenFd, 8);
+}
+
+bool MetricsExporter::init(const char* target, const char* format, const char* interval)
+{
+    if (format && !strcasecmp(format, "json"))
+        m_json = true;
+    else if (format && strcasecmp(format, "prometheus")) {
+        ERROR("unknown metrics format %s", format);
+        return false;
+    }
+    if (interval && atoi(interval) > 0)
+        m_intervalMs = atoi(interval);
+
+    bool ret;
+    if (!strncmp(target, "file:", 5)) {
+        m_path = target + 5;
+        ret = !m_path.empty();
+    }
+    else if (!strncmp(target, "unix:", 5))
+        ret = listenUnix(target + 5);
+    else if (!strncmp(target, "tcp:", 4))
+        ret = listenTcp(target + 4);
+    else {
+        ERROR("unknown metrics target %s", target);
+        return false;
+    }
+    if (!ret)
+        ERROR("can't export metrics to %s: %s", target, strerror(errno));
+    return ret;
+}
+
+void MetricsExporter::format(std::string& out)
+{
+    if (m_json)
+        Metrics::getInstance().writeJson(out);
+    else
+        Metrics::getInstance().writePrometheus(out);
+}
+
+//write to a temp file and rename, readers never see a partial file
+void MetricsExporter::writeFile()
+{
+    std::string out;
+    format(out);
+    std::string tmp = m_path + ".tmp";
+    FILE* fp = fopen(tmp.c_str(), "w");
+    if (!fp)
+        return;
+    bool ok = fwrite(out.data(), 1, out.size(), fp) == out.size();
+    if (fclose(fp) || !ok || rename(tmp.c_str(), m_path.c_str()))
+        unlink(tmp.c_str());
+}
+
+static void writeAll(int fd, const std::string& data)
+{
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = send(fd, data.data() + done, data.size() - done, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+        done += n;
+    }
+}
+
+//one snapshot per connection. clients speaking http get a minimal reply,
+//so prometheus can scrape us directly.
+void MetricsExporter::serve()
+{
+    int fd = accept4(m_listenFd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0)
+        return;
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    char request[512];
+    ssize_t n = 0;
+    //give the client a moment to send its request, but never block the loop for long
+    if (poll(&pfd, 1, 100) > 0)
+        n = recv(fd, request, sizeof(request) - 1, MSG_DONTWAIT);
+    std::string body;
+    format(body);
+    if (n >= 4 && !strncmp(request, "GET ", 4)) {
+        std::string reply;
+        appendf(reply, "HTTP/1.0 200 OK\r\nContent-Type: %s\r\nContent-Length: %zu\r\n\r\n",
+            m_json ? "application/json" : "text/plain; version=0.0.4", body.size());
+        writeAll(fd, reply);
+    }
+    writeAll(fd, body);
+    close(fd);
+}
+
+void MetricsExporter::loop()
+{
+    uint64_t next = nowNs();
+    while (!__atomic_load_n(&m_quit, __ATOMIC_ACQUIRE)) {
+        uint64_t now = nowNs();
+        if (now >= next) {
+            Metrics::getInstance().updateRates();
+            if (m_listenFd < 0)
+                writeFile();
+            next = now + (uint64_t)m_intervalMs * 1000000;
+        }
+        int timeout = (next - now) / 1000000 + 1;
+        if (m_listenFd < 0) {
+            //short naps so stop() does not wait a whole interval
+            struct timespec nap = { 0, 50 * 1000000 };
+            if (timeout < 50)
+                nap.tv_nsec = timeout * 1000000L;
+            nanosleep(&nap, NULL);
+            continue;
+        }
+        struct pollfd pfd;
+        pfd.fd = m_listenFd;
+        pfd.events = POLLIN;
+        if (timeout > 50)
+            timeout = 50;
+        if (poll(&pfd, 1, timeout) > 0)
+            serve();
+    }
+}
+
+void* MetricsExporter::start(void* exporter)
+{
+    ((MetricsExporter*)exporter)->loop();
+    return NULL;
+}
+
+//final update at exit, so the textfile has the last numbers
+void MetricsExporter::stop()
+{
+    MetricsExporter* exporter = s_exporter;
+    __atomic_store_n(&exporter->m_quit, true, __ATOMIC_RELEASE);
+    pthread_join(s_exporterThread, NULL);
+    Metrics::getInstance().updateRates();
+    if (exporter->m_listenFd < 0) {
+        exporter->writeFile();
+        return;
+    }
+    close(exporter->m_listenFd);
+    if (!exporter->m_path.empty())
+        unlink(exporter->m_path.c_str());
+}
+
+bool startMetricsExport()
+{
+    const char* target = getenv("YAMI_METRICS_EXPORT");
+    if (!target || !*target)
+        return true;
+    if (s_exporter)
+        return true;
+    //the registry must outlive the atexit handler below
+    Metrics::getInstance();
+    MetricsExporter* exporter = new MetricsExporter;
+    if (!exporter->init(target, getenv("YAMI_METRICS_FORMAT"), getenv("YAMI_METRICS_INTERVAL"))) {
+        delete exporter;
+        return false;
+    }
+    if (pthread_create(&s_exporterThread, NULL, MetricsExporter::start, exporter)) {
+        ERROR("create metrics thread failed");
+        delete exporter;
+        return false;
+    }
+    s_exporter = exporter;
+    atexit(MetricsExporter::stop);
+    return true;
+}
+
+};
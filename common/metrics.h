@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef metrics_h
+#define metrics_h
+
+#include "common/lock.h"
+
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace YamiMediaCodec{
+
+//process wide metrics registry.
+//look metrics up once, keep the pointer, and update it on the hot path,
+//updates are single atomic operations. metrics live until the process exits,
+//except those of instance labels, which their owner removes when it goes away.
+//labels use the prometheus form, e.g. "stage=\"decode\"".
+
+class Metric
+{
+public:
+    enum Type {
+        METRIC_COUNTER,
+        METRIC_GAUGE,
+        METRIC_HISTOGRAM,
+        METRIC_RATE,
+    };
+    Metric(Type type, const char* name, const char* labels, const char* help);
+    virtual ~Metric() {}
+
+    Type m_type;
+    std::string m_name;
+    std::string m_labels;
+    std::vector<std::pair<std::string, std::string> > m_labelPairs;
+    std::string m_help;
+private:
+    DISALLOW_COPY_AND_ASSIGN(Metric);
+};
+
+class Counter : public Metric
+{
+public:
+    Counter(const char* name, const char* labels, const char* help)
+        : Metric(METRIC_COUNTER, name, labels, help)
+        , m_value(0)
+    {
+    }
+    void add(uint64_t n = 1) { __atomic_fetch_add(&m_value, n, __ATOMIC_RELAXED); }
+    uint64_t value() { return __atomic_load_n(&m_value, __ATOMIC_RELAXED); }
+private:
+    uint64_t m_value;
+};
+
+class Gauge : public Metric
+{
+public:
+    Gauge(const char* name, const char* labels, const char* help)
+        : Metric(METRIC_GAUGE, name, labels, help)
+        , m_value(0)
+    {
+    }
+    void set(int64_t v) { __atomic_store_n(&m_value, v, __ATOMIC_RELAXED); }
+    void add(int64_t n) { __atomic_fetch_add(&m_value, n, __ATOMIC_RELAXED); }
+    int64_t value() { return __atomic_load_n(&m_value, __ATOMIC_RELAXED); }
+private:
+    int64_t m_value;
+};
+
+//histogram of integer observations, bounds are the inclusive bucket upper bounds
+class Histogram : public Metric
+{
+public:
+    Histogram(const char* name, const char* labels, const char* help,
+        const uint64_t* bounds, uint32_t count);
+    void observe(uint64_t v);
+
+    std::vector<uint64_t> m_bounds;
+    //one more bucket for +Inf
+    std::vector<uint64_t> m_counts;
+    uint64_t m_sum;
+};
+
+//per second rate of a counter, updated by the exporter
+class Rate : public Metric
+{
+public:
+    Rate(const char* name, const char* labels, const char* help, Counter* counter);
+    void update(uint64_t nowNs);
+    double value();
+    Counter* counter() const { return m_counter; }
+private:
+    Counter* m_counter;
+    uint64_t m_last;
+    uint64_t m_lastTime;
+    double m_rate;
+};
+
+class Metrics
+{
+public:
+    static Metrics& getInstance();
+
+    //same name and labels return the same metric
+    Counter* counter(const char* name, const char* labels, const char* help);
+    Gauge* gauge(const char* name, const char* labels, const char* help);
+    Histogram* histogram(const char* name, const char* labels, const char* help,
+        const uint64_t* bounds, uint32_t count);
+    Rate* rate(const char* name, const char* labels, const char* help, Counter* counter);
+
+    //number for instance labels, e.g. queue="async1"
+    uint32_t newInstanceId();
+    //drop the metrics of labels, and rates of them. pointers to them are
+    //invalid after this
+    void remove(const char* labels);
+
+    void updateRates();
+    void writePrometheus(std::string& out);
+    void writeJson(std::string& out);
+
+private:
+    Metrics();
+    Metric* find(Metric::Type type, const char* name, const char* labels);
+    //called with m_lock held, it keeps the metrics alive while we read them
+    void snapshot(std::vector<Metric*>& metrics);
+
+    Lock m_lock;
+    std::vector<Metric*> m_metrics;
+    uint32_t m_instanceId;
+    DISALLOW_COPY_AND_ASSIGN(Metrics);
+};
+
+//start the export thread if YAMI_METRICS_EXPORT is set:
+//  file:<path>   rewrite path every interval, for a textfile collector
+//  unix:<path>   serve one snapshot per connection on a unix socket
+//  tcp:<port>    same on 127.0.0.1:port, http requests get an http reply
+//YAMI_METRICS_FORMAT is prometheus (default) or json,
+//YAMI_METRICS_INTERVAL is the update interval in ms (default 1000)
+bool startMetricsExport();
+
+};
+
+#endif //metrics_h
@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef parsecount_h
+#define parsecount_h
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+//a decimal count in [min, max] for command line options, atoi would take
+//-1 as UINT_MAX. return 0 for anything else. c callers include it too
+static inline int parseCount(const char* str, uint32_t min, uint32_t max, uint32_t* value)
+{
+    char* end;
+    long long n;
+    errno = 0;
+    n = strtoll(str, &end, 10);
+    if (errno || end == str || *end || n < (long long)min || n > (long long)max)
+        return 0;
+    *value = (uint32_t)n;
+    return 1;
+}
+
+#endif //parsecount_h
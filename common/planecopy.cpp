@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "common/planecopy.h"
+#include "common/streamcopy.h"
+#include "common/log.h"
+
+#include <string.h>
+#include <unistd.h>
+
+namespace YamiMediaCodec{
+
+//one core copies ~1MB in well under 100us, smaller stripes cost more in wakeups
+#define MIN_STRIPE_SIZE (1024 * 1024)
+//memory bandwidth is saturated long before this
+#define MAX_STRIPES 8
+
+StripePool& StripePool::getInstance()
+{
+    static StripePool pool;
+    return pool;
+}
+
+StripePool::StripePool()
+    : m_cond(m_lock)
+    , m_done(m_lock)
+    , m_task(NULL)
+    , m_stripes(0)
+    , m_next(0)
+    , m_finished(0)
+    , m_maxStripes(1)
+    , m_started(false)
+    , m_quit(false)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus > MAX_STRIPES)
+        cpus = MAX_STRIPES;
+    if (cpus > 1)
+        m_maxStripes = cpus;
+}
+
+StripePool::~StripePool()
+{
+    {
+        AutoLock lock(m_lock);
+        m_quit = true;
+        m_cond.broadcast();
+    }
+    for (size_t i = 0; i < m_threads.size(); i++)
+        pthread_join(m_threads[i], NULL);
+}
+
+uint32_t StripePool::getStripes(size_t size)
+{
+    size_t stripes = size / MIN_STRIPE_SIZE;
+    if (stripes < 1)
+        return 1;
+    if (stripes > m_maxStripes)
+        return m_maxStripes;
+    return stripes;
+}
+
+//called with m_runLock held
+bool StripePool::start()
+{
+    if (m_started)
+        return !m_threads.empty();
+    m_started = true;
+    //the caller works on one stripe
+    for (uint32_t i = 1; i < m_maxStripes; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, threadFunc, this)) {
+            ERROR("create copy thread failed");
+            break;
+        }
+        m_threads.push_back(thread);
+    }
+    return !m_threads.empty();
+}
+
+void* StripePool::threadFunc(void* pool)
+{
+    ((StripePool*)pool)->loop();
+    return NULL;
+}
+
+bool StripePool::grab(StripeTask*& task, uint32_t& stripe, uint32_t& stripes)
+{
+    if (!m_task || m_next >= m_stripes)
+        return false;
+    task = m_task;
+    stripe = m_next++;
+    stripes = m_stripes;
+    return true;
+}
+
+void StripePool::finish()
+{
+    m_finished++;
+    if (m_finished == m_stripes)
+        m_done.signal();
+}
+
+void StripePool::loop()
+{
+    AutoLock lock(m_lock);
+    while (!m_quit) {
+        StripeTask* task;
+        uint32_t stripe, stripes;
+        if (!grab(task, stripe, stripes)) {
+            m_cond.wait();
+            continue;
+        }
+        m_lock.release();
+        task->run(stripe, stripes);
+        m_lock.acquire();
+        finish();
+    }
+}
+
+void StripePool::run(StripeTask& task, uint32_t stripes)
+{
+    if (stripes > m_maxStripes)
+        stripes = m_maxStripes;
+    //a busy pool is not waited for, other streams copy in parallel anyway
+    if (stripes > 1 && m_runLock.tryLock()) {
+        bool started = start();
+        if (started)
+            runStriped(task, stripes);
+        m_runLock.release();
+        if (started)
+            return;
+    }
+    for (uint32_t i = 0; i < stripes; i++)
+        task.run(i, stripes);
+}
+
+void StripePool::runStriped(StripeTask& task, uint32_t stripes)
+{
+    AutoLock lock(m_lock);
+    m_task = &task;
+    m_stripes = stripes;
+    m_next = 0;
+    m_finished = 0;
+    m_cond.broadcast();
+
+    StripeTask* t;
+    uint32_t stripe, count;
+    while (grab(t, stripe, count)) {
+        m_lock.release();
+        t->run(stripe, count);
+        m_lock.acquire();
+        finish();
+    }
+    while (m_finished < m_stripes)
+        m_done.wait();
+    m_task = NULL;
+}
+
+class PlaneCopyTask : public StripeTask
+{
+public:
+    PlaneCopyTask(uint8_t* dest, uint32_t destPitch, const uint8_t* src, uint32_t srcPitch,
+        uint32_t width, uint32_t height, PlaneCopyType type)
+        : m_dest(dest)
+        , m_destPitch(destPitch)
+        , m_src(src)
+        , m_srcPitch(srcPitch)
+        , m_width(width)
+        , m_height(height)
+        , m_type(type)
+    {
+    }
+    void run(uint32_t stripe, uint32_t stripes)
+    {
+        uint32_t rows = (m_height + stripes - 1) / stripes;
+        uint32_t start = rows * stripe;
+        if (start >= m_height)
+            return;
+        if (rows > m_height - start)
+            rows = m_height - start;
+        uint8_t* dest = m_dest + (size_t)m_destPitch * start;
+        const uint8_t* src = m_src + (size_t)m_srcPitch * start;
+        if (m_type == PLANE_COPY_READBACK) {
+            streamCopyPlane(dest, m_destPitch, src, m_srcPitch, m_width, rows);
+            return;
+        }
+        for (uint32_t i = 0; i < rows; i++) {
+            memcpy(dest, src, m_width);
+            dest += m_destPitch;
+            src += m_srcPitch;
+        }
+    }
+
+private:
+    uint8_t* m_dest;
+    uint32_t m_destPitch;
+    const uint8_t* m_src;
+    uint32_t m_srcPitch;
+    uint32_t m_width;
+    uint32_t m_height;
+    PlaneCopyType m_type;
+};
+
+void copyPlane(uint8_t* dest, uint32_t destPitch, const uint8_t* src, uint32_t srcPitch,
+    uint32_t width, uint32_t height, PlaneCopyType type)
+{
+    PlaneCopyTask task(dest, destPitch, src, srcPitch, width, height, type);
+    StripePool& pool = StripePool::getInstance();
+    pool.run(task, pool.getStripes((size_t)width * height));
+}
+
+};
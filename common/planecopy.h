@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef planecopy_h
+#define planecopy_h
+
+#include "common/condition.h"
+#include "common/lock.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <vector>
+
+namespace YamiMediaCodec{
+
+//one piece of a job split by rows
+class StripeTask
+{
+public:
+    virtual void run(uint32_t stripe, uint32_t stripes) = 0;
+    virtual ~StripeTask() {}
+};
+
+//small persistent worker pool for copying big frames.
+//run() splits a task into stripes, the calling thread works on stripes too
+//and returns when all of them are done. one job is in the pool at a time,
+//the callers meanwhile run their stripes inline instead of waiting.
+class StripePool
+{
+public:
+    static StripePool& getInstance();
+
+    //stripe count for a job touching size bytes, 1 for small jobs
+    uint32_t getStripes(size_t size);
+    void run(StripeTask& task, uint32_t stripes);
+
+    ~StripePool();
+private:
+    StripePool();
+    bool start();
+    //called with m_runLock held
+    void runStriped(StripeTask& task, uint32_t stripes);
+    bool grab(StripeTask*& task, uint32_t& stripe, uint32_t& stripes);
+    void finish();
+    static void* threadFunc(void* pool);
+    void loop();
+
+    Lock m_lock;
+    Condition m_cond;
+    Condition m_done;
+    //held by the caller whose job is in the pool
+    Lock m_runLock;
+
+    StripeTask* m_task;
+    uint32_t m_stripes;
+    uint32_t m_next;
+    uint32_t m_finished;
+
+    uint32_t m_maxStripes;
+    bool m_started;
+    bool m_quit;
+    std::vector<pthread_t> m_threads;
+    DISALLOW_COPY_AND_ASSIGN(StripePool);
+};
+
+enum PlaneCopyType {
+    PLANE_COPY_UPLOAD, //dest is mapped surface memory
+    PLANE_COPY_READBACK, //src is mapped surface memory
+};
+
+//copy height rows of width bytes, big planes are copied in parallel stripes
+void copyPlane(uint8_t* dest, uint32_t destPitch, const uint8_t* src, uint32_t srcPitch,
+    uint32_t width, uint32_t height, PlaneCopyType type);
+
+};
+
+#endif //planecopy_h
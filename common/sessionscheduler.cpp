@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "common/sessionscheduler.h"
+
+#include <stdio.h>
+#include <time.h>
+
+namespace YamiMediaCodec{
+
+//a late session may be stalled on its input, lower classes
+//still get a frame through this often
+#define THROTTLE_MAX_MS 100
+
+static const char* s_classNames[SESSION_PRIORITY_COUNT] = { "live", "batch" };
+
+static uint64_t nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+ScheduledSession::ScheduledSession(SessionPriority priority, float fps)
+    : m_priority(priority)
+    , m_period(fps > 0 ? (uint64_t)(1000000000 / fps) : 0)
+    , m_start(0)
+    , m_frames(0)
+    , m_checked(0)
+    , m_late(false)
+    , m_heldSince(0)
+{
+    SessionScheduler::getInstance().join(m_priority);
+}
+
+ScheduledSession::~ScheduledSession()
+{
+    SessionScheduler::getInstance().leave(m_priority, m_late);
+}
+
+bool ScheduledSession::pace(uint32_t maxWaitMs)
+{
+    SessionScheduler& scheduler = SessionScheduler::getInstance();
+    uint64_t now = nowNs();
+    if (!m_start)
+        m_start = now;
+    uint64_t limit = maxWaitMs == PACE_WAIT_FOREVER ? (uint64_t)-1 : now + (uint64_t)maxWaitMs * 1000000;
+
+    if (m_period && m_frames && m_checked != m_frames) {
+        //the last frame should be done by the time this one is due
+        m_checked = m_frames;
+        bool late = now > m_start + m_frames * m_period;
+        if (late) {
+            scheduler.missed(m_priority);
+            //count every late frame once, not every frame after it
+            m_start = now - m_frames * m_period;
+        }
+        if (late != m_late) {
+            m_late = late;
+            scheduler.setLate(m_priority, late);
+        }
+    }
+
+    //held once for THROTTLE_MAX_MS, the frame goes on however late others are
+    bool throttled = false;
+    while (1) {
+        if (!m_heldSince && !throttled && scheduler.hold(m_priority))
+            m_heldSince = nowNs();
+        if (m_heldSince) {
+            uint64_t release = m_heldSince + (uint64_t)THROTTLE_MAX_MS * 1000000;
+            if (!scheduler.waitWhileHeld(m_priority, release < limit ? release : limit)) {
+                if (limit < release)
+                    return false;
+                throttled = true;
+            }
+            m_heldSince = 0;
+        }
+        if (!m_period)
+            break;
+        //no faster than the target
+        uint64_t due = m_start + m_frames * m_period;
+        if (scheduler.waitUnlessHeld(m_priority, due < limit ? due : limit, !throttled)) {
+            if (due > limit)
+                return false;
+            break;
+        }
+    }
+    m_frames++;
+    scheduler.paced(m_priority);
+    return true;
+}
+
+SessionScheduler& SessionScheduler::getInstance()
+{
+    static SessionScheduler scheduler;
+    return scheduler;
+}
+
+SessionScheduler::SessionScheduler()
+    : m_cond(m_lock)
+{
+    Metrics& metrics = Metrics::getInstance();
+    for (int i = 0; i < SESSION_PRIORITY_COUNT; i++) {
+        m_late[i] = 0;
+        char labels[32];
+        snprintf(labels, sizeof(labels), "class=\"%s\"", s_classNames[i]);
+        ClassMetrics& m = m_metrics[i];
+        m.sessions = metrics.gauge("yami_sessions", labels, "sessions of each priority class");
+        m.late = metrics.gauge("yami_sessions_late", labels, "sessions behind their frame deadline");
+        m.frames = metrics.counter("yami_session_frames_total", labels, "frames started by sessions of each class");
+        m.misses = metrics.counter("yami_session_deadline_misses_total", labels, "frames done after the next one was due");
+        m.throttled = metrics.counter("yami_session_throttled_total", labels, "frames held back for a late higher class");
+        m.throttledUs = metrics.counter("yami_session_throttled_us_total", labels, "time frames were held back");
+    }
+}
+
+void SessionScheduler::join(SessionPriority priority)
+{
+    m_metrics[priority].sessions->add(1);
+}
+
+void SessionScheduler::leave(SessionPriority priority, bool late)
+{
+    m_metrics[priority].sessions->add(-1);
+    if (late)
+        setLate(priority, false);
+}
+
+void SessionScheduler::setLate(SessionPriority priority, bool late)
+{
+    AutoLock lock(m_lock);
+    if (late)
+        m_late[priority]++;
+    else if (m_late[priority])
+        m_late[priority]--;
+    //held sessions go on, waiting ones of lower classes are held
+    m_cond.broadcast();
+    m_metrics[priority].late->set(m_late[priority]);
+}
+
+void SessionScheduler::missed(SessionPriority priority)
+{
+    m_metrics[priority].misses->add();
+}
+
+void SessionScheduler::paced(SessionPriority priority)
+{
+    m_metrics[priority].frames->add();
+}
+
+bool SessionScheduler::isHeld(SessionPriority priority)
+{
+    for (int i = 0; i < priority; i++) {
+        if (m_late[i])
+            return true;
+    }
+    return false;
+}
+
+bool SessionScheduler::hold(SessionPriority priority)
+{
+    AutoLock lock(m_lock);
+    if (!isHeld(priority))
+        return false;
+    m_metrics[priority].throttled->add();
+    return true;
+}
+
+bool SessionScheduler::waitFor(uint64_t until)
+{
+    uint64_t now = nowNs();
+    if (now >= until)
+        return false;
+    //timedWait takes a realtime deadline
+    uint64_t wait = until - now;
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += wait / 1000000000;
+    deadline.tv_nsec += wait % 1000000000;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    m_cond.timedWait(deadline);
+    return true;
+}
+
+bool SessionScheduler::waitWhileHeld(SessionPriority priority, uint64_t until)
+{
+    uint64_t start = nowNs();
+    bool ret = true;
+    {
+        AutoLock lock(m_lock);
+        while (isHeld(priority)) {
+            if (!waitFor(until)) {
+                ret = false;
+                break;
+            }
+        }
+    }
+    m_metrics[priority].throttledUs->add((nowNs() - start) / 1000);
+    return ret;
+}
+
+bool SessionScheduler::waitUnlessHeld(SessionPriority priority, uint64_t until, bool holdable)
+{
+    AutoLock lock(m_lock);
+    while (!holdable || !isHeld(priority)) {
+        if (!waitFor(until))
+            return true;
+    }
+    return false;
+}
+
+};
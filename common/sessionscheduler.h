@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef sessionscheduler_h
+#define sessionscheduler_h
+
+#include "common/condition.h"
+#include "common/lock.h"
+#include "common/metrics.h"
+
+#include <limits.h>
+#include <stdint.h>
+#include <strings.h>
+
+namespace YamiMediaCodec{
+
+//priority classes, a lower value goes first
+enum SessionPriority {
+    SESSION_LIVE,
+    SESSION_BATCH,
+    SESSION_PRIORITY_COUNT,
+};
+
+//for sessions that don't ask for a class, live has to be asked for
+#define SESSION_DEFAULT_PRIORITY SESSION_BATCH
+
+inline bool parseSessionPriority(const char* str, SessionPriority& priority)
+{
+    if (!strcasecmp(str, "live"))
+        priority = SESSION_LIVE;
+    else if (!strcasecmp(str, "batch"))
+        priority = SESSION_BATCH;
+    else
+        return false;
+    return true;
+}
+
+#define PACE_WAIT_FOREVER UINT_MAX
+
+//one pipeline loop, call pace() before each frame.
+//with a frame rate target the session runs no faster than it, and a frame
+//that is not done when the next one is due is a deadline miss. while a
+//session is behind its deadlines, sessions of lower classes are held in pace().
+//a session without a target never misses, so live needs one to hold others.
+//
+//the scheduler only sees the sessions of its process. tools started side by
+//side on a host don't hold each other back: run the sessions that should in
+//one process (yamid jobs, yamidecode with many inputs, grid -g), and weigh
+//separate processes with the os, e.g. nice or cgroup cpu weights.
+class ScheduledSession
+{
+public:
+    //fps 0 runs as fast as the scheduler lets it, without deadlines
+    ScheduledSession(SessionPriority priority, float fps);
+    ~ScheduledSession();
+
+    //wait until the next frame may start. return false if it still may not
+    //after maxWaitMs, e.g. to give a pool thread to other tasks. the wait
+    //ends early when a higher class falls behind, to hold us at once
+    bool pace(uint32_t maxWaitMs = PACE_WAIT_FOREVER);
+
+private:
+    SessionPriority m_priority;
+    //ns per frame, 0 without a target
+    uint64_t m_period;
+    uint64_t m_start;
+    //frames paced so far, and the frame count the last deadline check was for
+    uint64_t m_frames;
+    uint64_t m_checked;
+    bool m_late;
+    //when a higher class started to hold us, 0 if it does not
+    uint64_t m_heldSince;
+    DISALLOW_COPY_AND_ASSIGN(ScheduledSession);
+};
+
+//process wide state of all sessions
+class SessionScheduler
+{
+public:
+    static SessionScheduler& getInstance();
+
+private:
+    friend class ScheduledSession;
+    SessionScheduler();
+
+    void join(SessionPriority priority);
+    void leave(SessionPriority priority, bool late);
+    void setLate(SessionPriority priority, bool late);
+    void missed(SessionPriority priority);
+    void paced(SessionPriority priority);
+    //return true and count it if a higher class is late
+    bool hold(SessionPriority priority);
+    //wait while a higher class is late, until ns on the monotonic clock.
+    //return false on timeout
+    bool waitWhileHeld(SessionPriority priority, uint64_t until);
+    //wait until ns on the monotonic clock, return false if a higher class
+    //got late before and we are holdable
+    bool waitUnlessHeld(SessionPriority priority, uint64_t until, bool holdable);
+    bool isHeld(SessionPriority priority);
+    //wait on m_cond until ns on the monotonic clock, false if it passed
+    bool waitFor(uint64_t until);
+
+    Lock m_lock;
+    Condition m_cond;
+    //late sessions of each class
+    uint32_t m_late[SESSION_PRIORITY_COUNT];
+
+    struct ClassMetrics {
+        Gauge* sessions;
+        Gauge* late;
+        Counter* frames;
+        Counter* misses;
+        Counter* throttled;
+        Counter* throttledUs;
+    };
+    ClassMetrics m_metrics[SESSION_PRIORITY_COUNT];
+    DISALLOW_COPY_AND_ASSIGN(SessionScheduler);
+};
+
+};
+
+#endif //sessionscheduler_h
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "common/streamcopy.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define STREAMCOPY_X86 1
+#include <smmintrin.h>
+#endif
+
+namespace YamiMediaCodec{
+
+typedef void (*PlaneCopyFunc)(uint8_t* dest, uint32_t destPitch,
+    const uint8_t* src, uint32_t srcPitch, uint32_t width, uint32_t height);
+
+static void plainCopyPlane(uint8_t* dest, uint32_t destPitch,
+    const uint8_t* src, uint32_t srcPitch, uint32_t width, uint32_t height)
+{
+    if (destPitch == width && srcPitch == width) {
+        memcpy(dest, src, (size_t)width * height);
+        return;
+    }
+    for (uint32_t h = 0; h < height; h++) {
+        memcpy(dest, src, width);
+        dest += destPitch;
+        src += srcPitch;
+    }
+}
+
+#ifdef STREAMCOPY_X86
+
+//small enough to stay in L1 while we copy it out to the destination
+#define BOUNCE_SIZE 4096
+
+__attribute__((target("sse4.1")))
+static void streamingCopyPlane(uint8_t* dest, uint32_t destPitch,
+    const uint8_t* src, uint32_t srcPitch, uint32_t width, uint32_t height)
+{
+    __m128i bounce[BOUNCE_SIZE / sizeof(__m128i)];
+    uint8_t* cache = (uint8_t*)bounce;
+
+    //make sure previous writes to the write combining buffers are visible
+    _mm_mfence();
+    for (uint32_t h = 0; h < height; h++) {
+        //MOVNTDQA needs 16 bytes aligned address, an aligned 16 bytes block never
+        //crosses a page, so it's safe to load the whole block around the row edges.
+        const uint8_t* end = src + width;
+        const uint8_t* s = (const uint8_t*)((uintptr_t)src & ~(uintptr_t)15);
+        size_t skip = src - s;
+        uint8_t* d = dest;
+        while (s < end) {
+            size_t chunk = (end - s + 15) & ~(size_t)15;
+            if (chunk > BOUNCE_SIZE)
+                chunk = BOUNCE_SIZE;
+            __m128i* from = (__m128i*)s;
+            size_t i = 0;
+            //4 loads for a cache line, so we use the whole streaming load buffer
+            for (; i + 4 <= chunk / 16; i += 4) {
+                __m128i x0 = _mm_stream_load_si128(from + i);
+                __m128i x1 = _mm_stream_load_si128(from + i + 1);
+                __m128i x2 = _mm_stream_load_si128(from + i + 2);
+                __m128i x3 = _mm_stream_load_si128(from + i + 3);
+                _mm_store_si128(bounce + i, x0);
+                _mm_store_si128(bounce + i + 1, x1);
+                _mm_store_si128(bounce + i + 2, x2);
+                _mm_store_si128(bounce + i + 3, x3);
+            }
+            for (; i < chunk / 16; i++)
+                _mm_store_si128(bounce + i, _mm_stream_load_si128(from + i));
+
+            const uint8_t* last = s + chunk;
+            if (last > end)
+                last = end;
+            size_t size = last - s - skip;
+            memcpy(d, cache + skip, size);
+            d += size;
+            s += chunk;
+            skip = 0;
+        }
+        dest += destPitch;
+        src += srcPitch;
+    }
+}
+
+#endif //STREAMCOPY_X86
+
+static PlaneCopyFunc selectCopyPlane()
+{
+#ifdef STREAMCOPY_X86
+    //we may run before other constructors
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.1"))
+        return streamingCopyPlane;
+#endif
+    return plainCopyPlane;
+}
+
+static const PlaneCopyFunc s_copyPlane = selectCopyPlane();
+
+bool hasStreamingLoad()
+{
+    return s_copyPlane != plainCopyPlane;
+}
+
+void streamCopy(void* dest, const void* src, size_t size)
+{
+    //keep each call in 32 bits rows
+    const size_t ROW = 1 << 20;
+    uint8_t* d = (uint8_t*)dest;
+    const uint8_t* s = (const uint8_t*)src;
+    if (size >= ROW) {
+        uint32_t rows = size / ROW;
+        s_copyPlane(d, ROW, s, ROW, ROW, rows);
+        d += (size_t)rows * ROW;
+        s += (size_t)rows * ROW;
+        size -= (size_t)rows * ROW;
+    }
+    if (size)
+        s_copyPlane(d, size, s, size, size, 1);
+}
+
+void streamCopyPlane(uint8_t* dest, uint32_t destPitch,
+    const uint8_t* src, uint32_t srcPitch, uint32_t width, uint32_t height)
+{
+    s_copyPlane(dest, destPitch, src, srcPitch, width, height);
+}
+
+};
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef streamcopy_h
+#define streamcopy_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace YamiMediaCodec{
+
+//copy helpers for reading back mapped surfaces.
+//a derived VAImage is usually mapped as uncached speculative write combining (USWC) memory,
+//normal loads from it are uncached and very slow. when the cpu has SSE4.1 we use
+//streaming loads (MOVNTDQA) through a small cache resident bounce buffer,
+//otherwise we fall back to memcpy. the kernel is selected once at runtime.
+
+//true if the streaming load kernel is in use
+bool hasStreamingLoad();
+
+//copy size bytes from mapped surface memory to normal memory
+void streamCopy(void* dest, const void* src, size_t size);
+
+//copy height rows of width bytes from mapped surface memory to normal memory
+void streamCopyPlane(uint8_t* dest, uint32_t destPitch,
+    const uint8_t* src, uint32_t srcPitch, uint32_t width, uint32_t height);
+
+};
+
+#endif //streamcopy_h
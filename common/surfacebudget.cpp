@@ -0,0 +1,318 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "common/surfacebudget.h"
+#include "common/common_def.h"
+#include "common/log.h"
+
+#include <algorithm>
+#include <stdlib.h>
+#include <time.h>
+
+namespace YamiMediaCodec{
+
+//drivers align surfaces to 16 anyway
+#define SURFACE_SIZE_ALIGN 16
+
+bool SurfaceBudget::Key::operator<(const Key& other) const
+{
+    if (display != other.display)
+        return display < other.display;
+    if (fourcc != other.fourcc)
+        return fourcc < other.fourcc;
+    if (width != other.width)
+        return width < other.width;
+    return height < other.height;
+}
+
+SurfaceBudget& SurfaceBudget::getInstance()
+{
+    static SurfaceBudget budget;
+    return budget;
+}
+
+SurfaceBudget::SurfaceBudget()
+    : m_cond(m_lock)
+    , m_cap(0)
+    , m_used(0)
+    , m_kept(0)
+    , m_waiters(0)
+{
+    const char* mb = getenv("YAMI_SURFACE_BUDGET_MB");
+    if (mb)
+        m_cap = strtoull(mb, NULL, 10) << 20;
+    Metrics& metrics = Metrics::getInstance();
+    m_usedBytes = metrics.gauge("yami_surface_budget_used_bytes", "", "bytes of pool surfaces in use");
+    m_keptBytes = metrics.gauge("yami_surface_budget_kept_bytes", "", "bytes of pool surfaces kept for reuse");
+    m_reused = metrics.counter("yami_surface_budget_reused_total", "", "surfaces handed out again instead of created");
+    m_waits = metrics.counter("yami_surface_budget_waits_total", "", "pools waiting for room in the budget");
+    m_denied = metrics.counter("yami_surface_budget_denied_total", "", "surfaces over the guaranteed ones not given for lack of room");
+    m_reclaimed = metrics.counter("yami_surface_budget_reclaimed_total", "", "idle surfaces taken back from pools for others");
+    if (m_cap)
+        metrics.gauge("yami_surface_budget_bytes", "", "cap of all pool surfaces")->set(m_cap);
+}
+
+void SurfaceBudget::getSizeClass(uint32_t& width, uint32_t& height)
+{
+    width = ALIGN_POW2(width, SURFACE_SIZE_ALIGN);
+    height = ALIGN_POW2(height, SURFACE_SIZE_ALIGN);
+}
+
+uint64_t SurfaceBudget::getSurfaceBytes(uint32_t fourcc, uint32_t width, uint32_t height)
+{
+    uint64_t pixels = (uint64_t)width * height;
+    switch (fourcc) {
+    case VA_FOURCC_BGRX:
+    case VA_FOURCC_BGRA:
+    case VA_FOURCC_RGBX:
+    case VA_FOURCC_RGBA:
+        return pixels * 4;
+    case VA_FOURCC_YUY2:
+    case VA_FOURCC_UYVY:
+        return pixels * 2;
+#ifdef VA_FOURCC_P010
+    case VA_FOURCC_P010:
+        return pixels * 3;
+#endif
+    default:
+        return pixels * 3 / 2;
+    }
+}
+
+bool SurfaceBudget::create(const Key& key, uint32_t count, std::vector<VASurfaceID>& surfaces)
+{
+    surfaces.resize(count);
+    VASurfaceAttrib attrib;
+    attrib.flags = VA_SURFACE_ATTRIB_SETTABLE;
+    attrib.type = VASurfaceAttribPixelFormat;
+    attrib.value.type = VAGenericValueTypeInteger;
+    attrib.value.value.i = key.fourcc;
+    uint32_t rtformat;
+    if (key.fourcc == VA_FOURCC_BGRX
+        || key.fourcc == VA_FOURCC_BGRA) {
+        rtformat = VA_RT_FORMAT_RGB32;
+    } else {
+        rtformat = VA_RT_FORMAT_YUV420;
+    }
+    VAStatus status = vaCreateSurfaces(key.display, rtformat, key.width, key.height,
+                                       &surfaces[0], surfaces.size(), &attrib, 1);
+    if (status != VA_STATUS_SUCCESS) {
+        ERROR("create surface failed fourcc = %d", key.fourcc);
+        surfaces.clear();
+        return false;
+    }
+    return true;
+}
+
+void SurfaceBudget::destroy(VADisplay display, std::vector<VASurfaceID>& surfaces)
+{
+    if (surfaces.size())
+        vaDestroySurfaces(display, &surfaces[0], surfaces.size());
+    surfaces.clear();
+}
+
+uint64_t SurfaceBudget::getRoom()
+{
+    return m_cap > m_used ? m_cap - m_used : 0;
+}
+
+void SurfaceBudget::evict(uint64_t size)
+{
+    while (m_used + m_kept + size > m_cap && !m_cache.empty()) {
+        SurfaceCache::iterator it = m_cache.begin();
+        m_kept -= getSurfaceBytes(it->first.fourcc, it->first.width, it->first.height) * it->second.size();
+        destroy(it->first.display, it->second);
+        m_cache.erase(it);
+    }
+}
+
+uint32_t SurfaceBudget::reclaim()
+{
+    AutoLock lock(m_reclaimLock);
+    uint32_t reclaimed = 0;
+    for (size_t i = 0; i < m_reclaimers.size(); i++)
+        reclaimed += m_reclaimers[i]->reclaim();
+    m_reclaimed->add(reclaimed);
+    return reclaimed;
+}
+
+bool SurfaceBudget::waitForRoom(uint64_t needed, uint64_t own, const struct timespec& deadline)
+{
+    bool waited = false;
+    while (getRoom() < needed && m_used > own) {
+        if (!waited) {
+            m_waits->add();
+            waited = true;
+        }
+        //idle surfaces come back through release(), it takes m_lock
+        m_lock.release();
+        uint32_t reclaimed = reclaim();
+        m_lock.acquire();
+        if (reclaimed)
+            continue;
+        m_waiters++;
+        bool woken = m_cond.timedWait(deadline);
+        m_waiters--;
+        if (!woken)
+            return getRoom() >= needed || m_used <= own;
+    }
+    return true;
+}
+
+bool SurfaceBudget::acquire(VADisplay display, uint32_t fourcc, uint32_t width, uint32_t height,
+    uint32_t minimum, uint32_t count, std::vector<VASurfaceID>& surfaces, uint32_t waitMs)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += waitMs / 1000;
+    deadline.tv_nsec += (waitMs % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    Key key = { display, fourcc, width, height };
+    getSizeClass(key.width, key.height);
+    uint64_t size = getSurfaceBytes(fourcc, key.width, key.height);
+    if (minimum > count)
+        minimum = count;
+
+    AutoLock lock(m_lock);
+    surfaces.clear();
+    SurfaceCache::iterator it = m_cache.find(key);
+    if (it != m_cache.end()) {
+        std::vector<VASurfaceID>& kept = it->second;
+        while (!kept.empty() && surfaces.size() < count) {
+            surfaces.push_back(kept.back());
+            kept.pop_back();
+            m_kept -= size;
+            m_used += size;
+            m_reused->add();
+        }
+        if (kept.empty())
+            m_cache.erase(it);
+    }
+
+    uint32_t have = surfaces.size();
+    uint32_t guaranteed = minimum > have ? minimum - have : 0;
+    uint32_t n = count - have;
+    if (m_cap && n) {
+        //only wait while others hold surfaces they can give back
+        if (!waitForRoom(guaranteed * size, have * size, deadline)) {
+            ERROR("no room for %u surfaces of %ux%u in %u ms", guaranteed, key.width, key.height, waitMs);
+            keep(key, size, surfaces);
+            return false;
+        }
+        if (getRoom() < guaranteed * size)
+            ERROR("surface budget is smaller than %u surfaces of %ux%u", guaranteed, key.width, key.height);
+        uint64_t fits = getRoom() / size;
+        if (fits < n) {
+            uint32_t granted = fits > guaranteed ? fits : guaranteed;
+            m_denied->add(n - granted);
+            n = granted;
+        }
+        evict(n * size);
+    }
+    if (n) {
+        std::vector<VASurfaceID> created;
+        if (!create(key, n, created)) {
+            keep(key, size, surfaces);
+            return false;
+        }
+        surfaces.insert(surfaces.end(), created.begin(), created.end());
+        m_used += n * size;
+    }
+    m_usedBytes->set(m_used);
+    m_keptBytes->set(m_kept);
+    return true;
+}
+
+void SurfaceBudget::release(VADisplay display, uint32_t fourcc, uint32_t width, uint32_t height,
+    const std::vector<VASurfaceID>& surfaces)
+{
+    Key key = { display, fourcc, width, height };
+    getSizeClass(key.width, key.height);
+    uint64_t bytes = getSurfaceBytes(fourcc, key.width, key.height) * surfaces.size();
+
+    AutoLock lock(m_lock);
+    m_used -= bytes < m_used ? bytes : m_used;
+    if (m_cap) {
+        std::vector<VASurfaceID>& kept = m_cache[key];
+        kept.insert(kept.end(), surfaces.begin(), surfaces.end());
+        m_kept += bytes;
+    }
+    else {
+        std::vector<VASurfaceID> destroyed(surfaces);
+        destroy(display, destroyed);
+    }
+    m_usedBytes->set(m_used);
+    m_keptBytes->set(m_kept);
+    m_cond.broadcast();
+}
+
+void SurfaceBudget::keep(const Key& key, uint64_t size, std::vector<VASurfaceID>& surfaces)
+{
+    if (surfaces.empty())
+        return;
+    m_used -= surfaces.size() * size;
+    m_kept += surfaces.size() * size;
+    std::vector<VASurfaceID>& kept = m_cache[key];
+    kept.insert(kept.end(), surfaces.begin(), surfaces.end());
+    surfaces.clear();
+    m_usedBytes->set(m_used);
+    m_keptBytes->set(m_kept);
+    m_cond.broadcast();
+}
+
+void SurfaceBudget::addReclaimer(SurfaceReclaimer* reclaimer)
+{
+    AutoLock lock(m_reclaimLock);
+    m_reclaimers.push_back(reclaimer);
+}
+
+void SurfaceBudget::removeReclaimer(SurfaceReclaimer* reclaimer)
+{
+    AutoLock lock(m_reclaimLock);
+    m_reclaimers.erase(std::remove(m_reclaimers.begin(), m_reclaimers.end(), reclaimer), m_reclaimers.end());
+}
+
+bool SurfaceBudget::isContended()
+{
+    AutoLock lock(m_lock);
+    return m_waiters > 0;
+}
+
+void SurfaceBudget::flush(VADisplay display)
+{
+    AutoLock lock(m_lock);
+    SurfaceCache::iterator it = m_cache.begin();
+    while (it != m_cache.end()) {
+        if (it->first.display != display) {
+            ++it;
+            continue;
+        }
+        m_kept -= getSurfaceBytes(it->first.fourcc, it->first.width, it->first.height) * it->second.size();
+        destroy(display, it->second);
+        m_cache.erase(it++);
+    }
+    m_keptBytes->set(m_kept);
+}
+
+};
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef surfacebudget_h
+#define surfacebudget_h
+
+#include "common/condition.h"
+#include "common/lock.h"
+#include "common/metrics.h"
+
+#include <map>
+#include <stdint.h>
+#include <va/va.h>
+#include <vector>
+
+namespace YamiMediaCodec{
+
+//how long acquire waits for the guaranteed surfaces before it fails
+#define SURFACE_BUDGET_WAIT_MS 2000
+
+//a holder of surfaces, e.g. a frame pool, that can part with idle ones
+class SurfaceReclaimer
+{
+public:
+    virtual ~SurfaceReclaimer() {}
+    //give the idle surfaces above our minimum back to the budget with
+    //release(), return how many. called from other threads
+    virtual uint32_t reclaim() = 0;
+};
+
+//process wide budget for the surfaces of our frame pools, decoders keep
+//their own. YAMI_SURFACE_BUDGET_MB caps the memory of all pools together,
+//without it surfaces are created and destroyed as they are asked for.
+//with a cap, surfaces given back are kept for the next pool of the same
+//display, fourcc and size class, until the room is needed by others.
+class SurfaceBudget
+{
+public:
+    static SurfaceBudget& getInstance();
+
+    //get up to count surfaces of the size class of width x height.
+    //the first minimum are guaranteed, without room for all of them the
+    //reclaimers give idle surfaces back, or we wait up to waitMs for others
+    //to. the rest is only taken while there is room. return false if the
+    //driver failed or no room came.
+    bool acquire(VADisplay display, uint32_t fourcc, uint32_t width, uint32_t height,
+        uint32_t minimum, uint32_t count, std::vector<VASurfaceID>& surfaces,
+        uint32_t waitMs = SURFACE_BUDGET_WAIT_MS);
+    //give back surfaces from acquire with the same format
+    void release(VADisplay display, uint32_t fourcc, uint32_t width, uint32_t height,
+        const std::vector<VASurfaceID>& surfaces);
+    //destroy the kept surfaces of display, call it before vaTerminate
+    void flush(VADisplay display);
+    //true while a pool waits in acquire for room
+    bool isContended();
+    //reclaimer is asked for idle surfaces while a pool waits for room,
+    //until it is removed
+    void addReclaimer(SurfaceReclaimer* reclaimer);
+    void removeReclaimer(SurfaceReclaimer* reclaimer);
+
+    //surfaces are allocated at the size class, it is never smaller than the size
+    static void getSizeClass(uint32_t& width, uint32_t& height);
+
+private:
+    SurfaceBudget();
+
+    struct Key {
+        VADisplay display;
+        uint32_t fourcc;
+        uint32_t width;
+        uint32_t height;
+        bool operator<(const Key& other) const;
+    };
+    typedef std::map<Key, std::vector<VASurfaceID> > SurfaceCache;
+
+    static uint64_t getSurfaceBytes(uint32_t fourcc, uint32_t width, uint32_t height);
+    bool create(const Key& key, uint32_t count, std::vector<VASurfaceID>& surfaces);
+    void destroy(VADisplay display, std::vector<VASurfaceID>& surfaces);
+    //room left without the kept surfaces
+    uint64_t getRoom();
+    //destroy kept surfaces until size fits in the room left
+    void evict(uint64_t size);
+    //called locked, wait until needed bytes fit while others hold more
+    //than own. false if they did not give enough back before deadline
+    bool waitForRoom(uint64_t needed, uint64_t own, const struct timespec& deadline);
+    //ask every reclaimer, called unlocked
+    uint32_t reclaim();
+    //put surfaces taken in a failed acquire back as kept, called locked
+    void keep(const Key& key, uint64_t size, std::vector<VASurfaceID>& surfaces);
+
+    Lock m_lock;
+    Condition m_cond;
+    uint64_t m_cap;
+    //bytes of surfaces handed out and kept
+    uint64_t m_used;
+    uint64_t m_kept;
+    uint32_t m_waiters;
+    SurfaceCache m_cache;
+    //taken before m_lock, never while holding it
+    Lock m_reclaimLock;
+    std::vector<SurfaceReclaimer*> m_reclaimers;
+
+    Gauge* m_usedBytes;
+    Gauge* m_keptBytes;
+    Counter* m_reused;
+    Counter* m_waits;
+    Counter* m_denied;
+    Counter* m_reclaimed;
+    DISALLOW_COPY_AND_ASSIGN(SurfaceBudget);
+};
+
+};
+
+#endif //surfacebudget_h
@@ -0,0 +1,312 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "testpattern.h"
+#include "common/common_def.h"
+#include "common/log.h"
+
+#include <VideoCommonDefs.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+namespace YamiMediaCodec{
+
+#define TEST_PATTERN_PREFIX "synthetic"
+
+//5x7 glyphs for 0-9 and A-Z, one byte per column, bit 0 is the top row
+static const uint8_t s_font[][5] = {
+    { 0x3e, 0x51, 0x49, 0x45, 0x3e }, { 0x00, 0x42, 0x7f, 0x40, 0x00 },
+    { 0x42, 0x61, 0x51, 0x49, 0x46 }, { 0x21, 0x41, 0x45, 0x4b, 0x31 },
+    { 0x18, 0x14, 0x12, 0x7f, 0x10 }, { 0x27, 0x45, 0x45, 0x45, 0x39 },
+    { 0x3c, 0x4a, 0x49, 0x49, 0x30 }, { 0x01, 0x71, 0x09, 0x05, 0x03 },
+    { 0x36, 0x49, 0x49, 0x49, 0x36 }, { 0x06, 0x49, 0x49, 0x29, 0x1e },
+    { 0x7e, 0x11, 0x11, 0x11, 0x7e }, { 0x7f, 0x49, 0x49, 0x49, 0x36 },
+    { 0x3e, 0x41, 0x41, 0x41, 0x22 }, { 0x7f, 0x41, 0x41, 0x22, 0x1c },
+    { 0x7f, 0x49, 0x49, 0x49, 0x41 }, { 0x7f, 0x09, 0x09, 0x09, 0x01 },
+    { 0x3e, 0x41, 0x49, 0x49, 0x7a }, { 0x7f, 0x08, 0x08, 0x08, 0x7f },
+    { 0x00, 0x41, 0x7f, 0x41, 0x00 }, { 0x20, 0x40, 0x41, 0x3f, 0x01 },
+    { 0x7f, 0x08, 0x14, 0x22, 0x41 }, { 0x7f, 0x40, 0x40, 0x40, 0x40 },
+    { 0x7f, 0x02, 0x0c, 0x02, 0x7f }, { 0x7f, 0x04, 0x08, 0x10, 0x7f },
+    { 0x3e, 0x41, 0x41, 0x41, 0x3e }, { 0x7f, 0x09, 0x09, 0x09, 0x06 },
+    { 0x3e, 0x41, 0x51, 0x21, 0x5e }, { 0x7f, 0x09, 0x19, 0x29, 0x46 },
+    { 0x46, 0x49, 0x49, 0x49, 0x31 }, { 0x01, 0x01, 0x7f, 0x01, 0x01 },
+    { 0x3f, 0x40, 0x40, 0x40, 0x3f }, { 0x1f, 0x20, 0x40, 0x20, 0x1f },
+    { 0x3f, 0x40, 0x38, 0x40, 0x3f }, { 0x63, 0x14, 0x08, 0x14, 0x63 },
+    { 0x07, 0x08, 0x70, 0x08, 0x07 }, { 0x61, 0x51, 0x49, 0x45, 0x43 },
+};
+
+static uint32_t hash(uint32_t a, uint32_t b = 0)
+{
+    uint32_t h = a * 0x9e3779b1u ^ (b + 0x7f4a7c15u) * 0x85ebca6bu;
+    h ^= h >> 15;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 13;
+    return h;
+}
+
+//0 to 255 and back over period
+static uint8_t triangle(uint32_t v, uint32_t period)
+{
+    uint32_t half = period / 2;
+    v %= period;
+    return (v < half ? v : period - v) * 255 / half;
+}
+
+struct Yuv {
+    uint8_t y, u, v;
+};
+
+class Painter
+{
+public:
+    Painter(TestPattern::Pattern pattern, uint32_t width, uint32_t height)
+        : m_pattern(pattern)
+        , m_width(width)
+        , m_height(height)
+        , m_scale(height / 120 ? height / 120 : 1)
+    {
+    }
+    Yuv pixel(uint32_t x, uint32_t y)
+    {
+        Yuv p;
+        switch (m_pattern) {
+        case TestPattern::PATTERN_GRADIENT: {
+            //periods of the frame size, so the panning window wraps without a jump
+            uint8_t h = triangle(x, m_width);
+            uint8_t v = triangle(y, m_height);
+            p.y = (h + v) / 2;
+            p.u = 64 + h / 2;
+            p.v = 192 - v / 2;
+            break;
+        }
+        case TestPattern::PATTERN_NOISE: {
+            uint32_t r = hash(x, y);
+            p.y = r;
+            p.u = 96 + ((r >> 8) & 63);
+            p.v = 96 + ((r >> 16) & 63);
+            break;
+        }
+        default: {
+            uint32_t cellWidth = 6 * m_scale;
+            uint32_t cellHeight = 9 * m_scale;
+            uint32_t gx = x % cellWidth / m_scale;
+            uint32_t gy = y % cellHeight / m_scale;
+            //about one space in ten characters
+            uint32_t c = hash(x / cellWidth, y / cellHeight) % 40;
+            bool on = gx < 5 && gy < 7 && c < N_ELEMENTS(s_font) && (s_font[c][gx] >> gy & 1);
+            p.y = on ? 235 : 16;
+            p.u = 128;
+            p.v = 128;
+            break;
+        }
+        }
+        return p;
+    }
+
+private:
+    TestPattern::Pattern m_pattern;
+    uint32_t m_width;
+    uint32_t m_height;
+    uint32_t m_scale;
+};
+
+TestPattern::TestPattern()
+    : m_fourcc(0)
+    , m_width(0)
+    , m_height(0)
+    , m_frames(DEFAULT_FRAMES)
+    , m_canvasWidth(0)
+    , m_canvasHeight(0)
+{
+}
+
+bool TestPattern::isTestPattern(const char* name)
+{
+    size_t len = strlen(TEST_PATTERN_PREFIX);
+    return name && !strncmp(name, TEST_PATTERN_PREFIX, len) && (!name[len] || name[len] == ':');
+}
+
+bool TestPattern::parseName(const char* name, Pattern& pattern)
+{
+    static const char* names[] = { "gradient", "noise", "text", "scenes" };
+    pattern = PATTERN_SCENES;
+    const char* p = name + strlen(TEST_PATTERN_PREFIX);
+    if (!*p)
+        return true;
+    p++;
+    const char* end = strchr(p, ':');
+    std::string patternName(p, end ? end - p : strlen(p));
+    if (!patternName.empty()) {
+        size_t i = 0;
+        for (; i < N_ELEMENTS(names); i++) {
+            if (patternName == names[i])
+                break;
+        }
+        if (i == N_ELEMENTS(names)) {
+            ERROR("unknown test pattern %s", patternName.c_str());
+            return false;
+        }
+        pattern = (Pattern)i;
+    }
+    if (end) {
+        char* last;
+        long frames = strtol(end + 1, &last, 10);
+        if ((*last && *last != ':') || last == end + 1 || frames < 0) {
+            ERROR("invalid frame count in %s", name);
+            return false;
+        }
+        m_frames = frames;
+    }
+    return true;
+}
+
+bool TestPattern::init(const char* name, uint32_t fourcc, uint32_t width, uint32_t height)
+{
+    Pattern pattern;
+    if (!isTestPattern(name) || !parseName(name, pattern))
+        return false;
+    if (!width || !height || (width & 1) || (height & 1)) {
+        ERROR("test pattern needs an even resolution, got %dx%d", width, height);
+        return false;
+    }
+    if (fourcc == YAMI_FOURCC('I', 'Y', 'U', 'V'))
+        fourcc = YAMI_FOURCC_I420;
+    if (fourcc != YAMI_FOURCC_I420 && fourcc != YAMI_FOURCC_YV12
+        && fourcc != YAMI_FOURCC_NV12 && fourcc != YAMI_FOURCC_YUY2) {
+        ERROR("test pattern does not support fourcc %.4s", (char*)&fourcc);
+        return false;
+    }
+    m_fourcc = fourcc;
+    m_width = width;
+    m_height = height;
+    m_canvasWidth = width * 2;
+    m_canvasHeight = height * 2;
+
+    if (pattern == PATTERN_SCENES) {
+        m_canvases.resize(PATTERN_SCENES);
+        for (uint32_t i = 0; i < PATTERN_SCENES; i++)
+            m_canvases[i].pattern = (Pattern)i;
+    }
+    else {
+        m_canvases.resize(1);
+        m_canvases[0].pattern = pattern;
+    }
+    for (size_t i = 0; i < m_canvases.size(); i++)
+        draw(m_canvases[i]);
+    return true;
+}
+
+void TestPattern::draw(Canvas& canvas)
+{
+    uint32_t cw = m_canvasWidth;
+    uint32_t ch = m_canvasHeight;
+    Painter painter(canvas.pattern, m_width, m_height);
+    if (m_fourcc == YAMI_FOURCC_YUY2) {
+        canvas.data.resize(cw * ch * 2);
+        uint8_t* p = &canvas.data[0];
+        for (uint32_t y = 0; y < ch; y++) {
+            for (uint32_t x = 0; x < cw; x += 2) {
+                Yuv p0 = painter.pixel(x, y);
+                p[0] = p0.y;
+                p[1] = p0.u;
+                p[2] = painter.pixel(x + 1, y).y;
+                p[3] = p0.v;
+                p += 4;
+            }
+        }
+        return;
+    }
+    //4:2:0, chroma comes from the top left pixel of each 2x2 block
+    canvas.data.resize(cw * ch * 3 / 2);
+    uint8_t* luma = &canvas.data[0];
+    uint8_t* chroma = luma + cw * ch;
+    uint8_t* v = chroma + cw * ch / 4;
+    for (uint32_t y = 0; y < ch; y++) {
+        for (uint32_t x = 0; x < cw; x++) {
+            Yuv p = painter.pixel(x, y);
+            *luma++ = p.y;
+            if ((x & 1) || (y & 1))
+                continue;
+            if (m_fourcc == YAMI_FOURCC_NV12) {
+                *chroma++ = p.u;
+                *chroma++ = p.v;
+            }
+            else {
+                *chroma++ = p.u;
+                *v++ = p.v;
+            }
+        }
+    }
+}
+
+//window position of frame index, even for chroma subsampling
+void TestPattern::getOffset(Pattern pattern, uint32_t index, uint32_t& x, uint32_t& y)
+{
+    switch (pattern) {
+    case PATTERN_GRADIENT:
+        x = index * 4 % m_width;
+        y = index * 2 % m_height;
+        break;
+    case PATTERN_NOISE: {
+        //far beyond motion search ranges, so every frame is new to the encoder
+        uint32_t h = hash(index);
+        x = (h & 0xffff) % (m_width / 2) * 2;
+        y = (h >> 16) % (m_height / 2) * 2;
+        break;
+    }
+    default:
+        x = 0;
+        y = index * 2 % m_height;
+        break;
+    }
+}
+
+void TestPattern::getFrame(uint32_t index, uint8_t* planes[3], uint32_t pitches[3], uint32_t& planeCount)
+{
+    Canvas& canvas = m_canvases[index / SCENE_FRAMES % m_canvases.size()];
+    uint32_t x, y;
+    getOffset(canvas.pattern, index, x, y);
+    uint32_t cw = m_canvasWidth;
+    uint32_t ch = m_canvasHeight;
+    uint8_t* base = &canvas.data[0];
+    if (m_fourcc == YAMI_FOURCC_YUY2) {
+        planes[0] = base + y * cw * 2 + x * 2;
+        pitches[0] = cw * 2;
+        planeCount = 1;
+        return;
+    }
+    planes[0] = base + y * cw + x;
+    pitches[0] = cw;
+    uint8_t* chroma = base + cw * ch;
+    if (m_fourcc == YAMI_FOURCC_NV12) {
+        planes[1] = chroma + y / 2 * cw + x;
+        pitches[1] = cw;
+        planeCount = 2;
+        return;
+    }
+    uint32_t u = m_fourcc == YAMI_FOURCC_I420 ? 1 : 2;
+    planes[u] = chroma + y / 2 * (cw / 2) + x / 2;
+    planes[3 - u] = planes[u] + cw * ch / 4;
+    pitches[1] = pitches[2] = cw / 2;
+    planeCount = 3;
+}
+
+};
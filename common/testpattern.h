@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef testpattern_h
+#define testpattern_h
+
+#include <stdint.h>
+#include <vector>
+
+namespace YamiMediaCodec{
+
+//procedural frames for encode and vpp benchmarks, no file io.
+//a pattern is drawn once into a canvas twice the frame size in each
+//direction. a frame is a window into the canvas, so it costs nothing to
+//make, or one copy when it goes to a buffer or surface.
+class TestPattern
+{
+public:
+    enum Pattern {
+        PATTERN_GRADIENT, //panning color ramps
+        PATTERN_NOISE, //random pixels, the window jumps every frame
+        PATTERN_TEXT, //scrolling lines of text
+        PATTERN_SCENES, //the others in turn, with a cut every SCENE_FRAMES
+    };
+    static const uint32_t SCENE_FRAMES = 60;
+    static const uint32_t DEFAULT_FRAMES = 300;
+
+    TestPattern();
+    //input names of the form synthetic[:pattern[:frames[:WxH]]], pattern is
+    //gradient, noise, text or scenes (default), frames 0 is endless.
+    //WxH is for tools that guess the resolution from the input name
+    static bool isTestPattern(const char* name);
+    //fourcc is I420, YV12, NV12 or YUY2, width and height are even
+    bool init(const char* name, uint32_t fourcc, uint32_t width, uint32_t height);
+    uint32_t getFrameCount() { return m_frames; }
+    //planes of frame index, they point into the canvas with its pitches
+    void getFrame(uint32_t index, uint8_t* planes[3], uint32_t pitches[3], uint32_t& planeCount);
+
+private:
+    struct Canvas {
+        Pattern pattern;
+        std::vector<uint8_t> data;
+    };
+    bool parseName(const char* name, Pattern& pattern);
+    void draw(Canvas& canvas);
+    void getOffset(Pattern pattern, uint32_t index, uint32_t& x, uint32_t& y);
+
+    uint32_t m_fourcc;
+    uint32_t m_width;
+    uint32_t m_height;
+    uint32_t m_frames;
+    //canvas size in pixels
+    uint32_t m_canvasWidth;
+    uint32_t m_canvasHeight;
+    std::vector<Canvas> m_canvases;
+};
+
+};
+
+#endif //testpattern_h
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef unittest_h
+#define unittest_h
+
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+
+//a file holding data, removed with us. for code that only takes file names
+class TempFile {
+public:
+    TempFile(const std::string& data)
+    {
+        char name[] = "/tmp/yamiunittestXXXXXX";
+        int fd = mkstemp(name);
+        if (fd < 0)
+            return;
+        if (write(fd, data.data(), data.size()) == (ssize_t)data.size())
+            m_name = name;
+        else
+            unlink(name);
+        close(fd);
+    }
+    ~TempFile()
+    {
+        if (!m_name.empty())
+            unlink(m_name.c_str());
+    }
+    const char* name() const { return m_name.c_str(); }
+    bool ok() const { return !m_name.empty(); }
+
+private:
+    std::string m_name;
+};
+
+#endif //unittest_h
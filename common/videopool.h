@@ -15,12 +15,35 @@
  */
 #ifndef videopool_h
 #define videopool_h
+#include "common/condition.h"
 #include "common/lock.h"
 #include <deque>
+#include <stdint.h>
 #include <VideoCommonDefs.h>
 
 namespace YamiMediaCodec{
 
+//optional accounting of all pools together, e.g. for metrics.
+//set it before the pools are created, a pool keeps the hook it started with.
+class VideoPoolHook
+{
+public:
+    virtual ~VideoPoolHook() {}
+    //buffers owned by a pool changed by n
+    virtual void owned(int64_t n) = 0;
+    //buffers handed out by a pool changed by n
+    virtual void inUse(int64_t n) = 0;
+
+    static VideoPoolHook* get() { return __atomic_load_n(&instance(), __ATOMIC_ACQUIRE); }
+    static void set(VideoPoolHook* hook) { __atomic_store_n(&instance(), hook, __ATOMIC_RELEASE); }
+private:
+    static VideoPoolHook*& instance()
+    {
+        static VideoPoolHook* hook = NULL;
+        return hook;
+    }
+};
+
 template <class T>
 class VideoPool : public EnableSharedFromThis<VideoPool<T> >
 {
@@ -40,24 +63,90 @@ public:
             T* p = m_freed.front();
             m_freed.pop_front();
             ret.reset(p, Recycler(this->shared_from_this()));
+            if (m_hook)
+                m_hook->inUse(1);
         }
         return ret;
     }
 
+    //wait up to waitMs for a buffer to come back, true if one is free
+    bool wait(uint32_t waitMs)
+    {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += waitMs / 1000;
+        deadline.tv_nsec += (waitMs % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        AutoLock _l(m_lock);
+        while (m_freed.empty()) {
+            if (!m_cond.timedWait(deadline))
+                break;
+        }
+        return !m_freed.empty();
+    }
+
+    //grow the pool by one buffer
+    void add(const SharedPtr<T>& buffer)
+    {
+        AutoLock _l(m_lock);
+        m_holder.push_back(buffer);
+        m_freed.push_back(buffer.get());
+        if (m_hook)
+            m_hook->owned(1);
+        m_cond.signal();
+    }
+
+    //shrink the pool by a free buffer, NULL if all are out
+    SharedPtr<T> remove()
+    {
+        SharedPtr<T> ret;
+        AutoLock _l(m_lock);
+        if (m_freed.empty())
+            return ret;
+        T* p = m_freed.back();
+        m_freed.pop_back();
+        for (size_t i = 0; i < m_holder.size(); i++) {
+            if (m_holder[i].get() == p) {
+                ret = m_holder[i];
+                m_holder.erase(m_holder.begin() + i);
+                break;
+            }
+        }
+        if (m_hook)
+            m_hook->owned(-1);
+        return ret;
+    }
+
+    ~VideoPool()
+    {
+        if (m_hook)
+            m_hook->owned(-(int64_t)m_holder.size());
+    }
+
 private:
 
     VideoPool(std::deque<SharedPtr<T> >& buffers)
+        : m_cond(m_lock)
+        , m_hook(VideoPoolHook::get())
     {
             m_holder.swap(buffers);
             for (size_t i = 0; i < m_holder.size(); i++) {
                 m_freed.push_back(m_holder[i].get());
             }
+            if (m_hook)
+                m_hook->owned(m_holder.size());
     }
 
     void recycle(T* ptr)
     {
         AutoLock _l(m_lock);
         m_freed.push_back(ptr);
+        if (m_hook)
+            m_hook->inUse(-1);
+        m_cond.signal();
     }
 
     class Recycler
@@ -76,8 +165,10 @@ private:
     };
 
     Lock m_lock;
+    Condition m_cond;
     std::deque<T*> m_freed;
     std::deque<SharedPtr<T> > m_holder;
+    VideoPoolHook* m_hook;
 };
 
 };
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "workstealingpool.h"
+#include "common/log.h"
+
+namespace YamiMediaCodec{
+
+WorkStealingPool::WorkStealingPool()
+    : m_threads(0)
+    , m_next(0)
+    , m_cond(m_lock)
+    , m_done(m_lock)
+    , m_queued(0)
+    , m_tasks(0)
+    , m_quit(false)
+{
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    stop();
+}
+
+bool WorkStealingPool::start(uint32_t threads)
+{
+    if (!threads || !m_workers.empty())
+        return false;
+    //all workers are there before a thread looks for one to steal from
+    for (uint32_t i = 0; i < threads; i++) {
+        Worker* worker = new Worker;
+        worker->pool = this;
+        worker->index = i;
+        m_workers.push_back(worker);
+    }
+    for (uint32_t i = 0; i < threads; i++) {
+        if (pthread_create(&m_workers[i]->thread, NULL, start, m_workers[i])) {
+            ERROR("create thread failed");
+            stop();
+            return false;
+        }
+        m_threads++;
+    }
+    std::deque<Runnable*> pending;
+    {
+        AutoLock lock(m_lock);
+        pending.swap(m_pending);
+        m_next = pending.size();
+    }
+    for (size_t i = 0; i < pending.size(); i++)
+        push(m_workers[i % m_workers.size()], pending[i]);
+    return true;
+}
+
+void* WorkStealingPool::start(void* worker)
+{
+    Worker* w = (Worker*)worker;
+    w->pool->loop(w);
+    return NULL;
+}
+
+void WorkStealingPool::push(Worker* worker, Runnable* task)
+{
+    {
+        AutoLock lock(worker->lock);
+        worker->tasks.push_back(task);
+    }
+    AutoLock lock(m_lock);
+    m_queued++;
+    m_cond.signal();
+}
+
+void WorkStealingPool::submit(Runnable* task)
+{
+    uint32_t index;
+    {
+        AutoLock lock(m_lock);
+        m_tasks++;
+        if (!m_threads) {
+            m_pending.push_back(task);
+            return;
+        }
+        index = m_next++ % m_workers.size();
+    }
+    push(m_workers[index], task);
+}
+
+Runnable* WorkStealingPool::take(Worker* worker)
+{
+    Runnable* task = NULL;
+    {
+        AutoLock lock(worker->lock);
+        if (!worker->tasks.empty()) {
+            task = worker->tasks.front();
+            worker->tasks.pop_front();
+        }
+    }
+    //steal, starting from our neighbour
+    for (size_t i = 1; !task && i < m_workers.size(); i++) {
+        Worker* victim = m_workers[(worker->index + i) % m_workers.size()];
+        AutoLock lock(victim->lock);
+        if (!victim->tasks.empty()) {
+            task = victim->tasks.back();
+            victim->tasks.pop_back();
+        }
+    }
+    if (task) {
+        AutoLock lock(m_lock);
+        m_queued--;
+    }
+    return task;
+}
+
+void WorkStealingPool::loop(Worker* worker)
+{
+    while (1) {
+        Runnable* task = take(worker);
+        if (!task) {
+            AutoLock lock(m_lock);
+            while (!m_queued && !m_quit)
+                m_cond.wait();
+            if (m_quit)
+                return;
+            continue;
+        }
+        if (task->run()) {
+            //the other tasks of this thread get their turn first
+            push(worker, task);
+            continue;
+        }
+        AutoLock lock(m_lock);
+        if (!--m_tasks)
+            m_done.broadcast();
+    }
+}
+
+void WorkStealingPool::wait()
+{
+    AutoLock lock(m_lock);
+    while (m_tasks)
+        m_done.wait();
+}
+
+void WorkStealingPool::stop()
+{
+    {
+        AutoLock lock(m_lock);
+        m_quit = true;
+        m_cond.broadcast();
+    }
+    for (size_t i = 0; i < m_workers.size(); i++) {
+        if (i < m_threads)
+            pthread_join(m_workers[i]->thread, NULL);
+        delete m_workers[i];
+    }
+    m_workers.clear();
+    m_threads = 0;
+}
+
+};
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef workstealingpool_h
+#define workstealingpool_h
+
+#include "common/condition.h"
+#include "common/lock.h"
+
+#include <deque>
+#include <pthread.h>
+#include <stdint.h>
+#include <vector>
+
+namespace YamiMediaCodec{
+
+//a piece of work that runs in slices, so many tasks can share a few threads
+class Runnable
+{
+public:
+    virtual ~Runnable() {}
+    //run one slice, return true to be run again later
+    virtual bool run() = 0;
+};
+
+//fixed number of threads, each with its own task deque.
+//a thread runs the task at the front and puts it to the back if it wants more time,
+//so its tasks take turns. an idle thread steals from the back of another thread,
+//the task that would wait longest there.
+class WorkStealingPool
+{
+public:
+    WorkStealingPool();
+    ~WorkStealingPool();
+
+    bool start(uint32_t threads);
+    //the pool does not own the task, keep it until wait() returns.
+    //tasks submitted before start() wait for it
+    void submit(Runnable* task);
+    //wait until every task returned false from run()
+    void wait();
+    void stop();
+
+private:
+    struct Worker {
+        WorkStealingPool* pool;
+        uint32_t index;
+        pthread_t thread;
+        Lock lock;
+        std::deque<Runnable*> tasks;
+    };
+    static void* start(void* worker);
+    void loop(Worker* worker);
+    Runnable* take(Worker* worker);
+    void push(Worker* worker, Runnable* task);
+
+    std::vector<Worker*> m_workers;
+    //workers with a running thread
+    uint32_t m_threads;
+    uint32_t m_next;
+    //submitted before start(), guarded by m_lock
+    std::deque<Runnable*> m_pending;
+
+    Lock m_lock;
+    Condition m_cond;
+    Condition m_done;
+    //tasks in the deques, guarded by m_lock
+    uint32_t m_queued;
+    //tasks not finished yet, guarded by m_lock
+    uint32_t m_tasks;
+    bool m_quit;
+    DISALLOW_COPY_AND_ASSIGN(WorkStealingPool);
+};
+
+};
+
+#endif //workstealingpool_h
@@ -5,7 +5,15 @@ include $(LOCAL_PATH)/../common.mk
 
 LOCAL_SRC_FILES := \
     ../tests/decodeinput.cpp \
+    ../tests/decodeinputmp4.cpp \
+    ../tests/decodeinputts.cpp \
+    ../tests/decodeinputunits.cpp \
+    ../tests/inputfollower.cpp \
+    ../tests/udpreceiver.cpp \
     ../tests/vppinputoutput.cpp \
+    ../common/metrics.cpp \
+    ../common/surfacebudget.cpp \
+    ../common/testpattern.cpp \
     androidplayer.cpp
 
 LOCAL_C_INCLUDES:= \
@@ -48,6 +48,8 @@ extern "C" {
 #include "common/common_def.h"
 #include "common/condition.h"
 #include "common/lock.h"
+#include "common/metrics.h"
+#include "common/sessionscheduler.h"
 
 using namespace std;
 
@@ -573,6 +575,8 @@ void usage(const char* app) {
         printf("   -r <row> \n");
         printf("   -d <index>, target display index, start from 1 \n");
         printf("   -s, put vpp and decode in single thread \n");
+        printf("   -p <live|batch>, batch grids are held back while live ones miss deadlines, default batch \n");
+        printf("   -f <fps>, show no faster than fps, default is as fast as the display takes them \n");
         printf("   -g, <grid command line> create other grid instance  \n");
         printf("       example: grid a.mp4 -g \"b.mp4 -d 2\"\n");
         printf("       it will render a.mp4 in first display and b.mp4 in second\n");
@@ -636,7 +640,8 @@ public:
     Grid(int fd, const SharedPtr<NativeDisplay>& nativeDisplay):m_fd(fd), m_nativeDisplay(nativeDisplay),
         m_vaDisplay((VADisplay)nativeDisplay->handle),
         m_width(0), m_height(0), m_col(0), m_row(0),
-        m_displayIdx(1), m_singleThread(false), m_vppThread(-1){}
+        m_displayIdx(1), m_singleThread(false),
+        m_priority(SESSION_DEFAULT_PRIORITY), m_fps(0), m_vppThread(-1){}
 
     ~Grid()
     {
@@ -710,9 +715,16 @@ private:
     {
         SharedPtr<VideoFrame> frame;
         FpsCalc fps;
+        char labels[32];
+        snprintf(labels, sizeof(labels), "display=\"%d\"", m_displayIdx);
+        Metrics& metrics = Metrics::getInstance();
+        Counter* shown = metrics.counter("yami_displayed_frames_total", labels, "frames queued to the display");
+        metrics.rate("yami_display_fps", labels, "frames per second queued to the display", shown);
         int width = m_width / m_col;
         int height = m_height / m_row;
+        ScheduledSession schedule(m_priority, m_fps);
         do {
+            schedule.pace();
             SharedPtr<VideoFrame> dest = m_renderer->dequeue();
             for (int i = 0; i < m_row; i++) {
                 for (int j = 0; j < m_col; j++) {
@@ -735,6 +747,7 @@ private:
             }
 
             fps.addFrame();
+            shown->add();
         } while (1);
 DONE:
         printf("playback on display %d done\n", m_displayIdx);
@@ -744,7 +757,7 @@ DONE:
     {
         char opt;
         optind = 0;
-        while ((opt = getopt(argc, argv, "c:r:d:s")) != -1)
+        while ((opt = getopt(argc, argv, "c:r:d:sp:f:")) != -1)
         {
             switch (opt) {
                 case 'c':
@@ -759,6 +772,13 @@ DONE:
                 case 's':
                     m_singleThread = true;
                     break;
+                case 'p':
+                    if (!parseSessionPriority(optarg, m_priority))
+                        return false;
+                    break;
+                case 'f':
+                    m_fps = atof(optarg);
+                    break;
                 default:
                     return false;
             }
@@ -790,6 +810,8 @@ DONE:
     int m_displayIdx;
     //put decode and vpp in single thread
     bool m_singleThread;
+    SessionPriority m_priority;
+    float m_fps;
     vector<char*> m_files;
     pthread_t m_vppThread;
     Arg m_arg;
@@ -903,6 +925,8 @@ private:
 int main(int argc, char** argv)
 {
     App app;
+    if (!startMetricsExport())
+        return -1;
     if (!app.init(argc, argv)) {
         ERROR("init grid app failed");
         return -1;
@@ -7,7 +7,15 @@ include $(LOCAL_PATH)/../common.mk
 LOCAL_SRC_FILES := \
         decodehelp.cpp \
         decodeinput.cpp \
+        decodeinputmp4.cpp \
+        decodeinputts.cpp \
+        decodeinputunits.cpp \
+        inputfollower.cpp \
+        udpreceiver.cpp \
         vppinputoutput.cpp \
+        ../common/metrics.cpp \
+        ../common/surfacebudget.cpp \
+        ../common/testpattern.cpp \
         v4l2decode.cpp
 
 LOCAL_C_INCLUDES:= \
@@ -42,6 +50,10 @@ include $(LOCAL_PATH)/../common.mk
 LOCAL_SRC_FILES := \
         encodeinput.cpp \
         encodeInputSurface.cpp \
+        ../common/planecopy.cpp \
+        ../common/streamcopy.cpp \
+        ../common/metrics.cpp \
+        ../common/testpattern.cpp \
         v4l2encode.cpp
 
 LOCAL_C_INCLUDES:= \
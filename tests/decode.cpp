@@ -22,14 +22,20 @@
 #endif
 
 #include "vppinputdecode.h"
+#include "decodeinputunits.h"
 #include "decodeoutput.h"
 #include "decodehelp.h"
+#include "common/metrics.h"
+#include "common/sessionscheduler.h"
+#include "common/workstealingpool.h"
 
+#include <algorithm>
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <limits.h>
+#include <time.h>
 
 SharedPtr<VppInput> createInput(DecodeParameter& para, SharedPtr<NativeDisplay>& display)
 {
@@ -56,6 +62,107 @@ SharedPtr<VppInput> createInput(DecodeParameter& para, SharedPtr<NativeDisplay>&
     return input;
 }
 
+static uint64_t nowUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+//one stream of a multi-stream run, decodes a few frames each time the pool runs it
+class DecodeSession : public Runnable {
+public:
+    DecodeSession(uint32_t index, const char* inputFile, uint32_t maxFrames)
+        : m_index(index)
+        , m_inputFile(inputFile)
+        , m_maxFrames(maxFrames)
+        , m_count(0)
+        , m_start(0)
+        , m_end(0)
+        , m_ok(true)
+        , m_frames(NULL)
+    {
+    }
+    bool init(DecodeParameter& para, const SharedPtr<VADisplay>& display)
+    {
+        m_output.reset(DecodeOutput::create(para.renderMode, para.renderFourcc, m_inputFile, para.outputFile.c_str(), para.syncDepth, display));
+        if (!m_output || !m_output->nativeDisplay())
+            return false;
+        SharedPtr<NativeDisplay> nativeDisplay = m_output->nativeDisplay();
+        DecodeParameter streamPara = para;
+        streamPara.inputFile = (char*)m_inputFile;
+        m_input = createInput(streamPara, nativeDisplay);
+        if (!m_input)
+            return false;
+        char labels[32];
+        snprintf(labels, sizeof(labels), "stream=\"%u\"", m_index);
+        m_frames = Metrics::getInstance().counter("yami_stream_frames_total", labels, "frames decoded by each stream");
+        SessionPriority priority;
+        float targetFps;
+        getStreamSchedule(&para, m_index, priority, targetFps);
+        m_schedule.reset(new ScheduledSession(priority, targetFps));
+        return true;
+    }
+    bool run()
+    {
+        //small slices so every stream gets its turn often
+        static const uint32_t SLICE_FRAMES = 4;
+        //give the thread to other streams instead of waiting long for our turn
+        static const uint32_t SLICE_WAIT_MS = 10;
+        if (!m_start)
+            m_start = nowUs();
+        SharedPtr<VideoFrame> frame;
+        for (uint32_t i = 0; i < SLICE_FRAMES; i++) {
+            if (m_count == m_maxFrames)
+                return finish();
+            if (!m_schedule->pace(SLICE_WAIT_MS))
+                return true;
+            if (!m_input->read(frame))
+                return finish();
+            if (!m_output->output(frame)) {
+                m_ok = false;
+                return finish();
+            }
+            m_count++;
+            m_frames->add();
+        }
+        return true;
+    }
+    uint32_t frames() const { return m_count; }
+    bool ok() const { return m_ok; }
+    void log()
+    {
+        double seconds = (m_end - m_start) / 1000000.0;
+        printf("stream %u: %u frames, %.2f fps%s, %s\n", m_index, m_count,
+            seconds > 0 ? m_count / seconds : 0, m_ok ? "" : ", failed", m_inputFile);
+    }
+
+private:
+    bool finish()
+    {
+        if (!m_output->flush())
+            m_ok = false;
+        m_end = nowUs();
+        //release the decoder and surfaces now, not when all streams are done
+        m_input.reset();
+        m_output.reset();
+        m_schedule.reset();
+        return false;
+    }
+    uint32_t m_index;
+    const char* m_inputFile;
+    uint32_t m_maxFrames;
+    uint32_t m_count;
+    uint64_t m_start;
+    uint64_t m_end;
+    bool m_ok;
+    SharedPtr<DecodeOutput> m_output;
+    SharedPtr<VppInput> m_input;
+    SharedPtr<ScheduledSession> m_schedule;
+    Counter* m_frames;
+    DISALLOW_COPY_AND_ASSIGN(DecodeSession);
+};
+
 class DecodeTest {
 public:
     bool init(int argc, char** argv)
@@ -64,7 +171,11 @@ public:
             fprintf(stderr, "process arguments failed.\n");
             return false;
         }
-        m_output.reset(DecodeOutput::create(m_params.renderMode, m_params.renderFourcc, m_params.inputFile, m_params.outputFile.c_str()));
+        if (!m_params.captureFile.empty())
+            return true;
+        if (m_params.inputFiles.size() > 1)
+            return initSessions();
+        m_output.reset(DecodeOutput::create(m_params.renderMode, m_params.renderFourcc, m_params.inputFile, m_params.outputFile.c_str(), m_params.syncDepth));
         if (!m_output) {
             fprintf(stderr, "DecodeOutput::create failed.\n");
             return false;
@@ -80,10 +191,18 @@ public:
     }
     bool run()
     {
+        if (!m_params.captureFile.empty())
+            return capture();
+        if (!m_sessions.empty())
+            return runSessions();
         FpsCalc fps;
         SharedPtr<VideoFrame> src;
         uint32_t count = 0;
-        while (m_vppInput->read(src)) {
+        SessionPriority priority;
+        float targetFps;
+        getStreamSchedule(&m_params, 0, priority, targetFps);
+        ScheduledSession schedule(priority, targetFps);
+        while (schedule.pace() && m_vppInput->read(src)) {
             if (!m_output->output(src))
                 break;
             count++;
@@ -91,11 +210,70 @@ public:
             if (count == m_params.renderFrames)
                 break;
         }
+        m_output->flush();
         fps.log();
         return true;
     }
 
 private:
+    bool capture()
+    {
+        SharedPtr<DecodeInput> input(DecodeInput::create(m_params.inputFile));
+        if (!input) {
+            fprintf(stderr, "DecodeInput::create failed.\n");
+            return false;
+        }
+        return captureDecodeUnits(input.get(), m_params.captureFile.c_str(), m_params.renderFrames);
+    }
+    //many streams on one display, run by a fixed pool of threads
+    bool initSessions()
+    {
+        if (m_params.renderMode > 0) {
+            fprintf(stderr, "render mode %d does not support many streams.\n", m_params.renderMode);
+            return false;
+        }
+        m_display = createVADisplay();
+        if (!m_display) {
+            fprintf(stderr, "create display failed.\n");
+            return false;
+        }
+        for (size_t i = 0; i < m_params.inputFiles.size(); i++) {
+            SharedPtr<DecodeSession> session(new DecodeSession(i, m_params.inputFiles[i].c_str(), m_params.renderFrames));
+            if (!session->init(m_params, m_display)) {
+                fprintf(stderr, "init stream %s failed.\n", m_params.inputFiles[i].c_str());
+                return false;
+            }
+            m_sessions.push_back(session);
+        }
+        return true;
+    }
+    bool runSessions()
+    {
+        //a stream runs on one thread at a time, more threads would only idle
+        uint32_t threads = std::min(m_params.threads, (uint32_t)m_sessions.size());
+        WorkStealingPool pool;
+        if (!pool.start(threads))
+            return false;
+        uint64_t start = nowUs();
+        for (size_t i = 0; i < m_sessions.size(); i++)
+            pool.submit(m_sessions[i].get());
+        pool.wait();
+        double seconds = (nowUs() - start) / 1000000.0;
+        uint64_t total = 0;
+        bool ok = true;
+        for (size_t i = 0; i < m_sessions.size(); i++) {
+            m_sessions[i]->log();
+            total += m_sessions[i]->frames();
+            if (!m_sessions[i]->ok())
+                ok = false;
+        }
+        printf("%u streams on %u threads: %llu frames, %.2f fps\n", (uint32_t)m_sessions.size(), threads,
+            (unsigned long long)total, seconds > 0 ? total / seconds : 0);
+        return ok;
+    }
+
+    SharedPtr<VADisplay> m_display;
+    std::vector<SharedPtr<DecodeSession> > m_sessions;
     SharedPtr<DecodeOutput> m_output;
     SharedPtr<NativeDisplay> m_nativeDisplay;
     SharedPtr<VppInput> m_vppInput;
@@ -105,8 +283,9 @@ private:
 int main(int argc, char* argv[])
 {
     DecodeTest decode;
+    if (!startMetricsExport())
+        return 1;
     if (!decode.init(argc, argv))
         return 1;
-    decode.run();
-    return 0;
+    return decode.run() ? 0 : 1;
 }
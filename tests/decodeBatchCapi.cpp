@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "decodeBatchCapi.h"
+#include "common/lock.h"
+
+#include <map>
+#include <vector>
+
+using namespace YamiMediaCodec;
+
+//hand frames over before the decoder runs out of surfaces
+#define MAX_PENDING_OUTPUTS 8
+
+struct OutputCallback {
+    DecodeOutputCallback callback;
+    void* userData;
+};
+
+typedef std::map<DecodeHandler, OutputCallback> CallbackMap;
+
+static Lock s_lock;
+static CallbackMap s_callbacks;
+
+static bool getCallback(DecodeHandler p, OutputCallback& callback)
+{
+    AutoLock lock(s_lock);
+    CallbackMap::iterator it = s_callbacks.find(p);
+    if (it == s_callbacks.end())
+        return false;
+    callback = it->second;
+    return true;
+}
+
+static void deliverOutputs(DecodeHandler p, const OutputCallback& callback, std::vector<VideoFrame*>& frames)
+{
+    if (frames.empty())
+        return;
+    callback.callback(p, &frames[0], frames.size(), callback.userData);
+    frames.clear();
+}
+
+Decode_Status decodeDecodeBatch(DecodeHandler p, VideoDecodeBuffer* buffers, uint32_t count, uint32_t* decoded)
+{
+    Decode_Status status = DECODE_SUCCESS;
+    uint32_t i = 0;
+    if (decoded)
+        *decoded = 0;
+    if (!p || (count && !buffers))
+        return DECODE_FAIL;
+
+    OutputCallback callback;
+    bool hasCallback = getCallback(p, callback);
+    std::vector<VideoFrame*> frames;
+    for (; i < count; i++) {
+        status = decodeDecode(p, &buffers[i]);
+        if (status < DECODE_SUCCESS || status == DECODE_FORMAT_CHANGE)
+            break;
+        if (!hasCallback)
+            continue;
+        VideoFrame* frame;
+        while ((frame = decodeGetOutput(p)))
+            frames.push_back(frame);
+        if (frames.size() >= MAX_PENDING_OUTPUTS)
+            deliverOutputs(p, callback, frames);
+    }
+    //frames of the old resolution go first on DECODE_FORMAT_CHANGE
+    if (hasCallback)
+        deliverOutputs(p, callback, frames);
+    if (decoded)
+        *decoded = i;
+    return status;
+}
+
+uint32_t decodeGetOutputs(DecodeHandler p, VideoFrame** frames, uint32_t max)
+{
+    uint32_t n = 0;
+    if (!p || !frames)
+        return 0;
+    while (n < max) {
+        VideoFrame* frame = decodeGetOutput(p);
+        if (!frame)
+            break;
+        frames[n++] = frame;
+    }
+    return n;
+}
+
+void decodeSetOutputCallback(DecodeHandler p, DecodeOutputCallback callback, void* userData)
+{
+    AutoLock lock(s_lock);
+    if (!callback) {
+        s_callbacks.erase(p);
+        return;
+    }
+    OutputCallback& c = s_callbacks[p];
+    c.callback = callback;
+    c.userData = userData;
+}
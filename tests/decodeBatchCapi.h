@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef decodeBatchCapi_h
+#define decodeBatchCapi_h
+
+#include "capi/VideoDecoderCapi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* batched calls on top of capi/VideoDecoderCapi.h, for bindings that pay for every call */
+
+/* frames are owned by the callback, release each one with frame->free(frame).
+   the array itself is only valid during the call */
+typedef void (*DecodeOutputCallback)(DecodeHandler p, VideoFrame** frames, uint32_t count, void* userData);
+
+/* decode count buffers in order, stop at the first failure or DECODE_FORMAT_CHANGE.
+   decoded returns the number of buffers consumed, on DECODE_FORMAT_CHANGE
+   the buffer at index decoded needs to be sent again. */
+Decode_Status decodeDecodeBatch(DecodeHandler p, VideoDecodeBuffer* buffers, uint32_t count, uint32_t* decoded);
+
+/* get up to max output frames, return the number of frames got */
+uint32_t decodeGetOutputs(DecodeHandler p, VideoFrame** frames, uint32_t max);
+
+/* with a callback, decodeDecodeBatch hands over all ready frames instead of leaving
+   them for decodeGetOutputs. pass NULL to unregister, do it before releaseDecoder */
+void decodeSetOutputCallback(DecodeHandler p, DecodeOutputCallback callback, void* userData);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //decodeBatchCapi_h
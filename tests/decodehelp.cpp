@@ -18,27 +18,49 @@
 #include "config.h"
 #endif
 #include "decodehelp.h"
+#include "decodeinput.h"
+#include "udpreceiver.h"
 
+#include "common/parsecount.h"
 #include "common/utils.h"
 
+#include <algorithm>
 #include <ctype.h>
 #include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
+#include <getopt.h>
 #include <VideoCommonDefs.h>
 
 using namespace YamiMediaCodec;
 
+//each frame in flight holds a decoder surface
+#define MAX_SYNC_DEPTH 16
+#define MAX_THREADS 256
+//VIDEO_MAX_FRAME of videodev2.h
+#define MAX_V4L2_QUEUE_DEPTH 32
+
 static void printHelp(const char* app)
 {
     printf("%s <options>\n", app);
-    printf("   -i media file to decode\n");
+    printf("   -i media file to decode, - for stdin, repeat it to decode many streams in one process [**]\n");
+    printf("      udp://[addr]:port or rtp://[addr]:port receive a live mpeg-ts stream, addr may be multicast\n");
+    printf("   --manifest <file> media files to decode, one per line [**]\n");
+    printf("   --threads <count> threads shared by all streams, 1 to %d, default is the cpu count [**]\n", MAX_THREADS);
+    printf("   --capture <file> save the decode units of -i to file and quit, -n limits the units.\n");
+    printf("                    decode the file with -i to leave out demuxing and parsing [**]\n");
+    printf("   --priority <live|batch>[,...] batch streams are held back while live ones miss deadlines, default batch [**]\n");
+    printf("   --targetfps <fps>[,...] decode no faster than fps, a frame done after the next is due misses its deadline [**]\n");
+    printf("      give one value per input in order, the last one goes on for the rest\n");
+    printf("   --follow <idle ms> decode files while they are written, until the writer closes them or they do not grow for idle ms, 1 to %d\n", MAX_FOLLOW_IDLE_MS);
+    printf("      udp:// and rtp:// inputs end after idle ms without data (default %d)\n", UDP_DEFAULT_IDLE_MS);
     printf("   -w wait before quit: 0:no-wait, 1:auto(jpeg wait), 2:wait\n");
     printf("   -f dumped fourcc [*]\n");
     printf("   -o dumped output dir\n");
     printf("   -n specifiy how many frames to be decoded\n");
+    printf("   -d frames in flight before we wait on gpu for -1, -2 and 0 render mode, 0 to %d, default 0 [*]\n", MAX_SYNC_DEPTH);
     printf("   -m <render mode>\n");
     printf("     -2: print MD5 by per frame and the whole decoded file MD5\n");
     printf("     -1: skip video rendering [*]\n");
@@ -48,7 +70,70 @@ static void printHelp(const char* app)
     printf("      3: texture: export video frame as drm name (RGBX) + texture from drm name\n");
     printf("      4: texture: export video frame as dma_buf(RGBX) + texutre from dma_buf\n");
     printf("      5: texture: export video frame as dma_buf(NV12) + texture from dma_buf. not implement yet\n");
+    printf("   --inqueue <count> bitstream buffers in v4l2 input queue, 1 to %d, default 2, v4l2decode only\n", MAX_V4L2_QUEUE_DEPTH);
+    printf("   --outqueue <count> frame buffers in v4l2 capture queue, 0 to %d, default is driver minimum + 2, v4l2decode only\n", MAX_V4L2_QUEUE_DEPTH);
     printf(" [*] v4l2decode doesn't support the option\n");
+    printf(" [**] yamidecode only, many streams support -2, -1 and 0 render mode, -o needs to be a dir\n");
+}
+
+//"a,b,c" into its items
+static void splitList(const char* str, std::vector<std::string>& items)
+{
+    items.clear();
+    const char* start = str;
+    const char* comma;
+    while ((comma = strchr(start, ','))) {
+        items.push_back(std::string(start, comma - start));
+        start = comma + 1;
+    }
+    items.push_back(start);
+}
+
+static bool parsePriorities(const char* str, std::vector<SessionPriority>& priorities)
+{
+    std::vector<std::string> items;
+    splitList(str, items);
+    priorities.resize(items.size());
+    for (size_t i = 0; i < items.size(); i++) {
+        if (!parseSessionPriority(items[i].c_str(), priorities[i]))
+            return false;
+    }
+    return true;
+}
+
+static bool parseTargetFps(const char* str, std::vector<float>& targetFps)
+{
+    std::vector<std::string> items;
+    splitList(str, items);
+    targetFps.resize(items.size());
+    for (size_t i = 0; i < items.size(); i++) {
+        char* end;
+        targetFps[i] = strtof(items[i].c_str(), &end);
+        if (end == items[i].c_str() || *end || targetFps[i] < 0)
+            return false;
+    }
+    return true;
+}
+
+static bool readManifest(const char* manifest, std::vector<std::string>& inputs)
+{
+    FILE* fp = fopen(manifest, "r");
+    if (!fp) {
+        fprintf(stderr, "can't open manifest %s\n", manifest);
+        return false;
+    }
+    char line[PATH_MAX];
+    while (fgets(line, sizeof(line), fp)) {
+        size_t len = strlen(line);
+        while (len && isspace(line[len - 1]))
+            line[--len] = '\0';
+        //skip empty lines and comments
+        if (!len || line[0] == '#')
+            continue;
+        inputs.push_back(line);
+    }
+    fclose(fp);
+    return true;
 }
 
 bool processCmdLine(int argc, char** argv, DecodeParameter* parameters)
@@ -59,16 +144,47 @@ bool processCmdLine(int argc, char** argv, DecodeParameter* parameters)
     parameters->waitBeforeQuit = 1;
     parameters->renderMode = 1;
     parameters->inputFile = NULL;
+    parameters->syncDepth = 0;
+    parameters->inputQueueDepth = 2;
+    parameters->outputQueueDepth = 0;
+    parameters->inputFiles.clear();
+    parameters->captureFile.clear();
+    parameters->priorities.assign(1, SESSION_DEFAULT_PRIORITY);
+    parameters->targetFps.assign(1, 0);
+    parameters->followIdleMs = 0;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    parameters->threads = cpus > 0 ? std::min(cpus, (long)MAX_THREADS) : 1;
 
-    char opt;
-    while ((opt = getopt(argc, argv, "h:m:n:i:f:o:w:?")) != -1) {
+    enum {
+        OPT_INPUT_QUEUE = 256,
+        OPT_OUTPUT_QUEUE,
+        OPT_MANIFEST,
+        OPT_THREADS,
+        OPT_CAPTURE,
+        OPT_PRIORITY,
+        OPT_TARGET_FPS,
+        OPT_FOLLOW,
+    };
+    const struct option longOpts[] = {
+        { "inqueue", required_argument, NULL, OPT_INPUT_QUEUE },
+        { "outqueue", required_argument, NULL, OPT_OUTPUT_QUEUE },
+        { "manifest", required_argument, NULL, OPT_MANIFEST },
+        { "threads", required_argument, NULL, OPT_THREADS },
+        { "capture", required_argument, NULL, OPT_CAPTURE },
+        { "priority", required_argument, NULL, OPT_PRIORITY },
+        { "targetfps", required_argument, NULL, OPT_TARGET_FPS },
+        { "follow", required_argument, NULL, OPT_FOLLOW },
+        { NULL, no_argument, NULL, 0 }
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h:m:n:i:f:o:w:d:?", longOpts, NULL)) != -1) {
         switch (opt) {
         case 'h':
         case '?':
             printHelp(argv[0]);
             return false;
         case 'i':
-            parameters->inputFile = optarg;
+            parameters->inputFiles.push_back(optarg);
             break;
         case 'w':
             parameters->waitBeforeQuit = atoi(optarg);
@@ -79,6 +195,12 @@ bool processCmdLine(int argc, char** argv, DecodeParameter* parameters)
         case 'n':
             parameters->renderFrames = atoi(optarg);
             break;
+        case 'd':
+            if (!parseCount(optarg, 0, MAX_SYNC_DEPTH, &parameters->syncDepth)) {
+                fprintf(stderr, "invalid sync depth: %s\n", optarg);
+                return false;
+            }
+            break;
         case 'f':
             if (strlen(optarg) == 4) {
                 parameters->renderFourcc = YAMI_FOURCC(toupper(optarg[0]), toupper(optarg[1]), toupper(optarg[2]), toupper(optarg[3]));
@@ -92,15 +214,60 @@ bool processCmdLine(int argc, char** argv, DecodeParameter* parameters)
         case 'o':
             outputFile = optarg;
             break;
+        case OPT_INPUT_QUEUE:
+            if (!parseCount(optarg, 1, MAX_V4L2_QUEUE_DEPTH, &parameters->inputQueueDepth)) {
+                fprintf(stderr, "invalid input queue depth: %s\n", optarg);
+                return false;
+            }
+            break;
+        case OPT_OUTPUT_QUEUE:
+            if (!parseCount(optarg, 0, MAX_V4L2_QUEUE_DEPTH, &parameters->outputQueueDepth)) {
+                fprintf(stderr, "invalid output queue depth: %s\n", optarg);
+                return false;
+            }
+            break;
+        case OPT_MANIFEST:
+            if (!readManifest(optarg, parameters->inputFiles))
+                return false;
+            break;
+        case OPT_THREADS:
+            if (!parseCount(optarg, 1, MAX_THREADS, &parameters->threads)) {
+                fprintf(stderr, "invalid thread count: %s\n", optarg);
+                return false;
+            }
+            break;
+        case OPT_CAPTURE:
+            parameters->captureFile = optarg;
+            break;
+        case OPT_PRIORITY:
+            if (!parsePriorities(optarg, parameters->priorities)) {
+                fprintf(stderr, "invalid priority: %s\n", optarg);
+                return false;
+            }
+            break;
+        case OPT_FOLLOW:
+            if (!parseCount(optarg, 1, MAX_FOLLOW_IDLE_MS, &parameters->followIdleMs)) {
+                fprintf(stderr, "invalid follow idle time: %s\n", optarg);
+                return false;
+            }
+            break;
+        case OPT_TARGET_FPS:
+            if (!parseTargetFps(optarg, parameters->targetFps)) {
+                fprintf(stderr, "invalid target fps: %s\n", optarg);
+                return false;
+            }
+            break;
         default:
             printHelp(argv[0]);
             break;
         }
     }
-    if (!parameters->inputFile) {
+    DecodeInput::setFollow(parameters->followIdleMs);
+    if (parameters->inputFiles.empty()) {
         fprintf(stderr, "no input media file specified.\n");
         return false;
     }
+    parameters->inputFile = (char*)parameters->inputFiles[0].c_str();
     if (outputFile.empty())
         outputFile = "./";
     parameters->outputFile = outputFile;
@@ -114,6 +281,15 @@ bool processCmdLine(int argc, char** argv, DecodeParameter* parameters)
     return true;
 }
 
+void getStreamSchedule(const DecodeParameter* parameters, uint32_t index,
+    SessionPriority& priority, float& targetFps)
+{
+    const std::vector<SessionPriority>& priorities = parameters->priorities;
+    priority = priorities[std::min((size_t)index, priorities.size() - 1)];
+    const std::vector<float>& fps = parameters->targetFps;
+    targetFps = fps[std::min((size_t)index, fps.size() - 1)];
+}
+
 bool possibleWait(const char* mimeType, const DecodeParameter* parameters)
 {
     // waitBeforeQuit 0:nowait, 1:auto(jpeg wait), 2:wait
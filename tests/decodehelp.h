@@ -16,8 +16,11 @@
 #ifndef decodehelp_h
 #define decodehelp_h
 
+#include "common/sessionscheduler.h"
+
 #include <stdint.h>
 #include <string>
+#include <vector>
 
 typedef struct DecodeParameter {
     char* inputFile;
@@ -27,11 +30,31 @@ typedef struct DecodeParameter {
     short waitBeforeQuit;
     uint32_t renderFrames;
     uint32_t renderFourcc;
+    uint32_t syncDepth;
+    //v4l2decode buffer count of input queue and capture queue
+    uint32_t inputQueueDepth;
+    uint32_t outputQueueDepth;
     std::string outputFile;
+    //all -i and --manifest inputs, inputFile is the first one
+    std::vector<std::string> inputFiles;
+    //worker threads shared by the streams when there is more than one input
+    uint32_t threads;
+    //record the decode units of inputFile here instead of decoding
+    std::string captureFile;
+    //scheduling class and frame rate target of the streams in input order,
+    //0 is unpaced. never empty, the last one goes on for the streams after it
+    std::vector<YamiMediaCodec::SessionPriority> priorities;
+    std::vector<float> targetFps;
+    //follow inputs still being written, end them after this idle time, 0 is off
+    uint32_t followIdleMs;
 } DecodeParameter;
 
 bool processCmdLine(int argc, char** argv, DecodeParameter* parameters);
 
 bool possibleWait(const char* mimeType, const DecodeParameter* parameters);
 
+//scheduling class and frame rate target of stream index
+void getStreamSchedule(const DecodeParameter* parameters, uint32_t index,
+    YamiMediaCodec::SessionPriority& priority, float& targetFps);
+
 #endif //decodehelp_h
@@ -19,11 +19,23 @@
 
 #include <string.h>
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "decodeinput.h"
+#include "decodeinputmp4.h"
+#include "decodeinputts.h"
+#include "decodeinputunits.h"
+#include "inputfollower.h"
+#include "udpreceiver.h"
+#include "common/common_def.h"
 #include "common/NonCopyable.h"
 #include "common/log.h"
 
+#include <algorithm>
+
 #ifdef __ENABLE_AVFORMAT__
 #include "decodeinputavformat.h"
 #endif
@@ -36,12 +48,18 @@ public:
     static const size_t CacheBufferSize = 8 * MaxNaluSize;
     MyDecodeInput();
     virtual ~MyDecodeInput();
-    bool initInput(const char* fileName);
+    bool initStream(int fd, const std::vector<uint8_t>& peeked);
     virtual bool isEOS() {return m_parseToEOS;}
     virtual bool init() = 0;
     virtual const string& getCodecData();
 protected:
-    FILE *m_fp;
+    //like fread, short only at the end of input
+    size_t readData(void* data, size_t size);
+    //what is there, at least a byte before the end of input
+    size_t readSome(void* data, size_t size);
+    int m_fd;
+    std::vector<uint8_t> m_peeked;
+    size_t m_peekedOffset;
     uint8_t *m_buffer;
     bool m_readToEOS;
     bool m_parseToEOS;
@@ -69,7 +87,8 @@ public:
     DecodeInputRaw();
     ~DecodeInputRaw();
     bool init();
-    bool ensureBufferData();
+    //more forces a read, for a growing file that ends mid unit
+    bool ensureBufferData(bool more = false);
     int32_t scanForStartCode(const uint8_t * data, uint32_t offset, uint32_t size);
     bool getNextDecodeUnit(VideoDecodeBuffer &inputBuffer);
     virtual bool isSyncWord(const uint8_t* buf) = 0;
@@ -106,14 +125,83 @@ DecodeInput::DecodeInput()
 {
 }
 
-DecodeInput* DecodeInput::create(const char* fileName)
+enum InputFormat {
+    INPUT_UNKNOWN,
+    //start codes, but no parameter set to tell h264 from h265
+    INPUT_ANNEXB,
+    INPUT_H264,
+    INPUT_H265,
+    INPUT_IVF,
+    INPUT_JPEG,
+    INPUT_TS,
+    INPUT_MP4,
+    INPUT_UNITS,
+};
+
+//enough for the ts sync check and the parameter sets of most streams
+#define PROBE_SIZE 4096
+
+static InputFormat probeAnnexB(const uint8_t* data, size_t size)
+{
+    //elementary streams start with a start code, other binary data
+    //has 00 00 01 too often to look further
+    size_t zeros = 0;
+    while (zeros < size && !data[zeros])
+        zeros++;
+    if (zeros < 2 || zeros >= size || data[zeros] != 1)
+        return INPUT_UNKNOWN;
+    for (size_t i = zeros - 2; i + 4 < size; i++) {
+        if (data[i] || data[i + 1] || data[i + 2] != 1)
+            continue;
+        uint8_t h0 = data[i + 3];
+        uint8_t h1 = data[i + 4];
+        //h265 vps/sps/pps with layer 0 and temporal id 0, these are
+        //h264 types 0, 2 and 4, which don't start a stream
+        if ((h0 == 0x40 || h0 == 0x42 || h0 == 0x44) && h1 == 0x01)
+            return INPUT_H265;
+        //h264 sps, h265 type 51 is unspecified
+        if (!(h0 & 0x80) && (h0 & 0x1f) == 7)
+            return INPUT_H264;
+        i += 2;
+    }
+    return INPUT_ANNEXB;
+}
+
+//three sync bytes a packet apart, the stream may start mid packet
+static bool isTs(const uint8_t* data, size_t size, uint32_t packetSize, uint32_t syncOffset)
+{
+    for (size_t start = syncOffset; start < packetSize && start + 2 * packetSize < size; start++) {
+        if (data[start] == 0x47 && data[start + packetSize] == 0x47 && data[start + 2 * packetSize] == 0x47)
+            return true;
+    }
+    return false;
+}
+
+static InputFormat probeFormat(const uint8_t* data, size_t size)
+{
+    if (size >= 8 && !memcmp(data, UNIT_FILE_MAGIC, 8))
+        return INPUT_UNITS;
+    if (size >= 4 && !memcmp(data, "DKIF", 4))
+        return INPUT_IVF;
+    if (size >= 3 && data[0] == 0xff && data[1] == 0xd8 && data[2] == 0xff)
+        return INPUT_JPEG;
+    if (size >= 8) {
+        static const char* boxes[] = { "ftyp", "moov", "mdat", "free", "skip", "wide" };
+        for (size_t i = 0; i < N_ELEMENTS(boxes); i++) {
+            if (!memcmp(data + 4, boxes[i], 4))
+                return INPUT_MP4;
+        }
+    }
+    if (isTs(data, size, 188, 0) || isTs(data, size, 192, 4))
+        return INPUT_TS;
+    return probeAnnexB(data, size);
+}
+
+static InputFormat getFormatFromExtension(const char* fileName)
 {
-    DecodeInput* input = NULL;
-    if(fileName==NULL)
-        return NULL;
     const char *ext = strrchr(fileName,'.');
     if(ext==NULL)
-        return NULL;
+        return INPUT_UNKNOWN;
     ext++;//h264;264;jsv;avc;26l;jvt;ivf
     if(strcasecmp(ext,"h264")==0 ||
         strcasecmp(ext,"264")==0 ||
@@ -121,35 +209,175 @@ DecodeInput* DecodeInput::create(const char* fileName)
         strcasecmp(ext,"avc")==0 ||
         strcasecmp(ext,"26l")==0 ||
         strcasecmp(ext,"jvt")==0 ) {
-        input = new DecodeInputH26x(YAMI_MIME_H264);
+        return INPUT_H264;
     } else if (strcasecmp(ext,"265") == 0 ||
                strcasecmp(ext,"h265") == 0 ||
                strcasecmp(ext,"bin") == 0 ) {
-        input = new DecodeInputH26x(YAMI_MIME_H265);
+        return INPUT_H265;
     } else if((strcasecmp(ext,"ivf")==0) ||
             (strcasecmp(ext,"vp8")==0) ||
             (strcasecmp(ext,"vp9")==0)) {
-            input = new DecodeInputVPX();
-        }
+        return INPUT_IVF;
+    }
     else if(strcasecmp(ext,"jpg")==0 ||
             strcasecmp(ext,"jpeg")==0 ||
             strcasecmp(ext,"mjpg")==0 ||
             strcasecmp(ext,"mjpeg")==0) {
-            input = new DecodeInputJPEG();
+        return INPUT_JPEG;
+    }
+    else if (strcasecmp(ext, "ts") == 0 ||
+             strcasecmp(ext, "m2ts") == 0 ||
+             strcasecmp(ext, "mts") == 0 ||
+             strcasecmp(ext, "trp") == 0) {
+        return INPUT_TS;
+    }
+    else if (strcasecmp(ext, "mp4") == 0 ||
+             strcasecmp(ext, "mov") == 0 ||
+             strcasecmp(ext, "m4v") == 0 ||
+             strcasecmp(ext, "3gp") == 0) {
+        return INPUT_MP4;
+    }
+    return INPUT_UNKNOWN;
+}
+
+static DecodeInput* createInput(InputFormat format)
+{
+    switch (format) {
+    case INPUT_H264:
+        return new DecodeInputH26x(YAMI_MIME_H264);
+    case INPUT_H265:
+        return new DecodeInputH26x(YAMI_MIME_H265);
+    case INPUT_IVF:
+        return new DecodeInputVPX();
+    case INPUT_JPEG:
+        return new DecodeInputJPEG();
+    case INPUT_TS:
+        return new DecodeInputTs();
+    case INPUT_MP4:
+        return new DecodeInputMp4();
+    case INPUT_UNITS:
+        return new DecodeInputUnits();
+    default:
+        return NULL;
+    }
+}
+
+static uint32_t s_followIdleMs = 0;
+
+//read up to size bytes, less only at the end of input
+static ssize_t readFully(int fd, uint8_t* data, size_t size, InputFollower* follower)
+{
+    size_t got = 0;
+    while (got < size) {
+        ssize_t n = follower ? follower->read(data + got, size - got) : read(fd, data + got, size - got);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -1;
+        if (!n)
+            break;
+        got += n;
+    }
+    return got;
+}
+
+DecodeInput* DecodeInput::create(const char* fileName)
+{
+    if(fileName==NULL)
+        return NULL;
+    if (UdpReceiver::isUrl(fileName)) {
+        //only mpeg-ts is sent this way
+        DecodeInputTs* input = new DecodeInputTs;
+        if (!input->initUdp(fileName, s_followIdleMs)) {
+            delete input;
+            return NULL;
         }
-    else {
-#ifdef __ENABLE_AVFORMAT__
-            input = new DecodeInputAvFormat();
-#else
+        return input;
+    }
+    bool isStdin = !strcmp(fileName, "-");
+    int fd = isStdin ? STDIN_FILENO : open(fileName, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "fail to open input file: %s\n", fileName);
+        return NULL;
+    }
+    struct stat st;
+    bool isFile = !fstat(fd, &st) && S_ISREG(st.st_mode);
+    SharedPtr<InputFollower> follower;
+    if (s_followIdleMs && isFile) {
+        follower.reset(new InputFollower);
+        if (!follower->init(fd, s_followIdleMs)) {
+            close(fd);
             return NULL;
-#endif
         }
+    }
+    std::vector<uint8_t> peeked(PROBE_SIZE);
+    ssize_t n = readFully(fd, &peeked[0], peeked.size(), follower.get());
+    if (n < 0) {
+        ERROR("read %s failed: %s", fileName, strerror(errno));
+        if (!isStdin)
+            close(fd);
+        return NULL;
+    }
+    peeked.resize(n);
+
+    //an empty input has nothing to probe, only its name
+    InputFormat format = peeked.empty() ? INPUT_UNKNOWN : probeFormat(&peeked[0], peeked.size());
+    if (format == INPUT_UNKNOWN || format == INPUT_ANNEXB) {
+        InputFormat fromName = isStdin ? INPUT_UNKNOWN : getFormatFromExtension(fileName);
+        if (fromName != INPUT_UNKNOWN)
+            format = fromName;
+        else if (format == INPUT_ANNEXB)
+            format = INPUT_H264;
+    }
+
+    //regular files start over, anything else gets the peeked bytes replayed
+    if (isFile && !lseek(fd, 0, SEEK_SET))
+        peeked.clear();
 
-    if(!input->initInput(fileName)) {
+    DecodeInput* input = createInput(format);
+    if (input) {
+        input->m_follower = follower;
+        if (input->initStream(fd, peeked))
+            return input;
+        delete input;
+        //fragmented mp4 and codecs we don't know
+        if (format != INPUT_MP4)
+            return NULL;
+    }
+    else
+        close(fd);
+
+#ifdef __ENABLE_AVFORMAT__
+    if (!isStdin) {
+        input = new DecodeInputAvFormat();
+        if (input->initInput(fileName))
+            return input;
         delete input;
-        return NULL;
     }
-    return input;
+#endif
+    ERROR("unsupported input %s", fileName);
+    return NULL;
+}
+
+void DecodeInput::setFollow(uint32_t idleMs)
+{
+    s_followIdleMs = idleMs;
+}
+
+bool DecodeInput::initInput(const char* fileName)
+{
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "fail to open input file: %s\n", fileName);
+        return false;
+    }
+    return initStream(fd, std::vector<uint8_t>());
+}
+
+bool DecodeInput::initStream(int fd, const std::vector<uint8_t>&)
+{
+    close(fd);
+    return false;
 }
 
 void DecodeInput::setResolution(const uint16_t width, const uint16_t height)
@@ -159,7 +387,8 @@ void DecodeInput::setResolution(const uint16_t width, const uint16_t height)
 }
 
 MyDecodeInput::MyDecodeInput()
-    : m_fp(NULL)
+    : m_fd(-1)
+    , m_peekedOffset(0)
     , m_buffer(NULL)
     , m_readToEOS(false)
     , m_parseToEOS(false)
@@ -168,25 +397,53 @@ MyDecodeInput::MyDecodeInput()
 
 MyDecodeInput::~MyDecodeInput()
 {
-    if(m_fp)
-        fclose(m_fp);
+    if (m_fd >= 0)
+        close(m_fd);
 
     if(m_buffer)
         free(m_buffer);
 }
 
-bool MyDecodeInput::initInput(const char* fileName)
+bool MyDecodeInput::initStream(int fd, const std::vector<uint8_t>& peeked)
 {
-    m_fp = fopen(fileName, "r");
-    if (!m_fp) {
-        fprintf(stderr, "fail to open input file: %s\n", fileName);
-        return false;
-    }
-
+    m_fd = fd;
+    m_peeked = peeked;
     m_buffer = static_cast<uint8_t*>(malloc(CacheBufferSize));
     return init();
 }
 
+size_t MyDecodeInput::readData(void* data, size_t size)
+{
+    uint8_t* p = static_cast<uint8_t*>(data);
+    size_t got = std::min(size, m_peeked.size() - m_peekedOffset);
+    if (got) {
+        memcpy(p, &m_peeked[m_peekedOffset], got);
+        m_peekedOffset += got;
+    }
+    if (got < size) {
+        ssize_t n = readFully(m_fd, p + got, size - got, m_follower.get());
+        if (n < 0)
+            ERROR("read input failed: %s", strerror(errno));
+        else
+            got += n;
+    }
+    return got;
+}
+
+size_t MyDecodeInput::readSome(void* data, size_t size)
+{
+    //followed inputs are regular files, they have nothing peeked.
+    //waiting for all of size could take as long as the recording
+    if (!m_follower)
+        return readData(data, size);
+    ssize_t n = m_follower->read(data, size);
+    if (n < 0) {
+        ERROR("read input failed: %s", strerror(errno));
+        return 0;
+    }
+    return n;
+}
+
 const string& MyDecodeInput::getCodecData()
 {
     //no codec data;
@@ -224,7 +481,7 @@ bool DecodeInputVPX::init()
     IvfHeader header;
     size_t size = sizeof(header);
     assert(size == 32);
-    if (size != fread (&header, 1, size, m_fp)) {
+    if (size != readData(&header, size)) {
         fprintf (stderr, "fail to read ivf header, quit\n");
         return false;
     }
@@ -242,13 +499,13 @@ bool DecodeInputVPX::init()
 
 bool DecodeInputVPX::getNextDecodeUnit(VideoDecodeBuffer &inputBuffer)
 {
-    if(m_ivfFrmHdrSize == fread (m_buffer, 1, m_ivfFrmHdrSize, m_fp)) {
+    if(m_ivfFrmHdrSize == readData(m_buffer, m_ivfFrmHdrSize)) {
         size_t framesize = 0;
         framesize = (uint32_t)(m_buffer[0]) + ((uint32_t)(m_buffer[1])<<8) + ((uint32_t)(m_buffer[2])<<16);
         assert (framesize < m_maxFrameSize);
         assert (framesize <= CacheBufferSize);
 
-        if (framesize != fread (m_buffer, 1, framesize, m_fp)) {
+        if (framesize != readData(m_buffer, framesize)) {
             fprintf (stderr, "fail to read frame data, quit\n");
             return false;
         }
@@ -285,7 +542,7 @@ bool DecodeInputRaw::init()
     return true;
 }
 
-bool DecodeInputRaw::ensureBufferData()
+bool DecodeInputRaw::ensureBufferData(bool more)
 {
     size_t readCount = 0;
 
@@ -293,7 +550,7 @@ bool DecodeInputRaw::ensureBufferData()
         return true;
 
     // available data is enough for parsing
-    if (m_lastReadOffset + MaxNaluSize < m_availableData)
+    if (!more && m_lastReadOffset + MaxNaluSize < m_availableData)
         return true;
 
     // move unused data to the begining of m_buffer
@@ -303,8 +560,10 @@ bool DecodeInputRaw::ensureBufferData()
         m_lastReadOffset = 0;
     }
 
-    readCount = fread(m_buffer + m_availableData, 1, CacheBufferSize-m_availableData, m_fp);
-    if (readCount < CacheBufferSize-m_availableData)
+    size_t size = CacheBufferSize - m_availableData;
+    readCount = readSome(m_buffer + m_availableData, size);
+    //a followed file is short until it is done, then there is nothing
+    if (m_follower ? !readCount : readCount < size)
         m_readToEOS = true;
 
     m_availableData += readCount;
@@ -340,6 +599,16 @@ bool DecodeInputRaw::getNextDecodeUnit(VideoDecodeBuffer &inputBuffer)
     ensureBufferData();
     DEBUG("m_lastReadOffset=0x%x, m_availableData=0x%x\n", m_lastReadOffset, m_availableData);
     offset = scanForStartCode(m_buffer, m_lastReadOffset+StartCodeSize, m_availableData);
+    //a growing file may end mid unit, wait for the rest. only scan the new
+    //bytes, the jpeg scan counts markers
+    while (offset == -1 && !m_readToEOS) {
+        uint32_t scanned = std::max(m_availableData + 1, m_lastReadOffset + 2 * StartCodeSize) - StartCodeSize - m_lastReadOffset;
+        ensureBufferData(true);
+        uint32_t from = m_lastReadOffset + scanned;
+        int32_t found = scanForStartCode(m_buffer, from, m_availableData);
+        if (found != -1)
+            offset = found + scanned - StartCodeSize;
+    }
 
     if (offset == -1) {
         assert(m_readToEOS);
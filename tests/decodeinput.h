@@ -17,16 +17,30 @@
 #define decodeinput_h
 
 #include <stdio.h>
+#include <stdint.h>
 #include <string>
+#include <vector>
 #include "VideoDecoderDefs.h"
 #include "VideoDecoderInterface.h"
 
+class InputFollower;
+
+//an hour, idle times go to poll() as an int
+#define MAX_FOLLOW_IDLE_MS 3600000
+
 using std::string;
 class DecodeInput {
 public:
     DecodeInput();
     virtual ~DecodeInput() {}
+    //fileName "-" is stdin. the format is sniffed from the first bytes,
+    //the extension only helps when they are not conclusive
     static DecodeInput * create(const char* fileName);
+    //inputs created after this follow regular files that are still being
+    //written, until the writer closes them or they are idle for idleMs.
+    //0 turns it off, the end of the file is the end of the input.
+    //at most MAX_FOLLOW_IDLE_MS
+    static void setFollow(uint32_t idleMs);
     virtual bool isEOS() = 0;
     virtual const char * getMimeType() = 0;
     virtual bool getNextDecodeUnit(VideoDecodeBuffer &inputBuffer) = 0;
@@ -35,10 +49,16 @@ public:
     virtual uint16_t getHeight() {return m_height;}
 
 protected:
-    virtual bool initInput(const char* fileName) = 0;
+    //opens fileName and calls initStream
+    virtual bool initInput(const char* fileName);
+    //read from fd, peeked bytes were already read from it and come first.
+    //the input owns fd, also when this fails. fd may be a pipe.
+    virtual bool initStream(int fd, const std::vector<uint8_t>& peeked);
     virtual void setResolution(const uint16_t width, const uint16_t height);
     uint16_t m_width;
     uint16_t m_height;
+    //set before initStream in follow mode
+    SharedPtr<InputFollower> m_follower;
 
 };
 #endif
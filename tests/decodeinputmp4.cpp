@@ -0,0 +1,525 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "decodeinputmp4.h"
+#include "inputfollower.h"
+#include "common/log.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//growth step when the input is a pipe
+#define MP4_READ_SIZE (4 * 1024 * 1024)
+
+//timestamps we hand out, the same as mpeg-ts
+#define MP4_OUTPUT_TIMESCALE 90000
+
+#define BOX_TYPE(a, b, c, d) (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (uint32_t)(d))
+
+static uint16_t readBE16(const uint8_t* p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static uint32_t readBE32(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint64_t readBE64(const uint8_t* p)
+{
+    return ((uint64_t)readBE32(p) << 32) | readBE32(p + 4);
+}
+
+struct Box {
+    uint32_t type;
+    const uint8_t* data;
+    uint64_t size;
+};
+
+//take the box at p and move p after it
+static bool nextBox(const uint8_t*& p, const uint8_t* end, Box& box)
+{
+    uint64_t left = end - p;
+    if (left < 8)
+        return false;
+    uint64_t size = readBE32(p);
+    uint32_t header = 8;
+    if (size == 1) {
+        if (left < 16)
+            return false;
+        size = readBE64(p + 8);
+        header = 16;
+    }
+    else if (!size) {
+        //last box, up to the end
+        size = left;
+    }
+    if (size < header || size > left)
+        return false;
+    box.type = readBE32(p + 4);
+    box.data = p + header;
+    box.size = size - header;
+    p += size;
+    return true;
+}
+
+static bool findBox(const uint8_t* data, uint64_t size, uint32_t type, Box& box)
+{
+    const uint8_t* end = data + size;
+    while (nextBox(data, end, box)) {
+        if (box.type == type)
+            return true;
+    }
+    return false;
+}
+
+DecodeInputMp4::DecodeInputMp4()
+    : m_data((uint8_t*)MAP_FAILED)
+    , m_size(0)
+    , m_mapSize(0)
+    , m_mime(NULL)
+    , m_lengthSize(0)
+    , m_next(0)
+    , m_parameterSetsSent(false)
+    , m_isEOS(false)
+{
+}
+
+DecodeInputMp4::~DecodeInputMp4()
+{
+    if (m_data != MAP_FAILED)
+        munmap(m_data, m_mapSize);
+}
+
+bool DecodeInputMp4::mapFile(int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) || !st.st_size)
+        return false;
+    m_size = m_mapSize = st.st_size;
+    //private and writable, so start codes can go over the length prefixes
+    //without touching the file. only the pages we write get copied.
+    m_data = (uint8_t*)mmap(NULL, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (m_data == MAP_FAILED) {
+        ERROR("mmap input failed");
+        return false;
+    }
+    madvise(m_data, m_size, MADV_SEQUENTIAL);
+    return true;
+}
+
+//the moov box may come last, so a pipe is read to the end first
+bool DecodeInputMp4::readStream(int fd, const std::vector<uint8_t>& peeked)
+{
+    m_mapSize = std::max(peeked.size(), (size_t)MP4_READ_SIZE);
+    m_data = (uint8_t*)mmap(NULL, m_mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (m_data == MAP_FAILED)
+        return false;
+    std::copy(peeked.begin(), peeked.end(), m_data);
+    m_size = peeked.size();
+    while (1) {
+        if (m_size == m_mapSize) {
+            void* data = mremap(m_data, m_mapSize, m_mapSize * 2, MREMAP_MAYMOVE);
+            if (data == MAP_FAILED) {
+                ERROR("no memory for the mp4 input");
+                return false;
+            }
+            m_data = (uint8_t*)data;
+            m_mapSize *= 2;
+        }
+        ssize_t n = read(fd, m_data + m_size, m_mapSize - m_size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0) {
+            ERROR("read mp4 failed: %s", strerror(errno));
+            return false;
+        }
+        if (!n)
+            break;
+        m_size += n;
+    }
+    return m_size;
+}
+
+bool DecodeInputMp4::initStream(int fd, const std::vector<uint8_t>& peeked)
+{
+    struct stat st;
+    bool ok;
+    if (peeked.empty() && !fstat(fd, &st) && S_ISREG(st.st_mode)) {
+        //moov is written last, a growing file can only be mapped when it is done
+        if (m_follower)
+            m_follower->waitForEnd();
+        ok = mapFile(fd);
+    } else
+        ok = readStream(fd, peeked);
+    close(fd);
+    if (!ok)
+        return false;
+
+    Box moov;
+    if (!findBox(m_data, m_size, BOX_TYPE('m', 'o', 'o', 'v'), moov)) {
+        ERROR("no moov in the mp4 input");
+        return false;
+    }
+    if (!parseMoov(moov.data, moov.size)) {
+        ERROR("no supported video track in the mp4 input");
+        return false;
+    }
+    return true;
+}
+
+bool DecodeInputMp4::parseMoov(const uint8_t* data, uint64_t size)
+{
+    const uint8_t* end = data + size;
+    Box trak;
+    while (nextBox(data, end, trak)) {
+        //first video track we can decode
+        if (trak.type == BOX_TYPE('t', 'r', 'a', 'k') && parseTrack(trak.data, trak.size))
+            return true;
+    }
+    return false;
+}
+
+bool DecodeInputMp4::parseTrack(const uint8_t* data, uint64_t size)
+{
+    Box mdia, hdlr, minf, stbl;
+    if (!findBox(data, size, BOX_TYPE('m', 'd', 'i', 'a'), mdia)
+        || !findBox(mdia.data, mdia.size, BOX_TYPE('h', 'd', 'l', 'r'), hdlr)
+        || hdlr.size < 12
+        || readBE32(hdlr.data + 8) != BOX_TYPE('v', 'i', 'd', 'e'))
+        return false;
+    if (!findBox(mdia.data, mdia.size, BOX_TYPE('m', 'i', 'n', 'f'), minf)
+        || !findBox(minf.data, minf.size, BOX_TYPE('s', 't', 'b', 'l'), stbl))
+        return false;
+    //version and flags, creation and modification time (64 bits in version 1), timescale
+    Box mdhd;
+    if (!findBox(mdia.data, mdia.size, BOX_TYPE('m', 'd', 'h', 'd'), mdhd) || mdhd.size < 4)
+        return false;
+    uint32_t timescaleOffset = mdhd.data[0] == 1 ? 20 : 12;
+    if (mdhd.size < timescaleOffset + 4)
+        return false;
+    uint32_t timescale = readBE32(mdhd.data + timescaleOffset);
+    if (!timescale)
+        return false;
+    Box stsd;
+    //version and flags, entry count, then the first sample entry
+    if (!findBox(stbl.data, stbl.size, BOX_TYPE('s', 't', 's', 'd'), stsd) || stsd.size < 8)
+        return false;
+    const uint8_t* p = stsd.data + 8;
+    Box entry;
+    if (!nextBox(p, stsd.data + stsd.size, entry))
+        return false;
+    m_mime = NULL;
+    m_lengthSize = 0;
+    m_parameterSets.clear();
+    switch (entry.type) {
+    case BOX_TYPE('a', 'v', 'c', '1'):
+    case BOX_TYPE('a', 'v', 'c', '3'):
+        m_mime = YAMI_MIME_H264;
+        break;
+    case BOX_TYPE('h', 'v', 'c', '1'):
+    case BOX_TYPE('h', 'e', 'v', '1'):
+        m_mime = YAMI_MIME_H265;
+        break;
+    case BOX_TYPE('v', 'p', '0', '8'):
+        m_mime = YAMI_MIME_VP8;
+        break;
+    case BOX_TYPE('v', 'p', '0', '9'):
+        m_mime = YAMI_MIME_VP9;
+        break;
+    case BOX_TYPE('j', 'p', 'e', 'g'):
+    case BOX_TYPE('m', 'j', 'p', 'a'):
+        m_mime = YAMI_MIME_JPEG;
+        break;
+    default:
+        return false;
+    }
+    return parseSampleEntry(entry.data, entry.size) && parseSampleTable(stbl.data, stbl.size, timescale);
+}
+
+bool DecodeInputMp4::parseSampleEntry(const uint8_t* data, uint64_t size)
+{
+    //VisualSampleEntry: 6 reserved, data reference index, 16 pre-defined,
+    //width, height, then 50 more bytes before the child boxes
+    static const uint32_t VISUAL_SAMPLE_ENTRY_SIZE = 78;
+    if (size < VISUAL_SAMPLE_ENTRY_SIZE)
+        return false;
+    setResolution(readBE16(data + 24), readBE16(data + 26));
+    const uint8_t* children = data + VISUAL_SAMPLE_ENTRY_SIZE;
+    uint64_t childrenSize = size - VISUAL_SAMPLE_ENTRY_SIZE;
+    Box config;
+    if (!strcmp(m_mime, YAMI_MIME_H264)) {
+        //avc3 may carry parameter sets in band only, avcC is still there for the length size
+        return findBox(children, childrenSize, BOX_TYPE('a', 'v', 'c', 'C'), config)
+            && parseAvcC(config.data, config.size);
+    }
+    if (!strcmp(m_mime, YAMI_MIME_H265)) {
+        return findBox(children, childrenSize, BOX_TYPE('h', 'v', 'c', 'C'), config)
+            && parseHvcC(config.data, config.size);
+    }
+    return true;
+}
+
+void DecodeInputMp4::addParameterSet(const uint8_t* data, uint32_t size)
+{
+    static const uint8_t startCode[] = { 0, 0, 0, 1 };
+    m_parameterSets.insert(m_parameterSets.end(), startCode, startCode + sizeof(startCode));
+    m_parameterSets.insert(m_parameterSets.end(), data, data + size);
+}
+
+bool DecodeInputMp4::parseAvcC(const uint8_t* data, uint64_t size)
+{
+    if (size < 7)
+        return false;
+    m_lengthSize = (data[4] & 3) + 1;
+    const uint8_t* p = data + 5;
+    const uint8_t* end = data + size;
+    //sps, then pps
+    for (int i = 0; i < 2; i++) {
+        if (p >= end)
+            return false;
+        uint32_t count = i ? *p : (*p & 0x1f);
+        p++;
+        for (uint32_t j = 0; j < count; j++) {
+            if (end - p < 2 || end - p - 2 < readBE16(p))
+                return false;
+            uint16_t len = readBE16(p);
+            addParameterSet(p + 2, len);
+            p += 2 + len;
+        }
+    }
+    return true;
+}
+
+bool DecodeInputMp4::parseHvcC(const uint8_t* data, uint64_t size)
+{
+    if (size < 23)
+        return false;
+    m_lengthSize = (data[21] & 3) + 1;
+    uint32_t arrays = data[22];
+    const uint8_t* p = data + 23;
+    const uint8_t* end = data + size;
+    //vps, sps, pps and sei arrays
+    for (uint32_t i = 0; i < arrays; i++) {
+        if (end - p < 3)
+            return false;
+        uint32_t count = readBE16(p + 1);
+        p += 3;
+        for (uint32_t j = 0; j < count; j++) {
+            if (end - p < 2 || end - p - 2 < readBE16(p))
+                return false;
+            uint16_t len = readBE16(p);
+            addParameterSet(p + 2, len);
+            p += 2 + len;
+        }
+    }
+    return true;
+}
+
+//ts in timescale to MP4_OUTPUT_TIMESCALE, without overflow for long files
+static int64_t rescale(int64_t ts, uint32_t timescale)
+{
+    return ts / timescale * MP4_OUTPUT_TIMESCALE + ts % timescale * MP4_OUTPUT_TIMESCALE / timescale;
+}
+
+bool DecodeInputMp4::parseSampleTable(const uint8_t* data, uint64_t size, uint32_t timescale)
+{
+    Box stsz, stsc, stco, stts, ctts;
+    bool co64 = false;
+    if (!findBox(data, size, BOX_TYPE('s', 't', 's', 'z'), stsz)
+        || !findBox(data, size, BOX_TYPE('s', 't', 's', 'c'), stsc)
+        || !findBox(data, size, BOX_TYPE('s', 't', 't', 's'), stts))
+        return false;
+    if (!findBox(data, size, BOX_TYPE('s', 't', 'c', 'o'), stco)) {
+        if (!findBox(data, size, BOX_TYPE('c', 'o', '6', '4'), stco))
+            return false;
+        co64 = true;
+    }
+    bool hasCtts = findBox(data, size, BOX_TYPE('c', 't', 't', 's'), ctts);
+
+    //all tables start with version and flags, then an entry count
+    if (stsz.size < 12 || stsc.size < 8 || stco.size < 8 || stts.size < 8 || (hasCtts && ctts.size < 8))
+        return false;
+    uint32_t fixedSize = readBE32(stsz.data + 4);
+    uint32_t sampleCount = readBE32(stsz.data + 8);
+    uint32_t chunkCount = readBE32(stco.data + 4);
+    uint32_t stscCount = readBE32(stsc.data + 4);
+    uint32_t sttsCount = readBE32(stts.data + 4);
+    uint32_t cttsCount = hasCtts ? readBE32(ctts.data + 4) : 0;
+    if ((!fixedSize && (stsz.size - 12) / 4 < sampleCount)
+        || (stco.size - 8) / (co64 ? 8 : 4) < chunkCount
+        || (stsc.size - 8) / 12 < stscCount
+        || (stts.size - 8) / 8 < sttsCount
+        || (hasCtts && (ctts.size - 8) / 8 < cttsCount))
+        return false;
+    if (!sampleCount || !stscCount) {
+        //samples are in moof boxes
+        ERROR("fragmented mp4 is not supported");
+        return false;
+    }
+    //the table says nothing about the count then, the file size does
+    if (fixedSize && sampleCount > m_size / fixedSize)
+        return false;
+    //nor may it be more than the chunks hold, before we allocate for it
+    uint64_t described = 0;
+    for (uint32_t i = 0; i < stscCount && described < sampleCount; i++) {
+        const uint8_t* entry = stsc.data + 8 + i * 12;
+        uint32_t firstChunk = readBE32(entry);
+        uint32_t lastChunk = i + 1 < stscCount ? readBE32(entry + 12) : chunkCount + 1;
+        if (firstChunk < lastChunk)
+            described += (uint64_t)(lastChunk - firstChunk) * readBE32(entry + 4);
+    }
+    if (sampleCount > described)
+        return false;
+
+    m_samples.resize(sampleCount);
+    //offsets, walk the chunks
+    uint32_t sample = 0;
+    for (uint32_t i = 0; i < stscCount && sample < sampleCount; i++) {
+        const uint8_t* entry = stsc.data + 8 + i * 12;
+        uint32_t firstChunk = readBE32(entry);
+        uint32_t samplesPerChunk = readBE32(entry + 4);
+        uint32_t lastChunk = i + 1 < stscCount ? readBE32(entry + 12) : chunkCount + 1;
+        if (!firstChunk || lastChunk > chunkCount + 1)
+            return false;
+        for (uint32_t chunk = firstChunk; chunk < lastChunk && sample < sampleCount; chunk++) {
+            uint64_t offset = co64 ? readBE64(stco.data + 8 + (chunk - 1) * 8)
+                                   : readBE32(stco.data + 8 + (chunk - 1) * 4);
+            for (uint32_t j = 0; j < samplesPerChunk && sample < sampleCount; j++) {
+                Sample& s = m_samples[sample];
+                s.size = fixedSize ? fixedSize : readBE32(stsz.data + 12 + sample * 4);
+                if (offset > m_size || s.size > m_size - offset)
+                    return false;
+                s.offset = offset;
+                offset += s.size;
+                sample++;
+            }
+        }
+    }
+    if (sample != sampleCount)
+        return false;
+
+    //decode time from stts, plus the composition offset from ctts
+    int64_t dts = 0;
+    sample = 0;
+    for (uint32_t i = 0; i < sttsCount && sample < sampleCount; i++) {
+        uint32_t count = readBE32(stts.data + 8 + i * 8);
+        uint32_t delta = readBE32(stts.data + 12 + i * 8);
+        for (uint32_t j = 0; j < count && sample < sampleCount; j++) {
+            m_samples[sample++].pts = dts;
+            dts += delta;
+        }
+    }
+    for (; sample < sampleCount; sample++)
+        m_samples[sample].pts = dts;
+    sample = 0;
+    for (uint32_t i = 0; i < cttsCount && sample < sampleCount; i++) {
+        uint32_t count = readBE32(ctts.data + 8 + i * 8);
+        //signed in version 1, version 0 writers use it the same way
+        int32_t offset = (int32_t)readBE32(ctts.data + 12 + i * 8);
+        for (uint32_t j = 0; j < count && sample < sampleCount; j++)
+            m_samples[sample++].pts += offset;
+    }
+    for (sample = 0; sample < sampleCount; sample++)
+        m_samples[sample].pts = rescale(m_samples[sample].pts, timescale);
+    return true;
+}
+
+//length prefixed NAL units to start codes
+bool DecodeInputMp4::toAnnexB(uint8_t*& data, uint32_t& size)
+{
+    uint8_t* p = data;
+    uint8_t* end = data + size;
+    if (m_lengthSize == 4) {
+        //same size, write over the prefix
+        while (end - p >= 4) {
+            uint32_t len = readBE32(p);
+            if (len > (uint32_t)(end - p - 4))
+                return false;
+            p[0] = p[1] = p[2] = 0;
+            p[3] = 1;
+            p += 4 + len;
+        }
+        return p == end;
+    }
+    m_scratch.clear();
+    while (end - p >= (ptrdiff_t)m_lengthSize) {
+        uint32_t len = 0;
+        for (uint32_t i = 0; i < m_lengthSize; i++)
+            len = (len << 8) | p[i];
+        p += m_lengthSize;
+        if (len > (uint32_t)(end - p))
+            return false;
+        static const uint8_t startCode[] = { 0, 0, 0, 1 };
+        m_scratch.insert(m_scratch.end(), startCode, startCode + sizeof(startCode));
+        m_scratch.insert(m_scratch.end(), p, p + len);
+        p += len;
+    }
+    if (p != end || m_scratch.empty())
+        return false;
+    data = &m_scratch[0];
+    size = m_scratch.size();
+    return true;
+}
+
+bool DecodeInputMp4::getNextDecodeUnit(VideoDecodeBuffer& inputBuffer)
+{
+    if (m_isEOS)
+        return false;
+    memset(&inputBuffer, 0, sizeof(inputBuffer));
+    if (!m_parameterSetsSent) {
+        m_parameterSetsSent = true;
+        if (!m_parameterSets.empty()) {
+            inputBuffer.data = &m_parameterSets[0];
+            inputBuffer.size = m_parameterSets.size();
+            inputBuffer.timeStamp = m_samples[0].pts;
+            return true;
+        }
+    }
+    if (m_next >= m_samples.size()) {
+        m_isEOS = true;
+        return false;
+    }
+    const Sample& sample = m_samples[m_next++];
+    uint8_t* data = m_data + sample.offset;
+    uint32_t size = sample.size;
+    //every sample is visited once, so it is rewritten once
+    if (m_lengthSize && !toAnnexB(data, size)) {
+        ERROR("bad NAL length in sample %u", (uint32_t)(m_next - 1));
+        m_isEOS = true;
+        return false;
+    }
+    inputBuffer.data = data;
+    inputBuffer.size = size;
+    inputBuffer.timeStamp = sample.pts;
+    return true;
+}
+
+const string& DecodeInputMp4::getCodecData()
+{
+    //parameter sets go in band
+    static const string dummy;
+    return dummy;
+}
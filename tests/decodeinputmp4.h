@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef decodeinputmp4_h
+#define decodeinputmp4_h
+
+#include "decodeinput.h"
+
+#include <vector>
+
+//mp4/mov demuxer without libavformat.
+//the sample tables are parsed once, samples are handed to the decoder straight
+//from a private mapping of the file. avcC/hvcC length prefixes are rewritten
+//to start codes in place, the parameter sets go out as the first decode unit.
+//fragmented mp4 is not supported.
+class DecodeInputMp4 : public DecodeInput
+{
+public:
+    DecodeInputMp4();
+    virtual ~DecodeInputMp4();
+    virtual bool isEOS() { return m_isEOS; }
+    virtual const char* getMimeType() { return m_mime; }
+    virtual bool getNextDecodeUnit(VideoDecodeBuffer& inputBuffer);
+    virtual const string& getCodecData();
+
+protected:
+    virtual bool initStream(int fd, const std::vector<uint8_t>& peeked);
+
+private:
+    struct Sample {
+        uint64_t offset;
+        uint32_t size;
+        //composition time in 90kHz, the mpeg-ts clock
+        int64_t pts;
+    };
+    bool mapFile(int fd);
+    bool readStream(int fd, const std::vector<uint8_t>& peeked);
+    bool parseMoov(const uint8_t* data, uint64_t size);
+    bool parseTrack(const uint8_t* data, uint64_t size);
+    bool parseSampleEntry(const uint8_t* data, uint64_t size);
+    bool parseAvcC(const uint8_t* data, uint64_t size);
+    bool parseHvcC(const uint8_t* data, uint64_t size);
+    bool parseSampleTable(const uint8_t* data, uint64_t size, uint32_t timescale);
+    void addParameterSet(const uint8_t* data, uint32_t size);
+    bool toAnnexB(uint8_t*& data, uint32_t& size);
+
+    uint8_t* m_data;
+    size_t m_size;
+    size_t m_mapSize;
+    const char* m_mime;
+    //NAL length prefix size, 0 for codecs without NAL units
+    uint32_t m_lengthSize;
+    std::vector<Sample> m_samples;
+    size_t m_next;
+    //parameter sets with start codes
+    std::vector<uint8_t> m_parameterSets;
+    bool m_parameterSetsSent;
+    //for 1 to 3 bytes length prefixes, they can't be rewritten in place
+    std::vector<uint8_t> m_scratch;
+    bool m_isEOS;
+};
+
+#endif //decodeinputmp4_h
@@ -0,0 +1,253 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "decodeinputmp4.h"
+
+#include "common/unittest.h"
+
+#include <string.h>
+
+using std::string;
+
+static string be32(uint32_t v)
+{
+    string s(4, '\0');
+    s[0] = v >> 24;
+    s[1] = v >> 16;
+    s[2] = v >> 8;
+    s[3] = v;
+    return s;
+}
+
+static string be16(uint16_t v)
+{
+    string s(2, '\0');
+    s[0] = v >> 8;
+    s[1] = v;
+    return s;
+}
+
+static string box(const char* type, const string& payload)
+{
+    return be32(8 + payload.size()) + type + payload;
+}
+
+//version and flags
+static string fullBox(const char* type, uint8_t version, const string& payload)
+{
+    return box(type, string(1, (char)version) + string(3, '\0') + payload);
+}
+
+//a length prefixed IDR slice NAL with one byte of payload
+static string sampleData(uint8_t id)
+{
+    return be32(2) + "\x65" + string(1, (char)id);
+}
+
+struct Mp4Layout {
+    //stsz: fixedSize, or the sizes of the samples
+    uint32_t fixedSize;
+    uint32_t sampleCount;
+    //samples per chunk, one stsc entry
+    uint32_t samplesPerChunk;
+    //mdhd
+    uint8_t mdhdVersion;
+    uint32_t timescale;
+    //stts, one entry for all samples
+    uint32_t delta;
+    //ctts offset of the second sample, 0 for no ctts
+    int32_t secondOffset;
+    //added to every chunk offset
+    uint32_t offsetError;
+    uint32_t samples;
+};
+
+static Mp4Layout defaultLayout()
+{
+    Mp4Layout l;
+    l.fixedSize = 0;
+    l.sampleCount = 3;
+    l.samplesPerChunk = 1;
+    l.mdhdVersion = 0;
+    l.timescale = 1000;
+    l.delta = 40;
+    l.secondOffset = 0;
+    l.offsetError = 0;
+    l.samples = 3;
+    return l;
+}
+
+//ftyp, mdat with the samples, then moov
+static string makeMp4(const Mp4Layout& l)
+{
+    string ftyp = box("ftyp", string("isom") + be32(0) + "isom");
+    string samples;
+    for (uint32_t i = 0; i < l.samples; i++)
+        samples += sampleData(i);
+    uint32_t mdatStart = ftyp.size() + 8;
+    string mdat = box("mdat", samples);
+
+    string mdhd;
+    if (l.mdhdVersion == 1)
+        mdhd = fullBox("mdhd", 1, string(16, '\0') + be32(l.timescale) + string(8, '\0') + string(4, '\0'));
+    else
+        mdhd = fullBox("mdhd", 0, string(8, '\0') + be32(l.timescale) + be32(0) + string(4, '\0'));
+    string hdlr = fullBox("hdlr", 0, be32(0) + "vide" + string(12, '\0') + string(1, '\0'));
+
+    //sps 67 01, pps 68 02, 4 byte lengths
+    string avcC = box("avcC", string("\x01\x42\x00\x1e\xff\xe1", 6) + be16(2) + "\x67\x01"
+        + string(1, '\x01') + be16(2) + "\x68\x02");
+    string visual = string(6, '\0') + be16(1) + string(16, '\0') + be16(64) + be16(48)
+        + string(50, '\0');
+    string stsd = fullBox("stsd", 0, be32(1) + box("avc1", visual + avcC));
+
+    string sizes;
+    if (!l.fixedSize) {
+        for (uint32_t i = 0; i < l.sampleCount; i++)
+            sizes += be32(6);
+    }
+    string stsz = fullBox("stsz", 0, be32(l.fixedSize) + be32(l.sampleCount) + sizes);
+    string stsc = fullBox("stsc", 0, be32(1) + be32(1) + be32(l.samplesPerChunk) + be32(1));
+    uint32_t chunks = (l.samples + l.samplesPerChunk - 1) / l.samplesPerChunk;
+    string offsets;
+    for (uint32_t i = 0; i < chunks; i++)
+        offsets += be32(mdatStart + i * l.samplesPerChunk * 6 + l.offsetError);
+    string stco = fullBox("stco", 0, be32(chunks) + offsets);
+    string stts = fullBox("stts", 0, be32(1) + be32(l.sampleCount) + be32(l.delta));
+    string ctts;
+    if (l.secondOffset)
+        ctts = fullBox("ctts", 0, be32(2) + be32(1) + be32(0) + be32(1) + be32(l.secondOffset));
+    string stbl = box("stbl", stsd + stts + ctts + stsc + stsz + stco);
+    string mdia = box("mdia", mdhd + hdlr + box("minf", stbl));
+    string moov = box("moov", box("trak", mdia));
+    return ftyp + mdat + moov;
+}
+
+#define DECODEINPUTMP4_TEST(name) \
+    TEST(DecodeInputMp4Test, name)
+
+class Mp4 : public DecodeInputMp4 {
+public:
+    bool open(const string& data)
+    {
+        m_file.reset(new TempFile(data));
+        return m_file->ok() && initInput(m_file->name());
+    }
+
+private:
+    SharedPtr<TempFile> m_file;
+};
+
+static void expectUnit(Mp4& mp4, const string& data, int64_t pts)
+{
+    VideoDecodeBuffer buffer;
+    ASSERT_TRUE(mp4.getNextDecodeUnit(buffer));
+    ASSERT_EQ(data.size(), buffer.size);
+    EXPECT_EQ(0, memcmp(buffer.data, data.data(), data.size()));
+    EXPECT_EQ(pts, buffer.timeStamp);
+}
+
+DECODEINPUTMP4_TEST(Samples)
+{
+    Mp4 mp4;
+    ASSERT_TRUE(mp4.open(makeMp4(defaultLayout())));
+    EXPECT_STREQ(YAMI_MIME_H264, mp4.getMimeType());
+    EXPECT_EQ(64, mp4.getWidth());
+    EXPECT_EQ(48, mp4.getHeight());
+    //parameter sets first, then the samples with start codes, 40ms apart in 90kHz
+    expectUnit(mp4, string("\0\0\0\x01\x67\x01\0\0\0\x01\x68\x02", 12), 0);
+    expectUnit(mp4, string("\0\0\0\x01\x65\x00", 6), 0);
+    expectUnit(mp4, string("\0\0\0\x01\x65\x01", 6), 3600);
+    expectUnit(mp4, string("\0\0\0\x01\x65\x02", 6), 7200);
+    VideoDecodeBuffer buffer;
+    EXPECT_FALSE(mp4.getNextDecodeUnit(buffer));
+    EXPECT_TRUE(mp4.isEOS());
+}
+
+DECODEINPUTMP4_TEST(Chunks)
+{
+    //two samples in the first chunk, one in the second
+    Mp4Layout l = defaultLayout();
+    l.samplesPerChunk = 2;
+    Mp4 mp4;
+    ASSERT_TRUE(mp4.open(makeMp4(l)));
+    VideoDecodeBuffer buffer;
+    ASSERT_TRUE(mp4.getNextDecodeUnit(buffer));
+    for (uint8_t i = 0; i < 3; i++) {
+        ASSERT_TRUE(mp4.getNextDecodeUnit(buffer));
+        ASSERT_EQ(6u, buffer.size);
+        EXPECT_EQ(i, buffer.data[5]);
+    }
+}
+
+DECODEINPUTMP4_TEST(Timescale)
+{
+    //version 1 mdhd, already in 90kHz, and a composition offset
+    Mp4Layout l = defaultLayout();
+    l.mdhdVersion = 1;
+    l.timescale = 90000;
+    l.delta = 3000;
+    l.secondOffset = 6000;
+    Mp4 mp4;
+    ASSERT_TRUE(mp4.open(makeMp4(l)));
+    VideoDecodeBuffer buffer;
+    ASSERT_TRUE(mp4.getNextDecodeUnit(buffer));
+    ASSERT_TRUE(mp4.getNextDecodeUnit(buffer));
+    EXPECT_EQ(0, buffer.timeStamp);
+    ASSERT_TRUE(mp4.getNextDecodeUnit(buffer));
+    EXPECT_EQ(9000, buffer.timeStamp);
+    ASSERT_TRUE(mp4.getNextDecodeUnit(buffer));
+    EXPECT_EQ(6000, buffer.timeStamp);
+}
+
+DECODEINPUTMP4_TEST(FixedSize)
+{
+    //every sample has the same size, stsz has no table
+    Mp4Layout l = defaultLayout();
+    l.fixedSize = 6;
+    Mp4 mp4;
+    EXPECT_TRUE(mp4.open(makeMp4(l)));
+
+    //a count the file can't hold is refused before the table is allocated
+    l.sampleCount = 0x40000000;
+    Mp4 huge;
+    EXPECT_FALSE(huge.open(makeMp4(l)));
+
+    //one the file could hold, but more than stsc and stco describe
+    l.fixedSize = 1;
+    l.sampleCount = 100;
+    Mp4 more;
+    EXPECT_FALSE(more.open(makeMp4(l)));
+}
+
+DECODEINPUTMP4_TEST(BadOffsets)
+{
+    //chunks pointing past the end of the file
+    Mp4Layout l = defaultLayout();
+    l.offsetError = 0x10000;
+    Mp4 mp4;
+    EXPECT_FALSE(mp4.open(makeMp4(l)));
+
+    //more samples than the chunks hold
+    l = defaultLayout();
+    l.sampleCount = 100;
+    Mp4 more;
+    EXPECT_FALSE(more.open(makeMp4(l)));
+}
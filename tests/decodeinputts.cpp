@@ -0,0 +1,399 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "decodeinputts.h"
+#include "inputfollower.h"
+#include "udpreceiver.h"
+#include "common/log.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TS_PACKET_SIZE 188
+#define TS_SYNC_BYTE 0x47
+#define TS_PAT_PID 0
+//read this many packets at a time
+#define TS_READ_PACKETS 256
+#define NO_GAP ((size_t)-1)
+
+enum {
+    STREAM_TYPE_MPEG1_VIDEO = 0x01,
+    STREAM_TYPE_MPEG2_VIDEO = 0x02,
+    STREAM_TYPE_H264 = 0x1b,
+    STREAM_TYPE_H265 = 0x24,
+};
+
+DecodeInputTs::DecodeInputTs()
+    : m_fd(-1)
+    , m_begin(0)
+    , m_end(0)
+    , m_readToEOS(false)
+    , m_packetSize(TS_PACKET_SIZE)
+    , m_pmtPid(-1)
+    , m_videoPid(-1)
+    , m_mime(NULL)
+    , m_pesStarted(false)
+    , m_continuity(-1)
+    , m_gapAt(NO_GAP)
+    , m_waitKeyframe(false)
+    , m_isEOS(false)
+{
+}
+
+DecodeInputTs::~DecodeInputTs()
+{
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+//make sure size bytes are buffered, return false if the input ends before
+bool DecodeInputTs::fill(size_t size)
+{
+    if (m_end - m_begin >= size)
+        return true;
+    if (m_begin) {
+        memmove(&m_buffer[0], &m_buffer[m_begin], m_end - m_begin);
+        m_end -= m_begin;
+        if (m_gapAt != NO_GAP)
+            m_gapAt = m_gapAt > m_begin ? m_gapAt - m_begin : 0;
+        m_begin = 0;
+    }
+    while (m_end < size && !m_readToEOS) {
+        ssize_t n;
+        if (m_receiver) {
+            bool discontinuity;
+            n = m_receiver->read(&m_buffer[m_end], m_buffer.size() - m_end, discontinuity);
+            if (discontinuity && m_gapAt == NO_GAP)
+                m_gapAt = m_end;
+        }
+        else if (m_follower)
+            n = m_follower->read(&m_buffer[m_end], m_buffer.size() - m_end);
+        else
+            n = read(m_fd, &m_buffer[m_end], m_buffer.size() - m_end);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            if (n < 0)
+                ERROR("read ts failed: %s", strerror(errno));
+            m_readToEOS = true;
+            break;
+        }
+        m_end += n;
+    }
+    return m_end - m_begin >= size;
+}
+
+bool DecodeInputTs::detectPacketSize()
+{
+    static const uint32_t sizes[] = { TS_PACKET_SIZE, TS_PACKET_SIZE + 4 };
+    static const uint32_t CHECK_PACKETS = 3;
+    fill(sizes[1] * (CHECK_PACKETS + 1));
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        uint32_t size = sizes[i];
+        uint32_t syncOffset = size - TS_PACKET_SIZE;
+        for (size_t start = 0; start < size && m_begin + start + size * CHECK_PACKETS <= m_end; start++) {
+            uint32_t j = 0;
+            for (; j < CHECK_PACKETS; j++) {
+                if (m_buffer[m_begin + start + j * size + syncOffset] != TS_SYNC_BYTE)
+                    break;
+            }
+            if (j == CHECK_PACKETS) {
+                m_packetSize = size;
+                m_begin += start;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+//next 188 byte packet, NULL at the end of input
+const uint8_t* DecodeInputTs::nextPacket()
+{
+    uint32_t syncOffset = m_packetSize - TS_PACKET_SIZE;
+    while (fill(m_packetSize)) {
+        if (m_begin >= m_gapAt) {
+            ERROR("lost datagrams before ts packet on pid %d", m_videoPid);
+            m_gapAt = NO_GAP;
+            resync();
+        }
+        const uint8_t* packet = &m_buffer[m_begin + syncOffset];
+        if (*packet != TS_SYNC_BYTE) {
+            //lost sync, look for it byte by byte
+            m_begin++;
+            continue;
+        }
+        m_begin += m_packetSize;
+        return packet;
+    }
+    return NULL;
+}
+
+bool DecodeInputTs::initStream(int fd, const std::vector<uint8_t>& peeked)
+{
+    m_fd = fd;
+    m_buffer.resize(std::max(peeked.size(), (size_t)(TS_PACKET_SIZE + 4) * TS_READ_PACKETS));
+    std::copy(peeked.begin(), peeked.end(), m_buffer.begin());
+    m_end = peeked.size();
+    return init();
+}
+
+bool DecodeInputTs::initUdp(const char* url, uint32_t idleMs)
+{
+    m_receiver.reset(new UdpReceiver);
+    if (!m_receiver->init(url, idleMs))
+        return false;
+    m_buffer.resize((TS_PACKET_SIZE + 4) * TS_READ_PACKETS);
+    //we join a live stream anywhere
+    m_waitKeyframe = true;
+    return init();
+}
+
+bool DecodeInputTs::init()
+{
+    if (!detectPacketSize()) {
+        ERROR("input is not a transport stream");
+        return false;
+    }
+    //find the video stream, its packets before the PMT are dropped
+    while (!m_mime) {
+        const uint8_t* packet = nextPacket();
+        if (!packet) {
+            ERROR("no supported video stream in the transport stream");
+            return false;
+        }
+        processPacket(packet);
+    }
+    return true;
+}
+
+//the section after pointer_field, return its body without the crc
+static const uint8_t* getSection(const uint8_t* payload, uint32_t size, uint32_t& sectionSize)
+{
+    if (!size || payload[0] + 1u > size)
+        return NULL;
+    size -= payload[0] + 1;
+    payload += payload[0] + 1;
+    if (size < 3)
+        return NULL;
+    uint32_t length = ((payload[1] & 0x0f) << 8) | payload[2];
+    //header after section_length is 5 bytes, crc is 4
+    if (length < 9 || length + 3 > size)
+        return NULL;
+    sectionSize = length - 9;
+    return payload + 8;
+}
+
+void DecodeInputTs::parsePat(const uint8_t* payload, uint32_t size)
+{
+    uint32_t sectionSize;
+    const uint8_t* p = getSection(payload, size, sectionSize);
+    if (!p)
+        return;
+    //first program, number 0 is the network PID
+    for (uint32_t i = 0; i + 4 <= sectionSize; i += 4) {
+        uint16_t program = (p[i] << 8) | p[i + 1];
+        if (program) {
+            m_pmtPid = ((p[i + 2] & 0x1f) << 8) | p[i + 3];
+            return;
+        }
+    }
+}
+
+void DecodeInputTs::parsePmt(const uint8_t* payload, uint32_t size)
+{
+    uint32_t sectionSize;
+    const uint8_t* p = getSection(payload, size, sectionSize);
+    if (!p || sectionSize < 4)
+        return;
+    uint32_t infoLength = ((p[2] & 0x0f) << 8) | p[3];
+    uint32_t i = 4 + infoLength;
+    while (i + 5 <= sectionSize) {
+        uint8_t type = p[i];
+        int pid = ((p[i + 1] & 0x1f) << 8) | p[i + 2];
+        uint32_t esInfoLength = ((p[i + 3] & 0x0f) << 8) | p[i + 4];
+        const char* mime = NULL;
+        switch (type) {
+        case STREAM_TYPE_H264:
+            mime = YAMI_MIME_H264;
+            break;
+        case STREAM_TYPE_H265:
+            mime = YAMI_MIME_H265;
+            break;
+        case STREAM_TYPE_MPEG1_VIDEO:
+        case STREAM_TYPE_MPEG2_VIDEO:
+            mime = YAMI_MIME_MPEG2;
+            break;
+        }
+        if (mime) {
+            m_videoPid = pid;
+            m_mime = mime;
+            return;
+        }
+        i += 5 + esInfoLength;
+    }
+}
+
+bool DecodeInputTs::processPacket(const uint8_t* packet)
+{
+    bool start = packet[1] & 0x40;
+    int pid = ((packet[1] & 0x1f) << 8) | packet[2];
+    uint8_t control = (packet[3] >> 4) & 3;
+    int continuity = packet[3] & 0x0f;
+    //no payload
+    if (!(control & 1))
+        return false;
+    uint32_t offset = 4;
+    if (control & 2)
+        offset += 1 + packet[4];
+    if (offset >= TS_PACKET_SIZE)
+        return false;
+    const uint8_t* payload = packet + offset;
+    uint32_t size = TS_PACKET_SIZE - offset;
+
+    if (pid == TS_PAT_PID) {
+        if (start && m_pmtPid < 0)
+            parsePat(payload, size);
+        return false;
+    }
+    if (pid == m_pmtPid) {
+        if (start && !m_mime)
+            parsePmt(payload, size);
+        return false;
+    }
+    if (pid != m_videoPid)
+        return false;
+
+    //a packet may be sent twice with the same counter, keep the first copy
+    if (continuity == m_continuity)
+        return false;
+    bool complete = false;
+    if (m_continuity >= 0 && continuity != ((m_continuity + 1) & 0x0f) && !m_waitKeyframe) {
+        //lost packets, the PES they were in is broken
+        ERROR("ts continuity error on pid %d", pid);
+        resync();
+    }
+    if (start) {
+        complete = m_pesStarted && !m_pes.empty();
+        if (complete)
+            std::swap(m_pes, m_unit);
+        m_pes.clear();
+        m_pesStarted = !m_waitKeyframe || isKeyframe(packet, payload, size);
+        if (m_pesStarted && m_waitKeyframe) {
+            INFO("ts resynced at a keyframe on pid %d", pid);
+            m_waitKeyframe = false;
+        }
+    }
+    m_continuity = continuity;
+    if (m_pesStarted)
+        m_pes.insert(m_pes.end(), payload, payload + size);
+    return complete;
+}
+
+void DecodeInputTs::resync()
+{
+    m_pes.clear();
+    m_pesStarted = false;
+    m_waitKeyframe = true;
+}
+
+//random access indicator, or a parameter set or intra picture in the
+//first packet of the PES
+bool DecodeInputTs::isKeyframe(const uint8_t* packet, const uint8_t* payload, uint32_t size)
+{
+    if ((packet[3] & 0x20) && packet[4] && (packet[5] & 0x40))
+        return true;
+    if (size < 9 || payload[0] || payload[1] || payload[2] != 1)
+        return false;
+    for (uint32_t i = 9 + payload[8]; i + 3 < size; i++) {
+        if (payload[i] || payload[i + 1] || payload[i + 2] != 1)
+            continue;
+        uint8_t code = payload[i + 3];
+        if (!strcmp(m_mime, YAMI_MIME_H264)) {
+            uint8_t type = code & 0x1f;
+            if (type == 5 || type == 7)
+                return true;
+        }
+        else if (!strcmp(m_mime, YAMI_MIME_H265)) {
+            //irap pictures, vps and sps
+            uint8_t type = (code >> 1) & 0x3f;
+            if ((type >= 16 && type <= 21) || type == 32 || type == 33)
+                return true;
+        }
+        else if (code == 0xb3) {
+            //mpeg2 sequence header
+            return true;
+        }
+        i += 2;
+    }
+    return false;
+}
+
+//payload and pts of the PES in m_unit
+bool DecodeInputTs::takePes(VideoDecodeBuffer& inputBuffer)
+{
+    const uint8_t* p = &m_unit[0];
+    size_t size = m_unit.size();
+    if (size < 9 || p[0] || p[1] || p[2] != 1) {
+        ERROR("bad PES header");
+        return false;
+    }
+    uint32_t headerSize = 9 + p[8];
+    if (headerSize >= size)
+        return false;
+    memset(&inputBuffer, 0, sizeof(inputBuffer));
+    //pts in 90kHz
+    if ((p[7] & 0x80) && p[8] >= 5) {
+        const uint8_t* t = p + 9;
+        inputBuffer.timeStamp = ((int64_t)(t[0] & 0x0e) << 29) | (t[1] << 22) | ((t[2] & 0xfe) << 14)
+            | (t[3] << 7) | (t[4] >> 1);
+    }
+    inputBuffer.data = &m_unit[headerSize];
+    inputBuffer.size = size - headerSize;
+    return true;
+}
+
+bool DecodeInputTs::getNextDecodeUnit(VideoDecodeBuffer& inputBuffer)
+{
+    while (!m_isEOS) {
+        const uint8_t* packet = nextPacket();
+        if (!packet) {
+            m_isEOS = true;
+            //the last PES ends with the input
+            if (!m_pesStarted || m_pes.empty())
+                return false;
+            std::swap(m_pes, m_unit);
+            m_pes.clear();
+            return takePes(inputBuffer);
+        }
+        if (processPacket(packet) && takePes(inputBuffer))
+            return true;
+    }
+    return false;
+}
+
+const string& DecodeInputTs::getCodecData()
+{
+    //parameter sets are in band
+    static const string dummy;
+    return dummy;
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef decodeinputts_h
+#define decodeinputts_h
+
+#include "decodeinput.h"
+
+#include <vector>
+
+class UdpReceiver;
+
+//mpeg-ts demuxer for h264, h265 and mpeg2 video.
+//it only reads forward, so pipes, fifos and udp work. a decode unit is one PES
+//packet, reassembled in a buffer that keeps its capacity between packets.
+//after lost packets it waits for the next keyframe.
+class DecodeInputTs : public DecodeInput
+{
+public:
+    DecodeInputTs();
+    virtual ~DecodeInputTs();
+    //receive from udp:// or rtp://, see UdpReceiver
+    bool initUdp(const char* url, uint32_t idleMs);
+    virtual bool isEOS() { return m_isEOS; }
+    virtual const char* getMimeType() { return m_mime; }
+    virtual bool getNextDecodeUnit(VideoDecodeBuffer& inputBuffer);
+    virtual const string& getCodecData();
+
+protected:
+    virtual bool initStream(int fd, const std::vector<uint8_t>& peeked);
+
+private:
+    bool init();
+    bool fill(size_t size);
+    bool detectPacketSize();
+    const uint8_t* nextPacket();
+    //return true when a PES is complete in m_pes
+    bool processPacket(const uint8_t* packet);
+    void parsePat(const uint8_t* payload, uint32_t size);
+    void parsePmt(const uint8_t* payload, uint32_t size);
+    bool takePes(VideoDecodeBuffer& inputBuffer);
+    //drop the PES and wait for a keyframe
+    void resync();
+    bool isKeyframe(const uint8_t* packet, const uint8_t* payload, uint32_t size);
+
+    int m_fd;
+    SharedPtr<UdpReceiver> m_receiver;
+    std::vector<uint8_t> m_buffer;
+    size_t m_begin;
+    size_t m_end;
+    bool m_readToEOS;
+    //188, or 192 for m2ts with a timecode before each packet
+    uint32_t m_packetSize;
+
+    int m_pmtPid;
+    int m_videoPid;
+    const char* m_mime;
+
+    //PES being reassembled, and the last one given to the decoder.
+    //they are swapped, so neither allocates after the first packets
+    std::vector<uint8_t> m_pes;
+    std::vector<uint8_t> m_unit;
+    bool m_pesStarted;
+    int m_continuity;
+    //where lost datagrams were in m_buffer, NO_GAP if none
+    size_t m_gapAt;
+    bool m_waitKeyframe;
+    bool m_isEOS;
+};
+
+#endif //decodeinputts_h
@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "decodeinputts.h"
+
+#include "common/unittest.h"
+
+#include <string.h>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+#define PMT_PID 0x100
+#define VIDEO_PID 0x101
+#define FRAME_SIZE 300
+#define FRAME_DURATION 3000
+
+//188 byte packets carrying data, the last one padded with an adaptation field
+static void addPackets(vector<string>& packets, int pid, const string& data, uint8_t& continuity)
+{
+    for (size_t i = 0; i < data.size(); i += 184) {
+        string chunk = data.substr(i, 184);
+        string packet(4, '\0');
+        packet[0] = 0x47;
+        packet[1] = (i ? 0 : 0x40) | (pid >> 8);
+        packet[2] = pid;
+        if (chunk.size() < 184) {
+            packet[3] = 0x30 | continuity;
+            uint8_t length = 183 - chunk.size();
+            packet += (char)length;
+            if (length)
+                packet += '\0' + string(length - 1, '\xff');
+        }
+        else
+            packet[3] = 0x10 | continuity;
+        packets.push_back(packet + chunk);
+        continuity = (continuity + 1) & 0x0f;
+    }
+}
+
+//a section padded to the end of its packet
+static string section(uint8_t tableId, const string& body)
+{
+    //5 byte header after section_length, 4 byte crc
+    uint32_t length = 5 + body.size() + 4;
+    string s(1, '\0');
+    s += (char)tableId;
+    s += (char)(0xb0 | (length >> 8));
+    s += (char)length;
+    s += string("\x00\x01\xc1\x00\x00", 5) + body + string(4, '\0');
+    return s + string(184 - s.size(), '\xff');
+}
+
+//an h264 slice, keyframes are IDR
+static string frame(uint8_t id, bool keyframe)
+{
+    string es("\x00\x00\x00\x01", 4);
+    es += keyframe ? '\x65' : '\x41';
+    es += (char)id;
+    return es + string(FRAME_SIZE - es.size(), '\x11');
+}
+
+//the frame in a PES with its pts
+static string pes(uint8_t id, bool keyframe)
+{
+    int64_t pts = id * FRAME_DURATION;
+    string header("\x00\x00\x01\xe0\x00\x00\x80\x80\x05", 9);
+    header += (char)(0x21 | ((pts >> 29) & 0x0e));
+    header += (char)(pts >> 22);
+    header += (char)(((pts >> 14) & 0xfe) | 1);
+    header += (char)(pts >> 7);
+    header += (char)(((pts << 1) & 0xfe) | 1);
+    return header + frame(id, keyframe);
+}
+
+//PAT, PMT, then a keyframe, a non keyframe and a keyframe, two packets each
+static vector<string> makeTs()
+{
+    vector<string> packets;
+    uint8_t patContinuity = 0, pmtContinuity = 0, videoContinuity = 0;
+    addPackets(packets, 0, section(0, string("\x00\x01", 2) + (char)(0xe0 | (PMT_PID >> 8)) + (char)(PMT_PID & 0xff)), patContinuity);
+    string stream("\x1b", 1);
+    stream += (char)(0xe0 | (VIDEO_PID >> 8));
+    stream += (char)(VIDEO_PID & 0xff);
+    stream += string("\xf0\x00", 2);
+    addPackets(packets, PMT_PID, section(2, string("\xe1\x01\xf0\x00", 4) + stream), pmtContinuity);
+    for (uint8_t i = 0; i < 3; i++)
+        addPackets(packets, VIDEO_PID, pes(i, i != 1), videoContinuity);
+    return packets;
+}
+
+static string join(const vector<string>& packets, const string& prefix = string())
+{
+    string ts;
+    for (size_t i = 0; i < packets.size(); i++)
+        ts += prefix + packets[i];
+    return ts;
+}
+
+#define DECODEINPUTTS_TEST(name) \
+    TEST(DecodeInputTsTest, name)
+
+class Ts : public DecodeInputTs {
+public:
+    bool open(const string& data)
+    {
+        m_file.reset(new TempFile(data));
+        return m_file->ok() && initInput(m_file->name());
+    }
+
+private:
+    SharedPtr<TempFile> m_file;
+};
+
+//the frames we get, in order
+static void expectFrames(Ts& ts, const vector<uint8_t>& ids)
+{
+    VideoDecodeBuffer buffer;
+    for (size_t i = 0; i < ids.size(); i++) {
+        ASSERT_TRUE(ts.getNextDecodeUnit(buffer));
+        string expected = frame(ids[i], ids[i] != 1);
+        ASSERT_EQ(expected.size(), buffer.size);
+        EXPECT_EQ(0, memcmp(buffer.data, expected.data(), expected.size()));
+        EXPECT_EQ(ids[i] * FRAME_DURATION, buffer.timeStamp);
+    }
+    EXPECT_FALSE(ts.getNextDecodeUnit(buffer));
+    EXPECT_TRUE(ts.isEOS());
+}
+
+static vector<uint8_t> frames(uint8_t a, int b = -1, int c = -1)
+{
+    vector<uint8_t> ids(1, a);
+    if (b >= 0)
+        ids.push_back(b);
+    if (c >= 0)
+        ids.push_back(c);
+    return ids;
+}
+
+DECODEINPUTTS_TEST(Pes)
+{
+    Ts ts;
+    ASSERT_TRUE(ts.open(join(makeTs())));
+    EXPECT_STREQ(YAMI_MIME_H264, ts.getMimeType());
+    expectFrames(ts, frames(0, 1, 2));
+}
+
+DECODEINPUTTS_TEST(M2ts)
+{
+    //a 4 byte timecode before each packet
+    Ts ts;
+    ASSERT_TRUE(ts.open(join(makeTs(), string("\x00\x00\x00\x00", 4))));
+    expectFrames(ts, frames(0, 1, 2));
+}
+
+DECODEINPUTTS_TEST(Duplicate)
+{
+    //the second packet of the first frame sent twice is dropped, not a loss
+    vector<string> packets = makeTs();
+    packets.insert(packets.begin() + 4, packets[3]);
+    Ts ts;
+    ASSERT_TRUE(ts.open(join(packets)));
+    expectFrames(ts, frames(0, 1, 2));
+}
+
+DECODEINPUTTS_TEST(Gap)
+{
+    //losing the second packet of frame 1 drops it, decoding resumes at frame 2
+    vector<string> packets = makeTs();
+    packets.erase(packets.begin() + 5);
+    Ts ts;
+    ASSERT_TRUE(ts.open(join(packets)));
+    expectFrames(ts, frames(0, 2));
+}
+
+DECODEINPUTTS_TEST(NotTs)
+{
+    Ts ts;
+    EXPECT_FALSE(ts.open(string(4096, '\0')));
+}
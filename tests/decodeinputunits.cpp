@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "decodeinputunits.h"
+#include "inputfollower.h"
+#include "common/common_def.h"
+#include "common/log.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define UNIT_FILE_VERSION 1
+
+struct UnitFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t codecDataSize;
+    char mime[40];
+};
+
+struct UnitHeader {
+    uint32_t size;
+    uint32_t flag;
+    int64_t timeStamp;
+};
+
+DecodeInputUnits::DecodeInputUnits()
+    : m_fd(-1)
+    , m_data((const uint8_t*)MAP_FAILED)
+    , m_size(0)
+    , m_next(0)
+    , m_isEOS(false)
+{
+}
+
+DecodeInputUnits::~DecodeInputUnits()
+{
+    if (m_data != MAP_FAILED)
+        munmap((void*)m_data, m_size);
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+bool DecodeInputUnits::initStream(int fd, const std::vector<uint8_t>& peeked)
+{
+    struct stat st;
+    if (!peeked.empty() || fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+        ERROR("unit files need to be mapped, they can't be read from a pipe");
+        close(fd);
+        return false;
+    }
+    m_fd = fd;
+    bool mapped = map(st.st_size);
+    //a followed file is mapped again when it grows
+    if (!m_follower) {
+        close(m_fd);
+        m_fd = -1;
+    }
+    if (!mapped)
+        return false;
+
+    UnitFileHeader header;
+    //the writer may not have finished the header yet
+    while (m_size < sizeof(header) && grow())
+        ;
+    if (m_size < sizeof(header)) {
+        ERROR("unit file is truncated");
+        return false;
+    }
+    memcpy(&header, m_data, sizeof(header));
+    if (memcmp(header.magic, UNIT_FILE_MAGIC, sizeof(header.magic)) || header.version != UNIT_FILE_VERSION) {
+        ERROR("not a version %d unit file", UNIT_FILE_VERSION);
+        return false;
+    }
+    while (header.codecDataSize > m_size - sizeof(header) && grow())
+        ;
+    if (header.codecDataSize > m_size - sizeof(header)) {
+        ERROR("unit file is truncated");
+        return false;
+    }
+    header.mime[sizeof(header.mime) - 1] = '\0';
+    m_mime = header.mime;
+    m_codecData.assign((const char*)m_data + sizeof(header), header.codecDataSize);
+    setResolution(header.width, header.height);
+    m_next = sizeof(header) + ALIGN8(header.codecDataSize);
+    return true;
+}
+
+bool DecodeInputUnits::map(size_t size)
+{
+    //an empty file has nothing to map yet
+    if (!size)
+        return true;
+    //shared and read only, the page cache is mapped without a copy and the
+    //last page sees what the writer adds to it, so growing is a mremap
+    void* data;
+    if (m_data == MAP_FAILED) {
+        //prefault it all, replay should not wait on the disk
+        data = mmap(NULL, size, PROT_READ, MAP_SHARED | MAP_POPULATE, m_fd, 0);
+    }
+    else {
+        data = mremap((void*)m_data, m_size, size, MREMAP_MAYMOVE);
+        if (data != MAP_FAILED)
+            madvise((uint8_t*)data + m_size, size - m_size, MADV_WILLNEED);
+    }
+    if (data == MAP_FAILED) {
+        ERROR("mmap unit file failed: %s", strerror(errno));
+        return false;
+    }
+    m_data = (const uint8_t*)data;
+    m_size = size;
+    return true;
+}
+
+bool DecodeInputUnits::grow()
+{
+    while (m_follower && m_follower->wait()) {
+        struct stat st;
+        if (fstat(m_fd, &st))
+            return false;
+        size_t size = st.st_size;
+        if (size <= m_size)
+            continue;
+        return map(size);
+    }
+    return false;
+}
+
+bool DecodeInputUnits::getNextDecodeUnit(VideoDecodeBuffer& inputBuffer)
+{
+    while ((m_next >= m_size || m_size - m_next < sizeof(UnitHeader)) && grow())
+        ;
+    if (m_next >= m_size || m_size - m_next < sizeof(UnitHeader)) {
+        m_isEOS = true;
+        return false;
+    }
+    while (((const UnitHeader*)(m_data + m_next))->size > m_size - m_next - sizeof(UnitHeader) && grow())
+        ;
+    const UnitHeader* unit = (const UnitHeader*)(m_data + m_next);
+    m_next += sizeof(UnitHeader);
+    if (unit->size > m_size - m_next) {
+        ERROR("unit file is truncated");
+        m_isEOS = true;
+        return false;
+    }
+    //the decoder interface is not const, it only reads the data
+    inputBuffer.data = (uint8_t*)m_data + m_next;
+    inputBuffer.size = unit->size;
+    inputBuffer.flag = unit->flag;
+    inputBuffer.timeStamp = unit->timeStamp;
+    m_next += ALIGN8((size_t)unit->size);
+    return true;
+}
+
+static bool writePadded(FILE* fp, const void* data, size_t size)
+{
+    static const uint8_t zeros[8] = { 0 };
+    size_t pad = ALIGN8(size) - size;
+    return fwrite(data, 1, size, fp) == size && fwrite(zeros, 1, pad, fp) == pad;
+}
+
+bool captureDecodeUnits(DecodeInput* input, const char* fileName, uint32_t maxUnits)
+{
+    FILE* fp = fopen(fileName, "wb");
+    if (!fp) {
+        fprintf(stderr, "fail to open unit file: %s\n", fileName);
+        return false;
+    }
+    UnitFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, UNIT_FILE_MAGIC, sizeof(header.magic));
+    header.version = UNIT_FILE_VERSION;
+    header.width = input->getWidth();
+    header.height = input->getHeight();
+    const string& codecData = input->getCodecData();
+    header.codecDataSize = codecData.size();
+    strncpy(header.mime, input->getMimeType(), sizeof(header.mime) - 1);
+
+    bool ret = writePadded(fp, &header, sizeof(header))
+        && writePadded(fp, codecData.data(), codecData.size());
+    uint32_t count = 0;
+    VideoDecodeBuffer buffer;
+    while (ret && count < maxUnits) {
+        memset(&buffer, 0, sizeof(buffer));
+        if (!input->getNextDecodeUnit(buffer))
+            break;
+        UnitHeader unit;
+        unit.size = buffer.size;
+        unit.flag = buffer.flag;
+        unit.timeStamp = buffer.timeStamp;
+        ret = writePadded(fp, &unit, sizeof(unit)) && writePadded(fp, buffer.data, buffer.size);
+        count++;
+    }
+    if (fclose(fp))
+        ret = false;
+    if (!ret) {
+        fprintf(stderr, "fail to write unit file: %s\n", fileName);
+        return false;
+    }
+    printf("captured %u units of %s to %s\n", count, input->getMimeType(), fileName);
+    return true;
+}
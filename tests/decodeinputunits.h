@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef decodeinputunits_h
+#define decodeinputunits_h
+
+#include "decodeinput.h"
+
+#define UNIT_FILE_MAGIC "YAMIUNIT"
+
+//replay of decode units recorded by captureDecodeUnits, for decoder
+//benchmarks without demuxing, parsing or disk reads. the file is mapped
+//and prefaulted, each unit is given to the decoder where it lies.
+//in follow mode the mapping grows with the file.
+//
+//layout, in host byte order: a 64 bytes header, the codec data, then for
+//each unit a 16 bytes header and its data. codec data and units are padded
+//to 8 bytes.
+class DecodeInputUnits : public DecodeInput
+{
+public:
+    DecodeInputUnits();
+    virtual ~DecodeInputUnits();
+    virtual bool isEOS() { return m_isEOS; }
+    virtual const char* getMimeType() { return m_mime.c_str(); }
+    virtual bool getNextDecodeUnit(VideoDecodeBuffer& inputBuffer);
+    virtual const string& getCodecData() { return m_codecData; }
+
+protected:
+    virtual bool initStream(int fd, const std::vector<uint8_t>& peeked);
+
+private:
+    //map the first size bytes of m_fd, growing the old mapping
+    bool map(size_t size);
+    //wait for a followed file to grow and map the new part
+    bool grow();
+
+    int m_fd;
+    const uint8_t* m_data;
+    size_t m_size;
+    size_t m_next;
+    string m_mime;
+    string m_codecData;
+    bool m_isEOS;
+};
+
+//write the codec data and up to maxUnits units of input to fileName
+bool captureDecodeUnits(DecodeInput* input, const char* fileName, uint32_t maxUnits);
+
+#endif //decodeinputunits_h
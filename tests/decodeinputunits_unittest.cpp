@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "decodeinputunits.h"
+#include "inputfollower.h"
+
+#include "common/unittest.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+#define UNIT_COUNT 3
+
+//units "unit0", "unit1", ... with pts 0, 1000, ...
+class FakeInput : public DecodeInput {
+public:
+    FakeInput()
+        : m_next(0)
+        , m_codecData("codec data")
+    {
+        setResolution(64, 48);
+    }
+    virtual bool isEOS() { return m_next == UNIT_COUNT; }
+    virtual const char* getMimeType() { return YAMI_MIME_H264; }
+    virtual bool getNextDecodeUnit(VideoDecodeBuffer& inputBuffer)
+    {
+        if (isEOS())
+            return false;
+        snprintf(m_unit, sizeof(m_unit), "unit%u", m_next);
+        inputBuffer.data = (uint8_t*)m_unit;
+        inputBuffer.size = strlen(m_unit);
+        inputBuffer.timeStamp = m_next * 1000;
+        m_next++;
+        return true;
+    }
+    virtual const string& getCodecData() { return m_codecData; }
+
+private:
+    uint32_t m_next;
+    string m_codecData;
+    char m_unit[16];
+};
+
+//a unit file captured from FakeInput
+static string makeUnits()
+{
+    TempFile file("");
+    if (!file.ok())
+        return string();
+    FakeInput input;
+    if (!captureDecodeUnits(&input, file.name(), UNIT_COUNT))
+        return string();
+    string data;
+    FILE* fp = fopen(file.name(), "rb");
+    char buffer[256];
+    size_t n;
+    while (fp && (n = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+        data.append(buffer, n);
+    if (fp)
+        fclose(fp);
+    return data;
+}
+
+#define DECODEINPUTUNITS_TEST(name) \
+    TEST(DecodeInputUnitsTest, name)
+
+class Units : public DecodeInputUnits {
+public:
+    //followMs 0 reads the file as it is
+    bool open(const char* fileName, uint32_t followMs)
+    {
+        int fd = ::open(fileName, O_RDONLY);
+        if (fd < 0)
+            return false;
+        if (followMs) {
+            m_follower.reset(new InputFollower);
+            if (!m_follower->init(fd, followMs)) {
+                close(fd);
+                return false;
+            }
+        }
+        return initStream(fd, std::vector<uint8_t>());
+    }
+};
+
+static void expectUnits(Units& units)
+{
+    EXPECT_STREQ(YAMI_MIME_H264, units.getMimeType());
+    EXPECT_EQ("codec data", units.getCodecData());
+    EXPECT_EQ(64, units.getWidth());
+    EXPECT_EQ(48, units.getHeight());
+    VideoDecodeBuffer buffer;
+    for (uint32_t i = 0; i < UNIT_COUNT; i++) {
+        ASSERT_TRUE(units.getNextDecodeUnit(buffer));
+        char expected[16];
+        snprintf(expected, sizeof(expected), "unit%u", i);
+        EXPECT_EQ(string(expected), string((const char*)buffer.data, buffer.size));
+        EXPECT_EQ(i * 1000, buffer.timeStamp);
+    }
+    EXPECT_FALSE(units.getNextDecodeUnit(buffer));
+    EXPECT_TRUE(units.isEOS());
+}
+
+DECODEINPUTUNITS_TEST(Replay)
+{
+    string data = makeUnits();
+    ASSERT_FALSE(data.empty());
+    TempFile file(data);
+    Units units;
+    ASSERT_TRUE(units.open(file.name(), 0));
+    expectUnits(units);
+}
+
+DECODEINPUTUNITS_TEST(Truncated)
+{
+    string data = makeUnits();
+    ASSERT_FALSE(data.empty());
+    TempFile empty("");
+    Units none;
+    EXPECT_FALSE(none.open(empty.name(), 0));
+
+    TempFile header(data.substr(0, 20));
+    Units partial;
+    EXPECT_FALSE(partial.open(header.name(), 0));
+}
+
+struct Writer {
+    const char* fileName;
+    string data;
+};
+
+static void* appendLater(void* arg)
+{
+    Writer* writer = (Writer*)arg;
+    usleep(50 * 1000);
+    FILE* fp = fopen(writer->fileName, "ab");
+    if (fp) {
+        fwrite(writer->data.data(), 1, writer->data.size(), fp);
+        fclose(fp);
+    }
+    return NULL;
+}
+
+DECODEINPUTUNITS_TEST(FollowHeader)
+{
+    //the file has only part of its header when we open it
+    string data = makeUnits();
+    ASSERT_FALSE(data.empty());
+    TempFile file(data.substr(0, 20));
+    Writer writer;
+    writer.fileName = file.name();
+    writer.data = data.substr(20);
+    pthread_t thread;
+    ASSERT_EQ(0, pthread_create(&thread, NULL, appendLater, &writer));
+    Units units;
+    bool opened = units.open(file.name(), 2000);
+    pthread_join(thread, NULL);
+    ASSERT_TRUE(opened);
+    expectUnits(units);
+}
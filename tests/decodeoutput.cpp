@@ -21,6 +21,7 @@
 #include "decodeoutput.h"
 #include "common/log.h"
 #include "common/VaapiUtils.h"
+#include "common/planecopy.h"
 
 #if __ENABLE_MD5__
 // including bsd/md5.h produces a warning with __bounded__ attribute,
@@ -55,8 +56,17 @@
 using namespace YamiMediaCodec;
 using std::vector;
 
+DecodeOutput::DecodeOutput()
+    : m_width(0)
+    , m_height(0)
+    , m_syncDepth(0)
+{
+}
+
 bool DecodeOutput::init()
 {
+    if (m_vaDisplay)
+        m_window.reset(new FrameSyncWindow(*m_vaDisplay, m_syncDepth));
     m_nativeDisplay.reset(new NativeDisplay);
     m_nativeDisplay->type = NATIVE_DISPLAY_VA;
     m_nativeDisplay->handle = (intptr_t)*m_vaDisplay;
@@ -85,11 +95,13 @@ public:
     ~DecodeOutputNull() {}
     bool init();
     bool output(const SharedPtr<VideoFrame>& frame);
+    bool flush();
 };
 
 bool DecodeOutputNull::init()
 {
-    m_vaDisplay = createVADisplay();
+    if (!m_vaDisplay)
+        m_vaDisplay = createVADisplay();
     if (!m_vaDisplay)
         return false;
     return DecodeOutput::init();
@@ -97,8 +109,18 @@ bool DecodeOutputNull::init()
 
 bool DecodeOutputNull::output(const SharedPtr<VideoFrame>& frame)
 {
-    VAStatus status = vaSyncSurface(*m_vaDisplay, (VASurfaceID)frame->surface);
-    return checkVaapiStatus(status, "vaSyncSurface");
+    SharedPtr<VideoFrame> ready;
+    return m_window->push(frame, ready);
+}
+
+bool DecodeOutputNull::flush()
+{
+    SharedPtr<VideoFrame> ready;
+    while (!m_window->empty()) {
+        if (!m_window->pop(ready))
+            return false;
+    }
+    return true;
 }
 
 class ColorConvert {
@@ -125,7 +147,7 @@ public:
         if (!init(width, height)) {
             return dest;
         }
-        dest = m_allocator->alloc();
+        dest = allocFrame(m_allocator, POOL_WAIT_MS);
         YamiStatus status = m_vpp->process(src, dest);
         if (status != YAMI_SUCCESS) {
             ERROR("vpp process return %d", status);
@@ -155,42 +177,65 @@ public:
         uint32_t planes, width[3], height[3];
         if (!getPlaneResolution(src->fourcc, src->crop.width, src->crop.height, width, height, planes)) {
             ERROR("get plane reoslution failed");
+            unmapImage(*m_display, image);
             return false;
         }
 
-        copyY(dest, p, image.offsets[0], width[0], height[0], image.pitches[0]);
-        copyUV(dest, p, image.offsets[1], width[1], height[1], image.pitches[1]);
-        copyUV(dest, p, image.offsets[1] + 1, width[1], height[1], image.pitches[1]);
+        uint32_t ySize = width[0] * height[0];
+        uint32_t uSize = width[1] / 2 * height[1];
+        dest.resize(ySize + uSize * 2);
+        if (ySize)
+            copyPlane(&dest[0], width[0], p + image.offsets[0], image.pitches[0], width[0], height[0], PLANE_COPY_READBACK);
+        if (uSize)
+            copyUV(&dest[ySize], &dest[ySize + uSize], p + image.offsets[1], width[1], height[1], image.pitches[1]);
         unmapImage(*m_display, image);
         return true;
     }
 
 private:
-    static void copyY(std::vector<uint8_t>& v, uint8_t* data, uint32_t offset, uint32_t width,
-        uint32_t height, uint32_t pitch)
-    {
-        data += offset;
-        for (uint32_t h = 0; h < height; h++) {
-            v.insert(v.end(), data, data + width);
-            data += pitch;
+    class DeinterleaveTask : public StripeTask {
+    public:
+        DeinterleaveTask(uint8_t* u, uint8_t* v, const uint8_t* uv, uint32_t size)
+            : m_u(u)
+            , m_v(v)
+            , m_uv(uv)
+            , m_size(size)
+        {
+        }
+        void run(uint32_t stripe, uint32_t stripes)
+        {
+            uint32_t len = (m_size + stripes - 1) / stripes;
+            uint32_t start = len * stripe;
+            if (start >= m_size)
+                return;
+            if (len > m_size - start)
+                len = m_size - start;
+            uint8_t* u = m_u + start;
+            uint8_t* v = m_v + start;
+            const uint8_t* uv = m_uv + start * 2;
+            for (uint32_t i = 0; i < len; i++) {
+                *u++ = uv[0];
+                *v++ = uv[1];
+                uv += 2;
+            }
         }
 
-    }
+    private:
+        uint8_t* m_u;
+        uint8_t* m_v;
+        const uint8_t* m_uv;
+        uint32_t m_size;
+    };
 
-    static void copyUV(std::vector<uint8_t>& v, uint8_t* data, uint32_t offset, uint32_t width,
+    //read the interleaved plane to system memory first, the mapped image is uncached
+    void copyUV(uint8_t* u, uint8_t* v, const uint8_t* data, uint32_t width,
         uint32_t height, uint32_t pitch)
     {
-        data += offset;
-        for (uint32_t h = 0; h < height; h++) {
-            uint8_t* start = data;
-            uint8_t* end = data + width;
-            while (start < end) {
-                v.push_back(*start);
-                start += 2 ;
-            }
-            data += pitch;
-        }
-
+        m_uv.resize(width * height);
+        copyPlane(&m_uv[0], width, data, pitch, width, height, PLANE_COPY_READBACK);
+        DeinterleaveTask task(u, v, &m_uv[0], m_uv.size() / 2);
+        StripePool& pool = StripePool::getInstance();
+        pool.run(task, pool.getStripes(m_uv.size()));
     }
 
     bool init(uint32_t width, uint32_t height)
@@ -219,6 +264,7 @@ private:
     SharedPtr<VADisplay> m_display;
     SharedPtr<FrameAllocator> m_allocator;
     SharedPtr<IVideoPostProcess> m_vpp;
+    vector<uint8_t> m_uv;
 };
 
 class DecodeOutputFile : public DecodeOutput {
@@ -231,8 +277,13 @@ public:
     }
     DecodeOutputFile() {}
     virtual bool init();
+    bool output(const SharedPtr<VideoFrame>& frame);
+    bool flush();
 
 protected:
+    //write a frame which is done on gpu
+    virtual bool write(const SharedPtr<VideoFrame>& frame) = 0;
+
     uint32_t m_destFourcc;
     const char* m_inputFile;
     const char* m_outputFile;
@@ -241,13 +292,34 @@ protected:
 
 bool DecodeOutputFile::init()
 {
-    m_vaDisplay = createVADisplay();
+    if (!m_vaDisplay)
+        m_vaDisplay = createVADisplay();
     if (!m_vaDisplay)
         return false;
     m_convert.reset(new ColorConvert(m_vaDisplay, m_destFourcc));
     return DecodeOutput::init();
 }
 
+bool DecodeOutputFile::output(const SharedPtr<VideoFrame>& frame)
+{
+    SharedPtr<VideoFrame> ready;
+    if (!m_window->push(frame, ready))
+        return false;
+    if (!ready)
+        return true;
+    return write(ready);
+}
+
+bool DecodeOutputFile::flush()
+{
+    SharedPtr<VideoFrame> ready;
+    while (!m_window->empty()) {
+        if (!m_window->pop(ready) || !write(ready))
+            return false;
+    }
+    return true;
+}
+
 class DecodeOutputDump : public DecodeOutputFile {
 public:
     DecodeOutputDump(const char* outputFile, const char* inputFile, uint32_t fourcc)
@@ -259,7 +331,7 @@ public:
 
 protected:
     bool setVideoSize(uint32_t width, uint32_t height);
-    bool output(const SharedPtr<VideoFrame>& frame);
+    bool write(const SharedPtr<VideoFrame>& frame);
 
 private:
     bool isI420Dest();
@@ -272,6 +344,7 @@ private:
 
 DecodeOutputDump::~DecodeOutputDump()
 {
+    flush();
     if (m_fp)
         fclose(m_fp);
 }
@@ -326,7 +399,7 @@ bool DecodeOutputDump::isI420Dest()
     return m_destFourcc == YAMI_FOURCC('I', '4', '2', '0');
 }
 
-bool DecodeOutputDump::output(const SharedPtr<VideoFrame>& frame)
+bool DecodeOutputDump::write(const SharedPtr<VideoFrame>& frame)
 {
     if (!setVideoSize(frame->crop.width, frame->crop.height))
         return false;
@@ -335,6 +408,9 @@ bool DecodeOutputDump::output(const SharedPtr<VideoFrame>& frame)
             return false;
         return fwrite(&m_data[0], 1, m_data.size(), m_fp) == m_data.size();
     }
+    //frames already in the format of the file skip the conversion
+    if (m_output->canPassThrough(frame))
+        return m_output->output(frame);
     SharedPtr<VideoFrame> dest = m_convert->convert(frame);
     return m_output->output(dest);
 }
@@ -350,7 +426,7 @@ public:
 
 protected:
     bool setVideoSize(uint32_t width, uint32_t height);
-    bool output(const SharedPtr<VideoFrame>& frame);
+    bool write(const SharedPtr<VideoFrame>& frame);
 
 private:
     std::string getOutputFileName(uint32_t width, uint32_t height);
@@ -412,6 +488,7 @@ std::string DecodeOutputMD5::writeToFile(MD5_CTX& t_ctx)
 
 DecodeOutputMD5::~DecodeOutputMD5()
 {
+    flush();
     if (m_file) {
         fprintf(m_file, "The whole frames MD5 ");
         std::string fileMd5 = writeToFile(m_fileMD5);
@@ -420,7 +497,7 @@ DecodeOutputMD5::~DecodeOutputMD5()
     }
 }
 
-bool DecodeOutputMD5::output(const SharedPtr<VideoFrame>& frame)
+bool DecodeOutputMD5::write(const SharedPtr<VideoFrame>& frame)
 {
     if (!setVideoSize(frame->crop.width, frame->crop.height))
         return false;
@@ -488,6 +565,7 @@ struct VADisplayTerminator {
     VADisplayTerminator() {}
     void operator()(VADisplay* display)
     {
+        SurfaceBudget::getInstance().flush(*display);
         vaTerminate(*display);
         delete display;
     }
@@ -715,7 +793,7 @@ bool DecodeOutputDmabuf::output(const SharedPtr<VideoFrame>& frame)
 {
     setVideoSize(frame->crop.width, frame->crop.height);
 
-    SharedPtr<VideoFrame> dest = m_allocator->alloc();
+    SharedPtr<VideoFrame> dest = allocFrame(m_allocator, POOL_WAIT_MS);
     YamiStatus result = m_vpp->process(frame, dest);
     if (result != YAMI_SUCCESS) {
         ERROR("vpp process failed, status = %d", result);
@@ -738,7 +816,8 @@ DecodeOutputDmabuf::DecodeOutputDmabuf(VideoDataMemoryType memoryType)
 #endif //__ENABLE_TESTS_GLES__
 #endif //__ENABLE_X11__
 
-DecodeOutput* DecodeOutput::create(int renderMode, uint32_t fourcc, const char* inputFile, const char* outputFile)
+DecodeOutput* DecodeOutput::create(int renderMode, uint32_t fourcc, const char* inputFile, const char* outputFile, uint32_t syncDepth,
+    const SharedPtr<VADisplay>& display)
 {
     DecodeOutput* output;
     switch (renderMode) {
@@ -773,6 +852,9 @@ DecodeOutput* DecodeOutput::create(int renderMode, uint32_t fourcc, const char*
         fprintf(stderr, "renderMode:%d, do not support this render mode\n", renderMode);
         return NULL;
     }
+    output->m_syncDepth = syncDepth;
+    if (renderMode <= 0)
+        output->m_vaDisplay = display;
     if (!output->init())
         fprintf(stderr, "DecodeOutput init failed\n");
     return output;
@@ -27,9 +27,15 @@
 class DecodeOutput
 {
 public:
-    static DecodeOutput* create(int renderMode, uint32_t fourcc, const char* inputFile, const char* outputFile);
+    //syncDepth: how many frames can be in flight before we wait on the oldest one
+    //display: share a display with other outputs, only -2, -1 and 0 render mode take it
+    static DecodeOutput* create(int renderMode, uint32_t fourcc, const char* inputFile, const char* outputFile, uint32_t syncDepth,
+        const SharedPtr<VADisplay>& display = SharedPtr<VADisplay>());
     virtual bool output(const SharedPtr<VideoFrame>& frame) = 0;
+    //output frames still in flight, call it at EOS
+    virtual bool flush() { return true; }
     SharedPtr<NativeDisplay> nativeDisplay();
+    DecodeOutput();
     virtual ~DecodeOutput() {}
 protected:
     virtual bool setVideoSize(uint32_t with, uint32_t height);
@@ -40,6 +46,8 @@ protected:
     uint32_t m_height;
     SharedPtr<VADisplay> m_vaDisplay;
     SharedPtr<NativeDisplay> m_nativeDisplay;
+    uint32_t m_syncDepth;
+    SharedPtr<FrameSyncWindow> m_window;
 };
 
 #endif //decodeoutput_h
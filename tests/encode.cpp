@@ -31,6 +31,7 @@
 #include "VideoEncoderInterface.h"
 #include "VideoEncoderHost.h"
 #include "encodeinput.h"
+#include "encodeoutputasync.h"
 #include "encodehelp.h"
 
 using namespace YamiMediaCodec;
@@ -38,12 +39,10 @@ using namespace YamiMediaCodec;
 int main(int argc, char** argv)
 {
     IVideoEncoder *encoder = NULL;
-    uint32_t maxOutSize = 0;
     EncodeInput* input;
     EncodeOutput* output;
     Encode_Status status;
     VideoFrameRawData inputBuffer;
-    VideoEncOutputBuffer outputBuffer;
     int encodeFrameCount = 0;
 
     yamiTraceInit();
@@ -51,7 +50,7 @@ int main(int argc, char** argv)
         return -1;
 
     DEBUG("inputFourcc: %.4s", (char*)(&(inputFourcc)));
-    input = EncodeInput::create(inputFileName, inputFourcc, videoWidth, videoHeight);
+    input = EncodeInput::create(inputFileName, inputFourcc, videoWidth, videoHeight, cameraMode);
     if (!input) {
         fprintf (stderr, "fail to init input stream\n");
         return -1;
@@ -71,8 +70,12 @@ int main(int argc, char** argv)
     assert(encoder != NULL);
 
     NativeDisplay nativeDisplay;
-    nativeDisplay.type = NATIVE_DISPLAY_DRM;
-    nativeDisplay.handle = -1;
+    //decoded input stays in surfaces, the encoder shares the decoder's display
+    bool surfaceInput = input->getNativeDisplay(nativeDisplay);
+    if (!surfaceInput) {
+        nativeDisplay.type = NATIVE_DISPLAY_DRM;
+        nativeDisplay.handle = -1;
+    }
     encoder->setNativeDisplay(&nativeDisplay);
 
     //configure encoding parameters
@@ -99,55 +102,44 @@ int main(int argc, char** argv)
     status = encoder->start();
     assert(status == ENCODE_SUCCESS);
 
-    //init output buffer
-    encoder->getMaxOutSize(&maxOutSize);
-
+    //output is drained in its own thread, the loop below only feeds input
+    EncodeOutputAsync async;
+    //camera buffers are requeued only after the encoder is done with them
+    if (!surfaceInput)
+        async.setRecycler(input);
 #ifdef __BUILD_GET_MV__
-    uint32_t size;
-    VideoEncMVBuffer MVBuffer;
     MVFp = fopen("feimv.bin","wb");
-    encoder->getMVBufferSize(&size);
-    if (!createMVBuffer(&MVBuffer, size)) {
-        fprintf (stderr, "fail to create MV buffer\n");
-        return -1;
-    }
+    async.setMVFile(MVFp);
 #endif
-    if (!createOutputBuffer(&outputBuffer, maxOutSize)) {
+    if (!async.start(encoder, output, inFlight)) {
         fprintf (stderr, "fail to create output\n");
         delete input;
         delete output;
         return -1;
     }
+    bool ret = true;
     uint64_t i = 0;
     while (!input->isEOS())
     {
-        memset(&inputBuffer, 0, sizeof(inputBuffer));
-        if (input->getOneFrameInput(inputBuffer)) {
-            inputBuffer.timeStamp = i++;
-            status = encoder->encode(&inputBuffer);
-            ASSERT(status == ENCODE_SUCCESS);
-            input->recycleOneFrameInput(inputBuffer);
+        if (surfaceInput) {
+            //the encoder holds the frame until it is coded, then it goes back to the decoder
+            SharedPtr<VideoFrame> frame;
+            if (!input->getOneSurfaceInput(frame))
+                break;
+            frame->timeStamp = i++;
+            ret = async.encode(frame);
         }
-        else
-            break;
-
-        //get the output buffer
-        do {
-#ifndef __BUILD_GET_MV__
-            status = encoder->getOutput(&outputBuffer, false);
-#else
-            status = encoder->getOutput(&outputBuffer, &MVBuffer, false);
-#endif
-            if (status == ENCODE_SUCCESS
-                && output->write(outputBuffer.data, outputBuffer.dataSize)) {
-                DEBUG("timeStamp(PTS) : " "%" PRIu64 "\n", outputBuffer.timeStamp);
-            }
-#ifdef __BUILD_GET_MV__
-            if (status == ENCODE_SUCCESS) {
-                fwrite(MVBuffer.data, MVBuffer.bufferSize, 1, MVFp);
+        else {
+            memset(&inputBuffer, 0, sizeof(inputBuffer));
+            if (input->getOneFrameInput(inputBuffer)) {
+                inputBuffer.timeStamp = i++;
+                ret = async.encode(&inputBuffer);
             }
-#endif
-        } while (status != ENCODE_BUFFER_NO_MORE);
+            else
+                break;
+        }
+        if (!ret)
+            break;
 
         encodeFrameCount++;
 
@@ -156,32 +148,20 @@ int main(int argc, char** argv)
     }
 
     // drain the output buffer
-    do {
-#ifndef __BUILD_GET_MV__
-       status = encoder->getOutput(&outputBuffer, true);
-#else
-       status = encoder->getOutput(&outputBuffer, &MVBuffer, true);
-#endif
-       if (status == ENCODE_SUCCESS
-           && output->write(outputBuffer.data, outputBuffer.dataSize)) {
-           DEBUG("timeStamp(PTS) : " "%" PRIu64 "\n", outputBuffer.timeStamp);
-       }
-#ifdef __BUILD_GET_MV__
-        if (status == ENCODE_SUCCESS) {
-            fwrite(MVBuffer.data, MVBuffer.bufferSize, 1, MVFp);
-        }
-#endif
-    } while (status != ENCODE_BUFFER_NO_MORE);
+    if (!async.finish())
+        ret = false;
 
     encoder->stop();
     releaseVideoEncoder(encoder);
-    free(outputBuffer.data);
     delete output;
     delete input;
 #ifdef __BUILD_GET_MV__
-    free(MVBuffer.data);
     fclose(MVFp);
 #endif
+    if (!ret) {
+        fprintf(stderr, "encode failed\n");
+        return -1;
+    }
     fprintf(stderr, "encode done\n");
     return 0;
 }
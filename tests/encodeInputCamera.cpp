@@ -26,6 +26,7 @@
 #include <errno.h>
 #include <sys/mman.h>
 #include <sys/ioctl.h>
+#include <sys/epoll.h>
 #include <linux/videodev2.h>
 #include "common/log.h"
 #include "common/utils.h"
@@ -44,10 +45,34 @@
         }                                                       \
     }while(0)
 
+//no frame in 2 seconds, the camera is gone
+#define FRAME_TIMEOUT_MS 2000
+
+bool EncodeInputCamera::setDataMode(const char* mode)
+{
+    if (!mode || !strcasecmp(mode, "mmap"))
+        return setDataMode(CAMERA_DATA_MODE_MMAP);
+    if (!strcasecmp(mode, "dmabuf"))
+        return setDataMode(CAMERA_DATA_MODE_DMABUF_MMAP);
+    if (!strcasecmp(mode, "userptr"))
+        return setDataMode(CAMERA_DATA_MODE_USRPTR);
+    ERROR("unsupported camera data mode %s", mode);
+    return false;
+}
+
+uint32_t EncodeInputCamera::getV4L2Memory()
+{
+    //dmabuf mode exports the mmap buffers, the capture queue is still a mmap queue
+    if (m_dataMode == CAMERA_DATA_MODE_USRPTR)
+        return V4L2_MEMORY_USERPTR;
+    return V4L2_MEMORY_MMAP;
+}
+
 bool EncodeInputCamera::initDevice(const char *cameraDevicePath)
 {
     struct v4l2_capability cap;
     struct v4l2_format fmt;
+    struct epoll_event event;
     bool ret = true;
 
     INFO();
@@ -66,16 +91,10 @@ bool EncodeInputCamera::initDevice(const char *cameraDevicePath)
         return false;
     }
 
-    switch (m_dataMode) {
-    case CAMERA_DATA_MODE_MMAP:
-        if (!(cap.capabilities & V4L2_CAP_STREAMING)) {
-            ERROR("camera device does not support video streaming\n");
-            return false;
-        }
-    break;
-    default:
-        ERROR("unsupported camera data mode");
-    break;
+    // all modes are streaming io
+    if (!(cap.capabilities & V4L2_CAP_STREAMING)) {
+        ERROR("camera device does not support video streaming\n");
+        return false;
     }
 
     // set video format and resolution, XXX get supported formats/resolutions first
@@ -92,40 +111,74 @@ bool EncodeInputCamera::initDevice(const char *cameraDevicePath)
         m_width = fmt.fmt.pix.width;
         m_height = fmt.fmt.pix.height;
     }
-
+    m_pitch = fmt.fmt.pix.bytesperline;
 
     switch (m_dataMode) {
     case CAMERA_DATA_MODE_MMAP:
         ret = initMmap();
-        ASSERT(ret);
+        break;
+    case CAMERA_DATA_MODE_DMABUF_MMAP:
+        ret = initDmabuf();
+        break;
+    case CAMERA_DATA_MODE_USRPTR:
+        ret = initUserptr(fmt.fmt.pix.sizeimage);
         break;
     default:
-        ERROR("unsupported yet");
+        ERROR("unsupported camera data mode");
+        ret = false;
         break;
     }
+    if (!ret)
+        return false;
+
+    // wait for frames with epoll, the fd set is built once instead of on every frame
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epollFd == -1) {
+        ERROR("epoll_create1 failed: %s", strerror(errno));
+        return false;
+    }
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = m_fd;
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_fd, &event) == -1) {
+        ERROR("epoll_ctl failed: %s", strerror(errno));
+        return false;
+    }
 
     return true;
 }
 
-bool EncodeInputCamera::initMmap(void)
+bool EncodeInputCamera::requestBuffers(uint32_t memory)
 {
     struct v4l2_requestbuffers rqbufs;
-    uint32_t index;
 
-    INFO();
     memset(&rqbufs, 0, sizeof(rqbufs));
     rqbufs.count = m_frameBufferCount;
-    rqbufs.memory = V4L2_MEMORY_MMAP;
+    rqbufs.memory = memory;
     rqbufs.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 
     IOCTL_CHECK_RET(m_fd, VIDIOC_REQBUFS, "VIDIOC_REQBUFS", rqbufs, false);
     INFO("rqbufs.count: %d\n", rqbufs.count);
+    if (!rqbufs.count) {
+        ERROR("no capture buffer");
+        return false;
+    }
 
     m_frameBuffers.resize(rqbufs.count);
     m_frameBufferCount = rqbufs.count;
+    return true;
+}
+
+bool EncodeInputCamera::initMmap(void)
+{
+    uint32_t index;
+
+    INFO();
+    if (!requestBuffers(V4L2_MEMORY_MMAP))
+        return false;
 
     DEBUG("map video frames: ");
-    for (index = 0; index < rqbufs.count; ++index) {
+    for (index = 0; index < m_frameBufferCount; ++index) {
         struct v4l2_buffer buf;
         memset(&buf, 0, sizeof(buf));
         buf.type        = V4L2_BUF_TYPE_VIDEO_CAPTURE;
@@ -152,33 +205,80 @@ bool EncodeInputCamera::initMmap(void)
     return true;
 }
 
+bool EncodeInputCamera::initDmabuf(void)
+{
+    uint32_t index;
+
+    INFO();
+    if (!requestBuffers(V4L2_MEMORY_MMAP))
+        return false;
+
+    // export the capture buffers, the encoder imports them and no one touches the pixels on cpu
+    m_dmabufFds.resize(m_frameBufferCount, -1);
+    for (index = 0; index < m_frameBufferCount; ++index) {
+        struct v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        buf.type        = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory      = V4L2_MEMORY_MMAP;
+        buf.index       = index;
+        IOCTL_CHECK_RET(m_fd, VIDIOC_QUERYBUF, "VIDIOC_QUERYBUF", buf, false);
+        m_frameBufferSize = buf.length;
+
+        struct v4l2_exportbuffer expbuf;
+        memset(&expbuf, 0, sizeof(expbuf));
+        expbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        expbuf.index = index;
+        expbuf.flags = O_CLOEXEC | O_RDWR;
+        IOCTL_CHECK_RET(m_fd, VIDIOC_EXPBUF, "VIDIOC_EXPBUF", expbuf, false);
+        m_dmabufFds[index] = expbuf.fd;
+        m_frameBuffers[index] = NULL;
+
+        DEBUG("index: %d, buf.length: %d, dmabuf: %d", index, buf.length, expbuf.fd);
+    }
+
+    return true;
+}
+
+bool EncodeInputCamera::initUserptr(uint32_t imageSize)
+{
+    uint32_t index;
+    long pageSize = sysconf(_SC_PAGESIZE);
+
+    INFO();
+    if (!requestBuffers(V4L2_MEMORY_USERPTR))
+        return false;
+
+    // the driver pins the pages, whole pages keep it away from our other data
+    m_frameBufferSize = (imageSize + pageSize - 1) & ~(pageSize - 1);
+    for (index = 0; index < m_frameBufferCount; ++index) {
+        void* buffer = NULL;
+        if (posix_memalign(&buffer, pageSize, m_frameBufferSize)) {
+            ERROR("allocate user buffer failed");
+            m_frameBuffers[index] = NULL;
+            return false;
+        }
+        m_frameBuffers[index] = (uint8_t*)buffer;
+        DEBUG("index: %d, size: %d, addr: %p", index, m_frameBufferSize, buffer);
+    }
+
+    return true;
+}
+
 bool EncodeInputCamera::startCapture(void)
 {
     unsigned int i;
     enum v4l2_buf_type type;
 
     INFO();
-    switch (m_dataMode) {
-    case CAMERA_DATA_MODE_MMAP:
-        for (i = 0; i < m_frameBufferCount; ++i) {
-            struct v4l2_buffer buf;
-            memset(&buf, 0, sizeof(buf));
-            buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-            buf.memory = V4L2_MEMORY_MMAP;
-            buf.index = i;
-
-            IOCTL_CHECK_RET(m_fd, VIDIOC_QBUF, "VIDIOC_QBUF", buf, false);
-        }
-
-        type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        IOCTL_CHECK_RET(m_fd, VIDIOC_STREAMON, "VIDIOC_STREAMON", type, false);
-        INFO("STREAMON ok\n");
-        break;
-    default:
-        ASSERT(0);
-        break;
+    for (i = 0; i < m_frameBufferCount; ++i) {
+        if (!enqueFrame(i))
+            return false;
     }
 
+    type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    IOCTL_CHECK_RET(m_fd, VIDIOC_STREAMON, "VIDIOC_STREAMON", type, false);
+    INFO("STREAMON ok\n");
+
     return true;
 }
 
@@ -199,11 +299,28 @@ bool EncodeInputCamera::init(const char* cameraPath, uint32_t fourcc, int width,
     ASSERT(ret);
     ret = startCapture();
     ASSERT(ret);
-    m_dataMode = CAMERA_DATA_MODE_MMAP;
 
     return true;
 }
 
+bool EncodeInputCamera::waitFrame()
+{
+    struct epoll_event event;
+    while (1) {
+        int ret = epoll_wait(m_epollFd, &event, 1, FRAME_TIMEOUT_MS);
+        if (ret > 0)
+            return true;
+        if (!ret) {
+            ERROR("wait frame timeout\n");
+            return false;
+        }
+        if (errno != EINTR) {
+            ERROR("epoll_wait failed: %s", strerror(errno));
+            return false;
+        }
+    }
+}
+
 int32_t EncodeInputCamera::dequeFrame(void)
 {
     struct v4l2_buffer buf;
@@ -211,58 +328,27 @@ int32_t EncodeInputCamera::dequeFrame(void)
 
     INFO();
     memset(&buf, 0, sizeof(buf));
-
-    switch (m_dataMode) {
-    case CAMERA_DATA_MODE_MMAP: {
-        // poll until there is available frames
-        while(1) {
-            fd_set fds;
-            struct timeval tv;
-
-            FD_ZERO(&fds);
-            FD_SET(m_fd, &fds);
-
-            /* Timeout. */
-            tv.tv_sec = 2;
-            tv.tv_usec = 0;
-
-            ret= select(m_fd + 1, &fds, NULL, NULL, &tv);
-
-            if (-1 == ret) {
-                if (EINTR == errno)
-                    continue;
-                ERROR("select failed");
-                return -1;
-            } else if (0 == ret) {
-                ERROR("select timeout\n");
-                return -1;
-            } else
-                break;
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = getV4L2Memory();
+
+    // try first, we only sleep in the kernel when the camera is behind us
+    while (1) {
+        ret = ioctl(m_fd, VIDIOC_DQBUF, &buf);
+        if (ret != -1)
+            break;
+        if (errno == EINTR)
+            continue;
+        if (errno != EAGAIN) {
+            ERROR("VIDIOC_DQBUF failed: %s", strerror(errno));
+            return -1;
         }
-
-
-        DEBUG("get one frame");
-        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_MMAP;
-        buf.length = m_frameBufferSize;
-
-        do {
-            ret = ioctl(m_fd, VIDIOC_DQBUF, &buf);
-            if (-1 == ret) {
-                usleep(5000);
-            } else
-                break;
-        } while (errno == EAGAIN || EINTR == errno);
-
-        ASSERT(ret != -1);
-        ASSERT(buf.index < m_frameBufferCount);
-    }
-    break;
-    default:
-        ASSERT(0);
-        break;
+        if (!waitFrame())
+            return -1;
     }
 
+    DEBUG("get one frame");
+    ASSERT(buf.index < m_frameBufferCount);
+
     return buf.index;
 }
 
@@ -272,34 +358,40 @@ bool EncodeInputCamera::enqueFrame(int32_t index)
     struct v4l2_buffer buf;
     memset(&buf, 0, sizeof(buf));
 
-    switch (m_dataMode) {
-    case CAMERA_DATA_MODE_MMAP:
-        DEBUG("recycle one frame (index: %d)\n", index);
-        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_MMAP;
-        buf.index = index;
-        buf.length = m_frameBufferSize;
+    DEBUG("recycle one frame (index: %d)\n", index);
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = getV4L2Memory();
+    buf.index = index;
+    buf.length = m_frameBufferSize;
+    if (m_dataMode == CAMERA_DATA_MODE_USRPTR)
+        buf.m.userptr = (unsigned long)m_frameBuffers[index];
 
-        IOCTL_CHECK_RET(m_fd, VIDIOC_QBUF, "VIDIOC_QBUF", buf, false);
-        break;
-    default:
-        ASSERT(0);
-        break;
-    }
+    IOCTL_CHECK_RET(m_fd, VIDIOC_QBUF, "VIDIOC_QBUF", buf, false);
     return true;
 }
 
 bool EncodeInputCamera::getOneFrameInput(VideoFrameRawData &inputBuffer)
 {
     int frameIndex = dequeFrame();
-    ASSERT((frameIndex >= 0) && ((uint32_t)frameIndex < m_frameBufferCount));
+    if (frameIndex < 0)
+        return false;
+    ASSERT((uint32_t)frameIndex < m_frameBufferCount);
 
     memset(&inputBuffer, 0, sizeof(inputBuffer));
     bool ret = fillFrameRawData(&inputBuffer, m_fourcc, m_width, m_height, m_frameBuffers[frameIndex]);
-    if(ret)
-        inputBuffer.internalID = frameIndex;
+    if (!ret)
+        return false;
 
-    return ret;
+    inputBuffer.internalID = frameIndex;
+    if (m_dataMode == CAMERA_DATA_MODE_DMABUF_MMAP) {
+        // packed yuyv, one plane at offset 0
+        inputBuffer.memoryType = VIDEO_DATA_MEMORY_TYPE_DMA_BUF;
+        inputBuffer.handle = m_dmabufFds[frameIndex];
+        if (m_pitch)
+            inputBuffer.pitch[0] = m_pitch;
+    }
+
+    return true;
 }
 
 bool EncodeInputCamera::recycleOneFrameInput(VideoFrameRawData &inputBuffer)
@@ -317,15 +409,8 @@ bool EncodeInputCamera::stopCapture(void)
     enum v4l2_buf_type type;
 
     INFO();
-    switch (m_dataMode) {
-    case CAMERA_DATA_MODE_MMAP:
-        type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        IOCTL_CHECK_RET(m_fd, VIDIOC_STREAMOFF, "VIDIOC_STREAMOFF", type, false);
-    break;
-    default:
-        ASSERT(0);
-    break;
-    }
+    type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    IOCTL_CHECK_RET(m_fd, VIDIOC_STREAMOFF, "VIDIOC_STREAMOFF", type, false);
 
     return true;
 }
@@ -343,10 +428,33 @@ bool EncodeInputCamera::uninitDevice()
                 return false;
             }
         break;
+    case CAMERA_DATA_MODE_DMABUF_MMAP:
+        for (i = 0; i < m_dmabufFds.size(); ++i)
+            if (m_dmabufFds[i] != -1)
+                close(m_dmabufFds[i]);
+        m_dmabufFds.clear();
+        break;
+    case CAMERA_DATA_MODE_USRPTR: {
+        // the driver may still hold the pages until the queue is released
+        struct v4l2_requestbuffers rqbufs;
+        memset(&rqbufs, 0, sizeof(rqbufs));
+        rqbufs.memory = V4L2_MEMORY_USERPTR;
+        rqbufs.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        IOCTL_CHECK_RET(m_fd, VIDIOC_REQBUFS, "VIDIOC_REQBUFS", rqbufs, false);
+        for (i = 0; i < m_frameBuffers.size(); ++i)
+            free(m_frameBuffers[i]);
+        break;
+    }
     default:
         ASSERT(0);
         break;
     }
+    m_frameBuffers.clear();
+
+    if (m_epollFd != -1) {
+        close(m_epollFd);
+        m_epollFd = -1;
+    }
 
     if (-1 == close(m_fd)) {
         ERROR("close device failed\n");
@@ -361,10 +469,11 @@ EncodeInputCamera::~EncodeInputCamera()
 {
     bool ret = true;
 
+    if (m_fd == -1)
+        return;
     ret = stopCapture();
     ASSERT(ret);
     ret = uninitDevice();
     ASSERT(ret);
 }
 
-
@@ -85,6 +85,36 @@ bool recycleOneFrameInput(EncodeInputHandler input, VideoFrameRawData *inputBuff
         return false;
 }
 
+bool getInputNativeDisplay(EncodeInputHandler input, NativeDisplay* display)
+{
+    if (input && display)
+        return ((EncodeInput*)input)->getNativeDisplay(*display);
+    else
+        return false;
+}
+
+static void freeSurfaceInput(VideoFrame* frame)
+{
+    delete (SharedPtr<VideoFrame>*)frame->user_data;
+    delete frame;
+}
+
+bool getOneSurfaceInput(EncodeInputHandler input, VideoFrame** frame)
+{
+    if (!input || !frame)
+        return false;
+    SharedPtr<VideoFrame> surface;
+    if (!((EncodeInput*)input)->getOneSurfaceInput(surface))
+        return false;
+    //the copy keeps the decoder's frame alive until the encoder frees it
+    VideoFrame* f = new VideoFrame;
+    *f = *surface;
+    f->user_data = (intptr_t) new SharedPtr<VideoFrame>(surface);
+    f->free = freeSurfaceInput;
+    *frame = f;
+    return true;
+}
+
 bool writeOutput(EncodeOutputHandler output, void* data, int size)
 {
     if(output)
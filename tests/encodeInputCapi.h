@@ -44,6 +44,14 @@ bool getOneFrameInput(EncodeInputHandler input, VideoFrameRawData *inputBuffer);
 
 bool recycleOneFrameInput(EncodeInputHandler input, VideoFrameRawData *inputBuffer);
 
+/* surface input, only inputs decoded on the gpu have it.
+   set the display to the encoder with encodeSetNativeDisplay before encodeStart */
+bool getInputNativeDisplay(EncodeInputHandler input, NativeDisplay* display);
+
+/* the frame goes to encodeEncode as it is, the encoder calls frame->free(frame).
+   call frame->free(frame) yourself if you drop it */
+bool getOneSurfaceInput(EncodeInputHandler input, VideoFrame** frame);
+
 bool writeOutput(EncodeOutputHandler output, void* data, int size);
 
 void releaseEncodeInput(EncodeInputHandler input);
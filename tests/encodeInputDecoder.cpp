@@ -19,20 +19,34 @@
 #endif
 
 #include "encodeInputDecoder.h"
+#include "vppinputoutput.h"
 #include "common/log.h"
 #include "common/VaapiUtils.h"
 #include "assert.h"
 
-EncodeInputDecoder::EncodeInputDecoder(DecodeInput* input)
+//encoders hold input frames until they are coded, e.g. for b frames
+#define VPP_SURFACES 8
+
+EncodeInputDecoder::EncodeInputDecoder(DecodeInput* input, uint32_t syncDepth)
     : m_input(input)
     , m_decoder(NULL)
+    , m_inputEOS(false)
     , m_isEOS(false)
+    , m_syncDepth(syncDepth)
     , m_id(0)
+    , m_allocatorWidth(0)
+    , m_allocatorHeight(0)
 {
 }
 EncodeInputDecoder::~EncodeInputDecoder()
 {
+    m_images.clear();
+    m_window.reset();
+    m_vpp.reset();
+    m_allocator.reset();
     if (m_decoder) {
+        //surfaces kept by the budget belong to the decoder's display
+        SurfaceBudget::getInstance().flush(m_decoder->getDisplayID());
         m_decoder->stop();
         releaseVideoDecoder(m_decoder);
     }
@@ -52,6 +66,7 @@ bool EncodeInputDecoder::init(const char* /*inputFileName*/, uint32_t /*fourcc*/
     configBuffer.profile = VAProfileNone;
     Decode_Status status = m_decoder->start(&configBuffer);
     assert(status == DECODE_SUCCESS);
+    m_window.reset(new FrameSyncWindow(m_decoder->getDisplayID(), m_syncDepth));
 
     while (!m_width || !m_height) {
         if (!decodeOneFrame())
@@ -69,7 +84,7 @@ bool EncodeInputDecoder::decodeOneFrame()
         memset(&inputBuffer, 0, sizeof(inputBuffer));
         //flush decoder
         m_decoder->decode(&inputBuffer);
-        m_isEOS = true;
+        m_inputEOS = true;
         return true;
     }
     Decode_Status status = m_decoder->decode(&inputBuffer);
@@ -141,28 +156,35 @@ private:
 
 bool EncodeInputDecoder::getOneFrameInput(VideoFrameRawData &inputBuffer)
 {
-    if (!m_decoder)
+    if (!m_decoder || m_isEOS)
         return false;
     if (m_input->isEOS()) {
-        m_isEOS = true;
+        m_inputEOS = true;
     }
+    //keep decoding until the window gives us a frame done on gpu
     SharedPtr<VideoFrame> frame;
-    do {
-        frame = m_decoder->getOutput();
-        if (frame) {
-            SharedPtr<MyRawImage> image = MyRawImage::create(m_decoder->getDisplayID(), frame, inputBuffer);
-            if (!image)
+    while (!frame) {
+        SharedPtr<VideoFrame> decoded = m_decoder->getOutput();
+        if (decoded) {
+            if (!m_window->push(decoded, frame))
                 return false;
-            inputBuffer.internalID = m_id;
-            m_images[m_id++] = image;
         }
-        else {
-            if (m_isEOS)
+        else if (m_inputEOS) {
+            if (!m_window->pop(frame)) {
+                m_isEOS = true;
                 return false;
+            }
+        }
+        else {
             if (!decodeOneFrame())
                 return false;
         }
-    } while (!frame);
+    }
+    SharedPtr<MyRawImage> image = MyRawImage::create(m_decoder->getDisplayID(), frame, inputBuffer);
+    if (!image)
+        return false;
+    inputBuffer.internalID = m_id;
+    m_images[m_id++] = image;
     return true;
 }
 
@@ -174,6 +196,84 @@ bool EncodeInputDecoder::recycleOneFrameInput(VideoFrameRawData &inputBuffer)
     return true;
 }
 
+bool EncodeInputDecoder::getNativeDisplay(NativeDisplay& display)
+{
+    if (!m_decoder)
+        return false;
+    memset(&display, 0, sizeof(display));
+    display.type = NATIVE_DISPLAY_VA;
+    display.handle = (intptr_t)m_decoder->getDisplayID();
+    return true;
+}
+
+bool EncodeInputDecoder::getOneSurfaceInput(SharedPtr<VideoFrame>& frame)
+{
+    if (!m_decoder || m_isEOS)
+        return false;
+    if (m_input->isEOS()) {
+        m_inputEOS = true;
+    }
+    //frames decoded ahead for getOneFrameInput go first
+    if (!m_window->empty()) {
+        if (!m_window->pop(frame))
+            return false;
+        return toEncoderFormat(frame);
+    }
+    //no sync and no map, the encoder waits on the surface itself
+    while (!(frame = m_decoder->getOutput())) {
+        if (m_inputEOS) {
+            m_isEOS = true;
+            return false;
+        }
+        if (!decodeOneFrame())
+            return false;
+    }
+    return toEncoderFormat(frame);
+}
+
+bool EncodeInputDecoder::toEncoderFormat(SharedPtr<VideoFrame>& frame)
+{
+    if (frame->fourcc == YAMI_FOURCC_NV12)
+        return true;
+    uint32_t width = frame->crop.width;
+    uint32_t height = frame->crop.height;
+    if (!m_vpp) {
+        NativeDisplay display;
+        getNativeDisplay(display);
+        m_vpp.reset(createVideoPostProcess(YAMI_VPP_SCALER), releaseVideoPostProcess);
+        if (!m_vpp || m_vpp->setNativeDisplay(display) != YAMI_SUCCESS) {
+            ERROR("create vpp failed");
+            m_vpp.reset();
+            return false;
+        }
+        //the decoder owns the display, this only holds the handle
+        SharedPtr<VADisplay> vaDisplay(new VADisplay(m_decoder->getDisplayID()));
+        m_allocator.reset(new PooledFrameAllocator(vaDisplay, VPP_SURFACES));
+    }
+    if (m_allocatorWidth != width || m_allocatorHeight != height) {
+        if (!m_allocator->setFormat(YAMI_FOURCC_NV12, width, height)) {
+            ERROR("create nv12 surfaces failed");
+            return false;
+        }
+        m_allocatorWidth = width;
+        m_allocatorHeight = height;
+    }
+    SharedPtr<VideoFrame> dest = allocFrame(m_allocator, POOL_WAIT_MS);
+    if (!dest) {
+        ERROR("no free nv12 surface");
+        return false;
+    }
+    YamiStatus status = m_vpp->process(frame, dest);
+    if (status != YAMI_SUCCESS) {
+        ERROR("vpp process failed = %d", status);
+        return false;
+    }
+    dest->timeStamp = frame->timeStamp;
+    dest->flags = frame->flags;
+    frame = dest;
+    return true;
+}
+
 bool EncodeInputDecoder::isEOS()
 {
     return m_isEOS;
@@ -20,29 +20,48 @@
 #include "encodeinput.h"
 
 #include "VideoDecoderHost.h"
+#include "VideoPostProcessHost.h"
 #include <map>
 
 using namespace YamiMediaCodec;
 
 class MyRawImage;
+class FrameSyncWindow;
+class FrameAllocator;
 class EncodeInputDecoder : public  EncodeInput {
 public:
-    EncodeInputDecoder(DecodeInput* input);
+    //syncDepth: decoded frames in flight before we map the oldest one, each
+    //holds a decoder surface so it is off by default
+    EncodeInputDecoder(DecodeInput* input, uint32_t syncDepth = 0);
     ~EncodeInputDecoder();
     virtual bool init(const char* inputFileName, uint32_t fourcc, int width, int height);
     virtual bool getOneFrameInput(VideoFrameRawData &inputBuffer);
     virtual bool recycleOneFrameInput(VideoFrameRawData &inputBuffer);
+    virtual bool getNativeDisplay(NativeDisplay& display);
+    virtual bool getOneSurfaceInput(SharedPtr<VideoFrame>& frame);
     virtual bool isEOS();
 private:
     bool decodeOneFrame();
+    //vpp to nv12 when the decoder gives a format encoders can't take
+    bool toEncoderFormat(SharedPtr<VideoFrame>& frame);
     DecodeInput* m_input;
     IVideoDecoder* m_decoder;
+    //input is done and decoder is flushed
+    bool m_inputEOS;
+    //all frames are out
     bool m_isEOS;
+    uint32_t m_syncDepth;
+    SharedPtr<FrameSyncWindow> m_window;
 
     typedef std::map<uint32_t, SharedPtr<MyRawImage> > ImageMap;
 
     ImageMap m_images;
     uint32_t m_id;
+
+    SharedPtr<IVideoPostProcess> m_vpp;
+    SharedPtr<FrameAllocator> m_allocator;
+    uint32_t m_allocatorWidth;
+    uint32_t m_allocatorHeight;
     DISALLOW_COPY_AND_ASSIGN(EncodeInputDecoder);
 };
 #endif
@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "encodeSurfaceCapi.h"
+#include "common/lock.h"
+#include "common/log.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace YamiMediaCodec;
+
+struct SurfaceRelease {
+    EncodeSurfaceRelease release;
+    void* userData;
+};
+
+static void freeSurfaceFrame(VideoFrame* frame)
+{
+    SurfaceRelease* r = (SurfaceRelease*)frame->user_data;
+    if (r->release)
+        r->release(frame->surface, r->userData);
+    delete r;
+    delete frame;
+}
+
+Encode_Status encodeEncodeSurface(EncodeHandler p, intptr_t surface, uint32_t fourcc,
+    uint32_t width, uint32_t height, int64_t timeStamp,
+    EncodeSurfaceRelease release, void* userData)
+{
+    VideoFrame* frame = new VideoFrame;
+    memset(frame, 0, sizeof(*frame));
+    frame->surface = surface;
+    frame->fourcc = fourcc;
+    frame->crop.width = width;
+    frame->crop.height = height;
+    frame->timeStamp = timeStamp;
+    SurfaceRelease* r = new SurfaceRelease;
+    r->release = release;
+    r->userData = userData;
+    frame->user_data = (intptr_t)r;
+    frame->free = freeSurfaceFrame;
+    if (!p) {
+        frame->free(frame);
+        return ENCODE_NULL_PTR;
+    }
+    //encodeEncode owns the frame from here, even on failure
+    return encodeEncode(p, frame);
+}
+
+class OutputBufferPool {
+public:
+    OutputBufferPool(uint32_t size, uint32_t count)
+        : m_size(size)
+        , m_count(count)
+    {
+    }
+    ~OutputBufferPool()
+    {
+        for (size_t i = 0; i < m_free.size(); i++)
+            destroy(m_free[i]);
+    }
+    VideoEncOutputBuffer* acquire()
+    {
+        {
+            AutoLock lock(m_lock);
+            if (!m_free.empty()) {
+                VideoEncOutputBuffer* b = m_free.back();
+                m_free.pop_back();
+                return b;
+            }
+        }
+        VideoEncOutputBuffer* b = new VideoEncOutputBuffer;
+        memset(b, 0, sizeof(*b));
+        b->data = static_cast<uint8_t*>(malloc(m_size));
+        if (!b->data) {
+            delete b;
+            return NULL;
+        }
+        b->bufferSize = m_size;
+        b->format = OUTPUT_EVERYTHING;
+        return b;
+    }
+    void release(VideoEncOutputBuffer* b)
+    {
+        {
+            AutoLock lock(m_lock);
+            if (m_free.size() < m_count) {
+                m_free.push_back(b);
+                return;
+            }
+        }
+        destroy(b);
+    }
+
+private:
+    static void destroy(VideoEncOutputBuffer* b)
+    {
+        free(b->data);
+        delete b;
+    }
+    Lock m_lock;
+    uint32_t m_size;
+    uint32_t m_count;
+    std::vector<VideoEncOutputBuffer*> m_free;
+    DISALLOW_COPY_AND_ASSIGN(OutputBufferPool);
+};
+
+EncodeOutputPoolHandler createOutputBufferPool(EncodeHandler p, uint32_t count)
+{
+    uint32_t maxOutSize = 0;
+    if (!p || encodeGetMaxOutSize(p, &maxOutSize) != ENCODE_SUCCESS || !maxOutSize) {
+        ERROR("failed to get max output size");
+        return NULL;
+    }
+    return new OutputBufferPool(maxOutSize, count);
+}
+
+Encode_Status encodeGetPooledOutput(EncodeHandler p, EncodeOutputPoolHandler pool,
+    VideoEncOutputBuffer** outBuffer, bool withWait)
+{
+    if (!p || !pool || !outBuffer)
+        return ENCODE_NULL_PTR;
+    *outBuffer = NULL;
+    OutputBufferPool* buffers = (OutputBufferPool*)pool;
+    VideoEncOutputBuffer* b = buffers->acquire();
+    if (!b)
+        return ENCODE_NO_MEMORY;
+    b->dataSize = 0;
+    b->format = OUTPUT_EVERYTHING;
+    Encode_Status status = encodeGetOutput(p, b, withWait);
+    if (status != ENCODE_SUCCESS) {
+        buffers->release(b);
+        return status;
+    }
+    *outBuffer = b;
+    return status;
+}
+
+void releaseOutputBuffer(EncodeOutputPoolHandler pool, VideoEncOutputBuffer* outBuffer)
+{
+    if (pool && outBuffer)
+        ((OutputBufferPool*)pool)->release(outBuffer);
+}
+
+void releaseOutputBufferPool(EncodeOutputPoolHandler pool)
+{
+    delete (OutputBufferPool*)pool;
+}
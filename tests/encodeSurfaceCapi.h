@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef encodeSurfaceCapi_h
+#define encodeSurfaceCapi_h
+
+#include "capi/VideoEncoderCapi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* surface input and pooled output on top of capi/VideoEncoderCapi.h */
+
+/* called once the encoder is done with the surface, it may be reused after that */
+typedef void (*EncodeSurfaceRelease)(intptr_t surface, void* userData);
+
+/* encode a VASurfaceID from the encoder's display without copying it.
+   release is called even if encoding fails, it can be NULL */
+Encode_Status encodeEncodeSurface(EncodeHandler p, intptr_t surface, uint32_t fourcc,
+    uint32_t width, uint32_t height, int64_t timeStamp,
+    EncodeSurfaceRelease release, void* userData);
+
+typedef void* EncodeOutputPoolHandler;
+
+/* buffers of encodeGetMaxOutSize bytes, call it after encodeStart.
+   count buffers are kept for reuse, more are allocated if they are all in use */
+EncodeOutputPoolHandler createOutputBufferPool(EncodeHandler p, uint32_t count);
+
+/* like encodeGetOutput, but the data goes to a buffer from the pool.
+   on ENCODE_SUCCESS give the buffer back with releaseOutputBuffer, from any thread */
+Encode_Status encodeGetPooledOutput(EncodeHandler p, EncodeOutputPoolHandler pool,
+    VideoEncOutputBuffer** outBuffer, bool withWait);
+
+void releaseOutputBuffer(EncodeOutputPoolHandler pool, VideoEncOutputBuffer* outBuffer);
+
+/* all buffers need to be released before it */
+void releaseOutputBufferPool(EncodeOutputPoolHandler pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //encodeSurfaceCapi_h
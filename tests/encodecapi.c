@@ -26,18 +26,42 @@
 #include "common/log.h"
 #include "capi/VideoEncoderCapi.h"
 #include "encodeInputCapi.h"
+#include "encodeSurfaceCapi.h"
 #include "VideoEncoderDefs.h"
 #include "encodehelp.h"
 
+static void writeOutputs(EncodeHandler encoder, EncodeOutputPoolHandler pool, EncodeOutputHandler output, bool withWait)
+{
+    Encode_Status status;
+    VideoEncOutputBuffer* outputBuffer;
+    do {
+        status = encodeGetPooledOutput(encoder, pool, &outputBuffer, withWait);
+        if (status == ENCODE_SUCCESS) {
+            if (!writeOutput(output, outputBuffer->data, outputBuffer->dataSize))
+                assert(0);
+            releaseOutputBuffer(pool, outputBuffer);
+        }
+    } while (status == ENCODE_SUCCESS);
+}
+
+//the decoded frame keeps its surface until the encoder is done with it
+static void releaseSurfaceInput(intptr_t surface, void* userData)
+{
+    VideoFrame* frame = (VideoFrame*)userData;
+    frame->free(frame);
+}
+
 int main(int argc, char** argv)
 {
     EncodeHandler encoder = NULL;
-    uint32_t maxOutSize = 0;
     EncodeInputHandler input;
     EncodeOutputHandler output;
+    EncodeOutputPoolHandler outputPool;
     Encode_Status status;
     VideoFrameRawData inputBuffer;
-    VideoEncOutputBuffer outputBuffer;
+    VideoFrame* frame;
+    NativeDisplay nativeDisplay;
+    bool surfaceInput;
     int encodeFrameCount = 0;
 
     if (!process_cmdline(argc, argv))
@@ -63,9 +87,12 @@ int main(int argc, char** argv)
     encoder = createEncoder(getOutputMimeType(output));
     assert(encoder != NULL);
 
-    NativeDisplay nativeDisplay;
-    nativeDisplay.type = NATIVE_DISPLAY_DRM;
-    nativeDisplay.handle = 0;
+    //decoded input hands over its surfaces, the encoder needs to share its display
+    surfaceInput = getInputNativeDisplay(input, &nativeDisplay);
+    if (!surfaceInput) {
+        nativeDisplay.type = NATIVE_DISPLAY_DRM;
+        nativeDisplay.handle = 0;
+    }
     encodeSetNativeDisplay(encoder, &nativeDisplay);
 
     //configure encoding parameters
@@ -84,49 +111,46 @@ int main(int argc, char** argv)
     status = encodeStart(encoder);
     assert(status == ENCODE_SUCCESS);
 
-    //init output buffer
-    encodeGetMaxOutSize(encoder, &maxOutSize);
-
-    if (!createOutputBuffer(&outputBuffer, maxOutSize)) {
-        fprintf (stderr, "fail to init input stream\n");
+    //init output buffer pool
+    outputPool = createOutputBufferPool(encoder, 4);
+    if (!outputPool) {
+        fprintf (stderr, "fail to init output buffer pool\n");
         return -1;
     }
 
     while (!encodeInputIsEOS(input))
     {
-        memset(&inputBuffer, 0, sizeof(inputBuffer));
-        if (getOneFrameInput(input, &inputBuffer)){
+        if (surfaceInput) {
+            if (!getOneSurfaceInput(input, &frame))
+                break;
+            //no copy, the encoder reads the decoded surface
+            status = encodeEncodeSurface(encoder, frame->surface, frame->fourcc,
+                frame->crop.width, frame->crop.height, frame->timeStamp,
+                releaseSurfaceInput, frame);
+        }
+        else {
+            memset(&inputBuffer, 0, sizeof(inputBuffer));
+            if (!getOneFrameInput(input, &inputBuffer))
+                break;
             status = encodeEncodeRawData(encoder, &inputBuffer);
             recycleOneFrameInput(input, &inputBuffer);
         }
-        else
-            break;
 
         //get the output buffer
-        do {
-            status = encodeGetOutput(encoder, &outputBuffer, false);
-            if (status == ENCODE_SUCCESS
-              && !writeOutput(output, outputBuffer.data, outputBuffer.dataSize))
-                assert(0);
-        } while (status != ENCODE_BUFFER_NO_MORE);
+        writeOutputs(encoder, outputPool, output, false);
 
         if (frameCount &&  encodeFrameCount++ > frameCount)
             break;
     }
 
     // drain the output buffer
-    do {
-       status = encodeGetOutput(encoder, &outputBuffer, true);
-       if (status == ENCODE_SUCCESS
-           && !writeOutput(output, outputBuffer.data, outputBuffer.dataSize))
-           assert(0);
-    } while (status != ENCODE_BUFFER_NO_MORE);
+    writeOutputs(encoder, outputPool, output, true);
 
     encodeStop(encoder);
     releaseEncoder(encoder);
     releaseEncodeInput(input);
     releaseEncodeOutput(output);
-    free(outputBuffer.data);
+    releaseOutputBufferPool(outputPool);
 
     fprintf(stderr, "encode done\n");
     return 0;
@@ -19,6 +19,11 @@
 #include <getopt.h>
 #include <VideoEncoderDefs.h>
 
+#include "common/parsecount.h"
+
+//each frame in flight holds a surface
+#define MAX_IN_FLIGHT 16
+
 static int idrInterval = 0;
 static int intraPeriod = 30;
 static int ipPeriod = 1;
@@ -32,6 +37,8 @@ static int initQp=26;
 static VideoRateControl rcMode = RATE_CONTROL_CQP;
 static int frameCount = 0;
 static int numRefFrames = 1;
+static char *cameraMode = NULL;
+static uint32_t inFlight = 4;
 
 #ifdef __BUILD_GET_MV__
 static FILE *MVFp;
@@ -55,6 +62,7 @@ static void print_help(const char* app)
 {
     printf("%s <options>\n", app);
     printf("   -i <source yuv filename> load YUV from a file\n");
+    printf("      synthetic[:gradient|noise|text|scenes[:frames]] generate frames instead, for benchmarks\n");
     printf("   -W <width> -H <height>\n");
     printf("   -o <coded file> optional\n");
     printf("   -b <bitrate: kbps> optional\n");
@@ -68,6 +76,8 @@ static void print_help(const char* app)
     printf("   --intraperiod <Intra frame period (default 30)> optional\n");
     printf("   --refnum <number of referece frames(default 1)> optional\n");
     printf("   --idrinterval <AVC/HEVC IDR frame interval (default 0)> optional\n");
+    printf("   --cameramode <mmap|dmabuf|userptr> capture buffer mode of camera input (default mmap) optional\n");
+    printf("   --inflight <frames submitted but not coded yet, 1 to %d (default 4)> optional\n", MAX_IN_FLIGHT);
 }
 
 static VideoRateControl string_to_rc_mode(char *str)
@@ -96,6 +106,8 @@ static bool process_cmdline(int argc, char *argv[])
         {"intraperiod", required_argument, NULL, 0 },
         {"refnum", required_argument, NULL, 0 },
         {"idrinterval", required_argument, NULL, 0 },
+        {"cameramode", required_argument, NULL, 0 },
+        {"inflight", required_argument, NULL, 0 },
         {NULL, no_argument, NULL, 0 }};
     int option_index;
 
@@ -159,6 +171,15 @@ static bool process_cmdline(int argc, char *argv[])
                 case 6:
                     idrInterval = atoi(optarg);
                     break;
+                case 7:
+                    cameraMode = optarg;
+                    break;
+                case 8:
+                    if (!parseCount(optarg, 1, MAX_IN_FLIGHT, &inFlight)) {
+                        fprintf(stderr, "invalid inflight: %s\n", optarg);
+                        return false;
+                    }
+                    break;
             }
         }
     }
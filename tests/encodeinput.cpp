@@ -25,6 +25,7 @@
 #include <ctype.h>
 #include "common/log.h"
 #include "common/utils.h"
+#include "common/planecopy.h"
 
 #include "encodeinput.h"
 #include "encodeInputDecoder.h"
@@ -33,7 +34,7 @@ using namespace YamiMediaCodec;
 
 #define MAX_WIDTH  8192
 #define MAX_HEIGHT 4320
-EncodeInput * EncodeInput::create(const char* inputFileName, uint32_t fourcc, int width, int height)
+EncodeInput * EncodeInput::create(const char* inputFileName, uint32_t fourcc, int width, int height, const char* cameraMode)
 {
     EncodeInput *input = NULL;
     if (!inputFileName) {
@@ -43,6 +44,9 @@ EncodeInput * EncodeInput::create(const char* inputFileName, uint32_t fourcc, in
         return NULL;
 #endif
     }
+    else if (TestPattern::isTestPattern(inputFileName)) {
+        input = new EncodeInputSynthetic;
+    }
     else {
 #ifndef ANDROID // temp disable transcoding and camera support on android
         DecodeInput* decodeInput = DecodeInput::create(inputFileName);
@@ -50,7 +54,12 @@ EncodeInput * EncodeInput::create(const char* inputFileName, uint32_t fourcc, in
             input = new EncodeInputDecoder(decodeInput);
         }
         else if (!strncmp(inputFileName, "/dev/video", strlen("/dev/video"))) {
-            input = new EncodeInputCamera;
+            EncodeInputCamera* camera = new EncodeInputCamera;
+            if (!camera->setDataMode(cameraMode)) {
+                delete camera;
+                return NULL;
+            }
+            input = camera;
         }
         else
 #endif
@@ -124,6 +133,74 @@ bool EncodeInputFile::init(const char* inputFileName, uint32_t fourcc, int width
     return true;
 }
 
+//read a big frame with pread in parallel stripes, it's a memory copy from page cache
+class StripedRead : public StripeTask {
+public:
+    StripedRead(int fd, off_t offset, uint8_t* buffer, size_t size, uint32_t stripes)
+        : m_fd(fd)
+        , m_offset(offset)
+        , m_buffer(buffer)
+        , m_size(size)
+        , m_read(stripes)
+    {
+    }
+    void run(uint32_t stripe, uint32_t stripes)
+    {
+        size_t len = (m_size + stripes - 1) / stripes;
+        size_t start = len * stripe;
+        if (start >= m_size)
+            return;
+        if (len > m_size - start)
+            len = m_size - start;
+        size_t done = 0;
+        while (done < len) {
+            ssize_t n = pread(m_fd, m_buffer + start + done, len - done, m_offset + start + done);
+            if (n <= 0)
+                break;
+            done += n;
+        }
+        m_read[stripe] = done;
+    }
+    //bytes read without a hole
+    size_t getReadSize()
+    {
+        size_t len = (m_size + m_read.size() - 1) / m_read.size();
+        size_t size = 0;
+        for (size_t i = 0; i < m_read.size(); i++) {
+            size += m_read[i];
+            if (m_read[i] < len)
+                break;
+        }
+        return size;
+    }
+
+private:
+    int m_fd;
+    off_t m_offset;
+    uint8_t* m_buffer;
+    size_t m_size;
+    std::vector<size_t> m_read;
+};
+
+size_t EncodeInputFile::readFrame(uint8_t* buffer)
+{
+    StripePool& pool = StripePool::getInstance();
+    uint32_t stripes = pool.getStripes(m_frameSize);
+    off_t offset = ftello(m_fp);
+    //pipes can't pread
+    if (stripes <= 1 || offset < 0)
+        return fread(buffer, sizeof(uint8_t), m_frameSize, m_fp);
+
+    StripedRead task(fileno(m_fp), offset, buffer, m_frameSize, stripes);
+    pool.run(task, stripes);
+    size_t ret = task.getReadSize();
+    if (fseeko(m_fp, offset + ret, SEEK_SET)) {
+        fprintf(stderr, "failed to seek input file\n");
+        return 0;
+    }
+    return ret;
+}
+
 bool EncodeInputFile::getOneFrameInput(VideoFrameRawData &inputBuffer)
 {
     if (m_readToEOS)
@@ -133,7 +210,7 @@ bool EncodeInputFile::getOneFrameInput(VideoFrameRawData &inputBuffer)
     if (inputBuffer.handle)
         buffer = reinterpret_cast<uint8_t*>(inputBuffer.handle);
 
-    size_t ret = fread(buffer, sizeof(uint8_t), m_frameSize, m_fp);
+    size_t ret = readFrame(buffer);
 
     if (ret <= 0) {
         m_readToEOS = true;
@@ -157,6 +234,70 @@ EncodeInputFile::~EncodeInputFile()
         free(m_buffer);
 }
 
+EncodeInputSynthetic::EncodeInputSynthetic()
+    : m_next(0)
+    , m_isEOS(false)
+{
+}
+
+bool EncodeInputSynthetic::init(const char* inputFileName, uint32_t fourcc, int width, int height)
+{
+    if (!fourcc)
+        fourcc = VA_FOURCC('I', '4', '2', '0');
+    if ((!width || !height) && !guessResolution(inputFileName, width, height)) {
+        fprintf(stderr, "synthetic input needs -W and -H\n");
+        return false;
+    }
+    if (width <= 0 || height <= 0 || width > MAX_WIDTH || height > MAX_HEIGHT) {
+        fprintf(stderr, "input width and height is invalid\n");
+        return false;
+    }
+    if (!m_pattern.init(inputFileName, fourcc, width, height))
+        return false;
+    m_width = width;
+    m_height = height;
+    m_fourcc = fourcc;
+    return true;
+}
+
+bool EncodeInputSynthetic::getOneFrameInput(VideoFrameRawData &inputBuffer)
+{
+    if (m_pattern.getFrameCount() && m_next >= m_pattern.getFrameCount()) {
+        m_isEOS = true;
+        return false;
+    }
+    uint8_t* planes[3];
+    uint32_t pitches[3];
+    uint32_t planeCount;
+    m_pattern.getFrame(m_next++, planes, pitches, planeCount);
+
+    //the caller has its own buffer, copy the window into it
+    if (inputBuffer.handle) {
+        uint8_t* buffer = reinterpret_cast<uint8_t*>(inputBuffer.handle);
+        if (!fillFrameRawData(&inputBuffer, m_fourcc, m_width, m_height, buffer))
+            return false;
+        uint32_t byteWidth[3], byteHeight[3], n;
+        if (!getPlaneResolution(m_fourcc, m_width, m_height, byteWidth, byteHeight, n))
+            return false;
+        for (uint32_t i = 0; i < n; i++)
+            copyPlane(buffer + inputBuffer.offset[i], inputBuffer.pitch[i], planes[i], pitches[i], byteWidth[i], byteHeight[i], PLANE_COPY_UPLOAD);
+        return true;
+    }
+
+    //no copy, the encoder reads the window of the canvas
+    memset(&inputBuffer, 0, sizeof(inputBuffer));
+    inputBuffer.memoryType = VIDEO_DATA_MEMORY_TYPE_RAW_POINTER;
+    inputBuffer.fourcc = m_fourcc;
+    inputBuffer.width = m_width;
+    inputBuffer.height = m_height;
+    inputBuffer.handle = reinterpret_cast<intptr_t>(planes[0]);
+    for (uint32_t i = 0; i < planeCount; i++) {
+        inputBuffer.pitch[i] = pitches[i];
+        inputBuffer.offset[i] = planes[i] - planes[0];
+    }
+    return true;
+}
+
 EncodeOutput::EncodeOutput():m_fp(NULL)
 {
 }
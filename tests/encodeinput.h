@@ -24,6 +24,7 @@
 #include "VideoEncoderDefs.h"
 #include "VideoEncoderInterface.h"
 #include "common/NonCopyable.h"
+#include "common/testpattern.h"
 #include <vector>
 #if ANDROID
 #include <gui/Surface.h>
@@ -40,12 +41,17 @@ class EncodeInputFile;
 class EncodeInputCamera;
 class EncodeInput {
 public:
-    static EncodeInput* create(const char* inputFileName, uint32_t fourcc, int width, int height);
+    //cameraMode is the capture data mode of a /dev/video* input, see EncodeInputCamera::setDataMode
+    static EncodeInput* create(const char* inputFileName, uint32_t fourcc, int width, int height, const char* cameraMode = NULL);
     EncodeInput() : m_width(0), m_height(0), m_frameSize(0) {};
     virtual ~EncodeInput() {};
     virtual bool init(const char* inputFileName, uint32_t fourcc, int width, int height) = 0;
     virtual bool getOneFrameInput(VideoFrameRawData &inputBuffer) = 0;
     virtual bool recycleOneFrameInput(VideoFrameRawData &inputBuffer) {return true;};
+    //surface input, the frame stays on the gpu. it belongs to the display from
+    //getNativeDisplay, the encoder needs to use the same one.
+    virtual bool getNativeDisplay(NativeDisplay& display) { return false; }
+    virtual bool getOneSurfaceInput(SharedPtr<VideoFrame>& frame) { return false; }
     virtual bool isEOS() = 0;
     int getWidth() { return m_width;}
     int getHeight() { return m_height;}
@@ -70,21 +76,39 @@ protected:
     uint8_t *m_buffer;
     bool m_readToEOS;
 private:
+    size_t readFrame(uint8_t* buffer);
     DISALLOW_COPY_AND_ASSIGN(EncodeInputFile);
 };
 
+//generated frames, for input names like synthetic:noise:600, see TestPattern
+class EncodeInputSynthetic : public EncodeInput {
+public:
+    EncodeInputSynthetic();
+    virtual bool init(const char* inputFileName, uint32_t fourcc, int width, int height);
+    virtual bool getOneFrameInput(VideoFrameRawData &inputBuffer);
+    virtual bool isEOS() { return m_isEOS; }
+
+private:
+    TestPattern m_pattern;
+    uint32_t m_next;
+    bool m_isEOS;
+    DISALLOW_COPY_AND_ASSIGN(EncodeInputSynthetic);
+};
+
 class EncodeInputCamera : public EncodeInput {
 public:
     enum CameraDataMode{
         CAMERA_DATA_MODE_MMAP,
-        // CAMERA_DATA_MODE_DMABUF_MMAP,
-        // CAMERA_DATA_MODE_USRPTR,
+        CAMERA_DATA_MODE_DMABUF_MMAP, // export mmap buffers as dmabuf
+        CAMERA_DATA_MODE_USRPTR,
         // CAMERA_DATA_MODE_DMABUF_USRPTR,
     };
-    EncodeInputCamera() :m_frameBufferCount(5), m_frameBufferSize(0), m_dataMode(CAMERA_DATA_MODE_MMAP) {};
+    EncodeInputCamera() :m_fd(-1), m_epollFd(-1), m_frameBufferCount(5), m_frameBufferSize(0), m_pitch(0), m_dataMode(CAMERA_DATA_MODE_MMAP) {};
     ~EncodeInputCamera();
     virtual bool init(const char* cameraPath, uint32_t fourcc, int width, int height);
     bool setDataMode(CameraDataMode mode = CAMERA_DATA_MODE_MMAP) {m_dataMode = mode; return true;};
+    // mmap, dmabuf or userptr, NULL for mmap
+    bool setDataMode(const char* mode);
 
     virtual bool getOneFrameInput(VideoFrameRawData &inputBuffer);
     virtual bool recycleOneFrameInput(VideoFrameRawData &inputBuffer);
@@ -92,15 +116,23 @@ public:
     // void getSupportedResolution();
 private:
     int m_fd;
+    int m_epollFd;
     std::vector<uint8_t*> m_frameBuffers;
+    std::vector<int> m_dmabufFds;
     uint32_t m_frameBufferCount;
     uint32_t m_frameBufferSize;
+    uint32_t m_pitch;
     CameraDataMode m_dataMode;
 
+    uint32_t getV4L2Memory();
     bool openDevice();
     bool initDevice(const char *cameraDevicePath);
+    bool requestBuffers(uint32_t memory);
     bool initMmap();
+    bool initDmabuf();
+    bool initUserptr(uint32_t imageSize);
     bool startCapture();
+    bool waitFrame();
     int32_t dequeFrame();
     bool enqueFrame(int32_t index);
     bool stopCapture();
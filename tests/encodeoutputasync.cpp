@@ -0,0 +1,301 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#define __STDC_FORMAT_MACROS
+#include "encodeoutputasync.h"
+#include "common/common_def.h"
+#include "common/log.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+EncodeOutputAsync::EncodeOutputAsync()
+    : m_cond(m_lock)
+    , m_encoder(NULL)
+    , m_output(NULL)
+    , m_maxInFlight(0)
+    , m_inFlight(0)
+    , m_submitted(0)
+    , m_drained(0)
+    , m_starvedAt(-1)
+    , m_eos(false)
+    , m_error(false)
+    , m_recycler(NULL)
+#ifdef __BUILD_GET_MV__
+    , m_mvFile(NULL)
+#endif
+    , m_started(false)
+    , m_framesIn(NULL)
+    , m_frames(NULL)
+    , m_bytes(NULL)
+    , m_frameSize(NULL)
+    , m_depth(NULL)
+    , m_fullWaits(NULL)
+    , m_emptyWaits(NULL)
+{
+    memset(&m_outputBuffer, 0, sizeof(m_outputBuffer));
+#ifdef __BUILD_GET_MV__
+    memset(&m_mvBuffer, 0, sizeof(m_mvBuffer));
+#endif
+}
+
+EncodeOutputAsync::~EncodeOutputAsync()
+{
+    finish();
+    if (!m_labels.empty())
+        Metrics::getInstance().remove(m_labels.c_str());
+}
+
+bool EncodeOutputAsync::start(IVideoEncoder* encoder, EncodeOutput* output, uint32_t inFlight)
+{
+    if (!encoder || !output || !inFlight || m_started)
+        return false;
+    m_encoder = encoder;
+    m_output = output;
+    m_maxInFlight = inFlight;
+
+    uint32_t maxOutSize = 0;
+    m_encoder->getMaxOutSize(&maxOutSize);
+    if (!maxOutSize) {
+        ERROR("invalid max output size");
+        return false;
+    }
+    m_buffer.resize(maxOutSize);
+    m_outputBuffer.data = &m_buffer[0];
+    m_outputBuffer.bufferSize = maxOutSize;
+    m_outputBuffer.format = OUTPUT_EVERYTHING;
+#ifdef __BUILD_GET_MV__
+    if (m_mvFile) {
+        uint32_t size = 0;
+        m_encoder->getMVBufferSize(&size);
+        m_mvData.resize(size);
+        m_mvBuffer.data = size ? &m_mvData[0] : NULL;
+        m_mvBuffer.bufferSize = size;
+    }
+#endif
+
+    //1K to 1M, covers qcif P frames to 4K I frames
+    static const uint64_t frameSizes[] = { 1 << 10, 4 << 10, 16 << 10, 64 << 10, 256 << 10, 1 << 20 };
+    Metrics& metrics = Metrics::getInstance();
+    m_framesIn = metrics.counter("yami_frames_total", "stage=\"encode_input\"", "frames out of each stage");
+    m_frames = metrics.counter("yami_frames_total", "stage=\"encode\"", "frames out of each stage");
+    metrics.rate("yami_fps", "stage=\"encode\"", "frames per second out of each stage", m_frames);
+    m_bytes = metrics.counter("yami_encoded_bytes_total", "", "bytes of encoded bitstream");
+    m_frameSize = metrics.histogram("yami_encoded_frame_bytes", "", "size of encoded frames",
+        frameSizes, N_ELEMENTS(frameSizes));
+    char labels[32];
+    snprintf(labels, sizeof(labels), "queue=\"encode%u\"", metrics.newInstanceId());
+    m_labels = labels;
+    m_depth = metrics.gauge("yami_queue_depth", labels, "frames waiting in the queue");
+    m_fullWaits = metrics.counter("yami_queue_full_waits_total", labels, "producer waits on a full queue");
+    m_emptyWaits = metrics.counter("yami_queue_empty_waits_total", labels, "consumer waits on an empty queue");
+
+    if (pthread_create(&m_thread, NULL, start, this)) {
+        ERROR("create thread failed");
+        return false;
+    }
+    m_started = true;
+    return true;
+}
+
+void* EncodeOutputAsync::start(void* async)
+{
+    EncodeOutputAsync* output = (EncodeOutputAsync*)async;
+    output->loop();
+    return NULL;
+}
+
+bool EncodeOutputAsync::write()
+{
+    if (!m_output->write(m_outputBuffer.data, m_outputBuffer.dataSize)) {
+        ERROR("write bitstream failed");
+        return false;
+    }
+    DEBUG("timeStamp(PTS) : " "%" PRIu64, m_outputBuffer.timeStamp);
+#ifdef __BUILD_GET_MV__
+    if (m_mvFile)
+        fwrite(m_mvBuffer.data, m_mvBuffer.bufferSize, 1, m_mvFile);
+#endif
+    m_frames->add();
+    m_bytes->add(m_outputBuffer.dataSize);
+    m_frameSize->observe(m_outputBuffer.dataSize);
+    return true;
+}
+
+void EncodeOutputAsync::loop()
+{
+    while (1) {
+        bool eos;
+        uint64_t submitted;
+        {
+            AutoLock lock(m_lock);
+            //nothing in the encoder, or it waits for more input
+            while (!m_eos && (!m_inFlight || m_starvedAt == (int64_t)m_submitted)) {
+                //submitter is slower than us
+                m_emptyWaits->add();
+                m_cond.wait();
+            }
+            eos = m_eos;
+            submitted = m_submitted;
+        }
+
+        Encode_Status status;
+#ifndef __BUILD_GET_MV__
+        status = m_encoder->getOutput(&m_outputBuffer, true);
+#else
+        if (m_mvFile)
+            status = m_encoder->getOutput(&m_outputBuffer, &m_mvBuffer, true);
+        else
+            status = m_encoder->getOutput(&m_outputBuffer, true);
+#endif
+        if (status == ENCODE_SUCCESS) {
+            bool ret = write();
+            recycle((int64_t)m_outputBuffer.timeStamp);
+            AutoLock lock(m_lock);
+            if (m_inFlight)
+                m_inFlight--;
+            m_drained++;
+            m_starvedAt = -1;
+            m_depth->set(m_inFlight);
+            if (!ret)
+                m_error = true;
+            m_cond.broadcast();
+            if (!ret)
+                return;
+        }
+        else if (status == ENCODE_BUFFER_NO_MORE) {
+            //all submitted before eos are out
+            if (eos)
+                return;
+            AutoLock lock(m_lock);
+            m_starvedAt = submitted;
+            m_cond.broadcast();
+        }
+        else {
+            ERROR("get output failed, status = %d", status);
+            AutoLock lock(m_lock);
+            m_error = true;
+            m_cond.broadcast();
+            return;
+        }
+    }
+}
+
+void EncodeOutputAsync::recycle(int64_t timeStamp)
+{
+    if (!m_recycler)
+        return;
+    VideoFrameRawData frame;
+    {
+        AutoLock lock(m_lock);
+        std::deque<VideoFrameRawData>::iterator it = m_coding.begin();
+        while (it != m_coding.end() && it->timeStamp != timeStamp)
+            ++it;
+        if (it == m_coding.end())
+            return;
+        frame = *it;
+        m_coding.erase(it);
+    }
+    m_recycler->recycleOneFrameInput(frame);
+}
+
+template <class Frame>
+bool EncodeOutputAsync::submit(Frame frame)
+{
+    uint64_t drained;
+    {
+        AutoLock lock(m_lock);
+        while (!m_error && m_inFlight >= m_maxInFlight && m_starvedAt != (int64_t)m_submitted) {
+            //encoder is slower than us
+            m_fullWaits->add();
+            m_cond.wait();
+        }
+        if (m_error)
+            return false;
+        drained = m_drained;
+    }
+
+    //the drainer only needs the lock for bookkeeping, do not hold it here
+    Encode_Status status;
+    while ((status = m_encoder->encode(frame)) == ENCODE_IS_BUSY) {
+        AutoLock lock(m_lock);
+        while (!m_error && m_drained == drained && m_starvedAt != (int64_t)m_submitted)
+            m_cond.wait();
+        if (m_error)
+            return false;
+        if (m_drained == drained) {
+            ERROR("encoder is busy, but has no output");
+            m_error = true;
+            m_cond.broadcast();
+            return false;
+        }
+        drained = m_drained;
+    }
+    AutoLock lock(m_lock);
+    if (status != ENCODE_SUCCESS) {
+        ERROR("encode failed status = %d", status);
+        m_error = true;
+        m_cond.broadcast();
+        return false;
+    }
+    m_framesIn->add();
+    m_inFlight++;
+    m_submitted++;
+    m_depth->set(m_inFlight);
+    m_cond.broadcast();
+    return true;
+}
+
+bool EncodeOutputAsync::encode(VideoFrameRawData* frame)
+{
+    if (!m_started)
+        return false;
+    if (m_recycler) {
+        //before the encoder has it, the drainer may get it out right away.
+        //finish() recycles it if encoding fails
+        AutoLock lock(m_lock);
+        m_coding.push_back(*frame);
+    }
+    return submit(frame);
+}
+
+bool EncodeOutputAsync::encode(const SharedPtr<VideoFrame>& frame)
+{
+    return m_started && submit(frame);
+}
+
+bool EncodeOutputAsync::finish()
+{
+    if (m_started) {
+        {
+            AutoLock lock(m_lock);
+            m_eos = true;
+            m_cond.broadcast();
+        }
+        pthread_join(m_thread, NULL);
+        m_started = false;
+    }
+    //nothing reads them after the thread is done
+    while (!m_coding.empty()) {
+        m_recycler->recycleOneFrameInput(m_coding.front());
+        m_coding.pop_front();
+    }
+    return !m_error;
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef encodeoutputasync_h
+#define encodeoutputasync_h
+#include "common/condition.h"
+#include "common/lock.h"
+#include "common/metrics.h"
+#include "encodeinput.h"
+
+#include <deque>
+#include <pthread.h>
+#include <vector>
+
+using namespace YamiMediaCodec;
+
+//frames submitted to the encoder but not out of getOutput yet
+#define DEFAULT_ENCODE_IN_FLIGHT 4
+//each of them holds a surface
+#define MAX_ENCODE_IN_FLIGHT 16
+
+//drains an encoder in its own thread: encode() only submits, the thread
+//blocks in getOutput() and writes the bitstream.
+//at most inFlight frames are between the two, they keep their surfaces.
+//when the encoder needs more input before it gives anything back (b frames)
+//encode() may go over the limit.
+//raw frames may point at buffers the encoder reads later (dmabuf, userptr),
+//with a recycler they go back to it only after they are coded.
+class EncodeOutputAsync
+{
+public:
+    EncodeOutputAsync();
+    ~EncodeOutputAsync();
+
+    //encoder and output need to outlive finish()
+    bool start(IVideoEncoder* encoder, EncodeOutput* output, uint32_t inFlight);
+#ifdef __BUILD_GET_MV__
+    //write motion vectors of every output to fp, call it before start()
+    void setMVFile(FILE* fp) { m_mvFile = fp; }
+#endif
+    //give raw frames back to input once they are coded, call it before start().
+    //their timeStamp needs to be unique
+    void setRecycler(EncodeInput* input) { m_recycler = input; }
+
+    //wait for room and submit, return false once encoding or writing failed
+    bool encode(VideoFrameRawData* frame);
+    bool encode(const SharedPtr<VideoFrame>& frame);
+
+    //drain the encoder and stop the thread, return false if anything failed
+    bool finish();
+
+    uint32_t maxInFlight() const { return m_maxInFlight; }
+
+private:
+    template <class Frame>
+    bool submit(Frame frame);
+    static void* start(void* async);
+    void loop();
+    bool write();
+    //the frame of timeStamp is coded
+    void recycle(int64_t timeStamp);
+
+    Lock       m_lock;
+    Condition  m_cond;
+    IVideoEncoder* m_encoder;
+    EncodeOutput*  m_output;
+    uint32_t   m_maxInFlight;
+    uint32_t   m_inFlight;
+    //submitted and drained frames, the drainer is starved while
+    //m_starvedAt is m_submitted
+    uint64_t   m_submitted;
+    uint64_t   m_drained;
+    int64_t    m_starvedAt;
+    bool       m_eos;
+    bool       m_error;
+
+    EncodeInput* m_recycler;
+    //raw frames the encoder may still read, in submit order
+    std::deque<VideoFrameRawData> m_coding;
+
+    VideoEncOutputBuffer m_outputBuffer;
+    std::vector<uint8_t> m_buffer;
+#ifdef __BUILD_GET_MV__
+    FILE* m_mvFile;
+    VideoEncMVBuffer m_mvBuffer;
+    std::vector<uint8_t> m_mvData;
+#endif
+
+    pthread_t  m_thread;
+    bool       m_started;
+
+    Counter*   m_framesIn;
+    Counter*   m_frames;
+    Counter*   m_bytes;
+    Histogram* m_frameSize;
+    //our instance labels
+    std::string m_labels;
+    Gauge*     m_depth;
+    Counter*   m_fullWaits;
+    Counter*   m_emptyWaits;
+
+    DISALLOW_COPY_AND_ASSIGN(EncodeOutputAsync);
+};
+#endif //encodeoutputasync_h
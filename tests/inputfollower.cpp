@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "inputfollower.h"
+#include "common/log.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+InputFollower::InputFollower()
+    : m_fd(-1)
+    , m_inotify(-1)
+    , m_idleMs(0)
+    , m_closed(false)
+{
+}
+
+InputFollower::~InputFollower()
+{
+    if (m_inotify >= 0)
+        close(m_inotify);
+}
+
+bool InputFollower::init(int fd, uint32_t idleMs)
+{
+    m_fd = fd;
+    m_idleMs = idleMs;
+    m_inotify = inotify_init1(IN_CLOEXEC);
+    if (m_inotify < 0) {
+        ERROR("inotify init failed: %s", strerror(errno));
+        return false;
+    }
+    //the proc link leads to the file we have open, even if it was renamed
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+    if (inotify_add_watch(m_inotify, path, IN_MODIFY | IN_CLOSE_WRITE) < 0) {
+        ERROR("watch input failed: %s", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+ssize_t InputFollower::read(void* data, size_t size)
+{
+    while (1) {
+        ssize_t n = ::read(m_fd, data, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n || !wait())
+            return n;
+    }
+}
+
+bool InputFollower::wait()
+{
+    if (m_closed)
+        return false;
+    struct pollfd fd;
+    fd.fd = m_inotify;
+    fd.events = POLLIN;
+    int ret;
+    while ((ret = poll(&fd, 1, m_idleMs)) < 0 && errno == EINTR)
+        ;
+    if (ret <= 0) {
+        //INFO may be empty, keep the branches in braces
+        if (ret < 0) {
+            ERROR("wait for input failed: %s", strerror(errno));
+        } else {
+            INFO("input did not grow for %u ms, take it as the end", m_idleMs);
+        }
+        m_closed = true;
+        return false;
+    }
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n = ::read(m_inotify, buffer, sizeof(buffer));
+    for (ssize_t i = 0; i < n;) {
+        const struct inotify_event* event = (const struct inotify_event*)(buffer + i);
+        if (event->mask & IN_CLOSE_WRITE)
+            m_closed = true;
+        i += sizeof(struct inotify_event) + event->len;
+    }
+    return true;
+}
+
+void InputFollower::waitForEnd()
+{
+    while (wait())
+        ;
+}
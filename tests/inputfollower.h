@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef inputfollower_h
+#define inputfollower_h
+
+#include "common/NonCopyable.h"
+
+#include <stdint.h>
+#include <sys/types.h>
+
+//tail mode for a file that is still being written, e.g. a recorder segment.
+//the end of the file only means "not yet": we wait on inotify for more
+//data, and the input ends when a writer closes the file or it does not
+//grow for idleMs.
+class InputFollower
+{
+public:
+    InputFollower();
+    ~InputFollower();
+
+    //watch the regular file behind fd, it stays owned by the caller
+    bool init(int fd, uint32_t idleMs);
+
+    //like read(2), but at the end of the file wait for more. 0 is the end.
+    ssize_t read(void* data, size_t size);
+    //wait for the file to change, false once the writer is done with it.
+    //after true, read again, the last data may come with the close
+    bool wait();
+    //wait until the writer is done, for inputs that need the whole file
+    void waitForEnd();
+
+private:
+    int m_fd;
+    int m_inotify;
+    uint32_t m_idleMs;
+    bool m_closed;
+    DISALLOW_COPY_AND_ASSIGN(InputFollower);
+};
+
+#endif //inputfollower_h
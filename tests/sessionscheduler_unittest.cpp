@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "common/sessionscheduler.h"
+
+#include "common/unittest.h"
+
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace YamiMediaCodec;
+
+static uint64_t nowMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+#define SESSIONSCHEDULER_TEST(name) \
+    TEST(SessionSchedulerTest, name)
+
+SESSIONSCHEDULER_TEST(ParsePriority)
+{
+    SessionPriority priority = SESSION_PRIORITY_COUNT;
+    EXPECT_TRUE(parseSessionPriority("LIVE", priority));
+    EXPECT_EQ(SESSION_LIVE, priority);
+    EXPECT_TRUE(parseSessionPriority("batch", priority));
+    EXPECT_EQ(SESSION_BATCH, priority);
+    EXPECT_FALSE(parseSessionPriority("realtime", priority));
+}
+
+SESSIONSCHEDULER_TEST(Rate)
+{
+    //6 frames at 100 fps, the last one starts 50 ms after the first
+    ScheduledSession session(SESSION_BATCH, 100);
+    uint64_t start = nowMs();
+    for (int i = 0; i < 6; i++)
+        EXPECT_TRUE(session.pace());
+    uint64_t elapsed = nowMs() - start;
+    EXPECT_LE(49u, elapsed);
+    EXPECT_GT(200u, elapsed);
+}
+
+SESSIONSCHEDULER_TEST(MaxWait)
+{
+    //the next frame is due in 100 ms, we don't wait for it
+    ScheduledSession session(SESSION_BATCH, 10);
+    EXPECT_TRUE(session.pace());
+    uint64_t start = nowMs();
+    EXPECT_FALSE(session.pace(10));
+    EXPECT_GT(50u, nowMs() - start);
+    //it is still the same frame
+    EXPECT_TRUE(session.pace());
+    EXPECT_LE(90u, nowMs() - start);
+}
+
+//a live session at 100 fps behind its deadline
+static SharedPtr<ScheduledSession> lateLiveSession()
+{
+    SharedPtr<ScheduledSession> live(new ScheduledSession(SESSION_LIVE, 100));
+    live->pace();
+    usleep(30 * 1000);
+    live->pace();
+    return live;
+}
+
+struct Batch {
+    uint64_t waitedMs;
+    bool ok;
+};
+
+static void* paceBatch(void* arg)
+{
+    Batch* batch = (Batch*)arg;
+    ScheduledSession session(SESSION_BATCH, 0);
+    uint64_t start = nowMs();
+    batch->ok = session.pace();
+    batch->waitedMs = nowMs() - start;
+    return NULL;
+}
+
+SESSIONSCHEDULER_TEST(Held)
+{
+    //batch waits while live is late, and goes on as soon as it is not
+    SharedPtr<ScheduledSession> live = lateLiveSession();
+    Batch batch;
+    batch.ok = false;
+    pthread_t thread;
+    ASSERT_EQ(0, pthread_create(&thread, NULL, paceBatch, &batch));
+    usleep(30 * 1000);
+    live.reset();
+    pthread_join(thread, NULL);
+    EXPECT_TRUE(batch.ok);
+    EXPECT_LE(25u, batch.waitedMs);
+    EXPECT_GT(80u, batch.waitedMs);
+}
+
+SESSIONSCHEDULER_TEST(HeldMaxWait)
+{
+    //a held pool task gives its thread back after maxWaitMs
+    SharedPtr<ScheduledSession> live = lateLiveSession();
+    ScheduledSession batch(SESSION_BATCH, 0);
+    uint64_t start = nowMs();
+    EXPECT_FALSE(batch.pace(10));
+    EXPECT_GT(50u, nowMs() - start);
+}
+
+SESSIONSCHEDULER_TEST(Throttle)
+{
+    //a live session stuck behind does not stop batch for good
+    SharedPtr<ScheduledSession> live = lateLiveSession();
+    Batch batch;
+    paceBatch(&batch);
+    EXPECT_TRUE(batch.ok);
+    EXPECT_LE(90u, batch.waitedMs);
+    EXPECT_GT(300u, batch.waitedMs);
+}
+
+SESSIONSCHEDULER_TEST(LiveNotHeld)
+{
+    SharedPtr<ScheduledSession> late = lateLiveSession();
+    ScheduledSession live(SESSION_LIVE, 0);
+    uint64_t start = nowMs();
+    EXPECT_TRUE(live.pace());
+    EXPECT_GT(20u, nowMs() - start);
+}
@@ -0,0 +1,337 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "common/common_def.h"
+#include "common/surfacebudget.h"
+#include "vppinputoutput.h"
+
+#include "common/unittest.h"
+
+#include <pthread.h>
+#include <set>
+#include <stdlib.h>
+#include <time.h>
+
+using namespace YamiMediaCodec;
+using std::vector;
+
+//the budget reads its cap once, before any test uses it.
+//10 surfaces of 256x256 nv12 fit in it
+static int s_capSet = setenv("YAMI_SURFACE_BUDGET_MB", "1", 1);
+
+#define WIDTH 256
+#define HEIGHT 256
+#define FITS 10
+
+//the driver, surfaces are numbers
+static Lock s_lock;
+static VASurfaceID s_nextSurface = 1;
+static std::set<VASurfaceID> s_live;
+static uint32_t s_created = 0;
+
+VAStatus vaCreateSurfaces(VADisplay, unsigned int, unsigned int, unsigned int,
+    VASurfaceID* surfaces, unsigned int count, VASurfaceAttrib*, unsigned int)
+{
+    AutoLock lock(s_lock);
+    for (unsigned int i = 0; i < count; i++) {
+        surfaces[i] = s_nextSurface++;
+        s_live.insert(surfaces[i]);
+    }
+    s_created += count;
+    return VA_STATUS_SUCCESS;
+}
+
+VAStatus vaDestroySurfaces(VADisplay, VASurfaceID* surfaces, int count)
+{
+    AutoLock lock(s_lock);
+    for (int i = 0; i < count; i++)
+        s_live.erase(surfaces[i]);
+    return VA_STATUS_SUCCESS;
+}
+
+static size_t liveSurfaces()
+{
+    AutoLock lock(s_lock);
+    return s_live.size();
+}
+
+//the pools are tested without their metrics, vppinputoutput.cpp is not linked
+void installPoolMetrics()
+{
+}
+
+static uint64_t nowMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint32_t createdSurfaces()
+{
+    AutoLock lock(s_lock);
+    return s_created;
+}
+
+//every test has its own display, nothing is kept between them
+static VADisplay s_display = (VADisplay)0x1000;
+
+class SurfaceBudgetTest : public ::testing::Test {
+protected:
+    SurfaceBudgetTest()
+        : m_budget(SurfaceBudget::getInstance())
+        , m_display(s_display)
+    {
+        s_display = (VADisplay)((intptr_t)s_display + 1);
+    }
+    virtual void SetUp()
+    {
+        ASSERT_EQ(0, s_capSet);
+        m_live = liveSurfaces();
+    }
+    virtual void TearDown()
+    {
+        m_budget.flush(m_display);
+        EXPECT_EQ(m_live, liveSurfaces());
+    }
+    bool acquire(uint32_t minimum, uint32_t count, vector<VASurfaceID>& surfaces,
+        uint32_t width = WIDTH)
+    {
+        return m_budget.acquire(m_display, VA_FOURCC_NV12, width, HEIGHT, minimum, count, surfaces);
+    }
+    void release(const vector<VASurfaceID>& surfaces, uint32_t width = WIDTH)
+    {
+        m_budget.release(m_display, VA_FOURCC_NV12, width, HEIGHT, surfaces);
+    }
+
+    SurfaceBudget& m_budget;
+    VADisplay m_display;
+    size_t m_live;
+};
+
+#define SURFACEBUDGET_TEST(name) \
+    TEST_F(SurfaceBudgetTest, name)
+
+SURFACEBUDGET_TEST(SizeClass)
+{
+    uint32_t width = 1920;
+    uint32_t height = 1080;
+    SurfaceBudget::getSizeClass(width, height);
+    EXPECT_EQ(1920u, width);
+    EXPECT_EQ(1088u, height);
+}
+
+SURFACEBUDGET_TEST(Reuse)
+{
+    //surfaces given back are handed out again to the same size class
+    vector<VASurfaceID> surfaces;
+    ASSERT_TRUE(acquire(2, 3, surfaces));
+    ASSERT_EQ(3u, surfaces.size());
+    std::set<VASurfaceID> first(surfaces.begin(), surfaces.end());
+    release(surfaces);
+
+    uint32_t created = createdSurfaces();
+    vector<VASurfaceID> again;
+    ASSERT_TRUE(acquire(2, 3, again, WIDTH - 8));
+    EXPECT_EQ(first, std::set<VASurfaceID>(again.begin(), again.end()));
+    EXPECT_EQ(created, createdSurfaces());
+    release(again, WIDTH - 8);
+}
+
+SURFACEBUDGET_TEST(Denied)
+{
+    //only the guaranteed surfaces are given over the cap
+    vector<VASurfaceID> held;
+    ASSERT_TRUE(acquire(2, FITS - 1, held));
+    ASSERT_EQ(FITS - 1u, held.size());
+    vector<VASurfaceID> surfaces;
+    ASSERT_TRUE(acquire(0, 5, surfaces));
+    EXPECT_EQ(1u, surfaces.size());
+    vector<VASurfaceID> none;
+    ASSERT_TRUE(acquire(0, 5, none));
+    EXPECT_TRUE(none.empty());
+    release(surfaces);
+    release(held);
+}
+
+SURFACEBUDGET_TEST(Evict)
+{
+    //kept surfaces of another size class make room for a new one
+    vector<VASurfaceID> small;
+    ASSERT_TRUE(acquire(2, FITS, small, WIDTH / 2));
+    release(small, WIDTH / 2);
+    size_t live = liveSurfaces();
+    vector<VASurfaceID> surfaces;
+    ASSERT_TRUE(acquire(2, FITS, surfaces));
+    EXPECT_EQ((size_t)FITS, surfaces.size());
+    EXPECT_GT(live + FITS, liveSurfaces());
+    release(surfaces);
+}
+
+struct Waiter {
+    SurfaceBudgetTest* test;
+    vector<VASurfaceID> surfaces;
+    bool ok;
+};
+
+class SurfaceBudgetWaitTest : public SurfaceBudgetTest {
+public:
+    static void* acquireInThread(void* arg)
+    {
+        Waiter* waiter = (Waiter*)arg;
+        SurfaceBudgetWaitTest* test = (SurfaceBudgetWaitTest*)waiter->test;
+        waiter->ok = test->acquire(2, 4, waiter->surfaces);
+        return NULL;
+    }
+};
+
+TEST_F(SurfaceBudgetWaitTest, Wait)
+{
+    //the guaranteed surfaces wait until others give theirs back
+    vector<VASurfaceID> held;
+    ASSERT_TRUE(acquire(2, FITS, held));
+    ASSERT_EQ((size_t)FITS, held.size());
+    EXPECT_FALSE(m_budget.isContended());
+
+    Waiter waiter;
+    waiter.test = this;
+    waiter.ok = false;
+    pthread_t thread;
+    ASSERT_EQ(0, pthread_create(&thread, NULL, acquireInThread, &waiter));
+    for (int i = 0; i < 1000 && !m_budget.isContended(); i++)
+        usleep(1000);
+    EXPECT_TRUE(m_budget.isContended());
+
+    //one surface is not enough for the waiter, two are
+    vector<VASurfaceID> back(held.end() - 1, held.end());
+    held.pop_back();
+    release(back);
+    usleep(20 * 1000);
+    EXPECT_TRUE(m_budget.isContended());
+    back.assign(held.end() - 1, held.end());
+    held.pop_back();
+    release(back);
+    pthread_join(thread, NULL);
+    EXPECT_TRUE(waiter.ok);
+    EXPECT_EQ(2u, waiter.surfaces.size());
+    EXPECT_FALSE(m_budget.isContended());
+    release(waiter.surfaces);
+    release(held);
+}
+
+class PooledFrameAllocatorTest : public SurfaceBudgetTest {
+protected:
+    SharedPtr<FrameAllocator> create(size_t poolsize)
+    {
+        SharedPtr<VADisplay> display(new VADisplay(m_display));
+        return SharedPtr<FrameAllocator>(new PooledFrameAllocator(display, poolsize));
+    }
+};
+
+#define POOLEDFRAMEALLOCATOR_TEST(name) \
+    TEST_F(PooledFrameAllocatorTest, name)
+
+struct Release {
+    SharedPtr<VideoFrame> frame;
+    uint32_t afterMs;
+};
+
+static void* releaseLater(void* arg)
+{
+    Release* release = (Release*)arg;
+    usleep(release->afterMs * 1000);
+    release->frame.reset();
+    return NULL;
+}
+
+POOLEDFRAMEALLOCATOR_TEST(Backpressure)
+{
+    //alloc() does not wait, the caller does
+    SharedPtr<FrameAllocator> allocator = create(2);
+    ASSERT_TRUE(allocator->setFormat(VA_FOURCC_NV12, WIDTH, HEIGHT));
+    SharedPtr<VideoFrame> first = allocator->alloc();
+    Release release;
+    release.frame = allocator->alloc();
+    release.afterMs = 20;
+    ASSERT_TRUE(first && release.frame);
+    EXPECT_EQ(WIDTH, release.frame->crop.width);
+    EXPECT_FALSE(allocator->alloc());
+    EXPECT_FALSE(allocator->waitForFrame(1));
+
+    pthread_t thread;
+    ASSERT_EQ(0, pthread_create(&thread, NULL, releaseLater, &release));
+    SharedPtr<VideoFrame> frame = allocFrame(allocator, POOL_WAIT_MS);
+    pthread_join(thread, NULL);
+    EXPECT_TRUE(frame);
+}
+
+POOLEDFRAMEALLOCATOR_TEST(Regrow)
+{
+    //a larger format while we hold a frame of the old one does not wait
+    //for it, the free surfaces go back first
+    SharedPtr<FrameAllocator> allocator = create(FITS);
+    ASSERT_TRUE(allocator->setFormat(VA_FOURCC_NV12, WIDTH, HEIGHT));
+    SharedPtr<VideoFrame> old = allocator->alloc();
+    ASSERT_TRUE(old);
+    ASSERT_TRUE(allocator->setFormat(VA_FOURCC_NV12, WIDTH, HEIGHT + 16));
+    SharedPtr<VideoFrame> frame = allocator->alloc();
+    ASSERT_TRUE(frame);
+    EXPECT_EQ(HEIGHT + 16, frame->crop.height);
+}
+
+POOLEDFRAMEALLOCATOR_TEST(Reclaim)
+{
+    //two pools fill the budget with idle surfaces, the third takes
+    //them back instead of waiting for its minimum
+    SharedPtr<FrameAllocator> a = create(FITS / 2);
+    SharedPtr<FrameAllocator> b = create(FITS / 2);
+    SharedPtr<FrameAllocator> c = create(FITS / 2);
+    ASSERT_TRUE(a->setFormat(VA_FOURCC_NV12, WIDTH, HEIGHT));
+    ASSERT_TRUE(b->setFormat(VA_FOURCC_NV12, WIDTH, HEIGHT));
+    uint64_t start = nowMs();
+    ASSERT_TRUE(c->setFormat(VA_FOURCC_NV12, WIDTH, HEIGHT));
+    EXPECT_GT(500u, nowMs() - start);
+    EXPECT_FALSE(m_budget.isContended());
+    //every pool kept its minimum
+    SharedPtr<FrameAllocator> pools[] = { a, b, c };
+    for (size_t i = 0; i < N_ELEMENTS(pools); i++) {
+        SharedPtr<VideoFrame> first = pools[i]->alloc();
+        SharedPtr<VideoFrame> second = pools[i]->alloc();
+        EXPECT_TRUE(first && second);
+    }
+}
+
+POOLEDFRAMEALLOCATOR_TEST(ReclaimBusy)
+{
+    //frames out can't be reclaimed, the wait for room gives up
+    SharedPtr<FrameAllocator> full = create(FITS);
+    ASSERT_TRUE(full->setFormat(VA_FOURCC_NV12, WIDTH, HEIGHT));
+    vector<SharedPtr<VideoFrame> > out;
+    for (int i = 0; i < FITS; i++) {
+        out.push_back(full->alloc());
+        ASSERT_TRUE(out.back());
+    }
+    vector<VASurfaceID> surfaces;
+    uint64_t start = nowMs();
+    EXPECT_FALSE(m_budget.acquire(m_display, VA_FOURCC_NV12, WIDTH, HEIGHT, 2, 4, surfaces, 50));
+    EXPECT_LE(45u, nowMs() - start);
+    EXPECT_TRUE(surfaces.empty());
+    EXPECT_FALSE(m_budget.isContended());
+}
@@ -0,0 +1,387 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "udpreceiver.h"
+#include "common/common_def.h"
+#include "common/log.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <time.h>
+#include <unistd.h>
+
+using namespace YamiMediaCodec;
+
+//seven ts packets and a rtp header, with room for rtp extensions
+#define UDP_MAX_DATAGRAM 2048
+#define UDP_RECV_BATCH 32
+#define UDP_ARENA_PACKETS 256
+//about 160ms at 50 Mbps, the kernel holds datagrams while we decode
+#define UDP_RECV_BUFFER (4 << 20)
+//power of 2, under half of the arena
+#define RTP_JITTER_SLOTS 64
+#define RTP_JITTER_MS 20
+#define RTP_HEADER_SIZE 12
+
+static uint64_t nowMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+UdpReceiver::UdpReceiver()
+    : m_fd(-1)
+    , m_rtp(false)
+    , m_idleMs(UDP_DEFAULT_IDLE_MS)
+    , m_readyHead(0)
+    , m_readyCount(0)
+    , m_held(0)
+    , m_nextSeq(0)
+    , m_highestSeq(0)
+    , m_seqStarted(false)
+    , m_gapSince(0)
+    , m_lost(false)
+    , m_current(-1)
+    , m_currentOffset(0)
+    , m_datagrams(NULL)
+    , m_bytes(NULL)
+    , m_lostPackets(NULL)
+    , m_reordered(NULL)
+    , m_late(NULL)
+    , m_batchSize(NULL)
+{
+}
+
+UdpReceiver::~UdpReceiver()
+{
+    if (m_fd >= 0)
+        close(m_fd);
+    if (!m_labels.empty())
+        Metrics::getInstance().remove(m_labels.c_str());
+}
+
+bool UdpReceiver::isUrl(const char* name)
+{
+    return !strncmp(name, "udp://", 6) || !strncmp(name, "rtp://", 6);
+}
+
+bool UdpReceiver::open(const char* url)
+{
+    m_rtp = !strncmp(url, "rtp://", 6);
+    //udp://@239.0.0.1:1234 is the usual way to write a multicast source
+    std::string host(url + 6);
+    if (!host.empty() && host[0] == '@')
+        host.erase(0, 1);
+    size_t colon = host.rfind(':');
+    if (colon == std::string::npos) {
+        ERROR("no port in %s", url);
+        return false;
+    }
+    int port = atoi(host.c_str() + colon + 1);
+    host.erase(colon);
+    if (port <= 0 || port > 65535) {
+        ERROR("bad port in %s", url);
+        return false;
+    }
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (!host.empty() && inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+        ERROR("bad ipv4 address in %s", url);
+        return false;
+    }
+
+    m_fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (m_fd < 0) {
+        ERROR("create socket failed: %s", strerror(errno));
+        return false;
+    }
+    int on = 1;
+    setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    //best effort, the system limit may be lower
+    int size = UDP_RECV_BUFFER;
+    setsockopt(m_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    if (bind(m_fd, (struct sockaddr*)&addr, sizeof(addr))) {
+        ERROR("bind %s failed: %s", url, strerror(errno));
+        return false;
+    }
+    if (IN_MULTICAST(ntohl(addr.sin_addr.s_addr))) {
+        struct ip_mreq mreq;
+        mreq.imr_multiaddr = addr.sin_addr;
+        mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+        if (setsockopt(m_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq))) {
+            ERROR("join %s failed: %s", url, strerror(errno));
+            return false;
+        }
+    }
+    return true;
+}
+
+bool UdpReceiver::init(const char* url, uint32_t idleMs)
+{
+    if (idleMs)
+        m_idleMs = idleMs;
+    if (!open(url))
+        return false;
+
+    m_arena.resize(UDP_ARENA_PACKETS * UDP_MAX_DATAGRAM);
+    m_offset.resize(UDP_ARENA_PACKETS);
+    m_length.resize(UDP_ARENA_PACKETS);
+    m_ready.resize(UDP_ARENA_PACKETS);
+    //lowest slots first, they are warm in the cache
+    for (uint32_t i = 0; i < UDP_ARENA_PACKETS; i++)
+        m_free.push_back(UDP_ARENA_PACKETS - 1 - i);
+    m_msgs.resize(UDP_RECV_BATCH);
+    m_iovecs.resize(UDP_RECV_BATCH);
+    m_batch.resize(UDP_RECV_BATCH);
+    m_jitter.assign(RTP_JITTER_SLOTS, -1);
+
+    static const uint64_t batchSizes[] = { 1, 2, 4, 8, 16, 32 };
+    Metrics& metrics = Metrics::getInstance();
+    char labels[32];
+    snprintf(labels, sizeof(labels), "input=\"udp%u\"", metrics.newInstanceId());
+    m_labels = labels;
+    m_datagrams = metrics.counter("yami_udp_datagrams_total", labels, "datagrams received");
+    m_bytes = metrics.counter("yami_udp_bytes_total", labels, "bytes of stream received");
+    m_lostPackets = metrics.counter("yami_udp_lost_total", labels, "rtp packets that never came");
+    m_reordered = metrics.counter("yami_udp_reordered_total", labels, "rtp packets that came after a later one");
+    m_late = metrics.counter("yami_udp_late_total", labels, "rtp packets dropped as duplicate or after they were given up");
+    m_batchSize = metrics.histogram("yami_udp_batch_datagrams", labels, "datagrams per recvmmsg",
+        batchSizes, N_ELEMENTS(batchSizes));
+    return true;
+}
+
+int UdpReceiver::receive(int timeoutMs)
+{
+    uint32_t count = std::min((size_t)UDP_RECV_BATCH, m_free.size());
+    if (!count)
+        return 0;
+    struct pollfd fd;
+    fd.fd = m_fd;
+    fd.events = POLLIN;
+    int ret;
+    while ((ret = poll(&fd, 1, timeoutMs)) < 0 && errno == EINTR)
+        ;
+    if (ret <= 0) {
+        if (ret < 0)
+            ERROR("wait for datagrams failed: %s", strerror(errno));
+        return ret;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t slot = m_free[m_free.size() - 1 - i];
+        m_batch[i] = slot;
+        m_iovecs[i].iov_base = &m_arena[slot * UDP_MAX_DATAGRAM];
+        m_iovecs[i].iov_len = UDP_MAX_DATAGRAM;
+        memset(&m_msgs[i], 0, sizeof(m_msgs[i]));
+        m_msgs[i].msg_hdr.msg_iov = &m_iovecs[i];
+        m_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int n;
+    while ((n = recvmmsg(m_fd, &m_msgs[0], count, MSG_DONTWAIT, NULL)) < 0 && errno == EINTR)
+        ;
+    if (n < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return 0;
+        ERROR("receive datagrams failed: %s", strerror(errno));
+        return -1;
+    }
+    m_free.resize(m_free.size() - n);
+    m_batchSize->observe(n);
+    uint64_t now = nowMs();
+    for (int i = 0; i < n; i++)
+        add(m_batch[i], m_msgs[i].msg_len, now);
+    return n;
+}
+
+void UdpReceiver::release(uint32_t slot)
+{
+    m_free.push_back(slot);
+}
+
+void UdpReceiver::add(uint32_t slot, uint32_t length, uint64_t now)
+{
+    m_datagrams->add();
+    //an empty read is the end for our reader
+    if (!length) {
+        release(slot);
+        return;
+    }
+    if (m_rtp) {
+        if (!addRtp(slot, length, now))
+            release(slot);
+        return;
+    }
+    m_offset[slot] = 0;
+    m_length[slot] = length;
+    m_ready[(m_readyHead + m_readyCount) % UDP_ARENA_PACKETS] = slot;
+    m_readyCount++;
+}
+
+void UdpReceiver::dropHeld()
+{
+    for (uint32_t i = 0; i < RTP_JITTER_SLOTS; i++) {
+        if (m_jitter[i] >= 0) {
+            release(m_jitter[i]);
+            m_jitter[i] = -1;
+        }
+    }
+    m_held = 0;
+}
+
+bool UdpReceiver::addRtp(uint32_t slot, uint32_t length, uint64_t now)
+{
+    const uint8_t* p = &m_arena[slot * UDP_MAX_DATAGRAM];
+    if (length < RTP_HEADER_SIZE || (p[0] >> 6) != 2)
+        return false;
+    uint32_t offset = RTP_HEADER_SIZE + (p[0] & 0x0f) * 4;
+    if (p[0] & 0x10) {
+        //the extension header and the words it counts
+        if (offset + 4 > length)
+            return false;
+        offset += 4 + ((p[offset + 2] << 8) | p[offset + 3]) * 4;
+    }
+    uint32_t padding = (p[0] & 0x20) ? p[length - 1] : 0;
+    if (offset + padding >= length)
+        return false;
+    m_offset[slot] = offset;
+    m_length[slot] = length - offset - padding;
+
+    uint16_t seq = (p[2] << 8) | p[3];
+    if (!m_seqStarted) {
+        m_seqStarted = true;
+        m_nextSeq = seq;
+        m_highestSeq = seq - 1;
+    }
+    int16_t diff = seq - m_nextSeq;
+    if (diff < 0 || m_jitter[seq % RTP_JITTER_SLOTS] >= 0) {
+        m_late->add();
+        return false;
+    }
+    if (diff >= RTP_JITTER_SLOTS) {
+        //too far ahead to wait for the ones between, a restarted sender or
+        //a long outage. start over here
+        m_lostPackets->add(diff - m_held);
+        dropHeld();
+        m_nextSeq = seq;
+        m_highestSeq = seq - 1;
+        m_gapSince = 0;
+        m_lost = true;
+    }
+    if ((int16_t)(seq - m_highestSeq) > 0)
+        m_highestSeq = seq;
+    else
+        m_reordered->add();
+    m_jitter[seq % RTP_JITTER_SLOTS] = slot;
+    m_held++;
+    if (!m_gapSince && seq != m_nextSeq)
+        m_gapSince = now;
+    return true;
+}
+
+int UdpReceiver::next(bool& discontinuity, uint64_t now)
+{
+    if (!m_rtp) {
+        if (!m_readyCount)
+            return -1;
+        uint32_t slot = m_ready[m_readyHead];
+        m_readyHead = (m_readyHead + 1) % UDP_ARENA_PACKETS;
+        m_readyCount--;
+        return slot;
+    }
+    while (m_held) {
+        int& entry = m_jitter[m_nextSeq % RTP_JITTER_SLOTS];
+        if (entry >= 0) {
+            int slot = entry;
+            entry = -1;
+            m_held--;
+            m_nextSeq++;
+            m_gapSince = m_held && m_jitter[m_nextSeq % RTP_JITTER_SLOTS] < 0 ? now : 0;
+            discontinuity = m_lost;
+            m_lost = false;
+            return slot;
+        }
+        if (!m_gapSince)
+            m_gapSince = now;
+        //later ones wait for it until the jitter time is over, or the buffer is half full
+        if (now - m_gapSince < RTP_JITTER_MS && m_held < RTP_JITTER_SLOTS / 2)
+            return -1;
+        //the ones up to the next we hold were missing as long, give them up too
+        uint32_t lost = 0;
+        do {
+            m_nextSeq++;
+            lost++;
+        } while (m_jitter[m_nextSeq % RTP_JITTER_SLOTS] < 0);
+        m_lostPackets->add(lost);
+        m_gapSince = 0;
+        m_lost = true;
+    }
+    return -1;
+}
+
+int UdpReceiver::getWaitMs(uint64_t now)
+{
+    //a missing rtp packet is only waited for the jitter time
+    if (m_held && m_gapSince) {
+        uint64_t waited = now - m_gapSince;
+        return waited < RTP_JITTER_MS ? RTP_JITTER_MS - waited : 0;
+    }
+    return m_idleMs;
+}
+
+ssize_t UdpReceiver::read(uint8_t* data, size_t size, bool& discontinuity)
+{
+    discontinuity = false;
+    while (m_current < 0) {
+        uint64_t now = nowMs();
+        m_current = next(discontinuity, now);
+        if (m_current >= 0) {
+            m_currentOffset = 0;
+            break;
+        }
+        bool waitingForGap = m_held;
+        int n = receive(getWaitMs(now));
+        if (n < 0)
+            return -1;
+        if (!n && !waitingForGap) {
+            INFO("no datagram for %u ms, take it as the end", m_idleMs);
+            return 0;
+        }
+    }
+    uint32_t slot = m_current;
+    size_t n = std::min(size, (size_t)(m_length[slot] - m_currentOffset));
+    memcpy(data, &m_arena[slot * UDP_MAX_DATAGRAM + m_offset[slot] + m_currentOffset], n);
+    m_currentOffset += n;
+    m_bytes->add(n);
+    if (m_currentOffset == m_length[slot]) {
+        release(slot);
+        m_current = -1;
+    }
+    return n;
+}
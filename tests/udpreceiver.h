@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef udpreceiver_h
+#define udpreceiver_h
+
+#include "common/metrics.h"
+#include "common/NonCopyable.h"
+
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <vector>
+
+//the stream ends when nothing comes for this long
+#define UDP_DEFAULT_IDLE_MS 5000
+
+//receives a mpeg-ts stream sent as udp datagrams, or rtp over udp, on
+//udp://[addr]:port or rtp://[addr]:port. a multicast addr is joined, an
+//empty one binds to every local address. ipv4 only.
+//
+//datagrams are received in batches with recvmmsg straight into a fixed
+//arena of packet buffers, so nothing is allocated after init. rtp packets
+//go through a reorder buffer by sequence number, a missing one is waited
+//for RTP_JITTER_MS before it is taken as lost.
+class UdpReceiver
+{
+public:
+    UdpReceiver();
+    ~UdpReceiver();
+
+    static bool isUrl(const char* name);
+    //idleMs 0 is UDP_DEFAULT_IDLE_MS
+    bool init(const char* url, uint32_t idleMs);
+
+    //copy up to size bytes of the stream, from one datagram at most.
+    //discontinuity is set when datagrams before these bytes were lost.
+    //0 is the end, nothing came for the idle time
+    ssize_t read(uint8_t* data, size_t size, bool& discontinuity);
+
+private:
+    bool open(const char* url);
+    //receive one batch into free arena buffers, return the datagram count
+    int receive(int timeoutMs);
+    void add(uint32_t slot, uint32_t length, uint64_t now);
+    bool addRtp(uint32_t slot, uint32_t length, uint64_t now);
+    //the next datagram in order, -1 if it did not come yet
+    int next(bool& discontinuity, uint64_t now);
+    int getWaitMs(uint64_t now);
+    void release(uint32_t slot);
+    void dropHeld();
+
+    int m_fd;
+    bool m_rtp;
+    uint32_t m_idleMs;
+
+    //arena of equal buffers, and the payload of the datagram in each
+    std::vector<uint8_t> m_arena;
+    std::vector<uint32_t> m_offset;
+    std::vector<uint32_t> m_length;
+    std::vector<uint32_t> m_free;
+
+    //recvmmsg batch, each entry points at a free buffer
+    std::vector<struct mmsghdr> m_msgs;
+    std::vector<struct iovec> m_iovecs;
+    std::vector<uint32_t> m_batch;
+
+    //plain udp datagrams in arrival order, a ring over the arena size
+    std::vector<uint32_t> m_ready;
+    uint32_t m_readyHead;
+    uint32_t m_readyCount;
+
+    //rtp reorder buffer indexed by sequence number, -1 is empty
+    std::vector<int> m_jitter;
+    uint32_t m_held;
+    uint16_t m_nextSeq;
+    uint16_t m_highestSeq;
+    bool m_seqStarted;
+    //when we started to wait for the missing m_nextSeq
+    uint64_t m_gapSince;
+    bool m_lost;
+
+    int m_current;
+    uint32_t m_currentOffset;
+
+    //our instance labels
+    std::string m_labels;
+    YamiMediaCodec::Counter* m_datagrams;
+    YamiMediaCodec::Counter* m_bytes;
+    YamiMediaCodec::Counter* m_lostPackets;
+    YamiMediaCodec::Counter* m_reordered;
+    YamiMediaCodec::Counter* m_late;
+    YamiMediaCodec::Histogram* m_batchSize;
+    DISALLOW_COPY_AND_ASSIGN(UdpReceiver);
+};
+
+#endif //udpreceiver_h
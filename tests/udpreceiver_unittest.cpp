@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "udpreceiver.h"
+#include "common/common_def.h"
+
+#include "common/unittest.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+//the stream ends this long after the last datagram
+#define IDLE_MS 100
+
+//datagrams sent over loopback to a receiver on a free port
+class Loopback {
+public:
+    Loopback()
+        : m_fd(socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0))
+    {
+        memset(&m_addr, 0, sizeof(m_addr));
+        m_addr.sin_family = AF_INET;
+        m_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        //the kernel picks a free port, the receiver binds it after we let it go
+        int probe = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        socklen_t size = sizeof(m_addr);
+        if (probe < 0 || bind(probe, (struct sockaddr*)&m_addr, size)
+            || getsockname(probe, (struct sockaddr*)&m_addr, &size)) {
+            close(m_fd);
+            m_fd = -1;
+        }
+        if (probe >= 0)
+            close(probe);
+    }
+    ~Loopback()
+    {
+        if (m_fd >= 0)
+            close(m_fd);
+    }
+    bool open(UdpReceiver& receiver, const char* scheme)
+    {
+        if (m_fd < 0)
+            return false;
+        char url[64];
+        snprintf(url, sizeof(url), "%s://127.0.0.1:%u", scheme, ntohs(m_addr.sin_port));
+        return receiver.init(url, IDLE_MS);
+    }
+    bool send(const string& datagram)
+    {
+        return sendto(m_fd, datagram.data(), datagram.size(), 0,
+                   (struct sockaddr*)&m_addr, sizeof(m_addr))
+            == (ssize_t)datagram.size();
+    }
+
+private:
+    int m_fd;
+    struct sockaddr_in m_addr;
+};
+
+static string payload(uint16_t seq)
+{
+    char data[16];
+    snprintf(data, sizeof(data), "packet%u", seq);
+    return data;
+}
+
+//version 2, mpeg-ts payload type, then the extension if there is one
+static string rtp(uint16_t seq, const string& extension = string())
+{
+    string packet(12, '\0');
+    packet[0] = extension.empty() ? 0x80 : 0x90;
+    packet[1] = 33;
+    packet[2] = seq >> 8;
+    packet[3] = seq;
+    return packet + extension + payload(seq);
+}
+
+static bool sendRtp(Loopback& loopback, const vector<uint16_t>& seqs)
+{
+    for (size_t i = 0; i < seqs.size(); i++) {
+        if (!loopback.send(rtp(seqs[i])))
+            return false;
+    }
+    return true;
+}
+
+template <size_t N>
+static vector<uint16_t> seqs(const uint16_t (&values)[N])
+{
+    return vector<uint16_t>(values, values + N);
+}
+
+//the next datagram of the stream, empty at the end
+static string readDatagram(UdpReceiver& receiver, bool& discontinuity)
+{
+    uint8_t data[2048];
+    ssize_t n = receiver.read(data, sizeof(data), discontinuity);
+    return n > 0 ? string((char*)data, n) : string();
+}
+
+static void expectPayloads(UdpReceiver& receiver, const vector<uint16_t>& expected, int discontinuityAt = -1)
+{
+    bool discontinuity;
+    for (size_t i = 0; i < expected.size(); i++) {
+        EXPECT_EQ(payload(expected[i]), readDatagram(receiver, discontinuity));
+        EXPECT_EQ((int)i == discontinuityAt, discontinuity);
+    }
+    EXPECT_EQ("", readDatagram(receiver, discontinuity));
+}
+
+#define UDPRECEIVER_TEST(name) \
+    TEST(UdpReceiverTest, name)
+
+UDPRECEIVER_TEST(Udp)
+{
+    //plain datagrams come as they are, in arrival order
+    Loopback loopback;
+    UdpReceiver receiver;
+    ASSERT_TRUE(loopback.open(receiver, "udp"));
+    static const uint16_t order[] = { 3, 1, 2, 0 };
+    for (size_t i = 0; i < N_ELEMENTS(order); i++)
+        ASSERT_TRUE(loopback.send(payload(order[i])));
+    expectPayloads(receiver, seqs(order));
+}
+
+UDPRECEIVER_TEST(Reorder)
+{
+    Loopback loopback;
+    UdpReceiver receiver;
+    ASSERT_TRUE(loopback.open(receiver, "rtp"));
+    static const uint16_t sent[] = { 10, 12, 11, 13 };
+    static const uint16_t expected[] = { 10, 11, 12, 13 };
+    ASSERT_TRUE(sendRtp(loopback, seqs(sent)));
+    expectPayloads(receiver, seqs(expected));
+}
+
+UDPRECEIVER_TEST(Gap)
+{
+    //the missing one is given up after the jitter time
+    Loopback loopback;
+    UdpReceiver receiver;
+    ASSERT_TRUE(loopback.open(receiver, "rtp"));
+    static const uint16_t sent[] = { 10, 11, 13, 14 };
+    ASSERT_TRUE(sendRtp(loopback, seqs(sent)));
+    expectPayloads(receiver, seqs(sent), 2);
+}
+
+UDPRECEIVER_TEST(GapBurst)
+{
+    //a run of missing ones is one gap
+    Loopback loopback;
+    UdpReceiver receiver;
+    ASSERT_TRUE(loopback.open(receiver, "rtp"));
+    static const uint16_t sent[] = { 10, 14, 15, 16 };
+    ASSERT_TRUE(sendRtp(loopback, seqs(sent)));
+    expectPayloads(receiver, seqs(sent), 1);
+}
+
+UDPRECEIVER_TEST(Duplicate)
+{
+    Loopback loopback;
+    UdpReceiver receiver;
+    ASSERT_TRUE(loopback.open(receiver, "rtp"));
+    //across the sequence number wrap
+    static const uint16_t sent[] = { 65534, 65535, 65535, 0 };
+    static const uint16_t expected[] = { 65534, 65535, 0 };
+    ASSERT_TRUE(sendRtp(loopback, seqs(sent)));
+    expectPayloads(receiver, seqs(expected));
+}
+
+UDPRECEIVER_TEST(Extension)
+{
+    //the extension is skipped, one that runs past the packet drops it
+    Loopback loopback;
+    UdpReceiver receiver;
+    ASSERT_TRUE(loopback.open(receiver, "rtp"));
+    ASSERT_TRUE(loopback.send(rtp(10, string("\xbe\xde\x00\x01\x01\x02\x03\x04", 8))));
+    ASSERT_TRUE(loopback.send(rtp(11, string("\xbe\xde\x00\x10", 4))));
+    string truncated = rtp(12).substr(0, 14);
+    truncated[0] = 0x90;
+    ASSERT_TRUE(loopback.send(truncated));
+    ASSERT_TRUE(loopback.send(rtp(13)));
+    static const uint16_t expected[] = { 10, 13 };
+    expectPayloads(receiver, seqs(expected), 1);
+}
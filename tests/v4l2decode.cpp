@@ -28,9 +28,13 @@
 #include <vector>
 #include <stdint.h>
 #include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
 
 #include "common/log.h"
 #include "common/utils.h"
+#include "common/lock.h"
+#include "common/condition.h"
 #include "decodeinput.h"
 #include "decodehelp.h"
 #if ANDROID
@@ -44,6 +48,9 @@
 #ifndef V4L2_EVENT_RESOLUTION_CHANGE
     #define V4L2_EVENT_RESOLUTION_CHANGE 5
 #endif
+#ifndef V4L2_BUF_FLAG_LAST
+    #define V4L2_BUF_FLAG_LAST 0x00100000
+#endif
 
 #if __ENABLE_V4L2_OPS__
 #include "v4l2/v4l2codec_device_ops.h"
@@ -202,12 +209,86 @@ static std::vector<EGLImageKHR> eglImages;
 static std::vector<GLuint> textureIds;
 #endif
 static bool isReadEOS=false;
-static int32_t stagingBufferInDevice = 0;
+//the device gave its last frame after we asked it to drain
+static bool outputLast = false;
+//the device does not take the stop command, we wait for it to go quiet
+static bool drainByQuiet = false;
 static uint32_t renderFrameCount = 0;
 
 static DecodeParameter params;
 
-bool feedOneInputFrame(DecodeInput * input, int fd, int index = -1 /* if index is not -1, simple enque it*/)
+static uint64_t getMicroseconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+//how long buffers stay in a v4l2 queue, from QBUF to DQBUF
+struct QueueStats {
+    QueueStats(const char* queueName)
+        : name(queueName)
+        , count(0)
+        , total(0)
+        , max(0)
+    {
+    }
+    void queued(uint32_t index)
+    {
+        if (index >= queuedTime.size())
+            queuedTime.resize(index + 1);
+        queuedTime[index] = getMicroseconds();
+    }
+    void dequeued(uint32_t index)
+    {
+        if (index >= queuedTime.size() || !queuedTime[index])
+            return;
+        uint64_t t = getMicroseconds() - queuedTime[index];
+        queuedTime[index] = 0;
+        count++;
+        total += t;
+        if (t > max)
+            max = t;
+    }
+    void print()
+    {
+        if (!count)
+            return;
+        fprintf(stdout, "%s queue: %" PRIu64 " buffers, residency avg %.2f ms, max %.2f ms\n",
+            name, count, total / 1000.0 / count, max / 1000.0);
+    }
+    const char* name;
+    std::vector<uint64_t> queuedTime;
+    uint64_t count;
+    uint64_t total;
+    uint64_t max;
+};
+
+//only touched by the input thread after start
+static QueueStats inputStats("input");
+//only touched by the main thread
+static QueueStats outputStats("capture");
+
+//dequeue a consumed input buffer, return -1 if the device holds all of them
+int32_t dequeueInputBuffer(int fd)
+{
+    struct v4l2_buffer buf;
+    struct v4l2_plane planes[k_inputPlaneCount];
+
+    memset(&buf, 0, sizeof(buf));
+    memset(&planes, 0, sizeof(planes));
+    buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE; // it indicates input buffer(raw frame) type
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.m.planes = planes;
+    buf.length = k_inputPlaneCount;
+    if (SIMULATE_V4L2_OP(Ioctl)(fd, VIDIOC_DQBUF, &buf) == -1)
+        return -1;
+    inputStats.dequeued(buf.index);
+    return buf.index;
+}
+
+//fill input buffer index and queue it to device, return false after EOS
+bool feedOneInputFrame(DecodeInput * input, int fd, int index)
 {
 
     VideoDecodeBuffer inputBuffer;
@@ -221,38 +302,56 @@ bool feedOneInputFrame(DecodeInput * input, int fd, int index = -1 /* if index i
     buf.memory = V4L2_MEMORY_MMAP;
     buf.m.planes = planes;
     buf.length = k_inputPlaneCount;
-
-    if (index == -1) {
-        ioctlRet = SIMULATE_V4L2_OP(Ioctl)(fd, VIDIOC_DQBUF, &buf);
-        if (ioctlRet == -1)
-            return true;
-        stagingBufferInDevice --;
-    } else {
-        buf.index = index;
-    }
+    buf.index = index;
 
     if (isReadEOS)
         return false;
 
     if (!input->getNextDecodeUnit(inputBuffer)) {
-        // send empty buffer for EOS
-        buf.m.planes[0].bytesused = 0;
+        //index stays with us, startDrain may use it
         isReadEOS = true;
-    } else {
-        ASSERT(inputBuffer.size <= k_maxInputBufferSize);
-        memcpy(inputFrames[buf.index], inputBuffer.data, inputBuffer.size);
-        buf.m.planes[0].bytesused = inputBuffer.size;
-        buf.m.planes[0].m.mem_offset = 0;
-        buf.flags = inputBuffer.flag;
+        return false;
     }
+    ASSERT(inputBuffer.size <= k_maxInputBufferSize);
+    memcpy(inputFrames[buf.index], inputBuffer.data, inputBuffer.size);
+    buf.m.planes[0].bytesused = inputBuffer.size;
+    buf.m.planes[0].m.mem_offset = 0;
+    buf.flags = inputBuffer.flag;
 
     ioctlRet = SIMULATE_V4L2_OP(Ioctl)(fd, VIDIOC_QBUF, &buf);
     ASSERT(ioctlRet != -1);
 
-    stagingBufferInDevice ++;
+    inputStats.queued(buf.index);
     return true;
 }
 
+//after input EOS, ask the device to decode everything it holds. it flags the
+//last capture buffer or sends an EOS event. devices without the stop command
+//take an empty input buffer at index instead.
+static void startDrain(int32_t fd, int32_t index)
+{
+    struct v4l2_decoder_cmd cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.cmd = V4L2_DEC_CMD_STOP;
+    if (SIMULATE_V4L2_OP(Ioctl)(fd, VIDIOC_DECODER_CMD, &cmd) == 0)
+        return;
+    WARNING("device has no V4L2_DEC_CMD_STOP, the end of stream is when it goes quiet");
+    drainByQuiet = true;
+
+    struct v4l2_buffer buf;
+    struct v4l2_plane planes[k_inputPlaneCount];
+    memset(&buf, 0, sizeof(buf));
+    memset(&planes, 0, sizeof(planes));
+    buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.m.planes = planes;
+    buf.length = k_inputPlaneCount;
+    buf.index = index;
+    int ioctlRet = SIMULATE_V4L2_OP(Ioctl)(fd, VIDIOC_QBUF, &buf);
+    ASSERT(ioctlRet != -1);
+    inputStats.queued(buf.index);
+}
+
 bool dumpOneVideoFrame(int32_t index)
 {
     uint32_t row;
@@ -317,6 +416,7 @@ static bool displayOneVideoFrameAndroid(int32_t fd, int32_t index)
 
     ioctlRet = SIMULATE_V4L2_OP(Ioctl)(fd, VIDIOC_QBUF, &buffer);
     ASSERT(ioctlRet != -1);
+    outputStats.queued(buffer.index);
 
     return true;
 }
@@ -355,6 +455,13 @@ bool takeOneOutputFrame(int fd, int index = -1/* if index is not -1, simple enqu
         ioctlRet = SIMULATE_V4L2_OP(Ioctl)(fd, VIDIOC_DQBUF, &buf);
         if (ioctlRet == -1)
             return false;
+        outputStats.dequeued(buf.index);
+        if (buf.flags & V4L2_BUF_FLAG_LAST) {
+            outputLast = true;
+            //the device may have had no frame left to flag
+            if (!buf.m.planes[0].bytesused)
+                return false;
+        }
 
         renderFrameCount++;
 #ifdef ANDROID
@@ -376,6 +483,7 @@ bool takeOneOutputFrame(int fd, int index = -1/* if index is not -1, simple enqu
 #ifndef ANDROID
     ioctlRet = SIMULATE_V4L2_OP(Ioctl)(fd, VIDIOC_QBUF, &buf);
     ASSERT(ioctlRet != -1);
+    outputStats.queued(buf.index);
 #endif
     INFO("renderFrameCount: %d", renderFrameCount);
     return true;
@@ -389,6 +497,9 @@ bool handleResolutionChange(int32_t fd)
     memset(&ev, 0, sizeof(ev));
 
     while (SIMULATE_V4L2_OP(Ioctl)(fd, VIDIOC_DQEVENT, &ev) == 0) {
+        //frames still queued for capture are taken after the events
+        if (ev.type == V4L2_EVENT_EOS)
+            outputLast = true;
         if (ev.type == V4L2_EVENT_RESOLUTION_CHANGE) {
             resolutionChanged = true;
             break;
@@ -414,6 +525,109 @@ bool handleResolutionChange(int32_t fd)
     return true;
 }
 
+//event loop: a poll thread waits on the device, then wakes the input thread
+//(refill consumed bitstream buffers) and the main thread (render and requeue
+//decoded frames). it polls again after both of them serviced the device.
+using YamiMediaCodec::Lock;
+using YamiMediaCodec::AutoLock;
+using YamiMediaCodec::Condition;
+
+static Lock loopLock;
+static Condition loopCond(loopLock);
+static uint32_t pollGeneration = 0;
+static uint32_t inputServiced = 0;
+static uint32_t outputServiced = 0;
+static bool eventPending = true; // try to get video resolution.
+//only for devices without the stop command
+static const uint32_t k_drainTimeoutMs = 100;
+static bool inputDone = false;
+//input thread only, after start
+static bool drainStarted = false;
+static bool loopQuit = false;
+
+struct InputThreadParam {
+    DecodeInput* input;
+    int32_t fd;
+};
+
+static void* pollThread(void* arg)
+{
+    int32_t fd = *(int32_t*)arg;
+    while (1) {
+        bool event = false;
+        int32_t ret = SIMULATE_V4L2_OP(Poll)(fd, true, &event);
+        AutoLock lock(loopLock);
+        if (loopQuit)
+            break;
+        if (ret) {
+            ERROR("poll device failed");
+            loopQuit = true;
+            loopCond.broadcast();
+            break;
+        }
+        if (event)
+            eventPending = true;
+        pollGeneration++;
+        loopCond.broadcast();
+        while (!loopQuit && ((!inputDone && inputServiced != pollGeneration) || outputServiced != pollGeneration))
+            loopCond.wait();
+        if (loopQuit)
+            break;
+    }
+    return NULL;
+}
+
+//wait for next poll result, return false when the loop quits.
+//after input EOS on a device without the stop command, we stop when it is
+//quiet for a while.
+static bool waitForDevice(uint32_t& seen)
+{
+    AutoLock lock(loopLock);
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += k_drainTimeoutMs * 1000000;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000;
+    deadline.tv_nsec %= 1000000000;
+    while (pollGeneration == seen && !loopQuit) {
+        if (!inputDone || !drainByQuiet)
+            loopCond.wait();
+        else if (!loopCond.timedWait(deadline))
+            break;
+    }
+    if (loopQuit || pollGeneration == seen)
+        return false;
+    seen = pollGeneration;
+    return true;
+}
+
+static void* inputThread(void* arg)
+{
+    InputThreadParam* param = (InputThreadParam*)arg;
+    uint32_t seen = 0;
+    while (waitForDevice(seen)) {
+        bool eos = false;
+        int32_t index;
+        while ((index = dequeueInputBuffer(param->fd)) != -1) {
+            if (!feedOneInputFrame(param->input, param->fd, index)) {
+                eos = true;
+                break;
+            }
+        }
+        if (eos && !drainStarted) {
+            startDrain(param->fd, index);
+            drainStarted = true;
+        }
+        AutoLock lock(loopLock);
+        inputServiced = seen;
+        if (eos || isReadEOS)
+            inputDone = true;
+        loopCond.broadcast();
+        if (inputDone)
+            break;
+    }
+    return NULL;
+}
+
 extern uint32_t v4l2PixelFormatFromMime(const char* mime);
 
 int main(int argc, char** argv)
@@ -439,6 +653,10 @@ int main(int argc, char** argv)
 
     if (!processCmdLine(argc, argv, &params))
         return -1;
+    if (params.inputFiles.size() > 1) {
+        ERROR("v4l2decode decodes one stream, got %u inputs", (uint32_t)params.inputFiles.size());
+        return -1;
+    }
 
     switch (params.renderMode) {
     case 0:
@@ -489,6 +707,12 @@ int main(int argc, char** argv)
     SIMULATE_V4L2_OP(FrameMemoryType)(fd, memoryType);
 #endif
 
+    //some devices report the end of a drain as an event, it is fine if not
+    struct v4l2_event_subscription subscription;
+    memset(&subscription, 0, sizeof(subscription));
+    subscription.type = V4L2_EVENT_EOS;
+    SIMULATE_V4L2_OP(Ioctl)(fd, VIDIOC_SUBSCRIBE_EVENT, &subscription);
+
     // query hw capability
     struct v4l2_capability caps;
     memset(&caps, 0, sizeof(caps));
@@ -539,7 +763,7 @@ int main(int argc, char** argv)
     memset(&reqbufs, 0, sizeof(reqbufs));
     reqbufs.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
     reqbufs.memory = V4L2_MEMORY_MMAP;
-    reqbufs.count = 2;
+    reqbufs.count = params.inputQueueDepth;
     ioctlRet = SIMULATE_V4L2_OP(Ioctl)(fd, VIDIOC_REQBUFS, &reqbufs);
     ASSERT(ioctlRet != -1);
     ASSERT(reqbufs.count>0);
@@ -571,8 +795,10 @@ int main(int argc, char** argv)
     }
 
     // feed input frames first
+    int32_t eosIndex = -1;
     for (i=0; i<inputQueueCapacity; i++) {
         if (!feedOneInputFrame(input, fd, i)) {
+            eosIndex = i;
             break;
         }
     }
@@ -623,6 +849,8 @@ int main(int argc, char** argv)
 #else
     uint32_t minOutputFrameCount = ctrl.value + k_extraOutputFrameCount + minUndequeuedBuffs;
 #endif
+    if (params.outputQueueDepth > minOutputFrameCount)
+        minOutputFrameCount = params.outputQueueDepth;
 
     memset(&reqbufs, 0, sizeof(reqbufs));
     reqbufs.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
@@ -763,29 +991,63 @@ int main(int argc, char** argv)
     ioctlRet = SIMULATE_V4L2_OP(Ioctl)(fd, VIDIOC_STREAMON, &type);
     ASSERT(ioctlRet != -1);
 
-    bool event_pending=true; // try to get video resolution.
-    uint32_t dqCountAfterEOS = 0;
-    do {
-        if (event_pending) {
-            handleResolutionChange(fd);
-        }
+    //a short stream ended while we filled the input queue
+    if (eosIndex != -1) {
+        startDrain(fd, eosIndex);
+        drainStarted = true;
+    }
+
+    InputThreadParam inputParam;
+    inputParam.input = input;
+    inputParam.fd = fd;
+    pthread_t pollThreadId, inputThreadId;
+    if (pthread_create(&pollThreadId, NULL, pollThread, &fd)
+        || pthread_create(&inputThreadId, NULL, inputThread, &inputParam)) {
+        ERROR("create event loop threads failed");
+        return -1;
+    }
 
-        takeOneOutputFrame(fd);
-        if (!feedOneInputFrame(input, fd)) {
-            if (stagingBufferInDevice == 0)
+    // the main thread drains output, it owns the egl context
+    uint32_t seen = 0;
+    while (waitForDevice(seen)) {
+        bool event;
+        {
+            AutoLock lock(loopLock);
+            event = eventPending;
+            eventPending = false;
+        }
+        if (event)
+            handleResolutionChange(fd);
+        while (takeOneOutputFrame(fd)) {
+            if (renderFrameCount == params.renderFrames || outputLast)
                 break;
-            dqCountAfterEOS++;
         }
-        if (dqCountAfterEOS == inputQueueCapacity)  // input drain
+        AutoLock lock(loopLock);
+        outputServiced = seen;
+        loopCond.broadcast();
+        if (renderFrameCount == params.renderFrames || outputLast)
             break;
-    } while (SIMULATE_V4L2_OP(Poll)(fd, true, &event_pending) == 0);
+    }
+
+    {
+        AutoLock lock(loopLock);
+        loopQuit = true;
+        loopCond.broadcast();
+    }
+    SIMULATE_V4L2_OP(SetDevicePollInterrupt)(fd);
+    pthread_join(pollThreadId, NULL);
+    pthread_join(inputThreadId, NULL);
+    SIMULATE_V4L2_OP(ClearDevicePollInterrupt)(fd);
 
-    // drain output buffer
+    // drain output buffer, the stop command tells us when it is done
     int retry = 3;
-    while (takeOneOutputFrame(fd) || (--retry)>0) { // output drain
+    while (drainByQuiet && renderFrameCount != params.renderFrames
+        && (takeOneOutputFrame(fd) || (--retry)>0)) { // output drain
         usleep(10000);
     }
 
+    inputStats.print();
+    outputStats.print();
     calcFps.fps(renderFrameCount);
     // SIMULATE_V4L2_OP(Munmap)(void* addr, size_t length)
     possibleWait(input->getMimeType(), &params);
@@ -32,6 +32,7 @@
 #include "encodeinput.h"
 
 static VideoDataMemoryType memoryType = VIDEO_DATA_MEMORY_TYPE_RAW_POINTER;
+static uint32_t inputMemory = V4L2_MEMORY_USERPTR;
 uint32_t inputFramePlaneCount = 3; // I420(default) format has 3 planes
 uint32_t inputFrameSize = 0;
 
@@ -57,13 +58,17 @@ bool readOneFrameData(uint32_t index)
 
     ASSERT(index<inputQueueCapacity);
 
-    bool ret = streamInput->getOneFrameInput(inputFrames[index]);
-    if (!ret || (frameCount && encodeFrameCount++>=frameCount)) {
+    //stop at the cap before we take a camera buffer we would not give back
+    if (frameCount && encodeFrameCount >= frameCount) {
         isReadEOS = true;
         return false;
     }
-
-    return ret;
+    if (!streamInput->getOneFrameInput(inputFrames[index])) {
+        isReadEOS = true;
+        return false;
+    }
+    encodeFrameCount++;
+    return true;
 }
 
 void fillV4L2Buffer(struct v4l2_buffer& buf, const VideoFrameRawData& frame)
@@ -82,6 +87,22 @@ void fillV4L2Buffer(struct v4l2_buffer& buf, const VideoFrameRawData& frame)
             buf.m.planes[i].m.userptr = data + frame.offset[i];
         }
     }
+    else if (memoryType == VIDEO_DATA_MEMORY_TYPE_DMA_BUF) {
+        // camera buffer exported as dmabuf, the encoder imports it directly
+        uint32_t width[3];
+        uint32_t height[3];
+        uint32_t planes;
+        bool ret;
+
+        ret = getPlaneResolution(frame.fourcc, frame.width, frame.height, width, height, planes);
+        ASSERT(ret && "get planes resolution failed");
+        for (uint32_t i = 0; i < planes; i++) {
+            buf.m.planes[i].m.fd = (int)frame.handle;
+            buf.m.planes[i].data_offset = frame.offset[i];
+            buf.m.planes[i].bytesused = frame.offset[i] + frame.pitch[i] * height[i];
+            buf.m.planes[i].length = buf.m.planes[i].bytesused;
+        }
+    }
     else if (memoryType == VIDEO_DATA_MEMORY_TYPE_ANDROID_NATIVE_BUFFER) {
         // !!! FIXME, v4l2 use long for userptr. so bad
         DEBUG("ANativeWindowBuffer, frame.handle: %p", (void*)frame.handle);
@@ -103,7 +124,7 @@ bool feedOneInputFrame(int fd, int index = -1 /* if index is not -1, simple enqu
     memset(planes, 0, sizeof(planes));
     buf.m.planes = planes;
     buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE; // it indicates input buffer(raw frame) type
-    buf.memory = V4L2_MEMORY_USERPTR;
+    buf.memory = inputMemory;
     buf.length = inputFramePlaneCount;
 
     if (index == -1) {
@@ -223,7 +244,12 @@ int main(int argc, char** argv)
         inputFourcc = VA_FOURCC_NV12;
     }
 #endif
-    streamInput = EncodeInput::create(inputFileName, inputFourcc, videoWidth, videoHeight);
+    bool isCamera = inputFileName && !strncmp(inputFileName, "/dev/video", strlen("/dev/video"));
+    if (isCamera && cameraMode && !strcasecmp(cameraMode, "dmabuf")) {
+        memoryType = VIDEO_DATA_MEMORY_TYPE_DMA_BUF;
+        inputMemory = V4L2_MEMORY_DMABUF;
+    }
+    streamInput = EncodeInput::create(inputFileName, inputFourcc, videoWidth, videoHeight, cameraMode);
     ASSERT(streamInput);
 
     // open device
@@ -323,15 +349,18 @@ int main(int argc, char** argv)
     struct v4l2_requestbuffers reqbufs;
     memset(&reqbufs, 0, sizeof(reqbufs));
     reqbufs.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
-    reqbufs.memory = V4L2_MEMORY_USERPTR;
+    reqbufs.memory = inputMemory;
     reqbufs.count = 2;
     ioctlRet = YamiV4L2_Ioctl(fd, VIDIOC_REQBUFS, &reqbufs);
     ASSERT(ioctlRet != -1);
     ASSERT(reqbufs.count>0 && reqbufs.count <= kMaxFrameQueueLength);
     inputQueueCapacity = reqbufs.count;
 
+    // file input reads into our buffers, camera hands out its own capture buffers
 #if ANDROID
-    if (memoryType != VIDEO_DATA_MEMORY_TYPE_ANDROID_NATIVE_BUFFER)
+    if (memoryType != VIDEO_DATA_MEMORY_TYPE_ANDROID_NATIVE_BUFFER && !isCamera)
+#else
+    if (!isCamera)
 #endif
     {
         for (i = 0; i < inputQueueCapacity; i++) {
@@ -422,7 +451,7 @@ int main(int argc, char** argv)
     // release queued input/output buffer
     memset(&reqbufs, 0, sizeof(reqbufs));
     reqbufs.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
-    reqbufs.memory = V4L2_MEMORY_USERPTR;
+    reqbufs.memory = inputMemory;
     reqbufs.count = 0;
     ioctlRet = YamiV4L2_Ioctl(fd, VIDIOC_REQBUFS, &reqbufs);
     ASSERT(ioctlRet != -1);
@@ -76,7 +76,12 @@ SharedPtr<FrameAllocator> createAllocator(const SharedPtr<VppOutput>& output, co
 {
     uint32_t fourcc;
     int width, height;
-    SharedPtr<FrameAllocator> allocator(new PooledFrameAllocator(display, 5));
+    uint32_t surfaces = 5;
+    //frames in flight in the encoder keep their surfaces
+    SharedPtr<VppOutputEncode> encode = std::tr1::dynamic_pointer_cast<VppOutputEncode>(output);
+    if (encode)
+        surfaces += encode->inFlight();
+    SharedPtr<FrameAllocator> allocator(new PooledFrameAllocator(display, surfaces));
     if (!output->getFormat(fourcc, width, height)
         || !allocator->setFormat(fourcc, width,height)) {
         allocator.reset();
@@ -116,7 +121,7 @@ public:
         YamiStatus  status;
         int count = 0;
         while (m_input->read(src)) {
-            dest = m_allocator->alloc();
+            dest = allocFrame(m_allocator, POOL_WAIT_MS);
             status = m_vpp->process(src, dest);
             if (status != YAMI_SUCCESS) {
                 ERROR("vpp process failed, status = %d", status);
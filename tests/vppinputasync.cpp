@@ -15,9 +15,12 @@
  */
 #include "vppinputasync.h"
 
+#include <stdio.h>
+
 VppInputAsync::VppInputAsync()
     :m_cond(m_lock), m_eos(false),
-     m_queueSize(0),m_quit(false)
+     m_queueSize(0),m_quit(false),
+     m_depth(NULL), m_fullWaits(NULL), m_emptyWaits(NULL)
 {
 }
 
@@ -51,6 +54,8 @@ void VppInputAsync::loop()
         {
             AutoLock lock(m_lock);
             while (m_queue.size() >= m_queueSize) {
+                //consumer is slower than us
+                m_fullWaits->add();
                 m_cond.wait();
                 if (m_quit)
                     return;
@@ -65,6 +70,7 @@ void VppInputAsync::loop()
            return;
         }
         m_queue.push_back(frame);
+        m_depth->set(m_queue.size());
         m_cond.signal();
    }
 }
@@ -73,6 +79,16 @@ bool VppInputAsync::init(const SharedPtr<VppInput>& input, uint32_t queueSize)
 {
     m_input = input;
     m_queueSize = queueSize;
+    m_width = input->getWidth();
+    m_height = input->getHeight();
+
+    Metrics& metrics = Metrics::getInstance();
+    char labels[32];
+    snprintf(labels, sizeof(labels), "queue=\"async%u\"", metrics.newInstanceId());
+    m_labels = labels;
+    m_depth = metrics.gauge("yami_queue_depth", labels, "frames waiting in the queue");
+    m_fullWaits = metrics.counter("yami_queue_full_waits_total", labels, "producer waits on a full queue");
+    m_emptyWaits = metrics.counter("yami_queue_empty_waits_total", labels, "consumer waits on an empty queue");
     if (pthread_create(&m_thread, NULL, start, this)) {
         ERROR("create thread failed");
         return false;
@@ -87,10 +103,13 @@ bool VppInputAsync::read(SharedPtr<VideoFrame>& frame)
     while (m_queue.empty()) {
         if (m_eos)
             return false;
+        //producer is slower than us
+        m_emptyWaits->add();
         m_cond.wait();
     }
     frame = m_queue.front();
     m_queue.pop_front();
+    m_depth->set(m_queue.size());
     m_cond.signal();
     return true;
 }
@@ -103,6 +122,8 @@ VppInputAsync::~VppInputAsync()
         m_cond.signal();
     }
     pthread_join(m_thread, NULL);
+    if (!m_labels.empty())
+        Metrics::getInstance().remove(m_labels.c_str());
 }
 
 bool VppInputAsync::init(const char* inputFileName, uint32_t fourcc, int width, int height)
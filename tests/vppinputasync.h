@@ -17,6 +17,7 @@
 #define vppinputasync_h
 #include "common/condition.h"
 #include "common/lock.h"
+#include "common/metrics.h"
 #include <deque>
 
 #include "vppinputoutput.h"
@@ -53,5 +54,11 @@ private:
     pthread_t  m_thread;
     bool       m_quit;
 
+    //our instance labels
+    std::string m_labels;
+    Gauge*     m_depth;
+    Counter*   m_fullWaits;
+    Counter*   m_emptyWaits;
+
 };
 #endif //vppinputasync_h
@@ -17,31 +17,63 @@
 
 bool VppInputDecode::init(const char* inputFileName, uint32_t /*fourcc*/, int /*width*/, int /*height*/)
 {
-    m_input.reset(DecodeInput::create(inputFileName));
-    if (!m_input)
+    SharedPtr<DecodeInput> input(DecodeInput::create(inputFileName));
+    if (!input)
         return false;
-    m_decoder.reset(createVideoDecoder(m_input->getMimeType()), releaseVideoDecoder);
-    if (!m_decoder) {
-        fprintf(stderr, "failed create decoder for %s", m_input->getMimeType());
+    SharedPtr<IVideoDecoder> decoder(createVideoDecoder(input->getMimeType()), releaseVideoDecoder);
+    if (!decoder) {
+        fprintf(stderr, "failed create decoder for %s", input->getMimeType());
         return false;
     }
+    return init(input, decoder);
+}
+
+bool VppInputDecode::init(const SharedPtr<DecodeInput>& input, const SharedPtr<IVideoDecoder>& decoder,
+    bool started)
+{
+    if (!input || !decoder)
+        return false;
+    m_input = input;
+    m_decoder = decoder;
+    m_started = started;
+    Metrics& metrics = Metrics::getInstance();
+    m_frames = metrics.counter("yami_frames_total", "stage=\"decode\"", "frames out of each stage");
+    metrics.rate("yami_fps", "stage=\"decode\"", "frames per second out of each stage", m_frames);
     return true;
 }
 
 bool VppInputDecode::config(NativeDisplay& nativeDisplay)
 {
+    const string codecData = m_input->getCodecData();
+    if (m_started) {
+        //stream headers come in band, a new size shows up as DECODE_FORMAT_CHANGE.
+        //codec data from a container needs a real start
+        if (codecData.empty()) {
+            if (!read(m_first))
+                return false;
+            //the size of the last stream gives no DECODE_FORMAT_CHANGE
+            const VideoFormatInfo* info = m_decoder->getFormatInfo();
+            m_width = info->width;
+            m_height = info->height;
+            return true;
+        }
+        m_decoder->stop();
+    }
     m_decoder->setNativeDisplay(&nativeDisplay);
 
     VideoConfigBuffer configBuffer;
     memset(&configBuffer, 0, sizeof(configBuffer));
     configBuffer.profile = VAProfileNone;
-    const string codecData = m_input->getCodecData();
     if (codecData.size()) {
         configBuffer.data = (uint8_t*)codecData.data();
         configBuffer.size = codecData.size();
     }
     configBuffer.width = m_input->getWidth();
     configBuffer.height = m_input->getHeight();
+    if (m_extraSurfaces) {
+        configBuffer.surfaceNumber = m_extraSurfaces;
+        configBuffer.flag |= HAS_SURFACE_NUMBER;
+    }
     Decode_Status status = m_decoder->start(&configBuffer);
     if (status == DECODE_SUCCESS) {
         //read first frame to update width height
@@ -61,8 +93,10 @@ bool VppInputDecode::read(SharedPtr<VideoFrame>& frame)
 
     while (1)  {
         frame = m_decoder->getOutput();
-        if (frame)
+        if (frame) {
+            m_frames->add();
             return true;
+        }
         if (m_error || m_eos)
             return false;
         VideoDecodeBuffer inputBuffer;
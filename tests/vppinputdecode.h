@@ -19,6 +19,7 @@
 #include "decodeinput.h"
 
 #include "vppinputoutput.h"
+#include "common/metrics.h"
 
 class VppInputDecode : public VppInput
 {
@@ -26,19 +27,33 @@ public:
     VppInputDecode()
         : m_eos(false)
         , m_error(false)
+        , m_extraSurfaces(0)
+        , m_started(false)
+        , m_frames(NULL)
     {
     }
     bool init(const char* inputFileName, uint32_t fourcc = 0, int width = 0, int height = 0);
+    //take a decoder created before, e.g. a warm one kept by yamid.
+    //it must be for input->getMimeType(), stopped or, with started, flushed
+    //after its last stream
+    bool init(const SharedPtr<DecodeInput>& input, const SharedPtr<IVideoDecoder>& decoder,
+        bool started = false);
     bool read(SharedPtr<VideoFrame>& frame);
 
+    //frames the stages after us may hold at once, call it before config().
+    //a started decoder keeps what it was started with
+    void setExtraSurfaces(uint32_t extra) { m_extraSurfaces = extra; }
     bool config(NativeDisplay& nativeDisplay);
     virtual ~VppInputDecode() {}
 private:
     bool m_eos;
     bool m_error;
+    uint32_t m_extraSurfaces;
+    bool m_started;
     SharedPtr<IVideoDecoder> m_decoder;
     SharedPtr<DecodeInput>   m_input;
     SharedPtr<VideoFrame>    m_first;
+    Counter* m_frames;
 };
 #endif //vppinputdecode_h
 
@@ -19,6 +19,7 @@
 #endif
 
 #include "vppinputdecodecapi.h"
+#include "common/common_def.h"
 
 static void freeFrame(VideoFrame* frame)
 {
@@ -27,6 +28,9 @@ static void freeFrame(VideoFrame* frame)
 
 VppInputDecodeCapi::~VppInputDecodeCapi()
 {
+    decodeSetOutputCallback(m_decoder, NULL, NULL);
+    for (size_t i = 0; i < m_frames.size(); i++)
+        freeFrame(m_frames[i]);
     decodeStop(m_decoder);
     releaseDecoder(m_decoder);
 }
@@ -59,15 +63,44 @@ bool VppInputDecodeCapi::config(NativeDisplay& nativeDisplay)
     configBuffer.width = m_input->getWidth();
     configBuffer.height = m_input->getHeight();
     Decode_Status status = decodeStart(m_decoder, &configBuffer);
-    return status == DECODE_SUCCESS;
+    if (status != DECODE_SUCCESS)
+        return false;
+    //frames come to us while decoding, no polling per buffer
+    decodeSetOutputCallback(m_decoder, outputReady, this);
+    return true;
+}
+
+void VppInputDecodeCapi::outputReady(DecodeHandler, VideoFrame** frames, uint32_t count, void* userData)
+{
+    VppInputDecodeCapi* self = (VppInputDecodeCapi*)userData;
+    self->m_frames.insert(self->m_frames.end(), frames, frames + count);
+}
+
+Decode_Status VppInputDecodeCapi::decode(VideoDecodeBuffer& inputBuffer)
+{
+    uint32_t decoded;
+    Decode_Status status = decodeDecodeBatch(m_decoder, &inputBuffer, 1, &decoded);
+    if (DECODE_FORMAT_CHANGE == status) {
+        const VideoFormatInfo* info = decodeGetFormatInfo(m_decoder);
+        ERROR("resolution changed to %dx%d", info->width, info->height);
+        //resend the buffer
+        status = decodeDecodeBatch(m_decoder, &inputBuffer, 1, &decoded);
+    }
+    return status;
 }
 
 bool VppInputDecodeCapi::read(SharedPtr<VideoFrame>& frame)
 {
     while (1) {
-        VideoFrame* tmp = decodeGetOutput(m_decoder);
-        if (tmp) {
-            frame.reset(tmp, freeFrame);
+        if (m_frames.empty()) {
+            //anything left after the callback, take all ready frames in one call
+            VideoFrame* frames[4];
+            uint32_t n = decodeGetOutputs(m_decoder, frames, N_ELEMENTS(frames));
+            m_frames.insert(m_frames.end(), frames, frames + n);
+        }
+        if (!m_frames.empty()) {
+            frame.reset(m_frames.front(), freeFrame);
+            m_frames.pop_front();
             return true;
         }
         if (m_error || m_eos)
@@ -75,24 +108,18 @@ bool VppInputDecodeCapi::read(SharedPtr<VideoFrame>& frame)
         VideoDecodeBuffer inputBuffer;
         Decode_Status status = DECODE_FAIL;
         if (m_input->getNextDecodeUnit(inputBuffer)) {
-            status = decodeDecode(m_decoder, &inputBuffer);
-            if (DECODE_FORMAT_CHANGE == status) {
-                const VideoFormatInfo* info = decodeGetFormatInfo(m_decoder);
-                ERROR("resolution changed to %dx%d", info->width, info->height);
-                //resend the buffer
-                status = decodeDecode(m_decoder, &inputBuffer);
-            }
+            status = decode(inputBuffer);
         }
         else { /*EOS, need to flush*/
             inputBuffer.data = NULL;
             inputBuffer.size = 0;
-            decodeDecode(m_decoder, &inputBuffer);
+            decode(inputBuffer);
             m_eos = true;
         }
         if (status != DECODE_SUCCESS) { /*failed, need to flush*/
             inputBuffer.data = NULL;
             inputBuffer.size = 0;
-            decodeDecode(m_decoder, &inputBuffer);
+            decode(inputBuffer);
             m_error = true;
         }
     }
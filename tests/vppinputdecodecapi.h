@@ -21,6 +21,8 @@
 #include "decodeinput.h"
 #include "vppinputoutput.h"
 #include "capi/VideoDecoderCapi.h"
+#include "decodeBatchCapi.h"
+#include <deque>
 
 class VppInputDecodeCapi : public VppInput {
 public:
@@ -36,10 +38,15 @@ public:
     bool config(NativeDisplay& nativeDisplay);
 
 private:
+    static void outputReady(DecodeHandler decoder, VideoFrame** frames, uint32_t count, void* userData);
+    Decode_Status decode(VideoDecodeBuffer& inputBuffer);
+
     bool m_eos;
     bool m_error;
     DecodeHandler m_decoder;
     SharedPtr<DecodeInput> m_input;
+    //drained from the decoder, not read yet
+    std::deque<VideoFrame*> m_frames;
 };
 
 #endif //vppinputdecodecapi_h
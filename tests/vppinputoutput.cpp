@@ -34,6 +34,29 @@
 #endif
 using namespace YamiMediaCodec;
 
+class PoolMetrics : public VideoPoolHook
+{
+public:
+    PoolMetrics()
+    {
+        //all pools together, the number of pools changes with resolution
+        Metrics& metrics = Metrics::getInstance();
+        m_frames = metrics.gauge("yami_pool_frames", "", "frames owned by video pools");
+        m_inUse = metrics.gauge("yami_pool_frames_in_use", "", "video pool frames held by users");
+    }
+    void owned(int64_t n) { m_frames->add(n); }
+    void inUse(int64_t n) { m_inUse->add(n); }
+private:
+    Gauge* m_frames;
+    Gauge* m_inUse;
+};
+
+void installPoolMetrics()
+{
+    static PoolMetrics hook;
+    VideoPoolHook::set(&hook);
+}
+
 #ifndef ANDROID
 SharedPtr<VADisplay> createVADisplay()
 {
@@ -66,6 +89,13 @@ SharedPtr<VppInput> VppInput::create(const char* inputFileName, uint32_t fourcc,
     if (!inputFileName)
         return input;
 
+    if (TestPattern::isTestPattern(inputFileName)) {
+        input.reset(new VppInputSynthetic);
+        if (!input->init(inputFileName, fourcc, width, height))
+            input.reset();
+        return input;
+    }
+
 #ifdef __ENABLE_CAPI__
     input.reset(new VppInputDecodeCapi);
     if (input->init(inputFileName, fourcc, width, height))
@@ -144,7 +174,7 @@ bool VppInputFile::read(SharedPtr<VideoFrame>& frame)
     if (m_readToEOS)
         return false;
 
-    frame = m_allocator->alloc();
+    frame = allocFrame(m_allocator, POOL_WAIT_MS);
     if (!frame) {
         ERROR("allocate frame failed");
         return false;
@@ -161,11 +191,52 @@ VppInputFile::~VppInputFile()
         fclose(m_fp);
 }
 
-VppOutput::VppOutput()
-    :m_fourcc(0), m_width(0), m_height(0)
+VppInputSynthetic::VppInputSynthetic()
+    : m_next(0)
 {
 }
 
+bool VppInputSynthetic::init(const char* inputFileName, uint32_t fourcc, int width, int height)
+{
+    if (!fourcc)
+        fourcc = VA_FOURCC('I', '4', '2', '0');
+    if ((!width || !height) && !guessResolution(inputFileName, width, height)) {
+        ERROR("synthetic input needs a resolution, e.g. synthetic:noise:300:1920x1080");
+        return false;
+    }
+    if (!m_pattern.init(inputFileName, fourcc, width, height))
+        return false;
+    m_width = width;
+    m_height = height;
+    m_fourcc = fourcc;
+    return true;
+}
+
+bool VppInputSynthetic::read(SharedPtr<VideoFrame>& frame)
+{
+    if (!m_allocator || !m_reader) {
+        ERROR("config VppInputSynthetic with allocator and reader, please!");
+        return false;
+    }
+    if (m_readToEOS || (m_pattern.getFrameCount() && m_next >= m_pattern.getFrameCount())) {
+        m_readToEOS = true;
+        return false;
+    }
+    frame = allocFrame(m_allocator, POOL_WAIT_MS);
+    if (!frame) {
+        ERROR("allocate frame failed");
+        return false;
+    }
+    uint8_t* planes[3];
+    uint32_t pitches[3];
+    uint32_t planeCount;
+    m_pattern.getFrame(m_next, planes, pitches, planeCount);
+    frame->timeStamp = m_next++;
+    if (!m_reader->upload(planes, pitches, frame))
+        m_readToEOS = true;
+    return !m_readToEOS;
+}
+
 SharedPtr<VppOutput> VppOutput::create(const char* outputFileName, uint32_t fourcc, int width, int height)
 {
     SharedPtr<VppOutput> output;
@@ -185,15 +256,6 @@ SharedPtr<VppOutput> VppOutput::create(const char* outputFileName, uint32_t four
 }
 
 
-bool VppOutput::getFormat(uint32_t& fourcc, int& width, int& height)
-{
-    fourcc = m_fourcc;
-    width = m_width;
-    height = m_height;
-    return true;
-}
-
-
 bool VppOutputFile::init(const char* outputFileName, uint32_t fourcc, int width, int height)
 {
     if (!outputFileName) {
@@ -18,7 +18,11 @@
 
 #include "common/log.h"
 #include "common/utils.h"
+#include "common/metrics.h"
 #include "common/videopool.h"
+#include "common/planecopy.h"
+#include "common/surfacebudget.h"
+#include "common/testpattern.h"
 #include "VideoCommonDefs.h"
 
 #include <stdio.h>
@@ -26,7 +30,9 @@
 #ifndef ANDROID
 #include <va/va_drm.h>
 #endif
+#include <algorithm>
 #include <vector>
+#include <deque>
 #include <limits.h>
 #include <fcntl.h>
 #include <unistd.h>
@@ -38,6 +44,7 @@ struct VADisplayDeleter
     VADisplayDeleter(int fd):m_fd(fd) {}
     void operator()(VADisplay* display)
     {
+        SurfaceBudget::getInstance().flush(*display);
         vaTerminate(*display);
         delete display;
         close(m_fd);
@@ -48,12 +55,17 @@ private:
 
 SharedPtr<VADisplay> createVADisplay();
 
+//report all video pools as yami_pool_frames{,_in_use}
+void installPoolMetrics();
+
 
 //virtual bool setFormat(uint32_t fourcc, int width, int height) = 0;
 class FrameReader
 {
 public:
     virtual bool read(FILE* fp,const SharedPtr<VideoFrame>& frame) = 0;
+    //fill frame from planes in memory
+    virtual bool upload(uint8_t* const planes[3], const uint32_t pitches[3], const SharedPtr<VideoFrame>& frame) { return false; }
     virtual ~FrameReader() {}
 };
 
@@ -68,84 +80,254 @@ class FrameAllocator
 {
 public:
     virtual bool setFormat(uint32_t fourcc, int width, int height) = 0;
+    //NULL when all frames are out, see waitForFrame
     virtual SharedPtr<VideoFrame> alloc() = 0;
+    //after alloc() failed, wait up to waitMs for a frame to come back.
+    //false if none did, the caller decides to wait more or give up
+    virtual bool waitForFrame(uint32_t /*waitMs*/) { return false; }
     virtual ~FrameAllocator() {}
 };
 
 
+//surfaces of a budget acquire, they go back with the last frame on them
+class SurfaceSet
+{
+public:
+    SurfaceSet(const SharedPtr<VADisplay>& display, uint32_t fourcc, int width, int height,
+        std::vector<VASurfaceID>& surfaces)
+        : m_display(display)
+        , m_fourcc(fourcc)
+        , m_width(width)
+        , m_height(height)
+    {
+        m_surfaces.swap(surfaces);
+    }
+    ~SurfaceSet()
+    {
+        SurfaceBudget::getInstance().release(*m_display, m_fourcc, m_width, m_height, m_surfaces);
+    }
+    const std::vector<VASurfaceID>& getSurfaces() const { return m_surfaces; }
+private:
+    SharedPtr<VADisplay> m_display;
+    uint32_t m_fourcc;
+    int m_width;
+    int m_height;
+    std::vector<VASurfaceID> m_surfaces;
+    DISALLOW_COPY_AND_ASSIGN(SurfaceSet);
+};
+
+//guaranteed surfaces of a pool under YAMI_SURFACE_BUDGET_MB
+#define POOL_MIN_SURFACES 2
+//how long the stages wait in waitForFrame before they give up
+#define POOL_WAIT_MS 2000
+
 //vaapi related operation
-class PooledFrameAllocator : public FrameAllocator
+//surfaces are kept at the largest size asked for, a smaller format only
+//changes the crop of the frames handed out. they are reallocated when the
+//fourcc changes or the size grows.
+//surfaces come from SurfaceBudget, under a tight budget the pool starts with
+//fewer than poolsize and grows while there is room. when all frames are out
+//alloc() returns NULL and the caller waits in waitForFrame. every surface
+//goes back on its own, the budget reclaims idle ones above the minimum for
+//pools waiting for room.
+class PooledFrameAllocator : public FrameAllocator, public SurfaceReclaimer
 {
 public:
     PooledFrameAllocator(const SharedPtr<VADisplay>& display, size_t poolsize):
-        m_display(display), m_poolsize(poolsize)
+        m_display(display), m_poolsize(poolsize),
+        m_minimum(std::min(poolsize, (size_t)POOL_MIN_SURFACES)),
+        m_surfaceCount(0),
+        m_fourcc(0), m_width(0), m_height(0),
+        m_surfaceWidth(0), m_surfaceHeight(0)
     {
+        installPoolMetrics();
+        Metrics& metrics = Metrics::getInstance();
+        m_allocs = metrics.counter("yami_surface_allocs_total", "", "surface pools allocated");
+        m_reuses = metrics.counter("yami_surface_reallocs_avoided_total", "",
+            "format changes served by the surfaces already allocated");
+        SurfaceBudget::getInstance().addReclaimer(this);
+    }
+    ~PooledFrameAllocator()
+    {
+        SurfaceBudget::getInstance().removeReclaimer(this);
     }
     bool setFormat(uint32_t fourcc, int width, int height)
     {
-        destroySurfaces();
-        m_surfaces.resize(m_poolsize);
-        VASurfaceAttrib attrib;
-        attrib.flags = VA_SURFACE_ATTRIB_SETTABLE;
-        attrib.type = VASurfaceAttribPixelFormat;
-        attrib.value.type = VAGenericValueTypeInteger;
-        attrib.value.value.i = fourcc;
-        uint32_t rtformat;
-        if (fourcc == VA_FOURCC_BGRX
-            || fourcc == VA_FOURCC_BGRA) {
-            rtformat = VA_RT_FORMAT_RGB32;
-            ERROR("rgb32");
-        } else {
-            rtformat = VA_RT_FORMAT_YUV420;
+        if (m_pool && fourcc == m_fourcc
+            && (uint32_t)width <= m_surfaceWidth && (uint32_t)height <= m_surfaceHeight) {
+            m_width = width;
+            m_height = height;
+            m_reuses->add();
+            return true;
         }
-        VAStatus status = vaCreateSurfaces(*m_display, rtformat, width, height,
-                                           &m_surfaces[0], m_surfaces.size(),&attrib, 1);
-        if (status != VA_STATUS_SUCCESS) {
-            ERROR("create surface failed fourcc = %d", fourcc);
-            m_surfaces.clear();
-            return false;
+        //frames still out keep the old pool and their surfaces alive, maybe
+        //held by our caller. give back the free ones and don't wait for room,
+        //the pool grows in alloc()
+        size_t minimum = m_minimum;
+        {
+            AutoLock lock(m_lock);
+            if (m_pool) {
+                while (m_pool->remove())
+                    ;
+                minimum = 0;
+            }
+            m_pool.reset();
+            m_surfaceCount = 0;
         }
-        std::deque<SharedPtr<VideoFrame> > buffers;
-        for (size_t i = 0;  i < m_surfaces.size(); i++) {
-            SharedPtr<VideoFrame> f(new VideoFrame);
-            memset(f.get(), 0, sizeof(VideoFrame));
-            //we need fill dest crop to work around libva's bug.
-            f->crop.width = width;
-            f->crop.height = height;
-            f->fourcc = fourcc;
-            f->surface = (intptr_t)m_surfaces[i];
-            buffers.push_back(f);
+        uint32_t surfaceWidth = width;
+        uint32_t surfaceHeight = height;
+        if (fourcc == m_fourcc) {
+            surfaceWidth = std::max(surfaceWidth, m_surfaceWidth);
+            surfaceHeight = std::max(surfaceHeight, m_surfaceHeight);
         }
+        SurfaceBudget::getSizeClass(surfaceWidth, surfaceHeight);
+        std::vector<VASurfaceID> surfaces;
+        if (!SurfaceBudget::getInstance().acquire(*m_display, fourcc, surfaceWidth, surfaceHeight,
+                minimum, m_poolsize, surfaces))
+            return false;
+        m_allocs->add();
+        m_fourcc = fourcc;
+        m_width = width;
+        m_height = height;
+        m_surfaceWidth = surfaceWidth;
+        m_surfaceHeight = surfaceHeight;
+
+        std::deque<SharedPtr<VideoFrame> > buffers;
+        createFrames(surfaces, buffers);
+        AutoLock lock(m_lock);
+        m_surfaceCount = buffers.size();
         m_pool = VideoPool<VideoFrame>::create(buffers);
         return true;
     }
     SharedPtr<VideoFrame> alloc()
     {
-        return m_pool->alloc();
+        SharedPtr<VideoFrame> f;
+        if (!m_pool)
+            return f;
+        f = m_pool->alloc();
+        //the budget gave us fewer surfaces, take one more while there is room
+        if (!f && getSurfaceCount() < m_poolsize && grow(0))
+            f = m_pool->alloc();
+        if (f) {
+            //we need fill dest crop to work around libva's bug.
+            f->crop.x = 0;
+            f->crop.y = 0;
+            f->crop.width = m_width;
+            f->crop.height = m_height;
+        }
+        return f;
     }
-    void destroySurfaces()
+    bool waitForFrame(uint32_t waitMs)
     {
-        if (m_surfaces.size())
-            vaDestroySurfaces(*m_display, &m_surfaces[0], m_surfaces.size());
+        if (!m_pool)
+            return false;
+        size_t count = getSurfaceCount();
+        if (count < m_poolsize && grow(0))
+            return true;
+        //none of ours can come back, wait for room in the budget
+        if (!count)
+            return grow(1, waitMs);
+        return m_pool->wait(waitMs);
     }
-    ~PooledFrameAllocator()
+    //idle surfaces above our minimum go to pools waiting for room
+    uint32_t reclaim()
     {
-        destroySurfaces();
+        AutoLock lock(m_lock);
+        uint32_t reclaimed = 0;
+        while (m_pool && m_surfaceCount > m_minimum && m_pool->remove()) {
+            m_surfaceCount--;
+            reclaimed++;
+        }
+        return reclaimed;
     }
 
 private:
+    //holds the surfaces until the pool and every frame of it are gone
+    class FrameDeleter
+    {
+    public:
+        FrameDeleter(const SharedPtr<SurfaceSet>& set)
+            : m_set(set)
+        {
+        }
+        void operator()(VideoFrame* frame) const
+        {
+            delete frame;
+        }
+    private:
+        SharedPtr<SurfaceSet> m_set;
+    };
+
+    //a set for each surface, so they go back one by one
+    void createFrames(std::vector<VASurfaceID>& surfaces, std::deque<SharedPtr<VideoFrame> >& buffers)
+    {
+        for (size_t i = 0;  i < surfaces.size(); i++) {
+            std::vector<VASurfaceID> one(1, surfaces[i]);
+            SharedPtr<SurfaceSet> set(new SurfaceSet(m_display, m_fourcc, m_surfaceWidth, m_surfaceHeight, one));
+            SharedPtr<VideoFrame> f(new VideoFrame, FrameDeleter(set));
+            memset(f.get(), 0, sizeof(VideoFrame));
+            f->fourcc = m_fourcc;
+            f->surface = (intptr_t)surfaces[i];
+            buffers.push_back(f);
+        }
+        surfaces.clear();
+    }
+
+    //one more surface, minimum 1 waits up to waitMs for room
+    bool grow(uint32_t minimum, uint32_t waitMs = SURFACE_BUDGET_WAIT_MS)
+    {
+        std::vector<VASurfaceID> surfaces;
+        if (!SurfaceBudget::getInstance().acquire(*m_display, m_fourcc, m_surfaceWidth, m_surfaceHeight,
+                minimum, 1, surfaces, waitMs) || surfaces.empty())
+            return false;
+        std::deque<SharedPtr<VideoFrame> > buffers;
+        createFrames(surfaces, buffers);
+        AutoLock lock(m_lock);
+        m_pool->add(buffers.front());
+        m_surfaceCount++;
+        return true;
+    }
+
+    size_t getSurfaceCount()
+    {
+        AutoLock lock(m_lock);
+        return m_surfaceCount;
+    }
+
     SharedPtr<VADisplay> m_display;
-    std::vector<VASurfaceID> m_surfaces;
+    //m_pool and m_surfaceCount change under m_lock, reclaim() comes from
+    //other threads
+    Lock m_lock;
     SharedPtr<VideoPool<VideoFrame> > m_pool;
     size_t m_poolsize;
+    size_t m_minimum;
+    size_t m_surfaceCount;
+    uint32_t m_fourcc;
+    int m_width;
+    int m_height;
+    uint32_t m_surfaceWidth;
+    uint32_t m_surfaceHeight;
+    Counter* m_allocs;
+    Counter* m_reuses;
 };
 
+//alloc() from allocator, waiting while all its frames are out. NULL if
+//none came back within waitMs
+inline SharedPtr<VideoFrame> allocFrame(const SharedPtr<FrameAllocator>& allocator, uint32_t waitMs)
+{
+    SharedPtr<VideoFrame> frame;
+    while (!(frame = allocator->alloc()) && allocator->waitForFrame(waitMs))
+        ;
+    return frame;
+}
+
 class VaapiFrameIO
 {
 public:
     typedef bool (*FileIoFunc)(char* ptr, int size, FILE* fp);
-    VaapiFrameIO(const SharedPtr<VADisplay>& display, FileIoFunc io)
-        :m_display(display), m_io(io)
+    //readback: io consumes surface data, otherwise io fills the surface
+    VaapiFrameIO(const SharedPtr<VADisplay>& display, FileIoFunc io, bool readback = false)
+        :m_display(display), m_io(io), m_readback(readback)
     {
 
     };
@@ -155,51 +337,130 @@ public:
             ERROR("invalid param");
             return false;
         }
-        VASurfaceID surface = (VASurfaceID)frame->surface;
         VAImage image;
+        char* buf;
+        uint32_t byteWidth[3], byteHeight[3], planes;
+        if (!mapImage(frame, image, buf, byteWidth, byteHeight, planes))
+            return false;
+        bool ret = true;
+        for (uint32_t i = 0; i < planes; i++) {
+            uint8_t* ptr = (uint8_t*)buf + image.offsets[i];
+            uint32_t w = byteWidth[i];
+            //the mapped surface is uncached, do file io on system memory
+            //and copy whole planes from or to the surface
+            m_plane.resize(w * byteHeight[i]);
+            if (m_plane.empty())
+                continue;
+            uint8_t* plane = &m_plane[0];
+            if (m_readback)
+                copyPlane(plane, w, ptr, image.pitches[i], w, byteHeight[i], PLANE_COPY_READBACK);
+            ret = m_io((char*)plane, m_plane.size(), fp);
+            if (!ret)
+                break;
+            if (!m_readback)
+                copyPlane(ptr, image.pitches[i], plane, w, w, byteHeight[i], PLANE_COPY_UPLOAD);
+        }
+        unmapImage(image);
+        return ret;
 
+    }
+    //fill the surface from planes in system memory
+    bool upload(uint8_t* const src[3], const uint32_t srcPitches[3], const SharedPtr<VideoFrame>& frame)
+    {
+        VAImage image;
+        char* buf;
+        uint32_t byteWidth[3], byteHeight[3], planes;
+        if (!mapImage(frame, image, buf, byteWidth, byteHeight, planes))
+            return false;
+        for (uint32_t i = 0; i < planes; i++) {
+            copyPlane((uint8_t*)buf + image.offsets[i], image.pitches[i], src[i], srcPitches[i],
+                byteWidth[i], byteHeight[i], PLANE_COPY_UPLOAD);
+        }
+        unmapImage(image);
+        return true;
+    }
+private:
+    bool mapImage(const SharedPtr<VideoFrame>& frame, VAImage& image, char*& buf,
+        uint32_t byteWidth[3], uint32_t byteHeight[3], uint32_t& planes)
+    {
+        VASurfaceID surface = (VASurfaceID)frame->surface;
         VAStatus status = vaDeriveImage(*m_display,surface,&image);
         if (status != VA_STATUS_SUCCESS) {
             ERROR("vaDeriveImage failed = %d", status);
             return false;
         }
-        uint32_t byteWidth[3], byteHeight[3], planes;
         //image.width is not equal to frame->crop.width.
         //for supporting VPG Driver, use YV12 to replace I420
         if (!getPlaneResolution(frame->fourcc, frame->crop.width, frame->crop.height, byteWidth, byteHeight, planes)) {
             ERROR("get plane reoslution failed for %x, %dx%d", frame->fourcc, frame->crop.width, frame->crop.height);
+            vaDestroyImage(*m_display, image.image_id);
             return false;
         }
-        char* buf;
         status = vaMapBuffer(*m_display, image.buf, (void**)&buf);
         if (status != VA_STATUS_SUCCESS) {
             vaDestroyImage(*m_display, image.image_id);
             ERROR("vaMapBuffer failed = %d", status);
             return false;
         }
-        bool ret = true;
-        for (uint32_t i = 0; i < planes; i++) {
-            char* ptr = buf + image.offsets[i];
-            int w = byteWidth[i];
-            for (uint32_t j = 0; j < byteHeight[i]; j++) {
-                ret = m_io(ptr, w, fp);
-                if (!ret)
-                    goto out;
-                ptr += image.pitches[i];
-            }
-        }
-    out:
+        return true;
+    }
+    void unmapImage(VAImage& image)
+    {
         vaUnmapBuffer(*m_display, image.buf);
         vaDestroyImage(*m_display, image.image_id);
-        return ret;
-
     }
-private:
     SharedPtr<VADisplay>  m_display;
     FileIoFunc  m_io;
+    bool m_readback;
+    std::vector<uint8_t> m_plane;
 };
 
 
+//frames stay in flight until the window is full, so the gpu queue does not drain
+//while the cpu waits on a frame. a frame is synced when it leaves the window.
+class FrameSyncWindow
+{
+public:
+    FrameSyncWindow(VADisplay display, uint32_t depth)
+        : m_display(display)
+        , m_depth(depth)
+    {
+    }
+    //ready is the synced oldest frame if the window is full, or empty
+    bool push(const SharedPtr<VideoFrame>& frame, SharedPtr<VideoFrame>& ready)
+    {
+        ready.reset();
+        m_frames.push_back(frame);
+        if (m_frames.size() <= m_depth)
+            return true;
+        return pop(ready);
+    }
+    //take the oldest frame and sync it, use it to drain the window at EOS
+    bool pop(SharedPtr<VideoFrame>& ready)
+    {
+        ready.reset();
+        if (m_frames.empty())
+            return false;
+        SharedPtr<VideoFrame> frame = m_frames.front();
+        m_frames.pop_front();
+        VAStatus status = vaSyncSurface(m_display, (VASurfaceID)frame->surface);
+        if (status != VA_STATUS_SUCCESS) {
+            ERROR("vaSyncSurface failed = %d", status);
+            return false;
+        }
+        ready = frame;
+        return true;
+    }
+    bool empty() const
+    {
+        return m_frames.empty();
+    }
+private:
+    VADisplay m_display;
+    uint32_t m_depth;
+    std::deque<SharedPtr<VideoFrame> > m_frames;
+};
+
 class VaapiFrameReader:public FrameReader
 {
 public:
@@ -211,6 +472,10 @@ public:
     {
         return m_frameio->doIO(fp, frame);
     }
+    bool upload(uint8_t* const planes[3], const uint32_t pitches[3], const SharedPtr<VideoFrame>& frame)
+    {
+        return m_frameio->upload(planes, pitches, frame);
+    }
 private:
     SharedPtr<VaapiFrameIO> m_frameio;
     static bool readFromFile(char* ptr, int size, FILE* fp)
@@ -223,7 +488,7 @@ class VaapiFrameWriter:public FrameWriter
 {
 public:
     VaapiFrameWriter(const SharedPtr<VADisplay>& display)
-        :m_frameio(new VaapiFrameIO(display, writeToFile))
+        :m_frameio(new VaapiFrameIO(display, writeToFile, true))
     {
     }
     bool write(FILE* fp, const SharedPtr<VideoFrame>& frame)
@@ -274,14 +539,51 @@ protected:
     SharedPtr<FrameAllocator> m_allocator;
 };
 
+//generated frames, for input names like synthetic:text, see TestPattern.
+//configure it like VppInputFile, the reader uploads the pattern.
+class VppInputSynthetic : public VppInputFile {
+public:
+    VppInputSynthetic();
+    bool init(const char* inputFileName, uint32_t fourcc, int width, int height);
+    virtual bool read(SharedPtr<VideoFrame>& frame);
+private:
+    TestPattern m_pattern;
+    uint32_t m_next;
+};
+
 class VppOutput
 {
 public:
     static SharedPtr<VppOutput>
         create(const char* outputFileName, uint32_t fourcc = 0, int width = 0, int height = 0);
-    bool getFormat(uint32_t& fourcc, int& width, int& height);
+    bool getFormat(uint32_t& fourcc, int& width, int& height)
+    {
+        fourcc = m_fourcc;
+        width = m_width;
+        height = m_height;
+        return true;
+    }
+    //true if frames of this format can go to output() as they are,
+    //so the stage before us can skip its vpp pass. the match is exact,
+    //any other fourcc or size needs the vpp to convert or scale
+    virtual bool canAccept(uint32_t fourcc, int width, int height)
+    {
+        return fourcc == m_fourcc && width == m_width && height == m_height;
+    }
+    bool canPassThrough(const SharedPtr<VideoFrame>& frame)
+    {
+        //outputs start at the surface origin, a crop offset needs a copy
+        if (!frame || frame->crop.x || frame->crop.y)
+            return false;
+        return canAccept(frame->fourcc, frame->crop.width, frame->crop.height);
+    }
     virtual bool output(const SharedPtr<VideoFrame>& frame) = 0;
-    VppOutput();
+    VppOutput()
+        : m_fourcc(0)
+        , m_width(0)
+        , m_height(0)
+    {
+    }
     virtual ~VppOutput(){}
 protected:
     virtual bool init(const char* outputFileName, uint32_t fourcc, int width, int height) = 0;
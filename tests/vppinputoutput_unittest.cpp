@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "vppinputoutput.h"
+
+#include "common/unittest.h"
+
+#include <string.h>
+#include <vector>
+
+//the driver, it records the surfaces synced
+static std::vector<VASurfaceID> s_synced;
+static VAStatus s_syncStatus = VA_STATUS_SUCCESS;
+
+VAStatus vaSyncSurface(VADisplay, VASurfaceID surface)
+{
+    s_synced.push_back(surface);
+    return s_syncStatus;
+}
+
+#define VPPOUTPUT_TEST(name) \
+    TEST(VppOutputTest, name)
+
+class FakeOutput : public VppOutput {
+public:
+    FakeOutput(uint32_t fourcc, int width, int height)
+    {
+        init(NULL, fourcc, width, height);
+    }
+    virtual bool output(const SharedPtr<VideoFrame>&) { return true; }
+
+protected:
+    virtual bool init(const char*, uint32_t fourcc, int width, int height)
+    {
+        m_fourcc = fourcc;
+        m_width = width;
+        m_height = height;
+        return true;
+    }
+};
+
+static SharedPtr<VideoFrame> createFrame(uint32_t fourcc, int x, int y, int width, int height, intptr_t surface = 0)
+{
+    SharedPtr<VideoFrame> frame(new VideoFrame);
+    memset(frame.get(), 0, sizeof(VideoFrame));
+    frame->fourcc = fourcc;
+    frame->crop.x = x;
+    frame->crop.y = y;
+    frame->crop.width = width;
+    frame->crop.height = height;
+    frame->surface = surface;
+    return frame;
+}
+
+VPPOUTPUT_TEST(PassThrough)
+{
+    FakeOutput output(YAMI_FOURCC_NV12, 320, 240);
+    EXPECT_TRUE(output.canAccept(YAMI_FOURCC_NV12, 320, 240));
+    EXPECT_TRUE(output.canPassThrough(createFrame(YAMI_FOURCC_NV12, 0, 0, 320, 240)));
+}
+
+VPPOUTPUT_TEST(NeedsVpp)
+{
+    //any other format, size or a crop offset goes through the vpp
+    FakeOutput output(YAMI_FOURCC_NV12, 320, 240);
+    EXPECT_FALSE(output.canPassThrough(SharedPtr<VideoFrame>()));
+    EXPECT_FALSE(output.canPassThrough(createFrame(YAMI_FOURCC_I420, 0, 0, 320, 240)));
+    EXPECT_FALSE(output.canPassThrough(createFrame(YAMI_FOURCC_NV12, 0, 0, 320, 256)));
+    EXPECT_FALSE(output.canPassThrough(createFrame(YAMI_FOURCC_NV12, 0, 0, 640, 480)));
+    EXPECT_FALSE(output.canPassThrough(createFrame(YAMI_FOURCC_NV12, 0, 8, 320, 240)));
+    EXPECT_FALSE(output.canPassThrough(createFrame(YAMI_FOURCC_NV12, 16, 0, 320, 240)));
+}
+
+#define FRAMESYNCWINDOW_TEST(name) \
+    TEST(FrameSyncWindowTest, name)
+
+static SharedPtr<VideoFrame> surfaceFrame(intptr_t surface)
+{
+    return createFrame(YAMI_FOURCC_NV12, 0, 0, 320, 240, surface);
+}
+
+FRAMESYNCWINDOW_TEST(Window)
+{
+    //frames leave the window in order, synced, once it holds more than depth
+    s_synced.clear();
+    FrameSyncWindow window(NULL, 2);
+    SharedPtr<VideoFrame> ready;
+    EXPECT_TRUE(window.push(surfaceFrame(1), ready));
+    EXPECT_FALSE(ready);
+    EXPECT_TRUE(window.push(surfaceFrame(2), ready));
+    EXPECT_FALSE(ready);
+    EXPECT_TRUE(s_synced.empty());
+    EXPECT_TRUE(window.push(surfaceFrame(3), ready));
+    ASSERT_TRUE(ready);
+    EXPECT_EQ(1, ready->surface);
+    ASSERT_EQ(1u, s_synced.size());
+    EXPECT_EQ(1u, s_synced[0]);
+
+    //drain at EOS
+    for (intptr_t surface = 2; surface <= 3; surface++) {
+        EXPECT_FALSE(window.empty());
+        ASSERT_TRUE(window.pop(ready));
+        EXPECT_EQ(surface, ready->surface);
+    }
+    EXPECT_TRUE(window.empty());
+    EXPECT_FALSE(window.pop(ready));
+    EXPECT_FALSE(ready);
+    EXPECT_EQ(3u, s_synced.size());
+}
+
+FRAMESYNCWINDOW_TEST(NoWindow)
+{
+    //depth 0 syncs every frame as it comes
+    s_synced.clear();
+    FrameSyncWindow window(NULL, 0);
+    SharedPtr<VideoFrame> ready;
+    for (intptr_t surface = 1; surface <= 3; surface++) {
+        EXPECT_TRUE(window.push(surfaceFrame(surface), ready));
+        ASSERT_TRUE(ready);
+        EXPECT_EQ(surface, ready->surface);
+        EXPECT_EQ((size_t)surface, s_synced.size());
+    }
+    EXPECT_TRUE(window.empty());
+}
+
+FRAMESYNCWINDOW_TEST(SyncFailed)
+{
+    s_synced.clear();
+    FrameSyncWindow window(NULL, 0);
+    SharedPtr<VideoFrame> ready;
+    s_syncStatus = VA_STATUS_ERROR_UNKNOWN;
+    EXPECT_FALSE(window.push(surfaceFrame(1), ready));
+    s_syncStatus = VA_STATUS_SUCCESS;
+    EXPECT_FALSE(ready);
+}
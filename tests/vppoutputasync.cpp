@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "vppoutputasync.h"
+
+#include <stdio.h>
+
+VppOutputAsync::VppOutputAsync()
+    :m_cond(m_lock), m_error(false), m_busy(false),
+     m_queueSize(0), m_started(false), m_quit(false),
+     m_depth(NULL), m_fullWaits(NULL), m_emptyWaits(NULL)
+{
+}
+
+SharedPtr<VppOutput>
+VppOutputAsync::create(const SharedPtr<VppOutput>& output, uint32_t queueSize)
+{
+    SharedPtr<VppOutput> ret;
+
+    if (!output || !queueSize)
+        return ret;
+    SharedPtr<VppOutputAsync> async(new VppOutputAsync());
+    if (!async->init(output, queueSize)) {
+        ERROR("init VppOutputAsync failed");
+        return ret;
+    }
+    ret = async;
+    return ret;
+}
+
+void* VppOutputAsync::start(void* async)
+{
+    VppOutputAsync* output = (VppOutputAsync*)async;
+    output->loop();
+    return NULL;
+}
+
+void VppOutputAsync::loop()
+{
+    while (1) {
+        SharedPtr<VideoFrame> frame;
+        {
+            AutoLock lock(m_lock);
+            while (m_queue.empty()) {
+                if (m_quit)
+                    return;
+                //producer is slower than us
+                m_emptyWaits->add();
+                m_cond.wait();
+            }
+            frame = m_queue.front();
+            m_queue.pop_front();
+            m_depth->set(m_queue.size());
+            m_busy = true;
+            m_cond.broadcast();
+        }
+        bool ret = m_output->output(frame);
+        //drop our reference before the producer wakes up
+        bool drain = !frame;
+        frame.reset();
+        AutoLock lock(m_lock);
+        m_busy = false;
+        if (!ret)
+            m_error = true;
+        m_cond.broadcast();
+        if (!ret || drain)
+            return;
+    }
+}
+
+bool VppOutputAsync::init(const SharedPtr<VppOutput>& output, uint32_t queueSize)
+{
+    m_output = output;
+    m_queueSize = queueSize;
+    if (!m_output->getFormat(m_fourcc, m_width, m_height))
+        return false;
+
+    Metrics& metrics = Metrics::getInstance();
+    char labels[32];
+    snprintf(labels, sizeof(labels), "queue=\"async%u\"", metrics.newInstanceId());
+    m_labels = labels;
+    m_depth = metrics.gauge("yami_queue_depth", labels, "frames waiting in the queue");
+    m_fullWaits = metrics.counter("yami_queue_full_waits_total", labels, "producer waits on a full queue");
+    m_emptyWaits = metrics.counter("yami_queue_empty_waits_total", labels, "consumer waits on an empty queue");
+    if (pthread_create(&m_thread, NULL, start, this)) {
+        ERROR("create thread failed");
+        return false;
+    }
+    m_started = true;
+    return true;
+}
+
+bool VppOutputAsync::output(const SharedPtr<VideoFrame>& frame)
+{
+    AutoLock lock(m_lock);
+    while (!m_error && m_queue.size() >= m_queueSize) {
+        //consumer is slower than us
+        m_fullWaits->add();
+        m_cond.wait();
+    }
+    if (m_error)
+        return false;
+    m_queue.push_back(frame);
+    m_depth->set(m_queue.size());
+    m_cond.broadcast();
+    return true;
+}
+
+bool VppOutputAsync::canAccept(uint32_t fourcc, int width, int height)
+{
+    return m_output->canAccept(fourcc, width, height);
+}
+
+bool VppOutputAsync::wait()
+{
+    AutoLock lock(m_lock);
+    while (!m_error && (m_busy || !m_queue.empty()))
+        m_cond.wait();
+    return !m_error;
+}
+
+VppOutputAsync::~VppOutputAsync()
+{
+    {
+        AutoLock lock(m_lock);
+        m_quit = true;
+        m_cond.broadcast();
+    }
+    if (m_started)
+        pthread_join(m_thread, NULL);
+    if (!m_labels.empty())
+        Metrics::getInstance().remove(m_labels.c_str());
+}
+
+bool VppOutputAsync::init(const char* outputFileName, uint32_t fourcc, int width, int height)
+{
+    assert(0 && "no need for this");
+    return false;
+}
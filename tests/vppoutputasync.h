@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef vppoutputasync_h
+#define vppoutputasync_h
+#include "common/condition.h"
+#include "common/lock.h"
+#include "common/metrics.h"
+#include <deque>
+
+#include "vppinputoutput.h"
+
+using namespace YamiMediaCodec;
+
+//runs output() of another VppOutput in its own thread.
+//output(frame) only queues the frame, the frame stays referenced until the
+//wrapped output is done with it. a NULL frame is passed through to drain,
+//it must be the last one.
+class VppOutputAsync : public VppOutput
+{
+public:
+    static SharedPtr<VppOutput>
+    create(const SharedPtr<VppOutput>& output, uint32_t queueSize);
+
+    //return false once the wrapped output failed
+    bool output(const SharedPtr<VideoFrame>& frame);
+    bool canAccept(uint32_t fourcc, int width, int height);
+
+    //wait until all queued frames are out, return false if any of them failed
+    bool wait();
+
+    VppOutputAsync();
+    virtual ~VppOutputAsync();
+
+protected:
+    //do not use this
+    bool init(const char* outputFileName, uint32_t fourcc, int width, int height);
+private:
+    bool init(const SharedPtr<VppOutput>& output, uint32_t queueSize);
+    static void* start(void* async);
+    void loop();
+
+    Lock       m_lock;
+    Condition  m_cond;
+    SharedPtr<VppOutput> m_output;
+    bool       m_error;
+    //a frame is out of the queue but not done yet
+    bool       m_busy;
+
+    typedef std::deque<SharedPtr<VideoFrame> > FrameQueue;
+    FrameQueue m_queue;
+    uint32_t   m_queueSize;
+
+    pthread_t  m_thread;
+    bool       m_started;
+    bool       m_quit;
+
+    //our instance labels
+    std::string m_labels;
+    Gauge*     m_depth;
+    Counter*   m_fullWaits;
+    Counter*   m_emptyWaits;
+};
+#endif //vppoutputasync_h
@@ -17,6 +17,7 @@
 #include "config.h"
 #endif
 #include "vppoutputencode.h"
+#include "common/common_def.h"
 
 EncodeParams::EncodeParams()
     : rcMode(RATE_CONTROL_CQP)
@@ -27,6 +28,7 @@ EncodeParams::EncodeParams()
     , intraPeriod(30)
     , numRefFrames(1)
     , idrInterval(0)
+    , inFlight(DEFAULT_ENCODE_IN_FLIGHT)
     , codec("AVC")
 {
     /*nothing to do*/
@@ -38,10 +40,22 @@ TranscodeParams::TranscodeParams()
     , oWidth(0)
     , oHeight(0)
     , fourcc(VA_FOURCC_NV12)
+    , priority(SESSION_DEFAULT_PRIORITY)
+    , targetFps(0)
 {
     /*nothing to do*/
 }
 
+VppOutputEncode::VppOutputEncode()
+{
+}
+
+VppOutputEncode::~VppOutputEncode()
+{
+    //the drain thread uses m_encoder and m_output
+    m_async.finish();
+}
+
 bool VppOutputEncode::init(const char* outputFileName, uint32_t /*fourcc*/, int width, int height)
 {
 
@@ -56,17 +70,6 @@ bool VppOutputEncode::init(const char* outputFileName, uint32_t /*fourcc*/, int
     return m_output;
 }
 
-void VppOutputEncode::initOuputBuffer()
-{
-    uint32_t maxOutSize;
-    m_encoder->getMaxOutSize(&maxOutSize);
-    m_buffer.resize(maxOutSize);
-    m_outputBuffer.bufferSize = maxOutSize;
-    m_outputBuffer.format = OUTPUT_EVERYTHING;
-    m_outputBuffer.data = &m_buffer[0];
-
-}
-
 static void setEncodeParam(const SharedPtr<IVideoEncoder>& encoder,
                            int width, int height, const EncodeParams* encParam)
 {
@@ -108,6 +111,9 @@ static void setEncodeParam(const SharedPtr<IVideoEncoder>& encoder,
 
 bool VppOutputEncode::config(NativeDisplay& nativeDisplay, const EncodeParams* encParam)
 {
+    EncodeParams defaultParam;
+    if (!encParam)
+        encParam = &defaultParam;
     m_encoder.reset(createVideoEncoder(m_output->getMimeType()), releaseVideoEncoder);
     if (!m_encoder)
         return false;
@@ -116,27 +122,13 @@ bool VppOutputEncode::config(NativeDisplay& nativeDisplay, const EncodeParams* e
 
     Encode_Status status = m_encoder->start();
     assert(status == ENCODE_SUCCESS);
-    initOuputBuffer();
-    return true;
+    return m_async.start(m_encoder.get(), m_output.get(), encParam->inFlight);
 }
 
 bool VppOutputEncode::output(const SharedPtr<VideoFrame>& frame)
 {
-    Encode_Status status = ENCODE_SUCCESS;
-    bool drain = !frame;
-    if (frame) {
-        status = m_encoder->encode(frame);
-        if (status != ENCODE_SUCCESS) {
-            fprintf(stderr, "encode failed status = %d\n", status);
-            return false;
-        }
-    }
-    do {
-        status = m_encoder->getOutput(&m_outputBuffer, drain);
-        if (status == ENCODE_SUCCESS
-            && !m_output->write(m_outputBuffer.data, m_outputBuffer.dataSize))
-             assert(0);
-    } while (status != ENCODE_BUFFER_NO_MORE);
-    return true;
-
+    //NULL drains the encoder, it must be the last one
+    if (!frame)
+        return m_async.finish();
+    return m_async.encode(frame);
 }
@@ -17,6 +17,8 @@
 #define vppoutputencode_h
 #include "VideoEncoderHost.h"
 #include "encodeinput.h"
+#include "encodeoutputasync.h"
+#include "common/sessionscheduler.h"
 #include <string>
 #include <vector>
 
@@ -37,6 +39,8 @@ public:
     int32_t intraPeriod;
     int32_t numRefFrames;
     int32_t idrInterval;
+    //frames between encode and getOutput, each keeps its surface
+    uint32_t inFlight;
     string codec;
 };
 
@@ -45,6 +49,13 @@ class TranscodeParams
 public:
     TranscodeParams();
 
+    //one output of an abr ladder, bitRate 0 keeps m_encParams
+    struct Rung {
+        int32_t width;
+        int32_t height;
+        int32_t bitRate;
+    };
+
     EncodeParams m_encParams;
     uint32_t frameCount;
     int32_t oWidth; /*output video width*/
@@ -52,23 +63,29 @@ public:
     uint32_t fourcc;
     string inputFileName;
     string outputFileName;
+    //decode once and encode every rung, oWidth and oHeight are not used then
+    std::vector<Rung> ladder;
+    //scheduling class and frame rate target, 0 is unpaced
+    SessionPriority priority;
+    float targetFps;
 };
 
 class VppOutputEncode : public VppOutput
 {
 public:
     virtual bool output(const SharedPtr<VideoFrame>& frame);
-    virtual ~VppOutputEncode(){}
+    VppOutputEncode();
+    virtual ~VppOutputEncode();
     bool config(NativeDisplay& nativeDisplay, const EncodeParams* encParam = NULL);
+    //frames the encoder may hold on top of the ones it codes, size input pools with it
+    uint32_t inFlight() const { return m_async.maxInFlight(); }
 protected:
     virtual bool init(const char* outputFileName, uint32_t fourcc, int width, int height);
 private:
-    void initOuputBuffer();
     const char* m_mime;
     SharedPtr<IVideoEncoder> m_encoder;
-    VideoEncOutputBuffer m_outputBuffer;
-    std::vector<uint8_t> m_buffer;
     SharedPtr<EncodeOutput> m_output;
+    EncodeOutputAsync m_async;
 };
 
 #endif
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "common/workstealingpool.h"
+
+#include "common/unittest.h"
+
+#include <vector>
+
+using namespace YamiMediaCodec;
+
+#define WORKSTEALINGPOOL_TEST(name) \
+    TEST(WorkStealingPoolTest, name)
+
+//runs slices times, remembers the threads it ran on
+class CountTask : public Runnable {
+public:
+    CountTask(uint32_t slices)
+        : m_left(slices)
+        , m_runs(0)
+    {
+    }
+    bool run()
+    {
+        m_runs++;
+        return --m_left > 0;
+    }
+    uint32_t runs() const { return m_runs; }
+
+private:
+    uint32_t m_left;
+    uint32_t m_runs;
+};
+
+WORKSTEALINGPOOL_TEST(SubmitAndWait)
+{
+    std::vector<CountTask> tasks(50, CountTask(7));
+    WorkStealingPool pool;
+    ASSERT_TRUE(pool.start(4));
+    for (size_t i = 0; i < tasks.size(); i++)
+        pool.submit(&tasks[i]);
+    pool.wait();
+    //every slice ran exactly once
+    for (size_t i = 0; i < tasks.size(); i++)
+        EXPECT_EQ(7u, tasks[i].runs());
+}
+
+WORKSTEALINGPOOL_TEST(SubmitBeforeStart)
+{
+    std::vector<CountTask> early(10, CountTask(3));
+    std::vector<CountTask> late(10, CountTask(3));
+    WorkStealingPool pool;
+    for (size_t i = 0; i < early.size(); i++)
+        pool.submit(&early[i]);
+    ASSERT_TRUE(pool.start(3));
+    for (size_t i = 0; i < late.size(); i++)
+        pool.submit(&late[i]);
+    pool.wait();
+    for (size_t i = 0; i < early.size(); i++) {
+        EXPECT_EQ(3u, early[i].runs());
+        EXPECT_EQ(3u, late[i].runs());
+    }
+}
+
+WORKSTEALINGPOOL_TEST(WaitAgain)
+{
+    //the pool takes new work after a wait
+    WorkStealingPool pool;
+    ASSERT_TRUE(pool.start(2));
+    for (int round = 0; round < 3; round++) {
+        CountTask task(5);
+        pool.submit(&task);
+        pool.wait();
+        EXPECT_EQ(5u, task.runs());
+    }
+}
+
+WORKSTEALINGPOOL_TEST(BadStart)
+{
+    WorkStealingPool pool;
+    uint32_t none = 0;
+    EXPECT_FALSE(pool.start(none));
+    ASSERT_TRUE(pool.start(1));
+    //started already
+    EXPECT_FALSE(pool.start(1));
+    pool.stop();
+}
@@ -0,0 +1,761 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "vppinputdecode.h"
+#include "vppinputoutput.h"
+#include "vppoutputencode.h"
+#include "yamidprotocol.h"
+#include "common/common_def.h"
+#include "common/condition.h"
+#include "common/lock.h"
+#include "common/log.h"
+#include "common/metrics.h"
+#include "common/parsecount.h"
+#include "common/sessionscheduler.h"
+#include "VideoPostProcessHost.h"
+
+#include <deque>
+#include <errno.h>
+#include <getopt.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace YamiMediaCodec;
+
+//yamid keeps the expensive parts of a yamitranscode run alive between jobs:
+//the va display, decoders, a scaler per worker and surface pools per size.
+//a decoder is flushed after a job and stays configured, the next stream of
+//its codec starts on the surfaces it already has.
+//a job only opens its files and creates its encoder.
+//jobs run at the same time share one session scheduler, batch jobs are held
+//back while live ones miss their frame deadlines.
+//
+//only the user running yamid may connect, the socket is 0600 and every peer
+//is checked, since jobs read and write files with yamid's rights.
+
+//each job has a worker and a decoder per codec
+#define MAX_JOBS 64
+#define MAX_WARM_DECODERS 16
+//a client that stops sending or reading gives its worker back after this
+#define CLIENT_IO_TIMEOUT_MS 5000
+
+static void print_help(const char* app)
+{
+    printf("%s <options>\n", app);
+    printf("   -s <socket path> default %s\n", yamidDefaultSocket().c_str());
+    printf("   -j <number of jobs run at the same time, 1 to %d> default 2\n", MAX_JOBS);
+    printf("   -w <codecs with warm decoders: h264,h265,vp8,vp9,jpeg,mpeg2,vc1> default h264,h265\n");
+    printf("   -n <warm decoders per codec, 0 to %d> default 2\n", MAX_WARM_DECODERS);
+}
+
+static const char* codecToMime(const string& codec)
+{
+    static const struct {
+        const char* codec;
+        const char* mime;
+    } mimes[] = {
+        { "h264", YAMI_MIME_H264 },
+        { "h265", YAMI_MIME_H265 },
+        { "vp8", YAMI_MIME_VP8 },
+        { "vp9", YAMI_MIME_VP9 },
+        { "jpeg", YAMI_MIME_JPEG },
+        { "mpeg2", YAMI_MIME_MPEG2 },
+        { "vc1", YAMI_MIME_VC1 },
+    };
+    for (size_t i = 0; i < N_ELEMENTS(mimes); i++) {
+        if (codec == mimes[i].codec)
+            return mimes[i].mime;
+    }
+    return NULL;
+}
+
+static uint64_t nowMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static string toString(uint64_t v)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%llu", (unsigned long long)v);
+    return buf;
+}
+
+//decoders with the display already set, shared by all workers.
+//a decoder that ran a job is kept started, so its va context and surfaces
+//are there for the next job
+class DecoderPool
+{
+public:
+    DecoderPool(const NativeDisplay& display)
+        : m_display(display)
+    {
+    }
+    bool warm(const char* mime, uint32_t count)
+    {
+        AutoLock lock(m_lock);
+        for (uint32_t i = 0; i < count; i++) {
+            IdleDecoder idle;
+            idle.decoder = create(mime);
+            if (!idle.decoder)
+                return false;
+            idle.started = false;
+            m_idle[mime].push_back(idle);
+        }
+        return true;
+    }
+    //started tells if the decoder is still configured from its last job
+    SharedPtr<IVideoDecoder> get(const char* mime, bool& started)
+    {
+        {
+            AutoLock lock(m_lock);
+            //configured ones are at the back
+            std::deque<IdleDecoder>& idle = m_idle[mime];
+            if (!idle.empty()) {
+                IdleDecoder d = idle.back();
+                idle.pop_back();
+                started = d.started;
+                return d.decoder;
+            }
+        }
+        //cold start, it is kept after the job
+        started = false;
+        return create(mime);
+    }
+    //the decoder must not have frames out. a decoder that failed is stopped,
+    //the others are flushed and keep their configuration
+    void put(const char* mime, const SharedPtr<IVideoDecoder>& decoder, bool ok)
+    {
+        IdleDecoder idle;
+        idle.decoder = decoder;
+        idle.started = ok;
+        if (ok)
+            decoder->flush();
+        else
+            decoder->stop();
+        AutoLock lock(m_lock);
+        if (ok)
+            m_idle[mime].push_back(idle);
+        else
+            m_idle[mime].push_front(idle);
+    }
+
+private:
+    SharedPtr<IVideoDecoder> create(const char* mime)
+    {
+        SharedPtr<IVideoDecoder> decoder(createVideoDecoder(mime), releaseVideoDecoder);
+        if (!decoder) {
+            ERROR("failed to create decoder for %s", mime);
+            return decoder;
+        }
+        decoder->setNativeDisplay(&m_display);
+        return decoder;
+    }
+    struct IdleDecoder {
+        SharedPtr<IVideoDecoder> decoder;
+        bool started;
+    };
+    NativeDisplay m_display;
+    Lock m_lock;
+    std::map<string, std::deque<IdleDecoder> > m_idle;
+    DISALLOW_COPY_AND_ASSIGN(DecoderPool);
+};
+
+class Yamid;
+
+//runs one job at a time, keeps its scaler and surface pools between jobs
+class JobWorker
+{
+public:
+    JobWorker(Yamid* daemon, const SharedPtr<VADisplay>& display, DecoderPool* decoders);
+    bool init();
+    bool start();
+    void join();
+
+private:
+    static void* start(void* worker);
+    void loop();
+    void serve(int fd);
+    bool runJob(const YamidFields& job, YamidFields& reply);
+    SharedPtr<FrameAllocator> getAllocator(uint32_t fourcc, int width, int height);
+    SharedPtr<VppOutput> createOutput(const YamidFields& job, int width, int height);
+
+    Yamid* m_daemon;
+    SharedPtr<VADisplay> m_display;
+    NativeDisplay m_nativeDisplay;
+    DecoderPool* m_decoders;
+    SharedPtr<IVideoPostProcess> m_vpp;
+    typedef std::map<uint32_t, SharedPtr<FrameAllocator> > AllocatorMap;
+    AllocatorMap m_allocators;
+    pthread_t m_thread;
+    DISALLOW_COPY_AND_ASSIGN(JobWorker);
+};
+
+class Yamid
+{
+public:
+    Yamid()
+        : m_socketPath(yamidDefaultSocket())
+        , m_workerCount(2)
+        , m_warmCodecs("h264,h265")
+        , m_warmCount(2)
+        , m_listenFd(-1)
+        , m_cond(m_lock)
+        , m_quit(false)
+        , m_jobs(NULL)
+        , m_failedJobs(NULL)
+        , m_setupTime(NULL)
+    {
+    }
+    ~Yamid()
+    {
+        if (m_listenFd >= 0) {
+            close(m_listenFd);
+            unlink(m_socketPath.c_str());
+        }
+    }
+    bool init(int argc, char** argv);
+    bool run();
+    void stop();
+
+    //for workers, return -1 on quit
+    int takeConnection();
+    //setupMs is -1 for a job that failed before it was set up
+    void jobDone(bool ok, int setupMs)
+    {
+        m_jobs->add();
+        if (!ok)
+            m_failedJobs->add();
+        if (setupMs >= 0)
+            m_setupTime->observe(setupMs);
+    }
+
+private:
+    bool processCmdLine(int argc, char** argv);
+    bool prepareSocketDir();
+    bool listenSocket();
+
+    string m_socketPath;
+    uint32_t m_workerCount;
+    string m_warmCodecs;
+    uint32_t m_warmCount;
+    int m_listenFd;
+
+    SharedPtr<VADisplay> m_display;
+    SharedPtr<DecoderPool> m_decoders;
+    std::vector<SharedPtr<JobWorker> > m_workers;
+
+    Lock m_lock;
+    Condition m_cond;
+    std::deque<int> m_connections;
+    bool m_quit;
+
+    Counter* m_jobs;
+    Counter* m_failedJobs;
+    Histogram* m_setupTime;
+    DISALLOW_COPY_AND_ASSIGN(Yamid);
+};
+
+JobWorker::JobWorker(Yamid* daemon, const SharedPtr<VADisplay>& display, DecoderPool* decoders)
+    : m_daemon(daemon)
+    , m_display(display)
+    , m_decoders(decoders)
+{
+    m_nativeDisplay.type = NATIVE_DISPLAY_VA;
+    m_nativeDisplay.handle = (intptr_t)*m_display;
+}
+
+bool JobWorker::init()
+{
+    m_vpp.reset(createVideoPostProcess(YAMI_VPP_SCALER), releaseVideoPostProcess);
+    return m_vpp && m_vpp->setNativeDisplay(m_nativeDisplay) == YAMI_SUCCESS;
+}
+
+bool JobWorker::start()
+{
+    if (pthread_create(&m_thread, NULL, start, this)) {
+        ERROR("create thread failed");
+        return false;
+    }
+    return true;
+}
+
+void JobWorker::join()
+{
+    pthread_join(m_thread, NULL);
+}
+
+void* JobWorker::start(void* worker)
+{
+    ((JobWorker*)worker)->loop();
+    return NULL;
+}
+
+void JobWorker::loop()
+{
+    int fd;
+    while ((fd = m_daemon->takeConnection()) >= 0) {
+        serve(fd);
+        close(fd);
+    }
+}
+
+void JobWorker::serve(int fd)
+{
+    uint32_t type;
+    YamidFields job;
+    if (!yamidReceive(fd, type, job) || type != YAMID_JOB) {
+        ERROR("bad job message");
+        return;
+    }
+    YamidFields reply;
+    uint64_t start = nowMs();
+    bool ok = runJob(job, reply);
+    reply["status"] = ok ? "ok" : "error";
+    reply["total_ms"] = toString(nowMs() - start);
+    m_daemon->jobDone(ok, yamidGetInt(reply, "setup_ms", -1));
+    if (!yamidSend(fd, YAMID_REPLY, reply))
+        ERROR("failed to send reply");
+}
+
+//pools stay around for the next job of the same fourcc, they keep the
+//largest size seen and smaller jobs crop from it
+SharedPtr<FrameAllocator> JobWorker::getAllocator(uint32_t fourcc, int width, int height)
+{
+    SharedPtr<FrameAllocator>& allocator = m_allocators[fourcc];
+    if (!allocator) {
+        //encode jobs keep frames in flight in the encoder
+        allocator.reset(new PooledFrameAllocator(m_display, 5 + DEFAULT_ENCODE_IN_FLIGHT));
+    }
+    if (!allocator->setFormat(fourcc, width, height)) {
+        ERROR("set format to %x, %dx%d failed", fourcc, width, height);
+        m_allocators.erase(fourcc);
+        return SharedPtr<FrameAllocator>();
+    }
+    return allocator;
+}
+
+SharedPtr<VppOutput> JobWorker::createOutput(const YamidFields& job, int width, int height)
+{
+    uint32_t fourcc = 0;
+    YamidFields::const_iterator it = job.find("fourcc");
+    if (it != job.end() && it->second.size() == 4) {
+        const char* s = it->second.c_str();
+        fourcc = VA_FOURCC(s[0], s[1], s[2], s[3]);
+    }
+    const string& name = job.find("output")->second;
+    SharedPtr<VppOutput> output = VppOutput::create(name.c_str(), fourcc, width, height);
+    SharedPtr<VppOutputFile> outputFile = std::tr1::dynamic_pointer_cast<VppOutputFile>(output);
+    if (outputFile) {
+        SharedPtr<FrameWriter> writer(new VaapiFrameWriter(m_display));
+        if (!outputFile->config(writer))
+            output.reset();
+        return output;
+    }
+    SharedPtr<VppOutputEncode> outputEncode = std::tr1::dynamic_pointer_cast<VppOutputEncode>(output);
+    if (outputEncode) {
+        EncodeParams params;
+        params.bitRate = yamidGetInt(job, "bitrate", 0) * 1024;//kbps to bps
+        if (params.bitRate)
+            params.rcMode = RATE_CONTROL_CBR;
+        params.fps = yamidGetInt(job, "fps", params.fps);
+        if (!outputEncode->config(m_nativeDisplay, &params))
+            output.reset();
+    }
+    return output;
+}
+
+bool JobWorker::runJob(const YamidFields& job, YamidFields& reply)
+{
+    uint64_t start = nowMs();
+    YamidFields::const_iterator type = job.find("job");
+    YamidFields::const_iterator inputName = job.find("input");
+    if (type == job.end() || inputName == job.end() || job.find("output") == job.end()) {
+        reply["error"] = "job, input and output are needed";
+        return false;
+    }
+    uint32_t frames = UINT_MAX;
+    if (type->second == "thumbnail")
+        frames = 1;
+    else if (type->second != "decode" && type->second != "transcode") {
+        reply["error"] = "unknown job " + type->second;
+        return false;
+    }
+    frames = yamidGetInt(job, "frames", frames);
+    int skip = yamidGetInt(job, "skip", 0);
+    SessionPriority priority = SESSION_DEFAULT_PRIORITY;
+    YamidFields::const_iterator priorityName = job.find("priority");
+    if (priorityName != job.end() && !parseSessionPriority(priorityName->second.c_str(), priority)) {
+        reply["error"] = "unknown priority " + priorityName->second;
+        return false;
+    }
+    //a live job comes in at the rate it goes out
+    int targetFps = yamidGetInt(job, "targetfps", 0);
+    if (priority == SESSION_LIVE && !targetFps)
+        targetFps = yamidGetInt(job, "fps", EncodeParams().fps);
+
+    SharedPtr<DecodeInput> decodeInput(DecodeInput::create(inputName->second.c_str()));
+    if (!decodeInput) {
+        reply["error"] = "can't open " + inputName->second;
+        return false;
+    }
+    const char* mime = decodeInput->getMimeType();
+    bool started;
+    SharedPtr<IVideoDecoder> decoder = m_decoders->get(mime, started);
+    if (!decoder) {
+        reply["error"] = string("no decoder for ") + mime;
+        return false;
+    }
+
+    uint32_t count = 0;
+    bool ok = false;
+    {
+        //everything holding decoded frames goes before the decoder is stopped
+        SharedPtr<VppInputDecode> input(new VppInputDecode);
+        SharedPtr<VppOutput> output;
+        SharedPtr<FrameAllocator> allocator;
+        uint32_t fourcc;
+        int width, height;
+        //frames passed through to the encoder stay in flight there
+        input->setExtraSurfaces(DEFAULT_ENCODE_IN_FLIGHT);
+        if (!input->init(decodeInput, decoder, started) || !input->config(m_nativeDisplay)) {
+            reply["error"] = "failed to start decoder";
+        }
+        else if (!(output = createOutput(job, yamidGetInt(job, "width", input->getWidth()),
+                       yamidGetInt(job, "height", input->getHeight())))) {
+            reply["error"] = "failed to create output " + job.find("output")->second;
+        }
+        else if (!output->getFormat(fourcc, width, height)
+            || !(allocator = getAllocator(fourcc, width, height))) {
+            reply["error"] = "failed to allocate output surfaces";
+        }
+        else {
+            reply["setup_ms"] = toString(nowMs() - start);
+            SharedPtr<VideoFrame> src;
+            ScheduledSession schedule(priority, targetFps);
+            ok = true;
+            while (count < frames && input->read(src)) {
+                if (skip > 0) {
+                    skip--;
+                    continue;
+                }
+                schedule.pace();
+                //same format and size go to the output as they are
+                SharedPtr<VideoFrame> dest = src;
+                if (!output->canPassThrough(src)) {
+                    dest = allocFrame(allocator, POOL_WAIT_MS);
+                    if (dest && m_vpp->process(src, dest) != YAMI_SUCCESS)
+                        dest.reset();
+                }
+                if (!dest || !output->output(dest)) {
+                    reply["error"] = "failed to process frame";
+                    ok = false;
+                    break;
+                }
+                count++;
+            }
+            //drain the encoder
+            if (ok && !output->output(SharedPtr<VideoFrame>())) {
+                reply["error"] = "failed to drain output";
+                ok = false;
+            }
+        }
+    }
+    m_decoders->put(mime, decoder, ok);
+    reply["frames"] = toString(count);
+    return ok;
+}
+
+int Yamid::takeConnection()
+{
+    AutoLock lock(m_lock);
+    while (m_connections.empty()) {
+        if (m_quit)
+            return -1;
+        m_cond.wait();
+    }
+    int fd = m_connections.front();
+    m_connections.pop_front();
+    return fd;
+}
+
+bool Yamid::processCmdLine(int argc, char** argv)
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "s:j:w:n:h")) != -1) {
+        switch (opt) {
+        case 's':
+            m_socketPath = optarg;
+            break;
+        case 'j':
+            if (!parseCount(optarg, 1, MAX_JOBS, &m_workerCount)) {
+                fprintf(stderr, "invalid job count: %s\n", optarg);
+                return false;
+            }
+            break;
+        case 'w':
+            m_warmCodecs = optarg;
+            break;
+        case 'n':
+            if (!parseCount(optarg, 0, MAX_WARM_DECODERS, &m_warmCount)) {
+                fprintf(stderr, "invalid warm decoder count: %s\n", optarg);
+                return false;
+            }
+            break;
+        default:
+            print_help(argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Yamid::listenSocket()
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (m_socketPath.size() >= sizeof(addr.sun_path)) {
+        ERROR("socket path %s is too long", m_socketPath.c_str());
+        return false;
+    }
+    strcpy(addr.sun_path, m_socketPath.c_str());
+    if (!prepareSocketDir())
+        return false;
+
+    struct stat st;
+    if (!lstat(m_socketPath.c_str(), &st)) {
+        if (!S_ISSOCK(st.st_mode)) {
+            ERROR("%s is not a socket", m_socketPath.c_str());
+            return false;
+        }
+        //a socket that answers belongs to a running daemon, one that does not is stale
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool running = fd >= 0 && !connect(fd, (struct sockaddr*)&addr, sizeof(addr));
+        if (fd >= 0)
+            close(fd);
+        if (running) {
+            ERROR("yamid is already running on %s", m_socketPath.c_str());
+            return false;
+        }
+        unlink(m_socketPath.c_str());
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        ERROR("failed to create socket: %s", strerror(errno));
+        return false;
+    }
+    //created 0600, no window where others can connect
+    mode_t mask = umask(0177);
+    int ret = bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+    umask(mask);
+    if (ret) {
+        ERROR("failed to bind %s: %s", m_socketPath.c_str(), strerror(errno));
+        close(fd);
+        return false;
+    }
+    //from here on the socket is ours, the destructor removes it
+    m_listenFd = fd;
+    if (listen(m_listenFd, 16)) {
+        ERROR("failed to listen on %s: %s", m_socketPath.c_str(), strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+//a missing directory is created 0700. an existing one must belong to us or
+//root, so nobody else can swap the socket
+bool Yamid::prepareSocketDir()
+{
+    size_t slash = m_socketPath.rfind('/');
+    if (slash == string::npos || !slash)
+        return true;
+    string dir = m_socketPath.substr(0, slash);
+    if (mkdir(dir.c_str(), 0700) && errno != EEXIST) {
+        ERROR("failed to create %s: %s", dir.c_str(), strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (lstat(dir.c_str(), &st) || !S_ISDIR(st.st_mode)) {
+        ERROR("%s is not a directory", dir.c_str());
+        return false;
+    }
+    if (st.st_uid != getuid() && st.st_uid != 0) {
+        ERROR("%s belongs to another user", dir.c_str());
+        return false;
+    }
+    return true;
+}
+
+//the peer must run as our user
+static bool isOurUser(int fd)
+{
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len))
+        return false;
+    return cred.uid == getuid();
+}
+
+bool Yamid::init(int argc, char** argv)
+{
+    if (!processCmdLine(argc, argv))
+        return false;
+    m_display = createVADisplay();
+    if (!m_display) {
+        ERROR("create display failed");
+        return false;
+    }
+    NativeDisplay nativeDisplay;
+    nativeDisplay.type = NATIVE_DISPLAY_VA;
+    nativeDisplay.handle = (intptr_t)*m_display;
+    m_decoders.reset(new DecoderPool(nativeDisplay));
+    size_t start = 0;
+    while (start < m_warmCodecs.size()) {
+        size_t end = m_warmCodecs.find(',', start);
+        if (end == string::npos)
+            end = m_warmCodecs.size();
+        string codec = m_warmCodecs.substr(start, end - start);
+        const char* mime = codecToMime(codec);
+        if (!mime || !m_decoders->warm(mime, m_warmCount)) {
+            ERROR("can't keep %s decoders warm", codec.c_str());
+            return false;
+        }
+        start = end + 1;
+    }
+    for (uint32_t i = 0; i < m_workerCount; i++) {
+        SharedPtr<JobWorker> worker(new JobWorker(this, m_display, m_decoders.get()));
+        if (!worker->init()) {
+            ERROR("init worker failed");
+            return false;
+        }
+        m_workers.push_back(worker);
+    }
+
+    Metrics& metrics = Metrics::getInstance();
+    //1ms to 1s
+    static const uint64_t setupTimes[] = { 1, 5, 10, 50, 100, 500, 1000 };
+    m_jobs = metrics.counter("yamid_jobs_total", "", "jobs run by yamid");
+    m_failedJobs = metrics.counter("yamid_failed_jobs_total", "", "jobs failed in yamid");
+    m_setupTime = metrics.histogram("yamid_job_setup_ms", "", "ms from job to first frame",
+        setupTimes, N_ELEMENTS(setupTimes));
+    return listenSocket();
+}
+
+static volatile sig_atomic_t s_quit;
+
+static void onSignal(int)
+{
+    s_quit = 1;
+}
+
+bool Yamid::run()
+{
+    //signals go to this thread only, so they interrupt accept
+    sigset_t signals, old;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, &old);
+    for (size_t i = 0; i < m_workers.size(); i++) {
+        if (!m_workers[i]->start()) {
+            pthread_sigmask(SIG_SETMASK, &old, NULL);
+            m_workers.resize(i);
+            stop();
+            return false;
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    printf("yamid listening on %s\n", m_socketPath.c_str());
+    while (!s_quit) {
+        int fd = accept4(m_listenFd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            ERROR("accept failed: %s", strerror(errno));
+            break;
+        }
+        if (!isOurUser(fd)) {
+            ERROR("rejected a connection from another user");
+            close(fd);
+            continue;
+        }
+        struct timeval timeout;
+        timeout.tv_sec = CLIENT_IO_TIMEOUT_MS / 1000;
+        timeout.tv_usec = (CLIENT_IO_TIMEOUT_MS % 1000) * 1000;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        AutoLock lock(m_lock);
+        m_connections.push_back(fd);
+        m_cond.signal();
+    }
+    stop();
+    return true;
+}
+
+void Yamid::stop()
+{
+    {
+        AutoLock lock(m_lock);
+        m_quit = true;
+        //jobs not started yet are dropped, the clients see a closed socket
+        while (!m_connections.empty()) {
+            close(m_connections.front());
+            m_connections.pop_front();
+        }
+        m_cond.broadcast();
+    }
+    for (size_t i = 0; i < m_workers.size(); i++)
+        m_workers[i]->join();
+    m_workers.clear();
+}
+
+int main(int argc, char** argv)
+{
+    //no SA_RESTART, a signal wakes up accept
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onSignal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    if (!startMetricsExport())
+        return -1;
+    Yamid yamid;
+    if (!yamid.init(argc, argv)) {
+        ERROR("init yamid failed");
+        return -1;
+    }
+    if (!yamid.run())
+        return -1;
+    return 0;
+}
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "yamidprotocol.h"
+
+#include <errno.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+//thin client for yamid, sends one job and prints the reply
+
+static void print_help(const char* app)
+{
+    printf("%s <options>\n", app);
+    printf("   -j <job: decode|transcode|thumbnail>\n");
+    printf("   -i <input file>\n");
+    printf("   -o <output file, the extension picks raw yuv or an encoder>\n");
+    printf("   -s <socket path> default %s\n", yamidDefaultSocket().c_str());
+    printf("   -W <width> -H <height> optional, default is the input size\n");
+    printf("   -c <fourcc of raw output: I420|NV12|YV12> optional\n");
+    printf("   -N <number of frames> optional, thumbnail default is 1\n");
+    printf("   -k <frames to skip before output> optional\n");
+    printf("   -b <bitrate: kbps> optional\n");
+    printf("   -f <frame rate> optional\n");
+    printf("   -p <live|batch> batch jobs are held back while live ones miss deadlines, default batch\n");
+    printf("   -t <fps> run no faster than fps, live defaults to the frame rate, optional\n");
+}
+
+//the daemon has its own working directory
+static bool absolutePath(const char* name, std::string& path)
+{
+    if (name[0] == '/') {
+        path = name;
+        return true;
+    }
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd)))
+        return false;
+    path = std::string(cwd) + "/" + name;
+    return true;
+}
+
+static int connectDaemon(const char* socketPath)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(addr.sun_path))
+        return -1;
+    strcpy(addr.sun_path, socketPath);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr))) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char** argv)
+{
+    std::string socketPath = yamidDefaultSocket();
+    const char* input = NULL;
+    const char* output = NULL;
+    YamidFields job;
+    int opt;
+    while ((opt = getopt(argc, argv, "j:i:o:s:W:H:c:N:k:b:f:p:t:h")) != -1) {
+        switch (opt) {
+        case 'j':
+            job["job"] = optarg;
+            break;
+        case 'i':
+            input = optarg;
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        case 's':
+            socketPath = optarg;
+            break;
+        case 'W':
+            job["width"] = optarg;
+            break;
+        case 'H':
+            job["height"] = optarg;
+            break;
+        case 'c':
+            job["fourcc"] = optarg;
+            break;
+        case 'N':
+            job["frames"] = optarg;
+            break;
+        case 'k':
+            job["skip"] = optarg;
+            break;
+        case 'b':
+            job["bitrate"] = optarg;
+            break;
+        case 'f':
+            job["fps"] = optarg;
+            break;
+        case 'p':
+            job["priority"] = optarg;
+            break;
+        case 't':
+            job["targetfps"] = optarg;
+            break;
+        default:
+            print_help(argv[0]);
+            return -1;
+        }
+    }
+    if (job.find("job") == job.end() || !input || !output) {
+        print_help(argv[0]);
+        return -1;
+    }
+    if (strchr(input, '\n') || strchr(output, '\n')) {
+        fprintf(stderr, "file names with new lines are not supported\n");
+        return -1;
+    }
+    if (!absolutePath(input, job["input"]) || !absolutePath(output, job["output"])) {
+        fprintf(stderr, "failed to get current directory\n");
+        return -1;
+    }
+
+    int fd = connectDaemon(socketPath.c_str());
+    if (fd < 0) {
+        fprintf(stderr, "can't connect to yamid on %s: %s\n", socketPath.c_str(), strerror(errno));
+        return -1;
+    }
+    uint32_t type;
+    YamidFields reply;
+    if (!yamidSend(fd, YAMID_JOB, job) || !yamidReceive(fd, type, reply) || type != YAMID_REPLY) {
+        fprintf(stderr, "yamid closed the connection\n");
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    for (YamidFields::iterator it = reply.begin(); it != reply.end(); ++it)
+        printf("%s: %s\n", it->first.c_str(), it->second.c_str());
+    return reply["status"] == "ok" ? 0 : -1;
+}
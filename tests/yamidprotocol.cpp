@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "yamidprotocol.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static bool writeAll(int fd, const void* data, size_t size)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    while (size) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool readAll(int fd, void* data, size_t size)
+{
+    uint8_t* p = (uint8_t*)data;
+    while (size) {
+        ssize_t n = read(fd, p, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool yamidSend(int fd, uint32_t type, const YamidFields& fields)
+{
+    std::string body;
+    for (YamidFields::const_iterator it = fields.begin(); it != fields.end(); ++it)
+        body += it->first + "=" + it->second + "\n";
+    if (body.size() > YAMID_MAX_MESSAGE)
+        return false;
+    YamidHeader header;
+    header.magic = YAMID_MAGIC;
+    header.type = type;
+    header.length = body.size();
+    return writeAll(fd, &header, sizeof(header)) && writeAll(fd, body.data(), body.size());
+}
+
+bool yamidReceive(int fd, uint32_t& type, YamidFields& fields)
+{
+    YamidHeader header;
+    if (!readAll(fd, &header, sizeof(header)))
+        return false;
+    if (header.magic != YAMID_MAGIC || header.length > YAMID_MAX_MESSAGE)
+        return false;
+    std::string body(header.length, '\0');
+    if (header.length && !readAll(fd, &body[0], header.length))
+        return false;
+    type = header.type;
+    fields.clear();
+    size_t start = 0;
+    while (start < body.size()) {
+        size_t end = body.find('\n', start);
+        if (end == std::string::npos)
+            end = body.size();
+        size_t eq = body.find('=', start);
+        if (eq != std::string::npos && eq < end)
+            fields[body.substr(start, eq - start)] = body.substr(eq + 1, end - eq - 1);
+        start = end + 1;
+    }
+    return true;
+}
+
+int yamidGetInt(const YamidFields& fields, const char* key, int def)
+{
+    YamidFields::const_iterator it = fields.find(key);
+    if (it == fields.end() || it->second.empty())
+        return def;
+    return atoi(it->second.c_str());
+}
+
+std::string yamidDefaultSocket()
+{
+    const char* dir = getenv("XDG_RUNTIME_DIR");
+    if (dir && *dir)
+        return std::string(dir) + "/yamid.sock";
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/yamid-%u/yamid.sock", (unsigned)getuid());
+    return path;
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef yamidprotocol_h
+#define yamidprotocol_h
+
+#include <stdint.h>
+#include <map>
+#include <string>
+
+//yamid talks over a unix stream socket. a message is a YamidHeader followed by
+//length bytes of "key=value\n" lines. the client sends one YAMID_JOB and gets
+//one YAMID_REPLY back.
+//
+//job keys: job=decode|transcode|thumbnail, input, output, and optional
+//width, height, fourcc, frames, skip, bitrate (kbps), fps, priority=live|batch,
+//targetfps (live defaults to fps).
+//reply keys: status=ok|error, error, frames, setup_ms, total_ms.
+
+#define YAMID_MAGIC 0x444d4159 //"YAMD"
+#define YAMID_MAX_MESSAGE (64 * 1024)
+
+enum YamidMessageType {
+    YAMID_JOB = 1,
+    YAMID_REPLY = 2,
+};
+
+struct YamidHeader {
+    uint32_t magic;
+    uint32_t type;
+    uint32_t length;
+};
+
+typedef std::map<std::string, std::string> YamidFields;
+
+bool yamidSend(int fd, uint32_t type, const YamidFields& fields);
+bool yamidReceive(int fd, uint32_t& type, YamidFields& fields);
+
+//$XDG_RUNTIME_DIR/yamid.sock, or /tmp/yamid-<uid>/yamid.sock without it.
+//yamid runs jobs with its own rights, so only its user may talk to it
+std::string yamidDefaultSocket();
+
+//value of key as integer, or def if it is not there
+int yamidGetInt(const YamidFields& fields, const char* key, int def);
+
+#endif //yamidprotocol_h
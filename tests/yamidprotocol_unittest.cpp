@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2016 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "yamidprotocol.h"
+
+#include "common/unittest.h"
+
+#include <sys/socket.h>
+
+#define YAMIDPROTOCOL_TEST(name) \
+    TEST(YamidProtocolTest, name)
+
+class SocketPair {
+public:
+    SocketPair()
+    {
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+            fds[0] = fds[1] = -1;
+    }
+    ~SocketPair()
+    {
+        for (int i = 0; i < 2; i++) {
+            if (fds[i] >= 0)
+                close(fds[i]);
+        }
+    }
+    int fds[2];
+};
+
+YAMIDPROTOCOL_TEST(RoundTrip)
+{
+    SocketPair s;
+    ASSERT_LE(0, s.fds[0]);
+    YamidFields job;
+    job["job"] = "transcode";
+    job["input"] = "/a/b c.mp4";
+    job["output"] = "out=1.264";
+    job["width"] = "1280";
+    job["empty"] = "";
+    ASSERT_TRUE(yamidSend(s.fds[0], YAMID_JOB, job));
+
+    uint32_t type;
+    YamidFields got;
+    got["stale"] = "x";
+    ASSERT_TRUE(yamidReceive(s.fds[1], type, got));
+    EXPECT_EQ((uint32_t)YAMID_JOB, type);
+    //values may hold '=' and spaces, old fields are gone
+    EXPECT_TRUE(job == got);
+    EXPECT_EQ(1280, yamidGetInt(got, "width", 0));
+    EXPECT_EQ(7, yamidGetInt(got, "height", 7));
+    EXPECT_EQ(7, yamidGetInt(got, "empty", 7));
+}
+
+YAMIDPROTOCOL_TEST(TwoMessages)
+{
+    SocketPair s;
+    ASSERT_LE(0, s.fds[0]);
+    YamidFields job, reply;
+    job["job"] = "decode";
+    reply["status"] = "ok";
+    ASSERT_TRUE(yamidSend(s.fds[0], YAMID_JOB, job));
+    ASSERT_TRUE(yamidSend(s.fds[0], YAMID_REPLY, reply));
+
+    uint32_t type;
+    YamidFields got;
+    ASSERT_TRUE(yamidReceive(s.fds[1], type, got));
+    EXPECT_EQ((uint32_t)YAMID_JOB, type);
+    EXPECT_TRUE(job == got);
+    ASSERT_TRUE(yamidReceive(s.fds[1], type, got));
+    EXPECT_EQ((uint32_t)YAMID_REPLY, type);
+    EXPECT_TRUE(reply == got);
+}
+
+YAMIDPROTOCOL_TEST(BadMessages)
+{
+    uint32_t type;
+    YamidFields got;
+
+    //wrong magic
+    SocketPair magic;
+    ASSERT_LE(0, magic.fds[0]);
+    YamidHeader header;
+    header.magic = 0x12345678;
+    header.type = YAMID_JOB;
+    header.length = 0;
+    ASSERT_EQ((ssize_t)sizeof(header), write(magic.fds[0], &header, sizeof(header)));
+    EXPECT_FALSE(yamidReceive(magic.fds[1], type, got));
+
+    //too long, refused before the body is read
+    SocketPair big;
+    ASSERT_LE(0, big.fds[0]);
+    header.magic = YAMID_MAGIC;
+    header.length = YAMID_MAX_MESSAGE + 1;
+    ASSERT_EQ((ssize_t)sizeof(header), write(big.fds[0], &header, sizeof(header)));
+    EXPECT_FALSE(yamidReceive(big.fds[1], type, got));
+
+    //peer gone in the middle of the body
+    SocketPair cut;
+    ASSERT_LE(0, cut.fds[0]);
+    header.length = 10;
+    ASSERT_EQ((ssize_t)sizeof(header), write(cut.fds[0], &header, sizeof(header)));
+    ASSERT_EQ(3, write(cut.fds[0], "a=b", 3));
+    close(cut.fds[0]);
+    cut.fds[0] = -1;
+    EXPECT_FALSE(yamidReceive(cut.fds[1], type, got));
+
+    //too big to send
+    SocketPair s;
+    ASSERT_LE(0, s.fds[0]);
+    YamidFields job;
+    job["input"] = std::string(YAMID_MAX_MESSAGE, 'a');
+    EXPECT_FALSE(yamidSend(s.fds[0], YAMID_JOB, job));
+}
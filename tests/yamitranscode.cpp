@@ -21,8 +21,14 @@
 #include "vppinputoutput.h"
 #include "vppoutputencode.h"
 #include "encodeinput.h"
+#include "udpreceiver.h"
 #include "tests/vppinputasync.h"
+#include "tests/vppoutputasync.h"
 #include "common/log.h"
+#include "common/metrics.h"
+#include "common/parsecount.h"
+#include "common/sessionscheduler.h"
+#include "common/utils.h"
 #include "VideoEncoderInterface.h"
 #include "VideoEncoderHost.h"
 #include "VideoPostProcessHost.h"
@@ -32,10 +38,15 @@
 
 using namespace YamiMediaCodec;
 
+//frames waiting for each ladder rung
+#define RUNG_QUEUE_SIZE 2
+
 static void print_help(const char* app)
 {
     printf("%s <options>\n", app);
     printf("   -i <source filename> load a raw yuv file or a compressed video file\n");
+    printf("      synthetic[:gradient|noise|text|scenes[:frames[:WxH]]] generate frames instead, for benchmarks\n");
+    printf("      udp://[addr]:port or rtp://[addr]:port receive a live mpeg-ts stream, addr may be multicast\n");
     printf("   -W <width> -H <height>\n");
     printf("   -o <coded file> optional\n");
     printf("   -b <bitrate: kbps> optional\n");
@@ -49,6 +60,37 @@ static void print_help(const char* app)
     printf("   --intraperiod <Intra frame period(default 30)> optional\n");
     printf("   --refnum <number of referece frames(default 1)> optional\n");
     printf("   --idrinterval <AVC/HEVC IDR frame interval(default 0)> optional\n");
+    printf("   --ladder <WxH[:kbps],WxH[:kbps],...> decode once, encode one output per rung, optional\n");
+    printf("            outputs are named after -o with _WxH before the extension\n");
+    printf("   --inflight <frames submitted but not coded yet, 1 to %d (default %d)> optional\n", MAX_ENCODE_IN_FLIGHT, DEFAULT_ENCODE_IN_FLIGHT);
+    printf("   --priority <live|batch> batch transcodes are held back while live ones miss deadlines (default batch) optional\n");
+    printf("   --follow <idle ms> transcode a compressed file while it is written, until the writer\n");
+    printf("            closes it or it does not grow for idle ms, 1 to %d, optional. udp:// and rtp:// inputs end after idle ms\n", MAX_FOLLOW_IDLE_MS);
+    printf("            without data (default %d)\n", UDP_DEFAULT_IDLE_MS);
+    printf("   --targetfps <fps> transcode no faster than fps, live defaults to the -f frame rate, optional\n");
+}
+
+static bool parseLadder(const char* str, TranscodeParams& para)
+{
+    string ladder(str);
+    size_t start = 0;
+    while (start < ladder.size()) {
+        size_t end = ladder.find(',', start);
+        if (end == string::npos)
+            end = ladder.size();
+        string rung = ladder.substr(start, end - start);
+        TranscodeParams::Rung r;
+        int kbps = 0;
+        int n = sscanf(rung.c_str(), "%dx%d:%d", &r.width, &r.height, &kbps);
+        if (n < 2 || r.width <= 0 || r.height <= 0 || kbps < 0) {
+            fprintf(stderr, "bad ladder rung %s\n", rung.c_str());
+            return false;
+        }
+        r.bitRate = kbps * 1024;//kbps to bps
+        para.ladder.push_back(r);
+        start = end + 1;
+    }
+    return !para.ladder.empty();
 }
 
 static VideoRateControl string_to_rc_mode(char *str)
@@ -77,6 +119,11 @@ static bool processCmdLine(int argc, char *argv[], TranscodeParams& para)
         {"intraperiod", required_argument, NULL, 0 },
         {"refnum", required_argument, NULL, 0 },
         {"idrinterval", required_argument, NULL, 0 },
+        {"ladder", required_argument, NULL, 0 },
+        {"inflight", required_argument, NULL, 0 },
+        {"priority", required_argument, NULL, 0 },
+        {"targetfps", required_argument, NULL, 0 },
+        {"follow", required_argument, NULL, 0 },
         {NULL, no_argument, NULL, 0 }};
     int option_index;
 
@@ -140,6 +187,38 @@ static bool processCmdLine(int argc, char *argv[], TranscodeParams& para)
                 case 6:
                     para.m_encParams.idrInterval = atoi(optarg);
                     break;
+                case 7:
+                    if (!parseLadder(optarg, para))
+                        return false;
+                    break;
+                case 8:
+                    if (!parseCount(optarg, 1, MAX_ENCODE_IN_FLIGHT, &para.m_encParams.inFlight)) {
+                        fprintf(stderr, "invalid inflight: %s\n", optarg);
+                        return false;
+                    }
+                    break;
+                case 9:
+                    if (!parseSessionPriority(optarg, para.priority)) {
+                        fprintf(stderr, "invalid priority: %s\n", optarg);
+                        return false;
+                    }
+                    break;
+                case 10:
+                    para.targetFps = atof(optarg);
+                    if (para.targetFps < 0) {
+                        fprintf(stderr, "invalid target fps: %s\n", optarg);
+                        return false;
+                    }
+                    break;
+                case 11: {
+                    uint32_t idleMs;
+                    if (!parseCount(optarg, 1, MAX_FOLLOW_IDLE_MS, &idleMs)) {
+                        fprintf(stderr, "invalid follow idle time: %s\n", optarg);
+                        return false;
+                    }
+                    DecodeInput::setFollow(idleMs);
+                    break;
+                }
             }
         }
     }
@@ -151,17 +230,40 @@ static bool processCmdLine(int argc, char *argv[], TranscodeParams& para)
     if (para.outputFileName.empty())
         para.outputFileName = "test.264";
 
-    if ((para.m_encParams.rcMode == RATE_CONTROL_CBR) && (para.m_encParams.bitRate <= 0)) {
+    //ladder rungs with their own bitrate do not need -b
+    bool useBitRate = para.ladder.empty();
+    for (size_t i = 0; i < para.ladder.size(); i++) {
+        if (!para.ladder[i].bitRate)
+            useBitRate = true;
+    }
+    if (useBitRate && (para.m_encParams.rcMode == RATE_CONTROL_CBR) && (para.m_encParams.bitRate <= 0)) {
         fprintf(stderr, "please make sure bitrate is positive when CBR mode\n");
         return false;
     }
 
+    //a live stream comes in at the rate it goes out
+    if (para.priority == SESSION_LIVE && !para.targetFps)
+        para.targetFps = para.m_encParams.fps;
+
     if (!strncmp(para.inputFileName.c_str(), "/dev/video", strlen("/dev/video")) && !para.frameCount)
         para.frameCount = 50;
 
     return true;
 }
 
+//decoded frames the stages after the decoder hold at most, the decoder needs
+//surfaces for them on top of its own
+static uint32_t heldFrames(const TranscodeParams& para)
+{
+    //a frame passed through to the encoder stays in flight there
+    uint32_t inFlight = para.m_encParams.inFlight;
+    if (para.ladder.empty())
+        return inFlight;
+    //rungs share frames, the slowest one holds its queue and the frame it
+    //works on. every rung may pass its frames through
+    return RUNG_QUEUE_SIZE + 1 + para.ladder.size() * inFlight;
+}
+
 SharedPtr<VppInput> createInput(TranscodeParams& para, const SharedPtr<VADisplay>& display)
 {
     SharedPtr<VppInput> input(VppInput::create(para.inputFileName.c_str()));
@@ -183,6 +285,7 @@ SharedPtr<VppInput> createInput(TranscodeParams& para, const SharedPtr<VADisplay
         NativeDisplay nativeDisplay;
         nativeDisplay.type = NATIVE_DISPLAY_VA;
         nativeDisplay.handle = (intptr_t)*display;
+        inputDecode->setExtraSurfaces(heldFrames(para));
         if(!inputDecode->config(nativeDisplay)) {
             ERROR("config input decode failed");
             input.reset();
@@ -224,7 +327,12 @@ SharedPtr<FrameAllocator> createAllocator(const SharedPtr<VppOutput>& output, co
 {
     uint32_t fourcc;
     int width, height;
-    SharedPtr<FrameAllocator> allocator(new PooledFrameAllocator(display, 5));
+    uint32_t surfaces = 5;
+    //frames in flight in the encoder keep their surfaces
+    SharedPtr<VppOutputEncode> encode = std::tr1::dynamic_pointer_cast<VppOutputEncode>(output);
+    if (encode)
+        surfaces += encode->inFlight();
+    SharedPtr<FrameAllocator> allocator(new PooledFrameAllocator(display, surfaces));
     if (!output->getFormat(fourcc, width, height)
         || !allocator->setFormat(fourcc, width,height)) {
         allocator.reset();
@@ -233,6 +341,97 @@ SharedPtr<FrameAllocator> createAllocator(const SharedPtr<VppOutput>& output, co
     return allocator;
 }
 
+static SharedPtr<IVideoPostProcess> createScaler(const SharedPtr<VADisplay>& display)
+{
+    NativeDisplay nativeDisplay;
+    nativeDisplay.type = NATIVE_DISPLAY_VA;
+    nativeDisplay.handle = (intptr_t)*display;
+    SharedPtr<IVideoPostProcess> vpp(createVideoPostProcess(YAMI_VPP_SCALER), releaseVideoPostProcess);
+    if (vpp && vpp->setNativeDisplay(nativeDisplay) != YAMI_SUCCESS)
+        vpp.reset();
+    return vpp;
+}
+
+//scale to the format of the next output and pass the frame on.
+//frames the next output takes as they are skip the vpp pass, the scaler
+//and its surfaces are only created for the first frame that needs them.
+class VppOutputScale : public VppOutput
+{
+public:
+    VppOutputScale()
+        : m_scaled(NULL)
+        , m_skipped(NULL)
+    {
+    }
+    bool config(const SharedPtr<VppOutput>& output, const SharedPtr<VADisplay>& display)
+    {
+        m_output = output;
+        m_display = display;
+        if (!m_output->getFormat(m_fourcc, m_width, m_height))
+            return false;
+        Metrics& metrics = Metrics::getInstance();
+        m_scaled = metrics.counter("yami_frames_total", "stage=\"vpp\"", "frames out of each stage");
+        m_skipped = metrics.counter("yami_vpp_skipped_total", "", "frames passed on without a vpp pass");
+        return true;
+    }
+    bool output(const SharedPtr<VideoFrame>& src)
+    {
+        //NULL drains the encoder
+        if (!src)
+            return m_output->output(src);
+        if (m_output->canPassThrough(src)) {
+            m_skipped->add();
+            return m_output->output(src);
+        }
+        if (!m_vpp) {
+            m_allocator = createAllocator(m_output, m_display);
+            m_vpp = createScaler(m_display);
+            if (!m_allocator || !m_vpp) {
+                ERROR("create scaler failed");
+                return false;
+            }
+        }
+        SharedPtr<VideoFrame> dest = allocFrame(m_allocator, POOL_WAIT_MS);
+        if (!dest) {
+            ERROR("failed to get output frame");
+            return false;
+        }
+        YamiStatus status = m_vpp->process(src, dest);
+        if (status != YAMI_SUCCESS) {
+            ERROR("failed to scale yami return %d", status);
+            return false;
+        }
+        m_scaled->add();
+        return m_output->output(dest);
+    }
+
+protected:
+    bool init(const char* /*outputFileName*/, uint32_t /*fourcc*/, int /*width*/, int /*height*/)
+    {
+        return false;
+    }
+
+private:
+    SharedPtr<VppOutput> m_output;
+    SharedPtr<VADisplay> m_display;
+    SharedPtr<FrameAllocator> m_allocator;
+    SharedPtr<IVideoPostProcess> m_vpp;
+    Counter* m_scaled;
+    Counter* m_skipped;
+};
+
+//out.264 to out_1280x720.264
+static string rungFileName(const string& name, int width, int height)
+{
+    char size[32];
+    snprintf(size, sizeof(size), "_%dx%d", width, height);
+    size_t dot = name.rfind('.');
+    size_t slash = name.rfind('/');
+    if (dot == string::npos || (slash != string::npos && dot < slash))
+        return name + size;
+    return name.substr(0, dot) + size + name.substr(dot);
+}
+
 class TranscodeTest
 {
 public:
@@ -246,67 +445,126 @@ public:
             printf("create display failed");
             return false;
         }
-        if (!createVpp()) {
-            ERROR("create vpp failed");
+        m_input = createInput(m_cmdParam, m_display);
+        if (!m_input) {
+            ERROR("create input failed");
             return false;
         }
-        m_input = createInput(m_cmdParam, m_display);
-        m_output =  createOutput(m_cmdParam, m_display);
-        if (!m_input || !m_output) {
-            ERROR("create input or output failed");
+        if (!m_cmdParam.ladder.empty())
+            return createLadder();
+        //no size on the command line or in the name, keep the input size
+        int width, height;
+        if ((!m_cmdParam.oWidth || !m_cmdParam.oHeight)
+            && !guessResolution(m_cmdParam.outputFileName.c_str(), width, height)) {
+            m_cmdParam.oWidth = m_input->getWidth();
+            m_cmdParam.oHeight = m_input->getHeight();
+        }
+        SharedPtr<VppOutput> output = createOutput(m_cmdParam, m_display);
+        if (!output) {
+            ERROR("create output failed");
+            return false;
+        }
+        SharedPtr<VppOutputScale> scale(new VppOutputScale);
+        if (!scale->config(output, m_display)) {
+            ERROR("config scaler failed");
             return false;
         }
-        m_allocator = createAllocator(m_output, m_display);
-        return m_allocator;
+        m_output = scale;
+        return true;
     }
 
     bool run()
     {
+        if (!m_rungs.empty())
+            return runLadder();
+
 
         SharedPtr<VideoFrame> src;
         FpsCalc fps;
         uint32_t count = 0;
-        while (m_input->read(src)) {
-            SharedPtr<VideoFrame> dest = m_allocator->alloc();
-            if (!dest) {
-                ERROR("failed to get output frame");
+        bool ret = true;
+        ScheduledSession schedule(m_cmdParam.priority, m_cmdParam.targetFps);
+        while (schedule.pace() && m_input->read(src)) {
+            if (!m_output->output(src)) {
+                ret = false;
                 break;
             }
-//disable scale for performance measure
-//#define DISABLE_SCALE 1
-#ifndef DISABLE_SCALE
-            YamiStatus status = m_vpp->process(src, dest);
-            if (status != YAMI_SUCCESS) {
-                ERROR("failed to scale yami return %d", status);
-                break;
-            }
-#else
-            dest = src;
-#endif
-            if(!m_output->output(dest))
-                break;
             count++;
             fps.addFrame();
             if(count >= m_cmdParam.frameCount)
                 break;
         }
+        src.reset();
+        if (!m_output->output(SharedPtr<VideoFrame>()))
+            ret = false;
         fps.log();
-        return true;
+        return ret;
     }
 private:
-    bool createVpp()
+    //every rung scales and encodes in its own thread
+    bool createLadder()
     {
-        NativeDisplay nativeDisplay;
-        nativeDisplay.type = NATIVE_DISPLAY_VA;
-        nativeDisplay.handle = (intptr_t)*m_display;
-        m_vpp.reset(createVideoPostProcess(YAMI_VPP_SCALER), releaseVideoPostProcess);
-        return m_vpp->setNativeDisplay(nativeDisplay) == YAMI_SUCCESS;
+        for (size_t i = 0; i < m_cmdParam.ladder.size(); i++) {
+            const TranscodeParams::Rung& r = m_cmdParam.ladder[i];
+            TranscodeParams para = m_cmdParam;
+            para.oWidth = r.width;
+            para.oHeight = r.height;
+            para.outputFileName = rungFileName(m_cmdParam.outputFileName, r.width, r.height);
+            if (r.bitRate) {
+                para.m_encParams.bitRate = r.bitRate;
+                para.m_encParams.rcMode = RATE_CONTROL_CBR;
+            }
+            SharedPtr<VppOutput> encode = createOutput(para, m_display);
+            if (!encode) {
+                ERROR("create output %s failed", para.outputFileName.c_str());
+                return false;
+            }
+            SharedPtr<VppOutputScale> scale(new VppOutputScale);
+            if (!scale->config(encode, m_display)) {
+                ERROR("config scaler for %s failed", para.outputFileName.c_str());
+                return false;
+            }
+            SharedPtr<VppOutputAsync> rung = std::tr1::dynamic_pointer_cast<VppOutputAsync>(
+                VppOutputAsync::create(scale, RUNG_QUEUE_SIZE));
+            if (!rung)
+                return false;
+            m_rungs.push_back(rung);
+        }
+        return true;
+    }
+
+    bool runLadder()
+    {
+        SharedPtr<VideoFrame> src;
+        FpsCalc fps;
+        uint32_t count = 0;
+        bool ret = true;
+        ScheduledSession schedule(m_cmdParam.priority, m_cmdParam.targetFps);
+        while (ret && schedule.pace() && m_input->read(src)) {
+            //each rung holds a reference, the decoder gets the surface back after the last one
+            for (size_t i = 0; i < m_rungs.size(); i++) {
+                if (!m_rungs[i]->output(src))
+                    ret = false;
+            }
+            src.reset();
+            count++;
+            fps.addFrame();
+            if(count >= m_cmdParam.frameCount)
+                break;
+        }
+        for (size_t i = 0; i < m_rungs.size(); i++) {
+            m_rungs[i]->output(SharedPtr<VideoFrame>());
+            if (!m_rungs[i]->wait())
+                ret = false;
+        }
+        fps.log();
+        return ret;
     }
+
     SharedPtr<VADisplay> m_display;
     SharedPtr<VppInput> m_input;
     SharedPtr<VppOutput> m_output;
-    SharedPtr<FrameAllocator> m_allocator;
-    SharedPtr<IVideoPostProcess> m_vpp;
+    std::vector<SharedPtr<VppOutputAsync> > m_rungs;
     TranscodeParams m_cmdParam;
 };
 
@@ -314,6 +572,8 @@ int main(int argc, char** argv)
 {
 
     TranscodeTest trans;
+    if (!startMetricsExport())
+        return -1;
     if (!trans.init(argc, argv)) {
         ERROR("init transcode with command line parameters failed");
         return -1;